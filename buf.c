@@ -23,6 +23,7 @@
  */
 
 #include "common.h"
+#include "byteorder.h"
 
 /*
  * Description : Allocates and initializes a new buffer.
@@ -93,7 +94,7 @@ extern int buf_append_word(BUF *dst, uint16_t src)
 {
   size_t new_len = dst->len + 2;
   if (new_len > dst->max) return -1;
-  *(uint16_t *)(dst->data + dst->len) = src;
+  store16(dst->data + dst->len, src);
   dst->len = new_len;
   return 0;
 }
@@ -111,7 +112,7 @@ extern int buf_append_long(BUF *dst, uint32_t src)
 {
   size_t new_len = dst->len + 4;
   if (new_len > dst->max) return -1;
-  *(uint32_t *)(dst->data + dst->len) = src;
+  store32(dst->data + dst->len, src);
   dst->len = new_len;
   return 0;
 }
@@ -182,7 +183,7 @@ extern int buf_get_word(BUF *src, uint16_t *dst)
 {
   size_t new_index = src->index + 2;
   if (new_index > src->len) return -1;
-  *dst = *(uint16_t *)(src->data + src->index);
+  *dst = load16(src->data + src->index);
   src->index = new_index;
   return 0;
 }
@@ -199,7 +200,7 @@ extern int buf_get_long(BUF *src, uint32_t *dst)
 {
   size_t new_index = src->index + 4;
   if (new_index > src->len) return -1;
-  *dst = *(uint32_t *)(src->data + src->index);
+  *dst = load32(src->data + src->index);
   src->index = new_index;
   return 0;
 }
@@ -22,6 +22,12 @@
  */
 
 #include "common.h"
+#include "byteorder.h"
+
+/*
+ * Out-of-line versions of the byteorder.h conversions. The names are
+ * parenthesized so the macros in byteorder.h do not expand them.
+ */
 
 /*
  * Description : Converts a 16 bit word from link to host byte order.
@@ -30,13 +36,9 @@
  *
  * Return Value : The 16 bit word in host byte order.
  */
-extern uint16_t ltohs(uint16_t linkshort)
+extern uint16_t (ltohs)(uint16_t linkshort)
 {
-#if BYTE_ORDER == BIG_ENDIAN
-  return *(uint8_t *)&linkshort + (*((uint8_t *)&linkshort + 1) << 8);
-#else
-  return linkshort;
-#endif
+  return ltoh16(linkshort);
 }
 
 /*
@@ -46,13 +48,9 @@ extern uint16_t ltohs(uint16_t linkshort)
  *
  * Return Value : The 16 bit word in link byte order.
  */
-extern uint16_t htols(uint16_t hostshort)
+extern uint16_t (htols)(uint16_t hostshort)
 {
-#if BYTE_ORDER == BIG_ENDIAN
-  return (*(uint8_t *)&hostshort << 8) + *((uint8_t *)&hostshort + 1);
-#else
-  return hostshort;
-#endif
+  return htol16(hostshort);
 }
 
 /*
@@ -62,14 +60,9 @@ extern uint16_t htols(uint16_t hostshort)
  *
  * Return Value : The 32 bit word in host byte order.
  */
-extern uint32_t ltohl(uint32_t linklong)
+extern uint32_t (ltohl)(uint32_t linklong)
 {
-#if BYTE_ORDER == BIG_ENDIAN
-  return *(uint8_t *)&linklong + (*((uint8_t *)&linklong + 1) << 8) +
-    (*((uint8_t *)&linklong + 2) << 16) + (*((uint8_t *)&linklong + 3) << 24);
-#else
-  return linklong;
-#endif
+  return ltoh32(linklong);
 }
 
 /*
@@ -79,13 +72,7 @@ extern uint32_t ltohl(uint32_t linklong)
  *
  * Return Value : The 32 bit word in link byte order.
  */
-extern uint32_t htoll(uint32_t hostlong)
+extern uint32_t (htoll)(uint32_t hostlong)
 {
-#if BYTE_ORDER == BIG_ENDIAN
-  uint32_t x = htonl(hostlong);
-  return (*(uint8_t *)&x << 24) + (*((uint8_t *)&x + 1) << 16) +
-    (*((uint8_t *)&x + 2) << 8) + *((uint8_t *)&x + 3);
-#else
-  return hostlong;
-#endif
+  return htol32(hostlong);
 }
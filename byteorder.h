@@ -0,0 +1,177 @@
+/*
+ * Inline byte order conversion.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+#ifndef _BYTEORDER_H
+#define _BYTEORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Link byte order is little endian. The conversions compile to nothing on
+ * little endian hosts and to a single byte swap instruction elsewhere.
+ * Loads and stores go through memcpy() so they are safe at any alignment;
+ * the compiler turns them into plain moves where the target allows it.
+ *
+ * ltohs(), htols(), ltohl() and htoll() are redirected here so existing
+ * callers are inlined. The out-of-line versions remain in byteorder.c for
+ * code that takes their address or does not include this header.
+ */
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define LINK_SWAP 1
+#else
+#define LINK_SWAP 0
+#endif
+
+static inline uint16_t ltoh16(uint16_t x)
+{
+  return LINK_SWAP ? __builtin_bswap16(x) : x;
+}
+
+static inline uint32_t ltoh32(uint32_t x)
+{
+  return LINK_SWAP ? __builtin_bswap32(x) : x;
+}
+
+#define htol16(x) ltoh16(x)
+#define htol32(x) ltoh32(x)
+
+#define ltohs(x) ltoh16(x)
+#define htols(x) htol16(x)
+#define ltohl(x) ltoh32(x)
+#define htoll(x) htol32(x)
+
+/*
+ * Unaligned loads and stores in host byte order.
+ */
+static inline uint16_t load16(const void *p)
+{
+  uint16_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static inline uint32_t load32(const void *p)
+{
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static inline void store16(void *p, uint16_t x)
+{
+  memcpy(p, &x, sizeof(x));
+  return;
+}
+
+static inline void store32(void *p, uint32_t x)
+{
+  memcpy(p, &x, sizeof(x));
+  return;
+}
+
+/*
+ * Unaligned loads and stores of link byte order values.
+ */
+static inline uint16_t load_le16(const void *p)
+{
+  return ltoh16(load16(p));
+}
+
+static inline uint32_t load_le32(const void *p)
+{
+  return ltoh32(load32(p));
+}
+
+static inline void store_le16(void *p, uint16_t x)
+{
+  store16(p, htol16(x));
+  return;
+}
+
+static inline void store_le32(void *p, uint32_t x)
+{
+  store32(p, htol32(x));
+  return;
+}
+
+/*
+ * Array conversion between link byte order data, at any alignment, and
+ * host words. On little endian hosts these are a single memcpy().
+ */
+static inline void ltoh16_array(uint16_t *dst, const void *src, size_t n)
+{
+  const uint8_t *s = (const uint8_t *)src;
+  size_t i;
+  if (!LINK_SWAP)
+    {
+      memcpy(dst, src, n * 2);
+      return;
+    }
+  for (i = 0; i < n; i++) dst[i] = load_le16(s + i * 2);
+  return;
+}
+
+static inline void ltoh32_array(uint32_t *dst, const void *src, size_t n)
+{
+  const uint8_t *s = (const uint8_t *)src;
+  size_t i;
+  if (!LINK_SWAP)
+    {
+      memcpy(dst, src, n * 4);
+      return;
+    }
+  for (i = 0; i < n; i++) dst[i] = load_le32(s + i * 4);
+  return;
+}
+
+static inline void htol16_array(void *dst, const uint16_t *src, size_t n)
+{
+  uint8_t *d = (uint8_t *)dst;
+  size_t i;
+  if (!LINK_SWAP)
+    {
+      memcpy(dst, src, n * 2);
+      return;
+    }
+  for (i = 0; i < n; i++) store_le16(d + i * 2, src[i]);
+  return;
+}
+
+static inline void htol32_array(void *dst, const uint32_t *src, size_t n)
+{
+  uint8_t *d = (uint8_t *)dst;
+  size_t i;
+  if (!LINK_SWAP)
+    {
+      memcpy(dst, src, n * 4);
+      return;
+    }
+  for (i = 0; i < n; i++) store_le32(d + i * 4, src[i]);
+  return;
+}
+
+#endif /* _BYTEORDER_H */
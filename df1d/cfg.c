@@ -25,28 +25,55 @@
 
 #include "df1.h"
 
+#define SIG_BASIS 2166136261U /* FNV-1a offset basis. */
+#define SIG_PRIME 16777619U /* FNV-1a prime. */
+
 xmlDocPtr doc;
 iconv_t utf8_conv; /* To convert UTF-8 returned from libxml to char. */
 
 static int xml_validate(void);
 static int xml_parse_root(void);
 static void xml_parse_conn(xmlNode *conn_node);
+static void xml_parse_modbus(CONN *conn, xmlNode *mb_node);
+static void xml_parse_master(CONN *conn, xmlNode *m_node);
+static void xml_parse_rt(xmlNode *rt_node);
+static void xml_parse_prio(xmlNode *p_node);
+static int xml_parse_prio_rule(xmlNode *rule_node);
+static int get_rule_field(xmlNode *rule_node, const char *attr,
+			  unsigned long max, long *dst);
+static int xml_parse_mb_map(const char *name, xmlNode *map_node, MODBUS *mb);
+static uint32_t xml_sig(const xmlNode *node, uint32_t sig);
+static uint32_t sig_add(uint32_t sig, const xmlChar *str);
 static int get_param_val(xmlNodePtr src, char *dst);
+static int get_attr_val(xmlNodePtr src, const char *attr, char *dst);
 static int get_name(const char *val, char *dst);
 static int get_duplex(const char *name, const char *val, DUPLEX_T *dst);
 static int get_error_detect(const char *name, const char *val, int *dst);
 static int get_tty_dev(const char *name, const char *val, char *dst);
 static int get_tty_rate(const char *name, const char *val, int *dst);
 static int get_sock_port(const char *name, const char *val, in_port_t *dst);
+static int get_group(const char *name, const char *val, char *dst);
 static int get_dup_detect(const char *name, const char *val, int *dst);
+static int get_early_ack(const char *name, const char *val, int *dst);
+static int get_allow_link_cfg(const char *name, const char *val, int *dst);
 static int get_max_nak(const char *name, const char *val, unsigned int *dst);
 static int get_max_enq(const char *name, const char *val, unsigned int *dst);
 static int get_ack_timeout(const char *name, const char *val,
 			   unsigned int *dst);
+static int get_mb_addr(const char *name, const char *val, const char *what,
+		       uint8_t *dst);
+static int get_mb_scan(const char *name, const char *val, unsigned int *dst);
+static int get_poll_mode(const char *name, const char *val, POLL_MODE_T *dst);
+static int get_slaves(const char *name, const char *val, MASTER *m);
+static int get_rt_prio(const char *val, int *dst);
+static int get_cpus(const char *val, cpu_set_t *dst);
+static int get_master_num(const char *name, const char *val, const char *what,
+			  unsigned int *dst);
 
 /*
  * Description : Reads the XML configuration file and initializes the
- *               connections.
+ *               connections. When reloading, running connections are
+ *               matched by name and only changed ones are reopened.
  *
  * Arguments :
  *
@@ -171,15 +198,38 @@ static int xml_validate(void)
 static int xml_parse_root(void)
 {
   xmlNode *node = xmlDocGetRootElement(doc);
+  in_port_t stats_port = 0;
+  rt_config(0, NULL); /* Real-time mode is off unless configured. */
+  prio_clear(); /* Every message is class zero unless configured. */
+  conn_reload_start();
   for (node = node->xmlChildrenNode; node != NULL; node = node->next)
-    if ((node->type == XML_ELEMENT_NODE) &&
-	xmlStrEqual(node->name, (const xmlChar *)"connection"))
-      xml_parse_conn(node);
+    if (node->type == XML_ELEMENT_NODE)
+      {
+	if (xmlStrEqual(node->name, (const xmlChar *)"connection"))
+	  xml_parse_conn(node);
+	else if (xmlStrEqual(node->name, (const xmlChar *)"realtime"))
+	  xml_parse_rt(node);
+	else if (xmlStrEqual(node->name, (const xmlChar *)"message_priority"))
+	  xml_parse_prio(node);
+	else if (xmlStrEqual(node->name, (const xmlChar *)"stats_port"))
+	  {
+	    char val[PATH_MAX];
+	    if (get_param_val(node, val)
+		|| get_sock_port("stats", val, &stats_port))
+	      stats_port = 0;
+	  }
+      }
+  conn_reload_end();
+  stats_config(stats_port);
   return 0;
 }
 
 /*
- * Description : Parses a connection element.
+ * Description : Parses a connection element. A connection already running
+ *               under the same name is kept, with its baud rate, limits,
+ *               duplicate detection and client port updated, unless a
+ *               setting that needs the connection reopened has changed.
+ *               It is also kept as it is if the element is invalid.
  *
  * Arguments : conn_node - Pointer to the connection element.
  *
@@ -189,15 +239,23 @@ static void xml_parse_conn(xmlNode *conn_node)
 {
   char name[CONN_NAME_LEN];
   char tty_dev[PATH_MAX];
-  DUPLEX_T duplex;
+  DUPLEX_T duplex = DUPLEX_FULL;
   int tty_rate;
   int use_crc;
-  in_port_t sock_port;
+  in_port_t sock_port = 0;
+  char group[CONN_NAME_LEN + 1] = "";
   unsigned int tx_max_nak;
   unsigned int tx_max_enq;
   int rx_dup_detect;
+  int rx_early_ack = 0;
+  int allow_link_cfg = 0;
   unsigned int ack_timeout;
   xmlNode *param;
+  xmlNode *mb_node = NULL;
+  xmlNode *m_node = NULL;
+  CONN *old = NULL; /* Running connection with the same name. */
+  uint32_t sig;
+  CONN *conn;
   for (param = conn_node->xmlChildrenNode; param != NULL; param = param->next)
     if (param->type == XML_ELEMENT_NODE)
       {
@@ -206,6 +264,15 @@ static void xml_parse_conn(xmlNode *conn_node)
 	if (xmlStrEqual(param->name, (const xmlChar *)"name"))
 	  {
 	    if (get_name(val, name)) return;
+	    old = conn_find(name);
+	    if ((old != NULL) && old->cfg_seen)
+	      {
+		log_msg(LOG_ERR, "%s:%d [%s] Duplicate connection name at line"
+			" %ld.\n", __FILE__, __LINE__, name,
+			xmlGetLineNo(conn_node));
+		return;
+	      }
+	    if (old != NULL) old->cfg_seen = 1;
 	    continue;
 	  }
 	if (xmlStrEqual(param->name, (const xmlChar *)"duplex"))
@@ -233,11 +300,26 @@ static void xml_parse_conn(xmlNode *conn_node)
 	    if (get_sock_port(name, val, &sock_port)) return;
 	    continue;
 	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"group"))
+	  {
+	    if (get_group(name, val, group)) return;
+	    continue;
+	  }
 	if (xmlStrEqual(param->name, (const xmlChar *)"duplicate_detect"))
 	  {
 	    if (get_dup_detect(name, val, &rx_dup_detect)) return;
 	    continue;
 	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"early_ack"))
+	  {
+	    if (get_early_ack(name, val, &rx_early_ack)) return;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"allow_link_cfg"))
+	  {
+	    if (get_allow_link_cfg(name, val, &allow_link_cfg)) return;
+	    continue;
+	  }
 	if (xmlStrEqual(param->name, (const xmlChar *)"max_nak"))
 	  {
 	    if (get_max_nak(name, val, &tx_max_nak)) return;
@@ -253,12 +335,442 @@ static void xml_parse_conn(xmlNode *conn_node)
 	    if (get_ack_timeout(name, val, &ack_timeout)) return;
 	    continue;
 	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"modbus"))
+	  {
+	    /*
+	     * Parsed once the connection exists so nothing needs to be freed
+	     * if any other parameter is invalid.
+	     */
+	    mb_node = param;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"master"))
+	  {
+	    m_node = param;
+	    continue;
+	  }
       }
-  conn_init(name, tty_dev, tty_rate, use_crc, sock_port, tx_max_nak,
-	    tx_max_enq, rx_dup_detect, ack_timeout);
+  if ((duplex == DUPLEX_MASTER) && (m_node == NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] A half-duplex master requires a 'master'"
+	      " element.\n", __FILE__, __LINE__, name);
+      return;
+    }
+  if (*group && (duplex != DUPLEX_FULL))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Only full-duplex connections may be"
+	      " grouped.\n", __FILE__, __LINE__, name);
+      return;
+    }
+  if (!sock_port && (!*group || (conn_group_owner(group) == NULL)
+		     || (conn_group_owner(group) == old)))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] A 'port' element is required unless"
+	      " another connection of the group owns its listener.\n",
+	      __FILE__, __LINE__, name);
+      return;
+    }
+  sig = xml_sig(m_node, xml_sig(mb_node, SIG_BASIS));
+  if (old != NULL)
+    {
+      if (!strcmp(old->tty_dev, tty_dev) && (old->duplex == duplex)
+	  && (!old->use_crc == !use_crc) && !strcmp(old->group, group)
+	  && (old->cfg_sig == sig))
+	{
+	  /*
+	   * The port only matters to the link holding the listener; other
+	   * links of a group use the owner's.
+	   */
+	  if ((old->owner == old) && (old->sock_port != sock_port))
+	    conn_set_port(old, sock_port);
+	  else old->sock_port = sock_port;
+	  conn_update(old, tty_rate, tx_max_nak, tx_max_enq, rx_dup_detect,
+		      rx_early_ack, ack_timeout);
+	  old->allow_link_cfg = allow_link_cfg ? 1 : 0;
+	  return;
+	}
+      log_msg(LOG_INFO, "%s:%d [%s] Settings changed, reopening"
+	      " connection.\n", __FILE__, __LINE__, name);
+      conn_close(old);
+    }
+  conn = conn_init(name, duplex, tty_dev, tty_rate, use_crc, sock_port,
+		   *group ? group : NULL, tx_max_nak, tx_max_enq,
+		   rx_dup_detect, rx_early_ack, ack_timeout);
+  if (conn != NULL)
+    {
+      conn->cfg_sig = sig;
+      conn->allow_link_cfg = allow_link_cfg ? 1 : 0;
+    }
+  if ((conn != NULL) && (m_node != NULL)) xml_parse_master(conn, m_node);
+  if ((conn != NULL) && (mb_node != NULL) && (conn->owner != conn))
+    log_msg(LOG_ERR, "%s:%d [%s] Modbus front end ignored, only the first"
+	    " connection of group %s may have one.\n", __FILE__, __LINE__,
+	    name, group);
+  else if ((conn != NULL) && (mb_node != NULL))
+    xml_parse_modbus(conn, mb_node);
   return; 
 }
 
+/*
+ * Description : Parses a connection's modbus element and starts the Modbus
+ *               TCP front end.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb_node - Pointer to the modbus element.
+ *
+ * Return Value : None.
+ */
+static void xml_parse_modbus(CONN *conn, xmlNode *mb_node)
+{
+  MODBUS *mb;
+  xmlNode *param;
+  int have_node = 0;
+  int have_addr = 0;
+  mb = mb_new();
+  if (mb == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error allocating memory for Modbus : %s\n",
+	      __FILE__, __LINE__, conn->name, strerror(errno));
+      return;
+    }
+  for (param = mb_node->xmlChildrenNode; param != NULL; param = param->next)
+    if (param->type == XML_ELEMENT_NODE)
+      {
+	char val[PATH_MAX];
+	if (xmlStrEqual(param->name, (const xmlChar *)"map"))
+	  {
+	    if (xml_parse_mb_map(conn->name, param, mb)) break;
+	    continue;
+	  }
+	if (get_param_val(param, val)) break;
+	if (xmlStrEqual(param->name, (const xmlChar *)"port"))
+	  {
+	    if (get_sock_port(conn->name, val, &mb->port)) break;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"node"))
+	  {
+	    if (get_mb_addr(conn->name, val, "node", &mb->node)) break;
+	    have_node = 1;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"address"))
+	  {
+	    if (get_mb_addr(conn->name, val, "address", &mb->addr)) break;
+	    have_addr = 1;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"scan"))
+	  {
+	    if (get_mb_scan(conn->name, val, &mb->scan_ticks)) break;
+	    continue;
+	  }
+      }
+  if (param != NULL)
+    {
+      mb_free(conn, mb);
+      return;
+    }
+  if (!mb->port || !have_node || !have_addr)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Modbus port, node and address must be"
+	      " specified.\n", __FILE__, __LINE__, conn->name);
+      mb_free(conn, mb);
+      return;
+    }
+  mb_start(conn, mb);
+  return;
+}
+
+/*
+ * Description : Parses a connection's master element and starts the
+ *               half-duplex master.
+ *
+ * Arguments : conn - Connection pointer.
+ *             m_node - Pointer to the master element.
+ *
+ * Return Value : None.
+ */
+static void xml_parse_master(CONN *conn, xmlNode *m_node)
+{
+  MASTER *m;
+  xmlNode *param;
+  unsigned int ms;
+  m = master_new();
+  if (m == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error allocating memory for master : %s\n",
+	      __FILE__, __LINE__, conn->name, strerror(errno));
+      return;
+    }
+  for (param = m_node->xmlChildrenNode; param != NULL; param = param->next)
+    if (param->type == XML_ELEMENT_NODE)
+      {
+	char val[PATH_MAX];
+	if (get_param_val(param, val)) break;
+	if (xmlStrEqual(param->name, (const xmlChar *)"polling"))
+	  {
+	    if (get_poll_mode(conn->name, val, &m->mode)) break;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"slaves"))
+	  {
+	    if (get_slaves(conn->name, val, m)) break;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"idle_polls"))
+	  {
+	    if (get_master_num(conn->name, val, "idle polls", &m->idle_polls))
+	      break;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"active_time"))
+	  {
+	    if (get_master_num(conn->name, val, "active time", &ms)) break;
+	    m->active_ticks = ms / (TICK_USEC / 1000);
+	    continue;
+	  }
+      }
+  if (param != NULL)
+    {
+      master_free(conn, m);
+      return;
+    }
+  if (!m->num_slaves)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] No slave stations given for the"
+	      " master.\n", __FILE__, __LINE__, conn->name);
+      master_free(conn, m);
+      return;
+    }
+  master_start(conn, m);
+  return;
+}
+
+/*
+ * Description : Parses the realtime element. Real-time mode is left off if
+ *               any parameter is invalid.
+ *
+ * Arguments : rt_node - Pointer to the realtime element.
+ *
+ * Return Value : None.
+ */
+static void xml_parse_rt(xmlNode *rt_node)
+{
+  xmlNode *param;
+  int prio = 0;
+  int pin = 0;
+  cpu_set_t cpus;
+  for (param = rt_node->xmlChildrenNode; param != NULL; param = param->next)
+    if (param->type == XML_ELEMENT_NODE)
+      {
+	char val[PATH_MAX];
+	if (get_param_val(param, val)) return;
+	if (xmlStrEqual(param->name, (const xmlChar *)"priority"))
+	  {
+	    if (get_rt_prio(val, &prio)) return;
+	    continue;
+	  }
+	if (xmlStrEqual(param->name, (const xmlChar *)"cpus"))
+	  {
+	    if (get_cpus(val, &cpus)) return;
+	    pin = 1;
+	    continue;
+	  }
+      }
+  if (!prio)
+    {
+      log_msg(LOG_ERR, "%s:%d Real-time mode requires a priority.\n",
+	      __FILE__, __LINE__);
+      return;
+    }
+  rt_config(prio, pin ? &cpus : NULL);
+  return;
+}
+
+/*
+ * Description : Parses the message_priority element. Rules parsed before an
+ *               invalid one are kept.
+ *
+ * Arguments : p_node - Pointer to the message_priority element.
+ *
+ * Return Value : None.
+ */
+static void xml_parse_prio(xmlNode *p_node)
+{
+  xmlNode *param;
+  unsigned int ms;
+  for (param = p_node->xmlChildrenNode; param != NULL; param = param->next)
+    if (param->type == XML_ELEMENT_NODE)
+      {
+	char val[PATH_MAX];
+	if (xmlStrEqual(param->name, (const xmlChar *)"rule"))
+	  {
+	    if (xml_parse_prio_rule(param)) return;
+	    continue;
+	  }
+	if (get_param_val(param, val)) return;
+	if (xmlStrEqual(param->name, (const xmlChar *)"aging"))
+	  {
+	    if (sscanf(val, "%u", &ms) != 1)
+	      {
+		log_msg(LOG_ERR, "%s:%d Error reading message priority"
+			" aging.\n", __FILE__, __LINE__);
+		return;
+	      }
+	    prio_set_aging(ms / (TICK_USEC / 1000));
+	    continue;
+	  }
+      }
+  return;
+}
+
+/*
+ * Description : Parses a message priority rule element, e.g.
+ *               <rule class="2" cmd="0x0f" fnc="0xaa" node="1" file="9"/>.
+ *               Attributes other than the class are optional, an absent
+ *               one matches any value.
+ *
+ * Arguments : rule_node - Pointer to the rule element.
+ *
+ * Return Value : Zero if the rule was added.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int xml_parse_prio_rule(xmlNode *rule_node)
+{
+  long cls, cmd, fnc, dst, file;
+  if (!xmlHasProp(rule_node, (const xmlChar *)"class")
+      || get_rule_field(rule_node, "class", PRIO_MAX, &cls)
+      || get_rule_field(rule_node, "cmd", 0xff, &cmd)
+      || get_rule_field(rule_node, "fnc", 0xff, &fnc)
+      || get_rule_field(rule_node, "node", 0xff, &dst)
+      || get_rule_field(rule_node, "file", 0xffff, &file))
+    {
+      log_msg(LOG_ERR, "%s:%d Invalid message priority rule at line %ld."
+	      " Classes are 0-%d.\n", __FILE__, __LINE__,
+	      xmlGetLineNo(rule_node), PRIO_MAX);
+      return -1;
+    }
+  return prio_add_rule(cls, cmd, fnc, dst, file);
+}
+
+/*
+ * Description : Gets a numeric attribute of a message priority rule, given
+ *               in decimal or with a 0x prefix in hexadecimal.
+ *
+ * Arguments : rule_node - Pointer to the rule element.
+ *             attr - Attribute name.
+ *             max - Largest valid value.
+ *             dst - Location to store the value, -1 if the attribute is
+ *                   absent.
+ *
+ * Return Value : Zero if the attribute was absent or successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_rule_field(xmlNode *rule_node, const char *attr,
+			  unsigned long max, long *dst)
+{
+  char val[PATH_MAX];
+  char *end;
+  unsigned long n;
+  *dst = -1;
+  if (!xmlHasProp(rule_node, (const xmlChar *)attr)) return 0;
+  if (get_attr_val(rule_node, attr, val)) return -1;
+  n = strtoul(val, &end, 0);
+  if ((end == val) || *end || (n > max)) return -1;
+  *dst = n;
+  return 0;
+}
+
+/*
+ * Description : Parses a Modbus map element, e.g.
+ *               <map table="holding" start="0" file="N7:0" elements="10"/>.
+ *
+ * Arguments : name - Connection name.
+ *             map_node - Pointer to the map element.
+ *             mb - Modbus front end to add the map to.
+ *
+ * Return Value : Zero if the map was added.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int xml_parse_mb_map(const char *name, xmlNode *map_node, MODBUS *mb)
+{
+  static const char *tables[] = {"holding", "input", "coil", "discrete"};
+  char val[PATH_MAX];
+  MB_TABLE_T table;
+  unsigned int start, file, element, elements;
+  char file_type;
+  if (get_attr_val(map_node, "table", val)) return -1;
+  for (table = MB_HOLDING; table <= MB_DISCRETE; table++)
+    if (!strcasecmp(val, tables[table])) break;
+  if ((table > MB_DISCRETE)
+      || get_attr_val(map_node, "start", val)
+      || (sscanf(val, "%u", &start) != 1) || (start > 65535)
+      || get_attr_val(map_node, "file", val)
+      || (sscanf(val, "%c%u:%u", &file_type, &file, &element) != 3)
+      || (file > 65535) || (element > 65535)
+      || get_attr_val(map_node, "elements", val)
+      || (sscanf(val, "%u", &elements) != 1) || (elements > 65535)
+      || mb_add_map(mb, table, start, toupper(file_type), file, element,
+		    elements))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Invalid Modbus map at line %ld.\n",
+	      __FILE__, __LINE__, name, xmlGetLineNo(map_node));
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Computes a signature of an element, its attributes and
+ *               everything it contains, ignoring whitespace between
+ *               elements.
+ *
+ * Arguments : node - Element, NULL if absent.
+ *             sig - Signature to add to.
+ *
+ * Return Value : The updated signature.
+ */
+static uint32_t xml_sig(const xmlNode *node, uint32_t sig)
+{
+  const xmlAttr *attr;
+  const xmlNode *child;
+  if (node == NULL) return sig;
+  sig = sig_add(sig, node->name);
+  for (attr = node->properties; attr != NULL; attr = attr->next)
+    {
+      sig = sig_add(sig, attr->name);
+      if (attr->children != NULL) sig = sig_add(sig, attr->children->content);
+    }
+  for (child = node->children; child != NULL; child = child->next)
+    {
+      if (child->type == XML_ELEMENT_NODE) sig = xml_sig(child, sig);
+      else if ((child->type == XML_TEXT_NODE)
+	       && !xmlIsBlankNode((xmlNode *)child))
+	sig = sig_add(sig, child->content);
+    }
+  return sig;
+}
+
+/*
+ * Description : Adds a string, including its terminator, to a signature.
+ *
+ * Arguments : sig - Signature to add to.
+ *             str - String to add, NULL is treated as empty.
+ *
+ * Return Value : The updated signature.
+ */
+static uint32_t sig_add(uint32_t sig, const xmlChar *str)
+{
+  if (str == NULL) str = (const xmlChar *)"";
+  do
+    {
+      sig ^= *str;
+      sig *= SIG_PRIME;
+    } while (*str++);
+  return sig;
+}
+
 /*
  * Description : Retrieves the text content of a node and converts it from
  *               UTF-8 to char. The converted string will be NULL terminated.
@@ -296,6 +808,41 @@ static int get_param_val(xmlNodePtr src, char *dst)
   return 0;
 }
 
+/*
+ * Description : Retrieves the value of an attribute and converts it from
+ *               UTF-8 to char. The converted string will be NULL terminated.
+ *
+ * Arguments : src - The node containing the attribute.
+ *             attr - Attribute name.
+ *             dst - Location to store the retrieved value.
+ *
+ * Return Value : Zero if the attribute was retrieved and converted
+ *                successfully.
+ *                Non-zero if the attribute is missing or an error occured.
+ */
+static int get_attr_val(xmlNodePtr src, const char *attr, char *dst)
+{
+  size_t i, val_max;
+  size_t dst_max = PATH_MAX - 1;
+  xmlChar *val;
+  const char *p;
+  val = xmlGetProp(src, (const xmlChar *)attr);
+  if (val == NULL) return -1;
+  p = (char *)val;
+  val_max = xmlStrlen(val);
+  i = iconv(utf8_conv, (char **)&p, &val_max, &dst, &dst_max);
+  xmlFree(val);
+  if (i == (size_t)-1)
+    {
+      log_msg(LOG_ERR, "%s:%d Error converting configuration"
+	      " attribute at line %ld : %s", __FILE__, __LINE__,
+	      xmlGetLineNo(src), strerror(errno));
+      return -1;
+    }
+  *dst = 0; /* Null terminate the converted string. */
+  return 0;
+}
+
 /*
  * Description : Gets the connection's name from the 'name' element.
  *
@@ -466,6 +1013,29 @@ static int get_sock_port(const char *name, const char *val, in_port_t *dst)
   return 0;
 }
 
+/*
+ * Description : Gets the name of the group the connection belongs to from
+ *               the 'group' element.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             dst - Pointer to location to store the group name.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_group(const char *name, const char *val, char *dst)
+{
+  if (!strlen(val) || (strlen(val) > CONN_NAME_LEN))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Invalid group name.\n", __FILE__,
+	      __LINE__, name);
+      return 1;
+    }
+  strcpy(dst, val);
+  return 0;
+}
+
 /*
  * Description : Gets the connection's duplicate message detection setting from
  *               the 'duplicate_detect' element.
@@ -492,6 +1062,56 @@ static int get_dup_detect(const char *name, const char *val, int *dst)
   return 0;
 }
 
+/*
+ * Description : Gets the connection's early ACK setting from the 'early_ack'
+ *               element.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_early_ack(const char *name, const char *val, int *dst)
+{
+  if (!strcasecmp(val, "yes")) *dst = 1;
+  else if (!strcasecmp(val, "no")) *dst = 0;
+  else
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error reading early ACK option."
+	      " Valid options are 'yes' and 'no'.\n",
+	      __FILE__, __LINE__, name);
+      return 1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Gets whether clients may change the link settings from the
+ *               'allow_link_cfg' element.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_allow_link_cfg(const char *name, const char *val, int *dst)
+{
+  if (!strcasecmp(val, "yes")) *dst = 1;
+  else if (!strcasecmp(val, "no")) *dst = 0;
+  else
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error reading link settings option."
+	      " Valid options are 'yes' and 'no'.\n",
+	      __FILE__, __LINE__, name);
+      return 1;
+    }
+  return 0;
+}
+
 /*
  * Description : Gets the connection's maximum allowable NAKs from the
  *               'max_nak' element.
@@ -567,5 +1187,222 @@ static int get_ack_timeout(const char *name, const char *val,
 	      __LINE__, name);
       return 1;
     }
+  if ((*dst < ACK_TIMEOUT_MIN) || (*dst > ACK_TIMEOUT_MAX))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Illegal value for ACK timeout. Valid"
+	      " values are %u-%u.\n", __FILE__, __LINE__, name,
+	      ACK_TIMEOUT_MIN, ACK_TIMEOUT_MAX);
+      return 1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Gets a Modbus front end's node or source address.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             what - Name of the element, for error messages.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_mb_addr(const char *name, const char *val, const char *what,
+		       uint8_t *dst)
+{
+  unsigned int addr;
+  if ((sscanf(val, "%u", &addr) != 1) || (addr > 254))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Illegal value for Modbus %s. Valid values"
+	      " are 0-254.\n", __FILE__, __LINE__, name, what);
+      return 1;
+    }
+  *dst = addr;
+  return 0;
+}
+
+/*
+ * Description : Gets a Modbus front end's cache refresh period in
+ *               milliseconds and converts it to ticks.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_mb_scan(const char *name, const char *val, unsigned int *dst)
+{
+  unsigned int ms;
+  if (sscanf(val, "%u", &ms) != 1)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error reading Modbus scan period.\n",
+	      __FILE__, __LINE__, name);
+      return 1;
+    }
+  *dst = ms / (TICK_USEC / 1000);
+  return 0;
+}
+
+/*
+ * Description : Gets a half-duplex master's polling method.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_poll_mode(const char *name, const char *val, POLL_MODE_T *dst)
+{
+  if (!strcasecmp(val, "standard")) *dst = POLL_STANDARD;
+  else if (!strcasecmp(val, "message")) *dst = POLL_MESSAGE;
+  else
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error reading polling method. "
+	      "Valid options are 'standard' and 'message'.\n", __FILE__,
+	      __LINE__, name);
+      return 1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Adds the slave stations from a list of addresses and
+ *               address ranges, e.g. "1-8,12", to a master's poll list.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             m - Master.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_slaves(const char *name, const char *val, MASTER *m)
+{
+  const char *p = val;
+  while (*p)
+    {
+      char *end;
+      unsigned long first = strtoul(p, &end, 10);
+      unsigned long last = first;
+      if (end == p) break;
+      if (*end == '-')
+	{
+	  p = end + 1;
+	  last = strtoul(p, &end, 10);
+	  if (end == p) break;
+	}
+      if ((first > last) || (last > 254)) break;
+      for (; first <= last; first++)
+	if (master_add_slave(m, first))
+	  {
+	    log_msg(LOG_ERR, "%s:%d [%s] Slave station %lu listed twice.\n",
+		    __FILE__, __LINE__, name, first);
+	    return 1;
+	  }
+      while (isspace(*end)) end++;
+      if (*end == ',') end++;
+      else if (*end) break;
+      while (isspace(*end)) end++;
+      p = end;
+    }
+  if (*p)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error reading slave stations. Valid"
+	      " addresses are 0-254.\n", __FILE__, __LINE__, name);
+      return 1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Gets one of a half-duplex master's numeric options.
+ *
+ * Arguments : name - Connection name.
+ *             val - Pointer to string containing the option.
+ *             what - Description of the option, for error messages.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_master_num(const char *name, const char *val, const char *what,
+			  unsigned int *dst)
+{
+  if (sscanf(val, "%u", dst) != 1)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error reading master %s.\n", __FILE__,
+	      __LINE__, name, what);
+      return 1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Gets the real-time scheduling priority.
+ *
+ * Arguments : val - Pointer to string containing the option.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_rt_prio(const char *val, int *dst)
+{
+  int max = sched_get_priority_max(SCHED_FIFO);
+  int min = sched_get_priority_min(SCHED_FIFO);
+  if ((sscanf(val, "%d", dst) != 1) || (*dst < min) || (*dst > max))
+    {
+      log_msg(LOG_ERR, "%s:%d Error reading real-time priority. Valid"
+	      " priorities are %d-%d.\n", __FILE__, __LINE__, min, max);
+      return 1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Gets the CPUs to run on from a list of CPU numbers and
+ *               ranges, e.g. "2-3,6".
+ *
+ * Arguments : val - Pointer to string containing the option.
+ *             dst - Pointer to location to store the selection.
+ *
+ * Return Value : Zero if the given parameter was successfully read.
+ *                Non-zero if an error occured or an invalid value was given.
+ */
+static int get_cpus(const char *val, cpu_set_t *dst)
+{
+  const char *p = val;
+  CPU_ZERO(dst);
+  while (*p)
+    {
+      char *end;
+      unsigned long first = strtoul(p, &end, 10);
+      unsigned long last = first;
+      if (end == p) break;
+      if (*end == '-')
+	{
+	  p = end + 1;
+	  last = strtoul(p, &end, 10);
+	  if (end == p) break;
+	}
+      if ((first > last) || (last >= CPU_SETSIZE)) break;
+      for (; first <= last; first++) CPU_SET(first, dst);
+      while (isspace(*end)) end++;
+      if (*end == ',') end++;
+      else if (*end) break;
+      while (isspace(*end)) end++;
+      p = end;
+    }
+  if (*p || !CPU_COUNT(dst))
+    {
+      log_msg(LOG_ERR, "%s:%d Error reading real-time CPUs. Give CPU numbers"
+	      " and ranges, e.g. 2-3,6.\n", __FILE__, __LINE__);
+      return 1;
+    }
   return 0;
 }
@@ -31,12 +31,26 @@ static int alloc_bufs(CONN *conn, CLIENT *client);
 static int read_client(CONN *conn, CLIENT *client);
 static int write_client(CONN *conn, CLIENT *client);
 static void find_next_tx(CONN *conn, CLIENT *start_client);
+static int tx_before(const CLIENT *a, const CLIENT *b);
+static void start_tx(CONN *conn, CLIENT *client);
 static int parse_sock_data(CONN *conn, CLIENT *client);
-static int rcv_app(CONN *conn, CLIENT *client, uint8_t byte);
+static int parse_unit(CONN *conn, CLIENT *client, uint8_t byte);
+static int unit_open(const CLIENT *client);
+static int parse_mux(CONN *conn, CLIENT *sess);
+static void reg_vc(CONN *conn, CLIENT *sess, uint8_t vid, uint8_t addr);
+static CLIENT *find_vc(const CONN *conn, const CLIENT *sess, uint8_t vid);
+static int internal(const CLIENT *client);
+static int rcv_app(CONN *conn, CLIENT *client, RBUF *in);
 static void rcv_ack(CONN *conn, CLIENT *client);
 static void rcv_nak(CONN *conn, CLIENT *client);
 static int reg_client(const CONN *conn, CLIENT *client);
 static CLIENT *find_addr(const CONN *conn, uint8_t addr);
+static void expire_msg(CONN *conn, CLIENT *client);
+static CLIENT *local_dst(const CONN *conn, const CLIENT *client);
+static int rx_busy(const CONN *conn, const CLIENT *client);
+static void route_local(CONN *conn);
+static void local_done(CONN *conn, CLIENT *client, int ok);
+static void link_cfg(CONN *conn, const CLIENT *client);
 static CLIENT *close_client(CONN *conn, CLIENT *client);
 
 /*
@@ -50,10 +64,9 @@ static CLIENT *close_client(CONN *conn, CLIENT *client);
  */
 extern void client_accept(CONN *conn)
 {
-  CLIENT *new_client;
-  CLIENT *next_client;
   int new_fd;
   int addr_len;
+  int nodelay = 1;
   struct sockaddr_in addr;
   char addr_p[INET_ADDRSTRLEN];
   addr_len = sizeof(addr);
@@ -69,16 +82,43 @@ extern void client_accept(CONN *conn)
       return;
     }
   /*
-   * Allocate and initialize a new client structure.
+   * ACKs and replies are small writes a client waits on; do not hold them
+   * back for the acknowledgement of the previous segment.
    */
+  setsockopt(new_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  if (client_adopt(conn, new_fd) == NULL)
+    {
+      close(new_fd);
+      return;
+    }
+  inet_ntop(AF_INET, &addr.sin_addr, addr_p, INET_ADDRSTRLEN);
+  log_msg(LOG_INFO, "%s:%d [%s] Client connected from %s.\n", __FILE__,
+	  __LINE__, conn->name, addr_p);
+  return;
+}
+
+/*
+ * Description : Allocates and initializes a new client structure for a
+ *               connected socket, accepted or handed over by a restarting
+ *               df1d.
+ *
+ * Arguments : conn - Connection holding the clients.
+ *             fd - Client socket.
+ *
+ * Return Value : The new client, awaiting registration.
+ *                NULL if memory allocation failed; the socket is left open.
+ */
+extern CLIENT *client_adopt(CONN *conn, int fd)
+{
+  CLIENT *new_client;
+  CLIENT *next_client;
   new_client = (CLIENT *)calloc(1, sizeof(CLIENT));
   if (new_client == NULL)
     {
       log_msg(LOG_ERR,
 	      "%s:%d [%s] Error allocating memory for new client : %s\n",
 	      __FILE__, __LINE__, conn->name, strerror(errno));
-      close(new_fd);
-      return;
+      return NULL;
     }
   if (alloc_bufs(conn, new_client))
     {
@@ -86,10 +126,9 @@ extern void client_accept(CONN *conn)
 	      "%s:%d [%s] Error allocating memory for client buffers : %s\n",
 	      __FILE__, __LINE__, conn->name, strerror(errno));
       free(new_client);
-      close(new_fd);
-      return;
+      return NULL;
     }
-  new_client->fd = new_fd;
+  new_client->fd = fd;
   new_client->state = CLIENT_CONNECTED;
   strncpy(new_client->name, "*!REG*", PCCC_NAME_LEN);
   /*
@@ -102,10 +141,7 @@ extern void client_accept(CONN *conn)
 	   next_client = next_client->next);
       next_client->next = new_client;
     }
-  inet_ntop(AF_INET, &addr.sin_addr, addr_p, INET_ADDRSTRLEN);
-  log_msg(LOG_INFO, "%s:%d [%s] Client connected from %s.\n", __FILE__,
-	  __LINE__, conn->name, addr_p);
-  return;
+  return new_client;
 }
 
 /*
@@ -124,6 +160,7 @@ extern int client_get_read_fds(const CONN *conn, fd_set *set)
   int high = 0;
   for (cur = conn->clients; cur != NULL; cur = cur->next)
     {
+      if (cur->fd < 0) continue; /* Internal clients have no socket. */
       FD_SET(cur->fd, set);
       if (cur->fd > high) high = cur->fd;
     }
@@ -146,7 +183,7 @@ extern int client_get_write_fds(const CONN *conn, fd_set *set)
   int write_pend = 0;
   CLIENT *client;
   for (client = conn->clients; client != NULL; client = client->next)
-    if (buf_write_ready(client->sock_out))
+    if ((client->fd >= 0) && rbuf_len(client->sock_out))
       {
 	FD_SET(client->fd, set);
 	write_pend = 1; 
@@ -173,6 +210,11 @@ extern int client_service_fds(CONN *conn, const fd_set *read,
   int ret = 0;
   for (client = conn->clients; (client != NULL) && *cnt;)
     {
+      if (client->fd < 0)
+	{
+	  client = client->next;
+	  continue;
+	}
       if (FD_ISSET(client->fd, read))
 	{
 	  *cnt--;
@@ -209,22 +251,32 @@ extern int client_service_fds(CONN *conn, const fd_set *read,
  */
 extern void client_msg_tx_ok(CONN *conn)
 {
-  if (conn->tx.client != NULL)
+  if ((conn->tx.client != NULL) && internal(conn->tx.client))
+    {
+      conn->tx.client->state = CLIENT_IDLE;
+      conn->tx.client->dcnts.tx_success++;
+      stats_tx_ok(conn->tx.client);
+      mb_tx_done(conn, 1);
+    }
+  else if (conn->tx.client != NULL)
     {
       log_msg(LOG_DEBUG, "%s:%d [%s.%s] Sending transmission success"
 	      " message to client.\n", __FILE__, __LINE__, conn->name,
 	      conn->tx.client->name);
-      if (buf_append_byte(conn->tx.client->sock_out, MSG_ACK))
+      if (client_send(conn->tx.client, MSG_ACK, NULL))
 	log_msg(LOG_ERR, "%s:%d [%s.%s] Could not send transmission"
 		" success notice to client because socket buffer full.\n",
 		__FILE__, __LINE__, conn->name, conn->tx.client->name);
       conn->tx.client->state = CLIENT_IDLE;
       conn->tx.client->dcnts.tx_success++;
+      stats_tx_ok(conn->tx.client);
     }
   else /* Client is defunct. */
     log_msg(LOG_ERR,
 	    "%s:%d [%s] Message transmission completed for defunct client.\n",
 	    __FILE__, __LINE__, conn->name);
+  master_tx_done(conn, 1);
+  group_tx_done(conn, 1);
   find_next_tx(conn, NULL);
   return;
 }
@@ -239,12 +291,18 @@ extern void client_msg_tx_ok(CONN *conn)
  */
 extern void client_msg_tx_fail(CONN *conn)
 {
-  if (conn->tx.client != NULL)
+  if ((conn->tx.client != NULL) && internal(conn->tx.client))
+    {
+      conn->tx.client->state = CLIENT_IDLE;
+      conn->tx.client->dcnts.tx_fail++;
+      mb_tx_done(conn, 0);
+    }
+  else if (conn->tx.client != NULL)
     {
       log_msg(LOG_DEBUG,
 	      "%s:%d [%s.%s] Sending transmission failure message.\n",
 	      __FILE__, __LINE__, conn->name, conn->tx.client->name);
-      if (buf_append_byte(conn->tx.client->sock_out, MSG_NAK))
+      if (client_send(conn->tx.client, MSG_NAK, NULL))
 	log_msg(LOG_ERR, "%s:%d [%s.%s] Could not send transmission"
 		" failure notice to client because socket buffer full.\n",
 		__FILE__, __LINE__, conn->name, conn->tx.client->name);
@@ -255,6 +313,8 @@ extern void client_msg_tx_fail(CONN *conn)
     log_msg(LOG_ERR,
 	    "%s:%d [%s] Message transmission failed for defunct client.\n",
 	    __FILE__, __LINE__, conn->name);
+  master_tx_done(conn, 0);
+  group_tx_done(conn, 0);
   find_next_tx(conn, NULL);
   return;
 }
@@ -280,30 +340,279 @@ extern void client_msg_rx(CONN *conn)
       conn->dcnts.unknown_dst++;
       rx_ack(conn);
     }
+  else if (group_rx_busy(conn, client) || client->local_pend)
+    {
+      /*
+       * The client has yet to accept a message received on another link
+       * of the group or routed locally; the NAK makes the sender try again.
+       */
+      log_msg(LOG_DEBUG, "%s:%d [%s.%s] Received message rejected because"
+	      " client busy with another message.\n", __FILE__, __LINE__,
+	      conn->name, client->name);
+      rx_nak(conn);
+    }
+  else if (internal(client)) /* Internal clients consume messages directly. */
+    {
+      conn->rx.client = client;
+      client->dcnts.msg_rx++;
+      mb_msg_rx(conn);
+    }
   else
     {
-      size_t new_len;
       log_msg(LOG_DEBUG,
 	      "%s:%d [%s.%s] Sending received message to client.\n",
 	      __FILE__, __LINE__, conn->name, client->name);
-      new_len = client->sock_out->len + conn->rx.app->len + 2;
-      if (new_len > client->sock_out->max)
+      if (client_send(client, MSG_SOH, conn->rx.app))
 	{
 	  log_msg(LOG_ERR, "%s:%d [%s.%s] Received message dropped"
 		  " because client's socket buffer full.\n", __FILE__,
 		  __LINE__, conn->name, client->name);
 	  rx_nak(conn);
 	  client->dcnts.sink_full++;
+	  return;
 	}
-      buf_append_byte(client->sock_out, MSG_SOH);
-      buf_append_byte(client->sock_out, conn->rx.app->len);
-      buf_append_buf(client->sock_out, conn->rx.app);
-      conn->rx.client = client;
       client->dcnts.msg_rx++;
+      /*
+       * In early ACK mode the message is acknowledged on the link now and
+       * the client's ACK or NAK is only counted when it arrives.
+       */
+      if (conn->rx.early_ack)
+	{
+	  client->acks_owed++;
+	  rx_ack(conn);
+	}
+      else conn->rx.client = client;
+    }
+  return;
+}
+
+/*
+ * Description : Client timeout handler. Ages messages waiting for the
+ *               transmitter, counting down their deadlines and discarding
+ *               any that expire before being transmitted.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void client_tick(CONN *conn)
+{
+  CLIENT *client;
+  for (client = conn->clients; client != NULL; client = client->next)
+    {
+      if (client->state != CLIENT_MSG_READY) continue;
+      client->prio_wait++;
+      if (client->dl_ticks && !--client->dl_ticks) expire_msg(conn, client);
     }
+  route_local(conn); /* Destinations may have been freed by the receiver. */
   return;
 }
 
+/*
+ * Description : Creates an internal client, used by df1d itself to send
+ *               commands over the link. Internal clients have no socket;
+ *               transmission results and received messages are passed to
+ *               the Modbus front end, the only user of internal clients.
+ *
+ * Arguments : conn - Connection pointer.
+ *             addr - Link address of the client.
+ *             name - Client name used in log messages.
+ *
+ * Return Value : A pointer to the new client.
+ *                NULL if the address is in use or an error occured.
+ */
+extern CLIENT *client_new_internal(CONN *conn, uint8_t addr, const char *name)
+{
+  CLIENT *new_client;
+  CLIENT *next_client;
+  new_client = (CLIENT *)calloc(1, sizeof(CLIENT));
+  if (new_client == NULL)
+    {
+      log_msg(LOG_ERR,
+	      "%s:%d [%s] Error allocating memory for new client : %s\n",
+	      __FILE__, __LINE__, conn->name, strerror(errno));
+      return NULL;
+    }
+  if (alloc_bufs(conn, new_client))
+    {
+      log_msg(LOG_ERR,
+	      "%s:%d [%s] Error allocating memory for client buffers : %s\n",
+	      __FILE__, __LINE__, conn->name, strerror(errno));
+      free(new_client);
+      return NULL;
+    }
+  new_client->fd = -1;
+  new_client->addr = addr;
+  strncpy(new_client->name, name, PCCC_NAME_LEN);
+  if (reg_client(conn, new_client))
+    {
+      buf_free(new_client->df1_tx);
+      rbuf_free(new_client->sock_out);
+      rbuf_free(new_client->sock_in);
+      free(new_client);
+      return NULL;
+    }
+  if (conn->clients == NULL) conn->clients = new_client;
+  else
+    {
+      for (next_client = conn->clients; next_client->next != NULL;
+	   next_client = next_client->next);
+      next_client->next = new_client;
+    }
+  return new_client;
+}
+
+/*
+ * Description : Closes an internal client.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Internal client to close.
+ *
+ * Return Value : None.
+ */
+extern void client_free_internal(CONN *conn, CLIENT *client)
+{
+  close_client(conn, client);
+  return;
+}
+
+/*
+ * Description : Creates a virtual client carried by a multiplexed session.
+ *               The client still has to register an address.
+ *
+ * Arguments : conn - Connection holding the clients.
+ *             sess - Session carrying the client.
+ *             vid - Id of the client within the session.
+ *
+ * Return Value : A pointer to the new client.
+ *                NULL if memory allocation failed.
+ */
+extern CLIENT *client_new_virtual(CONN *conn, CLIENT *sess, uint8_t vid)
+{
+  CLIENT *new_client;
+  CLIENT *next_client;
+  new_client = (CLIENT *)calloc(1, sizeof(CLIENT));
+  if (new_client != NULL) new_client->df1_tx = buf_new(CLIENT_BUF_SIZE);
+  if ((new_client == NULL) || (new_client->df1_tx == NULL))
+    {
+      log_msg(LOG_ERR,
+	      "%s:%d [%s] Error allocating memory for virtual client : %s\n",
+	      __FILE__, __LINE__, conn->name, strerror(errno));
+      free(new_client);
+      return NULL;
+    }
+  new_client->fd = -1;
+  new_client->mux = sess;
+  new_client->vid = vid;
+  new_client->state = CLIENT_CONNECTED;
+  snprintf(new_client->name, sizeof(new_client->name), "%.*s/%u",
+	   PCCC_NAME_LEN - 4, sess->name, vid);
+  if (conn->clients == NULL) conn->clients = new_client;
+  else
+    {
+      for (next_client = conn->clients; next_client->next != NULL;
+	   next_client = next_client->next);
+      next_client->next = new_client;
+    }
+  return new_client;
+}
+
+/*
+ * Description : Queues a unit for a client, through its session if it is a
+ *               virtual client. Either the whole unit is queued or nothing.
+ *
+ * Arguments : client - Destination client.
+ *             type - Unit type, MSG_SOH to send a message.
+ *             msg - Message to send with MSG_SOH, NULL for other types.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the socket buffer is full.
+ */
+extern int client_send(CLIENT *client, uint8_t type, const BUF *msg)
+{
+  RBUF *out = (client->mux != NULL) ? client->mux->sock_out
+    : client->sock_out;
+  size_t len = (msg != NULL) ? msg->len + 2 : 1;
+  if (client->mux != NULL) len++;
+  if (len > rbuf_room(out)) return -1;
+  if (client->mux != NULL) rbuf_put_byte(out, client->vid);
+  rbuf_put_byte(out, type);
+  if (msg == NULL) return 0;
+  rbuf_put_byte(out, msg->len);
+  rbuf_put(out, msg->data, msg->len);
+  return 0;
+}
+
+/*
+ * Description : Submits the message assembled in an internal client's
+ *               df1_tx buffer for transmission.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Internal client.
+ *
+ * Return Value : None.
+ */
+extern void client_internal_tx(CONN *conn, CLIENT *client)
+{
+  client->state = CLIENT_MSG_READY;
+  client->dl_ticks = 0;
+  client->prio = prio_class(client->df1_tx);
+  client->prio_wait = 0;
+  stats_queued(client);
+  find_next_tx(conn, client);
+  return;
+}
+
+/*
+ * Description : Hands the next waiting client message, if any, to the
+ *               transmitter. Used by the half-duplex master between polls.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void client_next_tx(CONN *conn)
+{
+  find_next_tx(conn, NULL);
+  return;
+}
+
+/*
+ * Description : Sends the waiting message of the client at a half-duplex
+ *               slave station that has just been polled. Messages are
+ *               queued per station, so whatever arrived before the poll
+ *               goes out in answer to it.
+ *
+ * Arguments : conn - Connection pointer.
+ *             stn - Polled station address.
+ *
+ * Return Value : Positive if a message was handed to the transmitter.
+ *                Zero if the station's client has nothing to send.
+ *                Negative if no client is registered at the station.
+ */
+extern int client_poll(CONN *conn, uint8_t stn)
+{
+  CLIENT *client = find_addr(conn, stn);
+  if (client == NULL) return -1;
+  if ((client->state != CLIENT_MSG_READY) || tx_busy(&conn->tx)) return 0;
+  start_tx(conn, client);
+  return 1;
+}
+
+/*
+ * Description : Finds the registered client at an address.
+ *
+ * Arguments : conn - Connection to search.
+ *             addr - Desired address.
+ *
+ * Return Value : A pointer to the matching client.
+ *                NULL if no matching client was found.
+ */
+extern CLIENT *client_find(const CONN *conn, uint8_t addr)
+{
+  return find_addr(conn, addr);
+}
+
 /*
  * Description : Closes all the clients of a particular connection.
  *
@@ -331,17 +640,17 @@ static int alloc_bufs(CONN *conn, CLIENT *client)
 {
   client->df1_tx = buf_new(CLIENT_BUF_SIZE);
   if (client->df1_tx == NULL) return -1;
-  client->sock_out = buf_new(CLIENT_BUF_SIZE);
+  client->sock_out = rbuf_new(CLIENT_BUF_SIZE);
   if (client->sock_out == NULL)
     {
       buf_free(client->df1_tx);
       return -1;
     }
-  client->sock_in = buf_new(CLIENT_BUF_SIZE);
+  client->sock_in = rbuf_new(CLIENT_BUF_SIZE);
   if (client->sock_in == NULL)
     {
       buf_free(client->df1_tx);
-      buf_free(client->sock_out);
+      rbuf_free(client->sock_out);
       return -1;
     }
   return 0;
@@ -359,7 +668,7 @@ static int alloc_bufs(CONN *conn, CLIENT *client)
  */
 static int read_client(CONN *conn, CLIENT *client)
 {
-  ssize_t len = buf_read(client->fd, client->sock_in);
+  ssize_t len = ring_buf_read(client->fd, client->sock_in);
   if (len < 0)
     {
       log_msg(LOG_ERR,
@@ -374,7 +683,7 @@ static int read_client(CONN *conn, CLIENT *client)
       return -1;
     }
   log_msg(LOG_DEBUG, "%s:%d [%s.%s] Received %u bytes from client.\n",
-	  __FILE__, __LINE__, conn->name, client->name, client->sock_in->len);
+	  __FILE__, __LINE__, conn->name, client->name, len);
   return 0;
 }
 
@@ -389,7 +698,7 @@ static int read_client(CONN *conn, CLIENT *client)
  */
 static int write_client(CONN *conn, CLIENT *client)
 {
-  ssize_t len = buf_write(client->fd, client->sock_out);
+  ssize_t len = ring_buf_write(client->fd, client->sock_out);
   if (len < 0)
     {
       log_msg(LOG_ERR,
@@ -416,31 +725,75 @@ static int write_client(CONN *conn, CLIENT *client)
 static void find_next_tx(CONN *conn, CLIENT *start_client)
 {
   CLIENT *client;
-  if (tx_busy(&conn->tx)) return; /* Transmitter currently in use. */
-  if (conn->clients == NULL) return; /* No more clients. */
+  CLIENT *next = NULL; /* Client selected for transmission. */
+  CONN *owner = conn->owner; /* Holds the clients of a group. */
+  if (owner->clients == NULL) return; /* No more clients. */
   if (start_client == NULL)
     {
-      if (conn->tx.client == NULL) start_client = conn->clients;
+      if (conn->tx.client == NULL) start_client = owner->clients;
       else
 	{
 	  start_client = conn->tx.client->next;
-	  if (start_client == NULL) start_client = conn->clients;
+	  if (start_client == NULL) start_client = owner->clients;
 	}
     }
+  conn = group_pick(conn); /* Least loaded idle link of a group. */
+  if (conn == NULL) return; /* Every link of the group is in use. */
+  if (tx_busy(&conn->tx)) return; /* Transmitter currently in use. */
+  if (!master_tx_window(conn)) return; /* Half-duplex master is polling. */
+  if (conn->duplex == DUPLEX_SLAVE) return; /* Sent only when polled. */
   client = start_client;
   do
     {
-      if (client->state == CLIENT_MSG_READY)
-	{
-	  tx_msg(conn, client);
-	  buf_empty(client->df1_tx);
-	  client->state = CLIENT_MSG_PEND;
-	  client->dcnts.tx_attempts++;
-	  break;
-	}
+      if ((client->state == CLIENT_MSG_READY)
+	  && (local_dst(conn, client) == NULL) /* Not sent on the link. */
+	  && ((next == NULL) || tx_before(client, next)))
+	next = client;
       client = client->next;
-      if (client == NULL) client = conn->clients;
+      if (client == NULL) client = owner->clients;
     } while (client != start_client);
+  if (next == NULL) return;
+  start_tx(conn, next);
+  if (conn != owner || owner->link != NULL)
+    find_next_tx(conn, NULL); /* Another link of the group may be idle. */
+  return;
+}
+
+/*
+ * Description : Orders two waiting messages for transmission. The higher
+ *               priority class, raised by aging, goes first. Within a class
+ *               messages with a deadline are served earliest deadline first,
+ *               and messages without one round robin after them.
+ *
+ * Arguments : a - Client with a message ready.
+ *             b - Client with the message currently selected.
+ *
+ * Return Value : Non-zero if a's message should be sent before b's.
+ */
+static int tx_before(const CLIENT *a, const CLIENT *b)
+{
+  unsigned int rank_a = prio_rank(a);
+  unsigned int rank_b = prio_rank(b);
+  if (rank_a != rank_b) return rank_a > rank_b;
+  return a->dl_ticks && (!b->dl_ticks || (a->dl_ticks < b->dl_ticks));
+}
+
+/*
+ * Description : Hands a client's waiting message to the transmitter.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Client with a message ready.
+ *
+ * Return Value : None.
+ */
+static void start_tx(CONN *conn, CLIENT *client)
+{
+  stats_tx_start(conn, client);
+  tx_msg(conn, client);
+  buf_empty(client->df1_tx);
+  client->state = CLIENT_MSG_PEND;
+  client->dl_ticks = 0;
+  client->dcnts.tx_attempts++;
   return;
 }
 
@@ -455,8 +808,15 @@ static void find_next_tx(CONN *conn, CLIENT *start_client)
 static int parse_sock_data(CONN *conn, CLIENT *client)
 {
   uint8_t byte;
-  while (!buf_get_byte(client->sock_in, &byte))
+  if (client->mux_sess) return parse_mux(conn, client);
+  while (rbuf_len(client->sock_in))
     {
+      if (client->state == CLIENT_MSG)
+	{
+	  if (rcv_app(conn, client, client->sock_in)) return -1;
+	  continue;
+	}
+      rbuf_get_byte(client->sock_in, &byte);
       switch (client->state)
 	{
 	case CLIENT_CONNECTED: /* First byte received is the client address. */
@@ -469,106 +829,364 @@ static int parse_sock_data(CONN *conn, CLIENT *client)
 	  break;
 	case CLIENT_REG_NAME:
 	  client->name[client->name_len_rcvd++] = byte;
-	  if (client->name_len_rcvd == client->name_len)
+	  if (client->name_len_rcvd < client->name_len) break;
+	  client->name[client->name_len] = 0;
+	  if (client->addr == MSG_MUX_ADDR)
+	    {
+	      log_msg(LOG_INFO, "%s:%d [%s.%s] Multiplexed session opened.\n",
+		      __FILE__, __LINE__, conn->name, client->name);
+	      client->mux_sess = 1;
+	      client->mux_state = MUX_ID;
+	      client->state = CLIENT_IDLE;
+	      return parse_mux(conn, client);
+	    }
+	  if (reg_client(conn, client)) return -1;
+	  break;
+	default:
+	  if (parse_unit(conn, client, byte)) return -1;
+	  break;
+	}
+    }
+  return 0;
+}
+
+/*
+ * Description : Parses a byte of a unit from a registered client, either a
+ *               message or an answer to a received message.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Source client.
+ *             byte - Byte received.
+ *
+ * Return Value : Non-zero if an error occured.
+ */
+static int parse_unit(CONN *conn, CLIENT *client, uint8_t byte)
+{
+  switch (client->state)
+    {
+    case CLIENT_IDLE:
+      if ((byte == MSG_SOH) || (byte == MSG_SOH_DL))
+	{
+	  log_msg(LOG_DEBUG, "%s:%d [%s.%s] Receiving new"
+		  " application layer message from client.\n", __FILE__,
+		  __LINE__, conn->name, client->name);
+	  client->deadline = 0;
+	  client->state = (byte == MSG_SOH) ? CLIENT_MSG_LEN
+	    : CLIENT_MSG_DL1;
+	  break;
+	}
+      if (byte == MSG_LINK_CFG)
+	{
+	  client->state = CLIENT_CFG_NAK;
+	  break;
+	}
+      /* Intentional fall-through. */
+    case CLIENT_MSG_READY:
+    case CLIENT_MSG_PEND:
+      switch (byte)
+	{
+	case MSG_SOH: /* Only one outstanding message allowed at a time. */
+	case MSG_SOH_DL:
+	  log_msg(LOG_ERR, "%s:%d [%s.%s] Message received from client "
+		  "while one is already pending transmission.\n", __FILE__,
+		  __LINE__, conn->name, client->name);
+	  return -1;
+	  break;
+	case MSG_ACK: /* Client acknowledged a received message. */
+	  rcv_ack(conn, client);
+	  break;
+	case MSG_NAK: /* Client rejected a received message. */
+	  rcv_nak(conn, client);
+	  break;
+	case MSG_LINK_CFG:
+	  log_msg(LOG_ERR, "%s:%d [%s.%s] Link settings received from client"
+		  " while a message is pending transmission.\n", __FILE__,
+		  __LINE__, conn->name, client->name);
+	  return -1;
+	  break;
+	default:
+	  log_msg(LOG_ERR, "%s:%d [%s.%s] Received unknown message type "
+		  "from client.\n", __FILE__, __LINE__, conn->name,
+		  client->name);
+	  return -1;
+	  break;
+	}
+      break;
+    case CLIENT_MSG_DL1:
+      client->deadline = byte;
+      client->state = CLIENT_MSG_DL2;
+      break;
+    case CLIENT_MSG_DL2:
+      client->deadline |= byte << 8;
+      client->state = CLIENT_MSG_LEN;
+      break;
+    case CLIENT_MSG_LEN:
+      if (!byte)
+	{
+	  log_msg(LOG_ERR, "%s:%d [%s.%s] Empty message received from"
+		  " client.\n", __FILE__, __LINE__, conn->name,
+		  client->name);
+	  return -1;
+	}
+      client->new_msg_len = byte;
+      client->state = CLIENT_MSG;
+      break;
+    case CLIENT_CFG_NAK:
+      client->cfg_nak = byte;
+      client->state = CLIENT_CFG_ENQ;
+      break;
+    case CLIENT_CFG_ENQ:
+      client->cfg_enq = byte;
+      client->state = CLIENT_CFG_TMO1;
+      break;
+    case CLIENT_CFG_TMO1:
+      client->cfg_timeout = byte;
+      client->state = CLIENT_CFG_TMO2;
+      break;
+    case CLIENT_CFG_TMO2:
+      client->cfg_timeout |= byte << 8;
+      client->state = CLIENT_IDLE;
+      link_cfg(conn, client);
+      break;
+    default: /* Registration and CLIENT_MSG are handled by the caller. */
+      break;
+    }
+  return 0;
+}
+
+/*
+ * Description : Determines if a client is part way through a unit.
+ *
+ * Arguments : client - Client pointer.
+ *
+ * Return Value : Non-zero if more bytes of the unit are expected.
+ */
+static int unit_open(const CLIENT *client)
+{
+  return (client->state == CLIENT_MSG_DL1) || (client->state == CLIENT_MSG_DL2)
+    || (client->state == CLIENT_MSG_LEN) || (client->state == CLIENT_MSG)
+    || (client->state >= CLIENT_CFG_NAK);
+}
+
+/*
+ * Description : Parses data received on a multiplexed session, passing each
+ *               unit to the virtual client its id names.
+ *
+ * Arguments : conn - Connection pointer.
+ *             sess - Session client.
+ *
+ * Return Value : Non-zero if an error occured; the session is closed along
+ *                with its virtual clients.
+ */
+static int parse_mux(CONN *conn, CLIENT *sess)
+{
+  uint8_t byte;
+  CLIENT *vc;
+  while (rbuf_len(sess->sock_in))
+    {
+      if (sess->mux_state == MUX_UNIT)
+	{
+	  vc = find_vc(conn, sess, sess->mux_id);
+	  if (vc->state == CLIENT_MSG)
+	    {
+	      if (rcv_app(conn, vc, sess->sock_in)) return -1;
+	    }
+	  else
 	    {
-	      client->name[client->name_len] = 0;
-	      if (reg_client(conn, client)) return -1;
+	      rbuf_get_byte(sess->sock_in, &byte);
+	      if (parse_unit(conn, vc, byte)) return -1;
 	    }
+	  if (!unit_open(vc)) sess->mux_state = MUX_ID;
+	  continue;
+	}
+      rbuf_get_byte(sess->sock_in, &byte);
+      switch (sess->mux_state)
+	{
+	case MUX_ID:
+	  sess->mux_id = byte;
+	  sess->mux_state = MUX_TYPE;
 	  break;
-	case CLIENT_IDLE:
-	  if (byte == MSG_SOH)
+	case MUX_TYPE:
+	  vc = find_vc(conn, sess, sess->mux_id);
+	  sess->mux_state = MUX_ID;
+	  if (byte == MSG_VC_REG) sess->mux_state = MUX_REG;
+	  else if (byte == MSG_VC_UNREG)
 	    {
-	      log_msg(LOG_DEBUG, "%s:%d [%s.%s] Receiving new"
-		      " application layer message from client.\n", __FILE__,
-		      __LINE__, conn->name, client->name);
-	      client->state = CLIENT_MSG_LEN;
-	      break;
+	      if (vc != NULL) close_client(conn, vc);
 	    }
-	  /* Intentional fall-through. */
-	case CLIENT_MSG_READY:
-	case CLIENT_MSG_PEND:
-	  switch (byte)
+	  else if (vc == NULL)
 	    {
-	    case MSG_SOH: /* Only one outstanding message allowed at a time. */
-	      log_msg(LOG_ERR, "%s:%d [%s.%s] Message received from client "
-		      "while one is already pending transmission.\n", __FILE__,
-		      __LINE__, conn->name, client->name);
+	      log_msg(LOG_ERR, "%s:%d [%s.%s] Unit received for unregistered"
+		      " virtual client %u.\n", __FILE__, __LINE__, conn->name,
+		      sess->name, sess->mux_id);
 	      return -1;
-	      break;
-	    case MSG_ACK: /* Client acknowledged a received message. */
-	      rcv_ack(conn, client);
-	      break;
-	    case MSG_NAK: /* Client rejected a received message. */
-	      rcv_nak(conn, client);
-	      break;
-	    default:
-	      log_msg(LOG_ERR, "%s:%d [%s.%s] Received unknown message type "
-		      "from client.\n", __FILE__, __LINE__, conn->name,
-		      client->name);
-	      return -1;
-	      break;
-	    }	  
+	    }
+	  else
+	    {
+	      if (parse_unit(conn, vc, byte)) return -1;
+	      if (unit_open(vc)) sess->mux_state = MUX_UNIT;
+	    }
 	  break;
-	case CLIENT_MSG_LEN:
-	  client->new_msg_len = byte;
-	  client->state = CLIENT_MSG;
+	case MUX_REG:
+	  reg_vc(conn, sess, sess->mux_id, byte);
+	  sess->mux_state = MUX_ID;
 	  break;
-	case CLIENT_MSG:
-	  if (rcv_app(conn, client, byte)) return -1;
+	case MUX_UNIT: /* Handled above. */
 	  break;
 	}
     }
   return 0;
 }
 
+/*
+ * Description : Registers a virtual client of a multiplexed session and
+ *               answers the session with MSG_ACK or MSG_NAK.
+ *
+ * Arguments : conn - Connection pointer.
+ *             sess - Session client.
+ *             vid - Virtual client id.
+ *             addr - Source address to register.
+ *
+ * Return Value : None.
+ */
+static void reg_vc(CONN *conn, CLIENT *sess, uint8_t vid, uint8_t addr)
+{
+  CLIENT *vc = NULL;
+  uint8_t rsp[2];
+  if (find_vc(conn, sess, vid) != NULL)
+    log_msg(LOG_ERR, "%s:%d [%s.%s] Virtual client %u already"
+	    " registered.\n", __FILE__, __LINE__, conn->name, sess->name, vid);
+  else vc = client_new_virtual(conn, sess, vid);
+  if (vc != NULL)
+    {
+      vc->addr = addr;
+      if (reg_client(conn, vc))
+	{
+	  close_client(conn, vc);
+	  vc = NULL;
+	}
+    }
+  rsp[0] = vid;
+  rsp[1] = (vc != NULL) ? MSG_ACK : MSG_NAK;
+  if (rbuf_put(sess->sock_out, rsp, sizeof(rsp)))
+    log_msg(LOG_ERR, "%s:%d [%s.%s] Could not answer virtual client"
+	    " registration because socket buffer full.\n", __FILE__, __LINE__,
+	    conn->name, sess->name);
+  return;
+}
+
+/*
+ * Description : Finds a virtual client of a multiplexed session.
+ *
+ * Arguments : conn - Connection pointer.
+ *             sess - Session client.
+ *             vid - Virtual client id.
+ *
+ * Return Value : The virtual client, NULL if not registered.
+ */
+static CLIENT *find_vc(const CONN *conn, const CLIENT *sess, uint8_t vid)
+{
+  CLIENT *client;
+  for (client = conn->owner->clients; client != NULL; client = client->next)
+    if ((client->mux == sess) && (client->vid == vid)) break;
+  return client;
+}
+
+/*
+ * Description : Determines if a client is internal, serving df1d itself.
+ *
+ * Arguments : client - Client pointer.
+ *
+ * Return Value : Non-zero for an internal client.
+ */
+static int internal(const CLIENT *client)
+{
+  return (client->fd < 0) && (client->mux == NULL);
+}
+
 /*
  * Description : Assembles an incoming application layer message from a client
- *               in that client's df1_tx buffer.
+ *               in that client's df1_tx buffer, copying as much of the
+ *               message as the contiguous data received holds.
  *
  * Arguments : conn - Connection pointer.
  *             client - Pointer to the client sourcing the message.
- *             byte - The next byte from the application layer message.
+ *             in - Data received, from the client's socket or the
+ *                  multiplexed session carrying it.
  *
  * Return Value : Zero if successfull.
  *                Non-zero if the application message being received
  *                overflowed the client's application message buffer.
  */
-static int rcv_app(CONN *conn, CLIENT *client, uint8_t byte)
+static int rcv_app(CONN *conn, CLIENT *client, RBUF *in)
 {
-  if (buf_append_byte(client->df1_tx, byte))
+  size_t span;
+  const uint8_t *data = rbuf_peek(in, &span);
+  if (span > client->new_msg_len - client->df1_tx->len)
+    span = client->new_msg_len - client->df1_tx->len;
+  if (buf_append_blob(client->df1_tx, (void *)data, span))
     {
       log_msg(LOG_ERR, "%s:%d [%s.%s] Buffer overflow while receiving "
 	      "application data.", __FILE__, __LINE__, conn->name,
 	      client->name);
       return -1;
     }
+  rbuf_consume(in, span);
   /*
-   * Once the message is completely received, queue it for transmission.
+   * Once the message is completely received, deliver it to a local client
+   * or queue it for transmission.
    */
   if (client->df1_tx->len == client->new_msg_len)
     {
       client->state = CLIENT_MSG_READY;
-      find_next_tx(conn, client);
+      client->dl_ticks = client->deadline
+	? client->deadline / (TICK_USEC / 1000) + 1 : 0;
+      client->prio = prio_class(client->df1_tx);
+      client->prio_wait = 0;
+      stats_queued(client);
+      if (local_dst(conn, client) != NULL) route_local(conn);
+      else find_next_tx(conn, client);
     }
   return 0;
 }
 
 /*
- * Description :
+ * Description : Handles a client's ACK of a received message. Messages ACKed
+ *               early on the link were delivered before any still pending,
+ *               so they are answered first.
  *
- * Arguments :
+ * Arguments : conn - Connection pointer.
+ *             client - Client sending the ACK.
  *
  * Return Value : None.
  */
 static void rcv_ack(CONN *conn, CLIENT *client)
 {
-  if (conn->rx.client == client)
+  CONN *link;
+  if (client->acks_owed)
     {
       log_msg(LOG_DEBUG,
-	      "%s:%d [%s.%s] Client accepted message from receiver.\n",
+	      "%s:%d [%s.%s] Client accepted early ACKed message.\n",
 	      __FILE__, __LINE__, conn->name, client->name);
-      rx_ack(conn);
+      client->acks_owed--;
       client->dcnts.msg_accept++;
+      return;
+    }
+  if (client->local_pend)
+    {
+      local_done(conn, client, 1);
+      return;
+    }
+  for (link = conn; link != NULL; link = link->link)
+    if (link->rx.client == client) break;
+  if (link != NULL)
+    {
+      log_msg(LOG_DEBUG,
+	      "%s:%d [%s.%s] Client accepted message from receiver.\n",
+	      __FILE__, __LINE__, link->name, client->name);
+      rx_ack(link);
+      client->dcnts.msg_accept++;
+      route_local(conn);
     }
   else
     log_msg(LOG_ERR, "%s:%d [%s.%s] Received unexpected ACK from client.\n",
@@ -577,21 +1195,42 @@ static void rcv_ack(CONN *conn, CLIENT *client)
 }
 
 /*
- * Description :
+ * Description : Handles a client's NAK of a received message. A message that
+ *               was ACKed early cannot be refused on the link any more and
+ *               is lost.
  *
- * Arguments :
+ * Arguments : conn - Connection pointer.
+ *             client - Client sending the NAK.
  *
  * Return Value : None.
  */
 static void rcv_nak(CONN *conn, CLIENT *client)
 {
-  if (conn->rx.client == client)
+  CONN *link;
+  if (client->acks_owed)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s.%s] Client rejected a message already"
+	      " acknowledged on the link, message lost.\n", __FILE__,
+	      __LINE__, conn->name, client->name);
+      client->acks_owed--;
+      client->dcnts.msg_reject++;
+      return;
+    }
+  if (client->local_pend)
+    {
+      local_done(conn, client, 0);
+      return;
+    }
+  for (link = conn; link != NULL; link = link->link)
+    if (link->rx.client == client) break;
+  if (link != NULL)
     {
       log_msg(LOG_DEBUG,
 	      "%s:%d [%s.%s] Client rejected message from receiver.\n",
-	      __FILE__, __LINE__, conn->name, client->name);
-      rx_nak(conn);
+	      __FILE__, __LINE__, link->name, client->name);
+      rx_nak(link);
       client->dcnts.msg_reject++;
+      route_local(conn);
     }
   else
     log_msg(LOG_ERR, "%s:%d [%s.%s] Received unexpected NAK from client.\n",
@@ -637,11 +1276,158 @@ static int reg_client(const CONN *conn, CLIENT *new_client)
 static CLIENT *find_addr(const CONN *conn, uint8_t addr)
 {
   CLIENT *client;
-  for (client = conn->clients; client != NULL; client = client->next)
-    if ((client->state >= CLIENT_IDLE) && (client->addr == addr)) break;
+  for (client = conn->owner->clients; client != NULL; client = client->next)
+    if ((client->state >= CLIENT_IDLE) && (client->addr == addr)
+	&& !client->mux_sess)
+      break;
   return client;
 }
 
+/*
+ * Description : Discards a client's message whose deadline passed before it
+ *               could be transmitted and notifies the client.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Client owning the expired message.
+ *
+ * Return Value : None.
+ */
+static void expire_msg(CONN *conn, CLIENT *client)
+{
+  log_msg(LOG_DEBUG, "%s:%d [%s.%s] Message deadline of %u mS expired"
+	  " before transmission.\n", __FILE__, __LINE__, conn->name,
+	  client->name, client->deadline);
+  if (client_send(client, MSG_EXPIRED, NULL))
+    log_msg(LOG_ERR, "%s:%d [%s.%s] Could not send expired message"
+	    " notice to client because socket buffer full.\n",
+	    __FILE__, __LINE__, conn->name, client->name);
+  buf_empty(client->df1_tx);
+  client->state = CLIENT_IDLE;
+  client->dcnts.expired++;
+  conn->dcnts.expired++;
+  return;
+}
+
+/*
+ * Description : Finds the local destination of a client's waiting message.
+ *               Messages addressed to another socket client registered on
+ *               the same connection are delivered directly rather than
+ *               transmitted on the link.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Client with a message ready.
+ *
+ * Return Value : The destination client.
+ *                NULL if the message goes out on the link.
+ */
+static CLIENT *local_dst(const CONN *conn, const CLIENT *client)
+{
+  CLIENT *dst;
+  if (internal(client) || (client->df1_tx->len <= client->df1_tx->index))
+    return NULL;
+  dst = find_addr(conn, client->df1_tx->data[client->df1_tx->index]);
+  if ((dst == NULL) || (dst == client) || internal(dst)) return NULL;
+  return dst;
+}
+
+/*
+ * Description : Determines if a client still has to answer a message
+ *               received from the link or routed locally. Only one such
+ *               message is given to a client at a time, so its answers can
+ *               be matched to them.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Client to test.
+ *
+ * Return Value : Non-zero if the client is busy.
+ */
+static int rx_busy(const CONN *conn, const CLIENT *client)
+{
+  const CONN *link;
+  if (client->local_pend) return 1;
+  for (link = conn->owner; link != NULL; link = link->link)
+    if (link->rx.client == client) return 1;
+  return 0;
+}
+
+/*
+ * Description : Delivers waiting messages addressed to local clients that
+ *               are free to take them. The sender is answered once the
+ *               destination ACKs or NAKs, as if sent over the link.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+static void route_local(CONN *conn)
+{
+  CLIENT *client;
+  CLIENT *dst;
+  for (client = conn->owner->clients; client != NULL; client = client->next)
+    {
+      if (client->state != CLIENT_MSG_READY) continue;
+      dst = local_dst(conn, client);
+      if ((dst == NULL) || rx_busy(conn, dst)) continue;
+      client->dcnts.tx_attempts++;
+      if (client_send(dst, MSG_SOH, client->df1_tx))
+	{
+	  log_msg(LOG_ERR, "%s:%d [%s.%s] Local message to %s dropped"
+		  " because its socket buffer full.\n", __FILE__, __LINE__,
+		  conn->name, client->name, dst->name);
+	  dst->dcnts.sink_full++;
+	  client_send(client, MSG_NAK, NULL);
+	  buf_empty(client->df1_tx);
+	  client->state = CLIENT_IDLE;
+	  client->dcnts.tx_fail++;
+	  continue;
+	}
+      log_msg(LOG_DEBUG, "%s:%d [%s.%s] Routing message locally to %s.\n",
+	      __FILE__, __LINE__, conn->name, client->name, dst->name);
+      dst->dcnts.msg_rx++;
+      dst->local_pend = 1;
+      dst->local_src = client;
+      buf_empty(client->df1_tx);
+      client->state = CLIENT_MSG_PEND;
+      client->dl_ticks = 0;
+    }
+  return;
+}
+
+/*
+ * Description : Completes a locally routed message once its destination
+ *               answers, passing the result to the sender. The next message
+ *               waiting for the destination is routed right away.
+ *
+ * Arguments : conn - Connection pointer.
+ *             client - Destination client.
+ *             ok - Non-zero if the destination accepted the message.
+ *
+ * Return Value : None.
+ */
+static void local_done(CONN *conn, CLIENT *client, int ok)
+{
+  CLIENT *src = client->local_src;
+  client->local_pend = 0;
+  client->local_src = NULL;
+  if (ok) client->dcnts.msg_accept++;
+  else client->dcnts.msg_reject++;
+  if (src != NULL) /* NULL if the sender closed. */
+    {
+      log_msg(LOG_DEBUG, "%s:%d [%s.%s] Local message %s by %s.\n",
+	      __FILE__, __LINE__, conn->name, src->name,
+	      ok ? "accepted" : "rejected", client->name);
+      if (client_send(src, ok ? MSG_ACK : MSG_NAK, NULL))
+	log_msg(LOG_ERR, "%s:%d [%s.%s] Could not send local message result"
+		" to client because socket buffer full.\n", __FILE__,
+		__LINE__, conn->name, src->name);
+      src->state = CLIENT_IDLE;
+      if (ok) src->dcnts.tx_success++;
+      else src->dcnts.tx_fail++;
+    }
+  route_local(conn);
+  return;
+}
+
 /*
  * Description : Frees memory allocated for a client and closes it's
  *               socket file descriptor.
@@ -655,23 +1441,39 @@ static CLIENT *find_addr(const CONN *conn, uint8_t addr)
  */
 static CLIENT *close_client(CONN *conn, CLIENT *client)
 {
-  CLIENT *next_client = client->next;
+  CLIENT *next_client;
+  CONN *link; /* Links of the connection's group. */
+  CLIENT *other;
+  /*
+   * A multiplexed session takes its virtual clients with it.
+   */
+  if (client->mux_sess)
+    for (other = conn->clients; other != NULL;)
+      other = (other->mux == client) ? close_client(conn, other)
+	: other->next;
+  next_client = client->next;
   log_msg(LOG_INFO, "%s:%d [%s.%s] Closing client.\n", __FILE__,
 	  __LINE__, conn->name, client->name);
   log_msg(LOG_INFO, "%s:%d [%s.%s] Client stats: %u msgs tx; %u msgs rx.\n",
 	  __FILE__, __LINE__, conn->name, client->name,
 	  client->dcnts.tx_attempts, client->dcnts.msg_rx);
+  if (client->acks_owed)
+    log_msg(LOG_ERR, "%s:%d [%s.%s] %u early ACKed message(s) may not have"
+	    " reached the client.\n", __FILE__, __LINE__, conn->name,
+	    client->name, client->acks_owed);
   /*
    * If the client being closed currently has a message out for transmission,
    * set the transmitter's client pointer to NULL so that it doesn't try to
    * notify a defunct client of the result of the transmission.
    */
-  if (conn->tx.client == client) conn->tx.client = NULL;
+  for (link = conn; link != NULL; link = link->link)
+    if (link->tx.client == client) link->tx.client = NULL;
   /*
    * If the client was sent a received message, but has not yet acknowledged
    * it, send an ACK.
    */
-  if (conn->rx.client == client) rx_ack(conn);
+  for (link = conn; link != NULL; link = link->link)
+    if (link->rx.client == client) rx_ack(link);
   /*
    * Remove the client from the connection's linked list.
    */
@@ -683,13 +1485,66 @@ static CLIENT *close_client(CONN *conn, CLIENT *client)
 	   prev_client = prev_client->next);
       prev_client->next = client->next;
     }
-  if (close(client->fd))
+  /*
+   * A locally routed message the client has not answered fails back to its
+   * sender, and one the client sent is no longer answered. Done once the
+   * client is off the list so nothing else is routed to it.
+   */
+  for (other = conn->clients; other != NULL; other = other->next)
+    if (other->local_src == client) other->local_src = NULL;
+  if (client->local_pend) local_done(conn, client, 0);
+  ring_forget(client->fd);
+  if ((client->fd >= 0) && close(client->fd))
     log_msg(LOG_ERR,
 	    "%s:%d [%s.%s] Error closing client file descriptor : %s\n",
 	    client->name, __FILE__, __LINE__, strerror(errno));
   buf_free(client->df1_tx);
-  buf_free(client->sock_out);
-  buf_free(client->sock_in);
+  rbuf_free(client->sock_out);
+  rbuf_free(client->sock_in);
   free(client);
   return next_client;
 }
+
+/*
+ * Description : Applies link settings received from a client to every link
+ *               of the client's connection. Settings are ignored unless
+ *               every link allows them and they are within range; a client
+ *               may not disable retries.
+ *
+ * Arguments : conn - Connection the client is registered on.
+ *             client - Client that sent the settings.
+ *
+ * Return Value : None.
+ */
+static void link_cfg(CONN *conn, const CLIENT *client)
+{
+  CONN *link;
+  for (link = conn->owner; link != NULL; link = link->link)
+    if (!link->allow_link_cfg)
+      {
+	log_msg(LOG_ERR, "%s:%d [%s.%s] Link settings from client refused"
+		" because not allowed on link %s.\n", __FILE__, __LINE__,
+		conn->name, client->name, link->name);
+	return;
+      }
+  if ((client->cfg_nak < LINK_CFG_RETRY_MIN)
+      || (client->cfg_enq < LINK_CFG_RETRY_MIN)
+      || (client->cfg_timeout < ACK_TIMEOUT_MIN)
+      || (client->cfg_timeout > ACK_TIMEOUT_MAX))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s.%s] Invalid link settings ignored. Max NAKs"
+	      " - %u, Max ENQs - %u, %u mS ACK timeout.\n", __FILE__, __LINE__,
+	      conn->name, client->name, client->cfg_nak, client->cfg_enq,
+	      client->cfg_timeout);
+      return;
+    }
+  for (link = conn->owner; link != NULL; link = link->link)
+    {
+      tx_config(link, client->cfg_nak, client->cfg_enq, client->cfg_timeout);
+      log_msg(LOG_INFO, "%s:%d [%s.%s] Link settings changed by client. Max"
+	      " NAKs - %u, Max ENQs - %u, %u tick(s) ACK timeout.\n", __FILE__,
+	      __LINE__, link->name, client->name, link->tx.max_nak,
+	      link->tx.max_enq, link->tx.tticks);
+    }
+  return;
+}
@@ -28,6 +28,7 @@
 #define LISTEN_BACKLOG 5
 
 static int sock_init(CONN *conn, in_port_t port);
+static in_port_t sock_get_port(int fd);
 static void parse_tty_data(CONN *conn);
 static CONN *close_conn(CONN *target);
 
@@ -37,23 +38,35 @@ static CONN *head; /* Pointer to the top of the linked list of connections. */
  * Description : Allocates and initializes a new connection instance.
  *
  * Arguments : name - Text name for connection.
+ *             duplex - Duplex mode.
  *             tty_dev - Serial port device.
  *             tty_rate - Serial port baud rate.
  *             use_crc - Non-zero to use CRC checksums, BCC otherwise.
- *             sock_port - TCP port to bind to for client connections.
+ *             sock_port - TCP port to bind to for client connections,
+ *                         zero if the group's owner provides it.
+ *             group - Connection group name, NULL if not grouped. Links
+ *                     after the first of a group share its listening
+ *                     socket and clients.
  *             tx_max_nak - Max NAKs allowed before transmission failure.
  *             tx_max_enq - Max ENQs allowed before transmission failure.
  *             rx_dup_detect - Non-zero to enable receiver duplicate message
  *                             detection.
+ *             rx_early_ack - Non-zero to ACK received messages once queued
+ *                            for a client.
  *
- * Return Value : None.
+ * Return Value : A pointer to the new connection.
+ *                NULL if the connection could not be initialized.
  */
-extern void conn_init(const char *name, const char *tty_dev, int tty_rate,
-		      int use_crc, in_port_t sock_port,
-		      unsigned int tx_max_nak, unsigned int tx_max_enq,
-		      int rx_dup_detect, unsigned int ack_timeout)
+extern CONN *conn_init(const char *name, DUPLEX_T duplex,
+		       const char *tty_dev, int tty_rate,
+		       int use_crc, in_port_t sock_port, const char *group,
+		       unsigned int tx_max_nak, unsigned int tx_max_enq,
+		       int rx_dup_detect, int rx_early_ack,
+		       unsigned int ack_timeout)
 {
   CONN *new;
+  CONN *owner = NULL; /* First link of the group being joined. */
+  int take_over = 0;
   log_msg(LOG_INFO, "%s:%d [%s] Initializing connection.\n", __FILE__,
 	  __LINE__, name);
   new = (CONN *)calloc(1, sizeof(CONN));
@@ -62,36 +75,54 @@ extern void conn_init(const char *name, const char *tty_dev, int tty_rate,
       log_msg(LOG_ERR, "%s:%d [%s] Failed to allocate memory for new"
 	      " connection : %s\n", __FILE__, __LINE__, name,
 	      strerror(errno));
-      return;
+      return NULL;
     }
   strncpy(new->name, name, CONN_NAME_LEN);
+  strncpy(new->tty_dev, tty_dev, PATH_MAX - 1);
+  new->sock_port = sock_port;
+  new->duplex = duplex;
   new->use_crc = use_crc;
+  new->owner = new;
+  if (group != NULL)
+    {
+      strncpy(new->group, group, CONN_NAME_LEN);
+      owner = conn_group_owner(group);
+      /*
+       * A link configured with the port takes the group back from a link
+       * that only holds the listener because the owner was closed, as when
+       * the owner is reopened on a reload.
+       */
+      take_over = (owner != NULL) && !owner->sock_port && sock_port;
+    }
   if (tty_open(new, tty_dev, tty_rate))
     {
       free(new);
-      return;
+      return NULL;
     }
-  if (sock_init(new, sock_port))
+  if ((owner != NULL)
+      && (!take_over || (sock_get_port(owner->sock_fd) == sock_port)))
+    new->sock_fd = -1; /* Uses or takes the owner's listener. */
+  else if (sock_init(new, sock_port))
     {
       tty_close(new);
       free(new);
-      return;
+      return NULL;
     }
   if (tx_init(new, tx_max_nak, tx_max_enq, ack_timeout))
     {
 
       tty_close(new);
       free(new);
-      return;
+      return NULL;
     }
-  if (rx_init(new, rx_dup_detect))
+  if (rx_init(new, rx_dup_detect, rx_early_ack))
     {
 
 
       tx_close(new);
       tty_close(new);
       free(new);
-      return;
+      return NULL;
     }
   /*
    * Append the new connection to the linked list.
@@ -103,6 +134,190 @@ extern void conn_init(const char *name, const char *tty_dev, int tty_rate,
       for (end = head; end->next != NULL; end = end->next);
       end->next = new;
     }
+  if (take_over) group_take_over(owner, new);
+  else if (owner != NULL) group_join(owner, new);
+  new->cfg_seen = 1;
+  return new;
+}
+
+/*
+ * Description : Gets the first connection of the list of connections.
+ *
+ * Arguments : None.
+ *
+ * Return Value : The first connection, NULL if there are none.
+ */
+extern CONN *conn_first(void)
+{
+  return head;
+}
+
+/*
+ * Description : Finds a connection by name.
+ *
+ * Arguments : name - Connection name.
+ *
+ * Return Value : The connection, NULL if not found.
+ */
+extern CONN *conn_find(const char *name)
+{
+  CONN *cur;
+  for (cur = head; cur != NULL; cur = cur->next)
+    if (!strcmp(cur->name, name)) return cur;
+  return NULL;
+}
+
+/*
+ * Description : Finds the link of a group holding its listening socket
+ *               and clients.
+ *
+ * Arguments : group - Group name.
+ *
+ * Return Value : The group's owner, NULL if no link of the group is open.
+ */
+extern CONN *conn_group_owner(const char *group)
+{
+  CONN *cur;
+  for (cur = head; cur != NULL; cur = cur->next)
+    if ((cur->owner == cur) && !strcmp(cur->group, group)) return cur;
+  return NULL;
+}
+
+/*
+ * Description : Moves a connection's client listener to another port.
+ *               Connected clients are not disturbed. The previous listener
+ *               is kept if the new one can't be opened.
+ *
+ * Arguments : conn - Connection holding the listener.
+ *             port - New TCP port.
+ *
+ * Return Value : None.
+ */
+extern void conn_set_port(CONN *conn, in_port_t port)
+{
+  int old_fd = conn->sock_fd;
+  if (sock_init(conn, port))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Keeping the previous client port %u.\n",
+	      __FILE__, __LINE__, conn->name, conn->sock_port);
+      conn->sock_fd = old_fd;
+      return;
+    }
+  ring_forget(old_fd);
+  if ((old_fd >= 0) && close(old_fd))
+    log_msg(LOG_ERR, "%s:%d [%s] Error closing listening socket : %s\n",
+	    __FILE__, __LINE__, conn->name, strerror(errno));
+  log_msg(LOG_INFO, "%s:%d [%s] Client port changed from %u to %u.\n",
+	  __FILE__, __LINE__, conn->name, conn->sock_port, port);
+  conn->sock_port = port;
+  return;
+}
+
+/*
+ * Description : Applies settings that can change while a connection is
+ *               running. Messages in progress are not disturbed.
+ *
+ * Arguments : conn - Connection pointer.
+ *             tty_rate - Serial port baud rate.
+ *             tx_max_nak - Max NAKs allowed before transmission failure.
+ *             tx_max_enq - Max ENQs allowed before transmission failure.
+ *             rx_dup_detect - Non-zero to enable receiver duplicate message
+ *                             detection.
+ *             rx_early_ack - Non-zero to ACK received messages once queued
+ *                            for a client.
+ *             ack_timeout - Milliseconds to wait for an ACK.
+ *
+ * Return Value : None.
+ */
+extern void conn_update(CONN *conn, int tty_rate, unsigned int tx_max_nak,
+			unsigned int tx_max_enq, int rx_dup_detect,
+			int rx_early_ack, unsigned int ack_timeout)
+{
+  int changed = 0;
+  if (tty_rate != conn->tty_rate)
+    {
+      if (tty_set_rate(conn, tty_rate))
+	log_msg(LOG_ERR, "%s:%d [%s] Keeping the previous baud rate.\n",
+		__FILE__, __LINE__, conn->name);
+      changed = 1;
+    }
+  if ((tx_max_nak != conn->tx.max_nak) || (tx_max_enq != conn->tx.max_enq)
+      || (ack_timeout / (TICK_USEC / 1000) != conn->tx.tticks))
+    {
+      tx_config(conn, tx_max_nak, tx_max_enq, ack_timeout);
+      changed = 1;
+    }
+  if (!rx_dup_detect != !conn->rx.dup_detect)
+    {
+      conn->rx.dup_detect = rx_dup_detect ? 1 : 0;
+      changed = 1;
+    }
+  if (!rx_early_ack != !conn->rx.early_ack)
+    {
+      conn->rx.early_ack = rx_early_ack ? 1 : 0;
+      changed = 1;
+    }
+  if (changed)
+    log_msg(LOG_INFO, "%s:%d [%s] Settings updated. Max NAKs - %u, Max ENQs"
+	    " - %u, %u tick(s) ACK timeout, duplicate detection %s, early ACK"
+	    " %s.\n", __FILE__, __LINE__, conn->name, conn->tx.max_nak,
+	    conn->tx.max_enq, conn->tx.tticks,
+	    conn->rx.dup_detect ? "enabled" : "disabled",
+	    conn->rx.early_ack ? "enabled" : "disabled");
+  else log_msg(LOG_DEBUG, "%s:%d [%s] Settings unchanged.\n", __FILE__,
+	       __LINE__, conn->name);
+  return;
+}
+
+/*
+ * Description : Begins reading the configuration into the running
+ *               connections. Connections found while reading are marked.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void conn_reload_start(void)
+{
+  CONN *cur;
+  for (cur = head; cur != NULL; cur = cur->next) cur->cfg_seen = 0;
+  return;
+}
+
+/*
+ * Description : Finishes reading the configuration, closing connections no
+ *               longer in it.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void conn_reload_end(void)
+{
+  CONN *cur = head;
+  while (cur != NULL)
+    {
+      if (cur->cfg_seen) cur = cur->next;
+      else
+	{
+	  log_msg(LOG_INFO, "%s:%d [%s] Connection removed from the"
+		  " configuration.\n", __FILE__, __LINE__, cur->name);
+	  cur = close_conn(cur);
+	}
+    }
+  return;
+}
+
+/*
+ * Description : Closes a single connection.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void conn_close(CONN *conn)
+{
+  close_conn(conn);
   return;
 }
 
@@ -124,12 +339,19 @@ extern int conn_get_read_fds(fd_set *set)
       int high_client;
       FD_SET(cur->tty_fd, set);
       if (cur->tty_fd > high) high = cur->tty_fd;
-      FD_SET(cur->sock_fd, set);
-      if (cur->sock_fd > high) high = cur->sock_fd;
+      if (cur->sock_fd >= 0)
+	{
+	  FD_SET(cur->sock_fd, set);
+	  if (cur->sock_fd > high) high = cur->sock_fd;
+	}
       high_client = client_get_read_fds(cur, set);
       if (high_client > high) high = high_client;
+      high_client = mb_get_read_fds(cur, set);
+      if (high_client > high) high = high_client;
     }
-  return high ? high + 1 : 0;
+  if (!high) return 0; /* No connections, nothing to report on. */
+  if (stats_get_read_fds(set) > high) high = stats_get_read_fds(set);
+  return high + 1;
 }
 
 /*
@@ -150,12 +372,13 @@ extern int conn_get_write_fds(fd_set *set)
   FD_ZERO(set);
   do
     {
-      if (buf_write_ready(cur->tty_out))
+      if (rbuf_len(cur->tty_out) || ring_wr_pend(cur->tty_fd))
 	{
 	  FD_SET(cur->tty_fd, set);
 	  write_pend = 1;
 	}
       write_pend |= client_get_write_fds(cur, set);
+      write_pend |= mb_get_write_fds(cur, set);
       cur = cur->next;
     } while (cur != NULL);
   return write_pend;
@@ -177,31 +400,40 @@ extern int conn_service_fds(const fd_set *read, const fd_set *write, int *cnt)
 {
   int ret = 0;
   CONN *cur = head;
+  stats_service_fds(read, cnt);
   do
     {
       if (client_service_fds(cur, read, write, cnt)) ret = 1;
-      if (FD_ISSET(cur->tty_fd, read))
+      if (mb_service_fds(cur, read, write, cnt)) ret = 1;
+      /*
+       * A completed write is handled before any reply read with it, so the
+       * transmitter is waiting for the ACK when it is parsed.
+       */
+      if ((write != NULL) && FD_ISSET(cur->tty_fd, write))
 	{
-	  if (tty_read(cur))
+	  if (tty_write(cur))
 	    {
 	      cur = close_conn(cur);
 	      ret = -1;
 	      continue;
 	    }
-	  parse_tty_data(cur);
 	  if (!--*cnt) return ret;
 	}
-      if ((write != NULL) && FD_ISSET(cur->tty_fd, write))
+      if (FD_ISSET(cur->tty_fd, read))
 	{
-	  if (tty_write(cur))
+	  if (tty_read(cur))
 	    {
 	      cur = close_conn(cur);
 	      ret = -1;
 	      continue;
 	    }
+	  parse_tty_data(cur);
 	  if (!--*cnt) return ret;
 	}
-      if (FD_ISSET(cur->sock_fd, read)) /* New client connecting. */
+      /*
+       * New client connecting, only the first link of a group listens.
+       */
+      if ((cur->sock_fd >= 0) && FD_ISSET(cur->sock_fd, read))
 	{
 	  client_accept(cur);
 	  ret = 1;
@@ -226,6 +458,10 @@ extern void conn_tick(void)
     {
       rx_tick(cur);
       tx_tick(cur);
+      client_tick(cur);
+      master_tick(cur);
+      group_tick(cur);
+      mb_tick(cur);
       cur = cur->next;
     } while (cur != NULL);
   return;
@@ -257,6 +493,8 @@ static int sock_init(CONN *conn, in_port_t port)
 {
   int flags = 1;
   struct sockaddr_in addr;
+  conn->sock_fd = handoff_listen(conn->name, 0, port);
+  if (conn->sock_fd >= 0) return 0; /* Still listening from before. */
   conn->sock_fd = socket(AF_INET, SOCK_STREAM, 0);
   if (conn->sock_fd < 0)
     {
@@ -314,6 +552,22 @@ static int sock_init(CONN *conn, in_port_t port)
   return 0;
 }
 
+/*
+ * Description : Gets the port a listening socket is bound to.
+ *
+ * Arguments : fd - Socket file descriptor.
+ *
+ * Return Value : The TCP port, zero if it can't be determined.
+ */
+static in_port_t sock_get_port(int fd)
+{
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  if ((fd < 0) || getsockname(fd, (struct sockaddr *)&addr, &addr_len))
+    return 0;
+  return ntohs(addr.sin_port);
+}
+
 /*
  * Description : Parses the raw data received from a TTY looking for
  *               link layer symbols. Application layer bytes are passed on to
@@ -330,9 +584,15 @@ static void parse_tty_data(CONN *conn)
     {
       uint8_t byte;
       if (rx_active(&conn->rx)) rx_msg(conn);
-      more = !buf_get_byte(conn->tty_in, &byte);
+      more = !rbuf_get_byte(conn->tty_in, &byte);
       if (more)
 	{
+	  /*
+	   * Station address and poll checksum of a half-duplex DLE ENQ or
+	   * DLE SOH.
+	   */
+	  if ((conn->duplex == DUPLEX_SLAVE) && slave_byte(conn, byte))
+	    continue;
 	  if (conn->read_sym) /* Previous link layer byte was a DLE. */
 	    {
 	      conn->read_sym = 0;
@@ -345,12 +605,29 @@ static void parse_tty_data(CONN *conn)
 		case SYM_STX:
 		  log_msg(LOG_DEBUG, "%s:%d [%s] Received DLE STX.\n",
 			  __FILE__, __LINE__, conn->name);
+		  master_msg_start(conn);
+		  slave_msg_start(conn);
 		  rx_msg(conn);
 		  continue;  
 		  break;
 		case SYM_ENQ:
+		  /*
+		   * Nothing polls a half-duplex master.
+		   */
+		  if (conn->duplex == DUPLEX_MASTER) break;
 		  conn->dcnts.enqs_in++;
-		  rx_enq(conn);
+		  if (conn->duplex == DUPLEX_SLAVE) slave_enq(conn);
+		  else rx_enq(conn);
+		  continue;
+		  break;
+		case SYM_SOH:
+		  if (conn->duplex != DUPLEX_SLAVE) break;
+		  slave_soh(conn);
+		  continue;
+		  break;
+		case SYM_EOT:
+		  if (conn->duplex != DUPLEX_MASTER) break;
+		  master_eot(conn);
 		  continue;
 		  break;
 		case SYM_ACK:
@@ -387,6 +664,7 @@ static void parse_tty_data(CONN *conn)
 
 /*
  * Description : Closes a connection and all of it's associated clients.
+ *               A grouped link leaves its clients to the rest of the group.
  *
  * Arguments : target - Pointer to connection to close.
  *
@@ -411,11 +689,17 @@ static CONN *close_conn(CONN *target)
       for (prev = head; prev->next != target; prev = prev->next);
       prev->next = target->next;
     }
+  group_leave(target);
+  mb_free(target, target->modbus);
+  master_free(target, target->master);
+  slave_close(target);
+  rt_close(target);
   client_close_all(target);
   rx_close(target);
   tx_close(target);
   tty_close(target);
-  if (close(target->sock_fd))
+  ring_forget(target->sock_fd);
+  if ((target->sock_fd >= 0) && close(target->sock_fd))
     log_msg(LOG_ERR, "%s:%d [%s] Error closing listening socket : %s\n",
 	    __FILE__, __LINE__, target->name, strerror(errno));
   free(target);
@@ -32,6 +32,7 @@
 #define _GNU_SOURCE
 #define _XOPEN_SOURCE 601
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 //#include <iconv.h>
@@ -46,6 +47,9 @@
 #include <sys/types.h>
 
 #include "../common.h"
+#include "../rbuf.h"
+#include "../byteorder.h"
+#include "../linkmsg.h"
 #include "../lib/pccc.h"
 
 #ifdef _WIN32
@@ -59,8 +63,10 @@
 #else
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <libxml/parser.h>
 #include <libxml/valid.h>
+#include <sched.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
@@ -74,8 +80,10 @@
 /*
  * Embedded symbol definitions.
  */
+#define SYM_SOH 0x01
 #define SYM_STX 0x02
 #define SYM_ETX 0x03
+#define SYM_EOT 0x04
 #define SYM_ENQ 0x05
 #define SYM_ACK 0x06
 #define SYM_NAK 0x15
@@ -87,8 +95,21 @@
 #define TICK_SEC 0
 #define TICK_USEC 10000
 
+/*
+ * ACK timeout range in mS.
+ */
+#define ACK_TIMEOUT_MIN (TICK_USEC / 1000)
+#define ACK_TIMEOUT_MAX 10000
+
+#define LINK_CFG_RETRY_MIN 1 /* Fewest NAKs or ENQs a client may set. */
+
 #define CONN_NAME_LEN 16 /* Maximum length of connection name. */
 
+#define STATS_LAT_BUCKETS 24 /* Power of two client latency buckets. */
+
+#define PRIO_MAX 15 /* Highest message priority class. */
+#define PRIO_AGING_DEF 100 /* Default ticks waited per class raised. */
+
 #define CRC_ADD(i, crc, val)  \
 for (crc ^= val, i = 8; i--;) \
   if (crc & 1)                \
@@ -117,6 +138,10 @@ struct link_diag_cnt /* Per-connection diagnostic counters. */
   unsigned int bytes_ignored; /* Spurious bytes received. */
   unsigned int dups; /* Duplicate messages received. */
   unsigned int rx_overflow; /* Receiver overflows. */
+  unsigned int expired; /* Messages discarded after their deadline passed. */
+  unsigned int link_downs; /* Times taken out of service by its group. */
+  unsigned int bytes_in; /* Bytes read from the TTY. */
+  unsigned int bytes_out; /* Bytes written to the TTY. */
 };
 
 struct client_diag_cnt /* Per-client diagnostic counters. */
@@ -129,6 +154,10 @@ struct client_diag_cnt /* Per-client diagnostic counters. */
   unsigned int msg_reject; /* Messages received but rejected by client. */
   unsigned int msg_accept; /* Messages received and accepted by client. */
   unsigned int rx_timeouts; /* Timed out awaiting response from client. */
+  unsigned int expired; /* Messages discarded after their deadline passed. */
+  unsigned int lat_hist[STATS_LAT_BUCKETS]; /* Queued to ACKed time,
+					       counted by power of two
+					       of uS. */
 };
 
 typedef enum /* Client states. */
@@ -137,24 +166,59 @@ typedef enum /* Client states. */
     CLIENT_REG_LEN, /* Next byte should be the length of the client's name. */
     CLIENT_REG_NAME, /* Receiving client name. */
     CLIENT_IDLE, /* Client registered, ready for messages. */
+    CLIENT_MSG_DL1, /* Next byte is the low byte of the message deadline. */
+    CLIENT_MSG_DL2, /* Next byte is the high byte of the message deadline. */
     CLIENT_MSG_LEN, /* Next byte is length of application layer message. */
     CLIENT_MSG, /* Receiving application layer message. */
     CLIENT_MSG_READY, /* Application layer message completely received. */
-    CLIENT_MSG_PEND /* Application layer message submitted to transmitter. */
+    CLIENT_MSG_PEND, /* Application layer message submitted to transmitter. */
+    CLIENT_CFG_NAK, /* Next byte is the maximum NAKs of a link setting. */
+    CLIENT_CFG_ENQ, /* Next byte is the maximum ENQs. */
+    CLIENT_CFG_TMO1, /* Next byte is the low byte of the ACK timeout. */
+    CLIENT_CFG_TMO2 /* Next byte is the high byte of the ACK timeout. */
   } CLIENT_STATE_T;
 
+typedef enum /* Multiplexed session parser states. */
+  {
+    MUX_ID, /* Next byte is a virtual client id. */
+    MUX_TYPE, /* Next byte is the type of the unit for that id. */
+    MUX_REG, /* Next byte is the address of a registering virtual client. */
+    MUX_UNIT /* Remainder of a unit belongs to the virtual client. */
+  } MUX_STATE_T;
+
 typedef struct _client /* Client specific data. */
 {
   char name[PCCC_NAME_LEN + 1];
-  int fd; /* Socket file descriptor. */
+  int fd; /* Socket file descriptor, -1 for an internal or virtual client. */
   CLIENT_STATE_T state;
   uint8_t addr; /* Source node address. */
   uint8_t name_len; /* Length of the client's name. */
   uint8_t name_len_rcvd; /* Number of name characters received. */
   uint8_t new_msg_len; /* Size of application layer message from client. */
+  uint16_t deadline; /* Deadline in mS received with the current message. */
+  uint8_t cfg_nak; /* Link setting being received: maximum NAKs. */
+  uint8_t cfg_enq; /* Maximum ENQs. */
+  uint16_t cfg_timeout; /* ACK timeout in mS. */
+  unsigned int dl_ticks; /* Ticks until the message expires, 0 if none. */
+  unsigned int prio; /* Priority class of the waiting message. */
+  unsigned int prio_wait; /* Ticks the waiting message has been passed over. */
+  struct timespec queued; /* Time the waiting message was queued. */
   BUF *df1_tx; /* Message to be transmitted on behalf of the client. */
-  BUF *sock_out; /* Data to be transmitted to the client. */
-  BUF *sock_in; /* Data received from the client. */
+  RBUF *sock_out; /* Data to be transmitted to the client. */
+  RBUF *sock_in; /* Data received from the client. */
+  unsigned int acks_owed; /* Early ACKed messages the client has yet to ACK. */
+  unsigned local_pend : 1; /* Set while a locally routed message is unACKed. */
+  struct _client *local_src; /* Sender of that message, NULL if closed. */
+  /*
+   * A multiplexed session is a socket client carrying virtual clients; it
+   * has no address itself. Virtual clients have no socket or socket
+   * buffers, their units travel through the session tagged with their id.
+   */
+  unsigned mux_sess : 1; /* Set for a multiplexed session. */
+  MUX_STATE_T mux_state; /* Session parser state. */
+  uint8_t mux_id; /* Session: id of the unit being parsed. */
+  struct _client *mux; /* Virtual client: its session, NULL otherwise. */
+  uint8_t vid; /* Virtual client: id within the session. */
   struct client_diag_cnt dcnts;
   struct _client *next; /* Next client in the linked list. */
 } CLIENT;
@@ -177,6 +241,7 @@ typedef struct _tx /* Message transmitter data. */
   unsigned int tticks; /* Number of ticks before a timeout occurs. */
   BUF *msg; /* Current message being transmitted. */
   CLIENT *client; /* Client who's message is currently being transmitted. */
+  uint8_t stn; /* Destination station of the current message. */
 } TX;
 
 typedef enum /* Receiver states. */
@@ -199,6 +264,9 @@ typedef struct _rx /* Message receiver data. */
   unsigned overflow : 1; /* Set if message being received has overflowed. */
   unsigned dup_detect : 1; /* Set if duplicate message detection enabled. */
   unsigned prev_dle : 1; /* Set if the previous application byte was DLE. */
+  unsigned ignore : 1; /* Set if the message is for another station. */
+  unsigned early_ack : 1; /* Set to ACK once queued for a client. */
+  int stn; /* Half-duplex station included in the checksum, -1 if none. */
   CLIENT *client; /* Pointer to the client which received the message. */
   union /* Checksum received from message. */
   {
@@ -219,31 +287,224 @@ typedef enum
     DUPLEX_SLAVE /* Half duplex slave. */ 
   } DUPLEX_T;
 
+typedef enum /* Half-duplex slave link states. */
+  {
+    SLAVE_LINK, /* Parsing link layer symbols. */
+    SLAVE_POLL_STN, /* DLE ENQ received, next byte is the station. */
+    SLAVE_POLL_CS, /* Reading the poll checksum. */
+    SLAVE_MSG_STN, /* DLE SOH received, next byte is the station. */
+    SLAVE_MSG_STX /* Station received, DLE STX should follow. */
+  } SLAVE_STATE_T;
+
+typedef struct _slave /* Half-duplex slave data. */
+{
+  SLAVE_STATE_T state;
+  unsigned prev_dle : 1; /* Set if the previous station byte was a DLE. */
+  uint8_t stn; /* Station address being received. */
+  uint8_t cs[2]; /* Poll checksum received. */
+  unsigned int cs_len; /* Poll checksum bytes received. */
+  uint8_t tx_stn; /* Station whose message awaits an ACK. */
+  unsigned int polls; /* Polls received for local stations. */
+  unsigned int eots; /* Polls answered with EOT. */
+} SLAVE;
+
+typedef enum /* Half-duplex master states. */
+  {
+    MASTER_IDLE, /* Nothing to poll, client messages sent as they arrive. */
+    MASTER_GAP, /* Between polls, a client message may be sent. */
+    MASTER_MSG, /* Client message being sent to a slave. */
+    MASTER_POLL_TX, /* Poll in the TTY output buffer. */
+    MASTER_POLL_WAIT, /* Poll sent, awaiting a message or EOT. */
+    MASTER_POLL_RX /* Receiving a message from the polled slave. */
+  } MASTER_STATE_T;
+
+typedef enum /* Half-duplex master polling methods. */
+  {
+    POLL_STANDARD, /* Every slave is polled, active slaves every scan. */
+    POLL_MESSAGE /* Slaves are only polled for replies to sent messages. */
+  } POLL_MODE_T;
+
+typedef struct _poll_slave /* A slave station on the poll list. */
+{
+  uint8_t addr;
+  unsigned active : 1; /* Set if polled every scan. */
+  unsigned int active_ticks; /* Ticks until an active slave becomes idle. */
+  unsigned int polls; /* Polls sent. */
+  unsigned int msgs; /* Messages received. */
+  unsigned int eots; /* EOTs received. */
+  unsigned int timeouts; /* Polls not answered. */
+  unsigned int rsp_cnt; /* Responses timed. */
+  long rsp_min; /* Fastest response in uS. */
+  long rsp_max; /* Slowest response in uS. */
+  long long rsp_sum; /* Total response time in uS, for the average. */
+} POLL_SLAVE;
+
+typedef struct _master /* Half-duplex master data. */
+{
+  MASTER_STATE_T state;
+  POLL_MODE_T mode;
+  POLL_SLAVE *slaves;
+  unsigned int num_slaves;
+  unsigned int idle_polls; /* Idle slaves polled per scan. */
+  unsigned int active_ticks; /* Time a slave stays active after a message. */
+  unsigned int scan_pos; /* Next slave checked for an active poll. */
+  unsigned int idle_pos; /* Next idle slave polled. */
+  unsigned int idle_left; /* Idle polls remaining in the current scan. */
+  unsigned int scans; /* Completed poll scans. */
+  POLL_SLAVE *cur; /* Slave being polled. */
+  POLL_SLAVE *repoll; /* Slave to poll again after the gap, NULL for the
+			 next slave in the scan. */
+  unsigned int msgs; /* Messages received from the slave this poll. */
+  unsigned int eticks; /* Ticks elapsed awaiting the poll response. */
+  struct timeval sent; /* Time the poll left the output buffer. */
+} MASTER;
+
+typedef enum /* Modbus tables a data file range can be mapped to. */
+  {
+    MB_HOLDING, /* Holding registers, read/write. */
+    MB_INPUT, /* Input registers, read only. */
+    MB_COIL, /* Coils, read/write. */
+    MB_DISCRETE /* Discrete inputs, read only. */
+  } MB_TABLE_T;
+
+typedef struct _mb_map /* Data file range mapped to a Modbus table. */
+{
+  MB_TABLE_T table;
+  uint16_t start; /* First Modbus register or bit number. */
+  unsigned int count; /* Number of registers or bits. */
+  uint8_t type; /* PCCC file type code. */
+  uint8_t elem_size; /* Bytes per element. */
+  uint16_t file;
+  uint16_t element; /* First element. */
+  uint16_t elements;
+  uint8_t image[236]; /* Cached link encoded data. */
+  unsigned valid : 1; /* Set once the cache has been filled. */
+  struct _mb_map *next;
+} MB_MAP;
+
+typedef struct _mb_sess /* Modbus TCP client session. */
+{
+  int fd;
+  RBUF *in; /* Partially received requests. */
+  RBUF *out; /* Responses pending transmission. */
+  unsigned int writes; /* Write requests queued by the session. */
+  struct _mb_sess *next;
+} MB_SESS;
+
+typedef struct _mb_write /* Modbus write request waiting for the link. */
+{
+  MB_SESS *sess; /* Requesting session, NULL if it has closed. */
+  MB_MAP *map; /* Map containing the written range. */
+  uint8_t adu[260]; /* Original request. */
+  unsigned int next; /* Next word of a coil write to send. */
+  struct _mb_write *next_write;
+} MB_WRITE;
+
+typedef enum /* Modbus internal client operations. */
+  {
+    MB_OP_NONE,
+    MB_OP_SCAN, /* Reading a map into the cache. */
+    MB_OP_WRITE /* Writing part of a queued write request. */
+  } MB_OP_T;
+
+typedef struct _modbus /* Modbus TCP front end data. */
+{
+  int sock_fd; /* Socket listening for Modbus TCP connections. */
+  in_port_t port;
+  uint8_t node; /* Node address of the controller holding the data. */
+  uint8_t addr; /* Source address used on the link. */
+  CLIENT *client; /* Internal client issuing commands on the link. */
+  unsigned int scan_ticks; /* Cache refresh period. */
+  unsigned int scan_eticks; /* Ticks since the last cache refresh started. */
+  unsigned int reply_ticks; /* Ticks remaining for the reply, 0 if none. */
+  MB_OP_T op; /* Operation in progress. */
+  MB_MAP *scan; /* Map being read. */
+  uint16_t tns; /* Transaction number of the outstanding command. */
+  uint8_t wr_data[236]; /* Data being written by the outstanding command. */
+  uint16_t wr_elem; /* First element being written. */
+  uint16_t wr_count; /* Number of elements being written. */
+  uint16_t wr_mask; /* Bit mask of a masked write, 0 for a plain write. */
+  MB_MAP *maps;
+  MB_SESS *sessions;
+  MB_WRITE *writes; /* Queued write requests, oldest first. */
+  MB_WRITE *writes_end; /* Newest queued write request, NULL if none. */
+  unsigned int num_writes; /* Number of queued write requests. */
+  unsigned wrote : 1; /* Set if the last command started was a write. */
+} MODBUS;
+
+#define ACK_LAT_BUCKETS 24 /* Power of two latency histogram buckets. */
+
+typedef struct _ack_lat /* Wakeup to DLE ACK latency measurement. */
+{
+  struct timespec msg; /* Wakeup that completed the last message received. */
+  struct timespec ack; /* Wakeup that completed the message being ACKed. */
+  unsigned ack_pend : 1; /* Set while an ACK waits in the TTY buffer. */
+  unsigned int samples; /* ACKs measured. */
+  unsigned long min; /* Shortest latency, uS. */
+  unsigned long max; /* Longest latency, uS. */
+  unsigned long long sum; /* Total of all latencies, uS. */
+  unsigned int hist[ACK_LAT_BUCKETS]; /* Counts by power of two of uS. */
+} ACK_LAT;
+
 typedef struct _conn /* DF1 connection instance data. */
 {
   char name[CONN_NAME_LEN + 1];
+  char group[CONN_NAME_LEN + 1]; /* Group name, empty if not grouped. */
+  char tty_dev[PATH_MAX]; /* Serial port device. */
+  int tty_rate; /* Serial port baud rate. */
   int tty_fd; /* Serial port file descriptor. */
+  in_port_t sock_port; /* Configured client port, 0 if none. */
   int sock_fd; /* Socket listening for new client connections. */
   DUPLEX_T duplex; /* Duplex mode. */
   unsigned use_crc : 1; /* Set if using CRC checksums, BCC otherwise. */
   unsigned read_sym : 1; /* Set if the previous link layer byte was a DLE. */
   unsigned embed_rsp : 1; /* Set if embedded responses were detected. */
   long byte_usec; /* Time in uS to transmit one byte at current baud rate. */
-  BUF *tty_in; /* Raw data received from the TTY. */
-  BUF *tty_out; /* Data to be transmitted out the TTY. */
+  RBUF *tty_in; /* Raw data received from the TTY. */
+  RBUF *tty_out; /* Data to be transmitted out the TTY. */
   TX tx; /* Transmitter data. */
   RX rx; /* Receiver data. */
   CLIENT *clients; /* Linked list of clients. */
+  MODBUS *modbus; /* Modbus TCP front end, NULL if not configured. */
+  MASTER *master; /* Half-duplex master data, NULL unless a master. */
+  SLAVE slave; /* Half-duplex slave data. */
+  struct _conn *owner; /* Link holding the group listener and clients. */
+  struct _conn *link; /* Next link of the group, NULL if the last. */
+  unsigned int link_fails; /* Successive transmission failures. */
+  unsigned int down_ticks; /* Ticks until a failed link is retried. */
+  ACK_LAT lat; /* ACK latency measurement. */
+  struct timespec tx_end; /* Estimated end of the last message sent. */
+  unsigned int ack_wait[STATS_LAT_BUCKETS]; /* End of message to ACK
+					       received, counted by power of
+					       two of uS. */
+  unsigned int node_cnt[256]; /* Messages sent by destination node. */
+  unsigned int file_cnt[256]; /* Typed logical commands sent by data file,
+				 files from 255 up counted together. */
+  uint32_t cfg_sig; /* Signature of the master and modbus settings. */
+  unsigned cfg_seen : 1; /* Set once found in the configuration read. */
+  unsigned allow_link_cfg : 1; /* Set if clients may change link settings. */
   struct link_diag_cnt dcnts;
   struct _conn *next; /* Pointer to the next connection. */
 } CONN;
 
 extern int cfg_read(const char *file);
 
-extern void conn_init(const char *name, const char *tty_dev, int tty_rate,
-		      int use_crc, in_port_t sock_port,
-		      unsigned int tx_max_nak, unsigned int tx_max_enq,
-		      int rx_dup_detect, unsigned int ack_timeout);
+extern CONN *conn_init(const char *name, DUPLEX_T duplex,
+		       const char *tty_dev, int tty_rate,
+		       int use_crc, in_port_t sock_port, const char *group,
+		       unsigned int tx_max_nak, unsigned int tx_max_enq,
+		       int rx_dup_detect, int rx_early_ack,
+		       unsigned int ack_timeout);
+extern CONN *conn_first(void);
+extern CONN *conn_find(const char *name);
+extern CONN *conn_group_owner(const char *group);
+extern void conn_set_port(CONN *conn, in_port_t port);
+extern void conn_update(CONN *conn, int tty_rate, unsigned int tx_max_nak,
+			unsigned int tx_max_enq, int rx_dup_detect,
+			int rx_early_ack, unsigned int ack_timeout);
+extern void conn_reload_start(void);
+extern void conn_reload_end(void);
+extern void conn_close(CONN *conn);
 extern int conn_get_read_fds(fd_set *set);
 extern int conn_get_write_fds(fd_set *set);
 extern int conn_service_fds(const fd_set *read, const fd_set *write, int *cnt);
@@ -251,6 +512,9 @@ extern void conn_tick(void);
 extern void conn_close_all(void);
 
 extern void client_accept(CONN *conn);
+extern CLIENT *client_adopt(CONN *conn, int fd);
+extern CLIENT *client_new_virtual(CONN *conn, CLIENT *sess, uint8_t vid);
+extern int client_send(CLIENT *client, uint8_t type, const BUF *msg);
 extern int client_get_read_fds(const CONN *conn, fd_set *set);
 extern int client_get_write_fds(const CONN *conn, fd_set *set);
 extern int client_service_fds(CONN *conn, const fd_set *read,
@@ -258,24 +522,37 @@ extern int client_service_fds(CONN *conn, const fd_set *read,
 extern void client_msg_tx_ok(CONN *conn);
 extern void client_msg_tx_fail(CONN *conn);
 extern void client_msg_rx(CONN *conn);
+extern void client_tick(CONN *conn);
+extern CLIENT *client_new_internal(CONN *conn, uint8_t addr, const char *name);
+extern void client_free_internal(CONN *conn, CLIENT *client);
+extern void client_internal_tx(CONN *conn, CLIENT *client);
+extern void client_next_tx(CONN *conn);
+extern int client_poll(CONN *conn, uint8_t stn);
+extern CLIENT *client_find(const CONN *conn, uint8_t addr);
 extern void client_close_all(CONN *conn);
 
 extern int tty_open(CONN *conn, const char *dev, int rate);
 extern int tty_read(CONN *conn);
 extern int tty_write(CONN *conn);
+extern int tty_set_rate(CONN *conn, int rate);
 extern void tty_close(CONN *conn);
 
 extern int tx_init(CONN *conn, unsigned int max_nak, unsigned int max_enq,
 		   unsigned int ack_timeout);
+extern void tx_config(CONN *conn, unsigned int max_nak, unsigned int max_enq,
+		      unsigned int ack_timeout);
 extern void tx_msg(CONN *conn, CLIENT *client);
 extern void tx_data_sent(CONN *conn);
 extern void tx_tick(CONN *conn);
 extern void tx_ack(CONN *conn);
 extern void tx_nak(CONN *conn);
+extern void tx_poll(CONN *conn, uint8_t stn);
+extern void tx_eot(CONN *conn);
+extern int tx_resend(CONN *conn);
 extern int tx_busy(const TX *tx);
 extern void tx_close(CONN *conn);
 
-extern int rx_init(CONN *conn, int dup_detect);
+extern int rx_init(CONN *conn, int dup_detect, int early_ack);
 extern void rx_msg(CONN *conn);
 extern void rx_ack(CONN *conn);
 extern void rx_nak(CONN *conn);
@@ -285,10 +562,96 @@ extern void rx_set_nak(RX *rx);
 extern int rx_active(const RX *rx);
 extern void rx_close(CONN *conn);
 
+extern int slave_byte(CONN *conn, uint8_t byte);
+extern void slave_enq(CONN *conn);
+extern void slave_soh(CONN *conn);
+extern void slave_msg_start(CONN *conn);
+extern void slave_close(CONN *conn);
+
+extern MASTER *master_new(void);
+extern int master_add_slave(MASTER *m, uint8_t addr);
+extern int master_start(CONN *conn, MASTER *m);
+extern int master_tx_window(const CONN *conn);
+extern void master_tx_done(CONN *conn, int ok);
+extern void master_data_sent(CONN *conn);
+extern void master_eot(CONN *conn);
+extern void master_msg_start(CONN *conn);
+extern void master_rx_done(CONN *conn);
+extern void master_tick(CONN *conn);
+extern void master_free(CONN *conn, MASTER *m);
+
+extern void group_join(CONN *owner, CONN *conn);
+extern void group_take_over(CONN *owner, CONN *conn);
+extern CONN *group_pick(CONN *conn);
+extern void group_tx_done(CONN *conn, int ok);
+extern int group_rx_busy(const CONN *conn, const CLIENT *client);
+extern void group_tick(CONN *conn);
+extern void group_leave(CONN *conn);
+
+extern MODBUS *mb_new(void);
+extern int mb_add_map(MODBUS *mb, MB_TABLE_T table, uint16_t start,
+		      char file_type, uint16_t file, uint16_t element,
+		      uint16_t elements);
+extern int mb_start(CONN *conn, MODBUS *mb);
+extern int mb_get_read_fds(const CONN *conn, fd_set *set);
+extern int mb_get_write_fds(const CONN *conn, fd_set *set);
+extern int mb_service_fds(CONN *conn, const fd_set *read,
+			  const fd_set *write, int *cnt);
+extern MB_SESS *mb_adopt(CONN *conn, int fd);
+extern void mb_msg_rx(CONN *conn);
+extern void mb_tx_done(CONN *conn, int ok);
+extern void mb_tick(CONN *conn);
+extern void mb_free(CONN *conn, MODBUS *mb);
+
 extern void log_open(int log_to_console, int lev);
 extern void log_msg(int lev, const char *fmt, ...);
 extern void log_close(void);
 
+extern int ring_start(void);
+extern int ring_active(void);
+extern int ring_wait(int nfds, fd_set *read, fd_set *write,
+		     const sigset_t *mask, volatile int *tick);
+extern ssize_t ring_read(int fd, void *dst, size_t len);
+extern ssize_t ring_write(int fd, const void *src, size_t len);
+extern int ring_wr_pend(int fd);
+extern ssize_t ring_buf_read(int fd, RBUF *dst);
+extern ssize_t ring_buf_write(int fd, RBUF *src);
+extern void ring_forget(int fd);
+extern void ring_stop(void);
+
+extern void rt_config(int prio, const cpu_set_t *cpus);
+extern void rt_apply(void);
+extern void rt_wake(void);
+extern void rt_msg_rcvd(CONN *conn);
+extern void rt_ack_queued(CONN *conn);
+extern void rt_ack_sent(CONN *conn);
+extern void rt_close(CONN *conn);
+
+extern void prio_clear(void);
+extern int prio_add_rule(unsigned int cls, int cmd, int fnc, int dst,
+			 long file);
+extern void prio_set_aging(unsigned int ticks);
+extern unsigned int prio_class(const BUF *msg);
+extern unsigned int prio_rank(const CLIENT *client);
+extern long data_file_num(const BUF *msg);
+
+extern void stats_config(in_port_t port);
+extern void stats_start(void);
+extern void stats_stop(void);
+extern int stats_get_read_fds(fd_set *set);
+extern void stats_service_fds(const fd_set *read, int *cnt);
+extern void stats_queued(CLIENT *client);
+extern void stats_tx_start(CONN *conn, const CLIENT *client);
+extern void stats_tx_ok(CLIENT *client);
+extern void stats_msg_sent(CONN *conn);
+extern void stats_msg_acked(CONN *conn);
+
+extern int handoff_start(int argc, char *const argv[]);
+extern int handoff_recv(int sock);
+extern int handoff_tty(const char *name, const char *dev);
+extern int handoff_listen(const char *name, int modbus, in_port_t port);
+extern int handoff_resume(void);
+
 extern int timer_start(void);
 extern int timer_stop(void);
 
@@ -0,0 +1,494 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * df1dtop - live monitor of df1d links and clients.
+ *
+ * Polls the statistics port of a running df1d, see stats.c, and shows the
+ * rates between successive snapshots: link utilization, frame, ACK, NAK
+ * and ENQ rates, checksum errors and duplicates, the busiest destination
+ * nodes and data files, and every client's queue, throughput and latency
+ * percentiles. Nothing in df1d is enabled or slowed down to provide this.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define NAME_LEN 64
+#define LAT_BUCKETS 24 /* Latency buckets in a client record. */
+#define TOP_N 5 /* Destination nodes and files listed per link. */
+
+enum /* Link counters, in snapshot order. */
+  {
+    L_BYTES_IN, L_BYTES_OUT, L_MSGS_TX, L_MSGS_RX, L_ACKS_IN, L_NAKS_IN,
+    L_ENQS_OUT, L_ACKS_OUT, L_NAKS_OUT, L_ENQS_IN, L_BAD_CS, L_DUPS,
+    L_TX_FAIL, L_EXPIRED, L_COUNTERS
+  };
+
+typedef struct _link_rec /* A link record. */
+{
+  char name[NAME_LEN];
+  long byte_usec;
+  unsigned int cnt[L_COUNTERS];
+  unsigned int node[256];
+  unsigned int file[256];
+} LINK_REC;
+
+typedef struct _client_rec /* A client record. */
+{
+  char link[NAME_LEN];
+  char name[NAME_LEN];
+  unsigned int addr;
+  unsigned int queued;
+  unsigned int sending;
+  unsigned int backlog;
+  unsigned int tx;
+  unsigned int rx;
+  unsigned int fail;
+  unsigned int hist[LAT_BUCKETS];
+} CLIENT_REC;
+
+typedef struct _snap /* A statistics snapshot. */
+{
+  double time;
+  LINK_REC *links;
+  size_t num_links;
+  CLIENT_REC *clients;
+  size_t num_clients;
+} SNAP;
+
+typedef struct _rank /* Entry in a busiest nodes or files list. */
+{
+  unsigned int id;
+  unsigned int cnt;
+} RANK;
+
+static char *fetch(const char *host, const char *port);
+static int parse(char *text, SNAP *snap);
+static void show(const SNAP *prev, const SNAP *cur, const char *host,
+		 const char *port);
+static void show_top(const char *title, const unsigned int *prev,
+		     const unsigned int *cur, double dt, int file);
+static void percentiles(const unsigned int *prev, const unsigned int *cur,
+			char *dst);
+static const LINK_REC *find_link(const SNAP *snap, const char *name);
+static const CLIENT_REC *find_client(const SNAP *snap,
+				     const CLIENT_REC *client);
+static void free_snap(SNAP *snap);
+
+/*
+ * Description : Program entry point.
+ *
+ * Arguments : argc - Number of arguments.
+ *             argv - Argument vector.
+ *
+ * Return Value : Zero on a normal exit, one if df1d could not be reached.
+ */
+int main(int argc, char *argv[])
+{
+  const char usage[] = \
+    "Usage: df1dtop [options] [host]\n"
+    "   -b : Batch mode, print each refresh instead of redrawing.\n"
+    "   -d <sec> : Refresh period, default 1.\n"
+    "   -h : Print this message and exit.\n"
+    "   -n <count> : Exit after this many refreshes.\n"
+    "   -p <port> : df1d statistics port, default 10600.\n";
+  const char *host = "localhost";
+  const char *port = "10600";
+  unsigned int delay = 1;
+  long count = -1;
+  int batch = 0;
+  SNAP prev = {0};
+  SNAP cur;
+  int i;
+  while ((i = getopt(argc, argv, "bd:hn:p:")) != -1)
+    {
+      switch (i)
+	{
+	case 'b':
+	  batch = 1;
+	  break;
+	case 'd':
+	  delay = atoi(optarg);
+	  if (!delay) delay = 1;
+	  break;
+	case 'n':
+	  count = atol(optarg);
+	  break;
+	case 'p':
+	  port = optarg;
+	  break;
+	default:
+	  printf("%s", usage);
+	  return 0;
+	}
+    }
+  if (optind < argc) host = argv[optind];
+  for (;;)
+    {
+      char *text = fetch(host, port);
+      if (text == NULL) return 1;
+      memset(&cur, 0, sizeof(cur));
+      if (parse(text, &cur))
+	{
+	  free(text);
+	  free_snap(&cur);
+	  sleep(delay);
+	  continue; /* Cut short, try again. */
+	}
+      free(text);
+      if (prev.time > 0.0)
+	{
+	  if (!batch) printf("\033[H\033[2J");
+	  show(&prev, &cur, host, port);
+	  fflush(stdout);
+	  if (count > 0) count--;
+	  if (!count) break;
+	}
+      free_snap(&prev);
+      prev = cur;
+      sleep(delay);
+    }
+  free_snap(&prev);
+  free_snap(&cur);
+  return 0;
+}
+
+/*
+ * Description : Retrieves a snapshot from df1d.
+ *
+ * Arguments : host - Host running df1d.
+ *             port - Statistics port.
+ *
+ * Return Value : The snapshot text, to be freed by the caller.
+ *                NULL if df1d could not be reached.
+ */
+static char *fetch(const char *host, const char *port)
+{
+  struct addrinfo hints = {0};
+  struct addrinfo *res;
+  struct addrinfo *ai;
+  char *text = NULL;
+  size_t len = 0;
+  size_t size = 0;
+  ssize_t n;
+  int fd = -1;
+  int err;
+  hints.ai_socktype = SOCK_STREAM;
+  err = getaddrinfo(host, port, &hints, &res);
+  if (err)
+    {
+      fprintf(stderr, "df1dtop: %s : %s\n", host, gai_strerror(err));
+      return NULL;
+    }
+  for (ai = res; ai != NULL; ai = ai->ai_next)
+    {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      if (!connect(fd, ai->ai_addr, ai->ai_addrlen)) break;
+      close(fd);
+      fd = -1;
+    }
+  freeaddrinfo(res);
+  if (fd < 0)
+    {
+      fprintf(stderr, "df1dtop: Cannot connect to %s port %s : %s\n", host,
+	      port, strerror(errno));
+      return NULL;
+    }
+  do
+    {
+      if (size - len < 4096)
+	{
+	  char *p = realloc(text, size + 16384);
+	  if (p == NULL) break;
+	  text = p;
+	  size += 16384;
+	}
+      n = read(fd, text + len, size - len - 1);
+      if (n > 0) len += n;
+    } while (n > 0);
+  close(fd);
+  if (text != NULL) text[len] = 0;
+  return text;
+}
+
+/*
+ * Description : Parses snapshot text.
+ *
+ * Arguments : text - Snapshot text, modified while parsing.
+ *             snap - Snapshot to fill in.
+ *
+ * Return Value : Zero if a complete snapshot was parsed.
+ *                Non-zero if it was cut short or could not be read.
+ */
+static int parse(char *text, SNAP *snap)
+{
+  char *line;
+  char *save;
+  int done = 0;
+  for (line = strtok_r(text, "\n", &save); line != NULL;
+       line = strtok_r(NULL, "\n", &save))
+    {
+      char link[NAME_LEN];
+      unsigned int id, cnt;
+      if (!strncmp(line, "time ", 5)) snap->time = atof(line + 5);
+      else if (!strncmp(line, "link ", 5))
+	{
+	  LINK_REC *l = realloc(snap->links,
+				(snap->num_links + 1) * sizeof(LINK_REC));
+	  unsigned int *c;
+	  if (l == NULL) return -1;
+	  snap->links = l;
+	  l += snap->num_links++;
+	  memset(l, 0, sizeof(*l));
+	  c = l->cnt;
+	  if (sscanf(line, "link %63s %ld %u %u %u %u %u %u %u %u %u %u %u %u"
+		     " %u %u", l->name, &l->byte_usec, &c[0], &c[1], &c[2],
+		     &c[3], &c[4], &c[5], &c[6], &c[7], &c[8], &c[9], &c[10],
+		     &c[11], &c[12], &c[13]) != 2 + L_COUNTERS)
+	    return -1;
+	}
+      else if ((sscanf(line, "node %63s %u %u", link, &id, &cnt) == 3)
+	       && snap->num_links && (id < 256))
+	snap->links[snap->num_links - 1].node[id] = cnt;
+      else if ((sscanf(line, "file %63s %u %u", link, &id, &cnt) == 3)
+	       && snap->num_links && (id < 256))
+	snap->links[snap->num_links - 1].file[id] = cnt;
+      else if (!strncmp(line, "client ", 7))
+	{
+	  CLIENT_REC *c = realloc(snap->clients, (snap->num_clients + 1)
+				  * sizeof(CLIENT_REC));
+	  char *p;
+	  int used;
+	  unsigned int i;
+	  if (c == NULL) return -1;
+	  snap->clients = c;
+	  c += snap->num_clients++;
+	  memset(c, 0, sizeof(*c));
+	  if (sscanf(line, "client %63s %63s %u %u %u %u %u %u %u%n", c->link,
+		     c->name, &c->addr, &c->queued, &c->sending, &c->backlog,
+		     &c->tx, &c->rx, &c->fail, &used) != 9)
+	    return -1;
+	  for (p = line + used, i = 0; i < LAT_BUCKETS; i++)
+	    c->hist[i] = strtoul(p, &p, 10);
+	}
+      else if (!strcmp(line, "end")) done = 1;
+    }
+  return !done;
+}
+
+/*
+ * Description : Prints the rates between two snapshots.
+ *
+ * Arguments : prev - Earlier snapshot.
+ *             cur - Latest snapshot.
+ *             host - Host running df1d.
+ *             port - Statistics port.
+ *
+ * Return Value : None.
+ */
+static void show(const SNAP *prev, const SNAP *cur, const char *host,
+		 const char *port)
+{
+  double dt = cur->time - prev->time;
+  size_t i;
+  if (dt <= 0.0) dt = 1.0;
+  printf("df1dtop - %s:%s - %zu link(s), %zu client(s), %.1f s interval\n\n",
+	 host, port, cur->num_links, cur->num_clients, dt);
+  printf("%-16s %5s %5s %7s %7s %7s %6s %6s %6s %6s %5s\n", "LINK", "TX%",
+	 "RX%", "FRM/s", "ACK/s", "NAK/s", "ENQ/s", "BADCS", "DUPS", "FAIL",
+	 "EXP");
+  for (i = 0; i < cur->num_links; i++)
+    {
+      const LINK_REC *l = &cur->links[i];
+      const LINK_REC *p = find_link(prev, l->name);
+      unsigned int d[L_COUNTERS];
+      unsigned int j;
+      if (p == NULL) continue; /* New since the last refresh. */
+      for (j = 0; j < L_COUNTERS; j++) d[j] = l->cnt[j] - p->cnt[j];
+      printf("%-16s %5.1f %5.1f %7.1f %7.1f %7.1f %6.1f %6u %6u %6u %5u\n",
+	     l->name, d[L_BYTES_OUT] * (double)l->byte_usec / (dt * 1e4),
+	     d[L_BYTES_IN] * (double)l->byte_usec / (dt * 1e4),
+	     (d[L_MSGS_TX] + d[L_MSGS_RX]) / dt,
+	     (d[L_ACKS_IN] + d[L_ACKS_OUT]) / dt,
+	     (d[L_NAKS_IN] + d[L_NAKS_OUT]) / dt,
+	     (d[L_ENQS_IN] + d[L_ENQS_OUT]) / dt, d[L_BAD_CS], d[L_DUPS],
+	     d[L_TX_FAIL], d[L_EXPIRED]);
+      show_top("nodes", p->node, l->node, dt, 0);
+      show_top("files", p->file, l->file, dt, 1);
+    }
+  printf("\n%-16s %-16s %4s %2s %6s %7s %7s %5s %9s %9s %9s\n", "CLIENT",
+	 "LINK", "ADDR", "Q", "BACKLG", "TX/s", "RX/s", "FAIL", "P50 mS",
+	 "P90 mS", "P99 mS");
+  for (i = 0; i < cur->num_clients; i++)
+    {
+      const CLIENT_REC *c = &cur->clients[i];
+      const CLIENT_REC *p = find_client(prev, c);
+      char pct[32];
+      if (p == NULL) continue;
+      percentiles(p->hist, c->hist, pct);
+      printf("%-16s %-16s %4u %c%c %6u %7.1f %7.1f %5u %s\n", c->name,
+	     c->link, c->addr, c->queued ? 'Q' : '-', c->sending ? 'S' : '-',
+	     c->backlog, (c->tx - p->tx) / dt, (c->rx - p->rx) / dt,
+	     c->fail - p->fail, pct);
+    }
+  return;
+}
+
+/*
+ * Description : Prints a link's busiest destination nodes or data files
+ *               over the interval.
+ *
+ * Arguments : title - List name.
+ *             prev - Earlier counts, indexed by node or file.
+ *             cur - Latest counts.
+ *             dt - Interval in seconds.
+ *             file - Set if listing files, the last counts files 255 up.
+ *
+ * Return Value : None.
+ */
+static void show_top(const char *title, const unsigned int *prev,
+		     const unsigned int *cur, double dt, int file)
+{
+  RANK top[TOP_N] = {{0}};
+  unsigned int i, j;
+  for (i = 0; i < 256; i++)
+    {
+      unsigned int d = cur[i] - prev[i];
+      if (!d || (d <= top[TOP_N - 1].cnt)) continue;
+      for (j = TOP_N - 1; j && (d > top[j - 1].cnt); j--) top[j] = top[j - 1];
+      top[j].id = i;
+      top[j].cnt = d;
+    }
+  if (!top[0].cnt) return;
+  printf("  %s:", title);
+  for (j = 0; (j < TOP_N) && top[j].cnt; j++)
+    printf("  %u%s %.1f/s", top[j].id, (file && (top[j].id == 255)) ? "+" : "",
+	   top[j].cnt / dt);
+  putchar('\n');
+  return;
+}
+
+/*
+ * Description : Formats the median, 90th and 99th percentile latency over
+ *               the interval. Each is the upper bound of the power of two
+ *               bucket it falls in.
+ *
+ * Arguments : prev - Earlier latency buckets.
+ *             cur - Latest latency buckets.
+ *             dst - Location for the formatted percentiles.
+ *
+ * Return Value : None.
+ */
+static void percentiles(const unsigned int *prev, const unsigned int *cur,
+			char *dst)
+{
+  static const unsigned int pct[] = {50, 90, 99};
+  unsigned int d[LAT_BUCKETS];
+  char num[16];
+  unsigned long total = 0;
+  unsigned int i, k;
+  for (i = 0; i < LAT_BUCKETS; i++) total += d[i] = cur[i] - prev[i];
+  *dst = 0;
+  for (k = 0; k < 3; k++)
+    {
+      unsigned long n = 0;
+      if (!total)
+	{
+	  strcat(dst, "        -");
+	  if (k < 2) strcat(dst, " ");
+	  continue;
+	}
+      for (i = 0; i < LAT_BUCKETS - 1; i++)
+	{
+	  n += d[i];
+	  if (n * 100 >= total * pct[k]) break;
+	}
+      sprintf(num, "%c%.1f", (i == LAT_BUCKETS - 1) ? '>' : '<',
+	      (2UL << i) / 1000.0);
+      sprintf(dst + strlen(dst), "%9s", num);
+      if (k < 2) strcat(dst, " ");
+    }
+  return;
+}
+
+/*
+ * Description : Finds a link in a snapshot.
+ *
+ * Arguments : snap - Snapshot to search.
+ *             name - Link name.
+ *
+ * Return Value : The link record, NULL if not found.
+ */
+static const LINK_REC *find_link(const SNAP *snap, const char *name)
+{
+  size_t i;
+  for (i = 0; i < snap->num_links; i++)
+    if (!strcmp(snap->links[i].name, name)) return &snap->links[i];
+  return NULL;
+}
+
+/*
+ * Description : Finds the record of the same client in another snapshot.
+ *
+ * Arguments : snap - Snapshot to search.
+ *             client - Client record to match by link, name and address.
+ *
+ * Return Value : The client record, NULL if not found.
+ */
+static const CLIENT_REC *find_client(const SNAP *snap,
+				     const CLIENT_REC *client)
+{
+  size_t i;
+  for (i = 0; i < snap->num_clients; i++)
+    {
+      const CLIENT_REC *c = &snap->clients[i];
+      if ((c->addr == client->addr) && !strcmp(c->link, client->link)
+	  && !strcmp(c->name, client->name))
+	return c;
+    }
+  return NULL;
+}
+
+/*
+ * Description : Frees the records of a snapshot.
+ *
+ * Arguments : snap - Snapshot.
+ *
+ * Return Value : None.
+ */
+static void free_snap(SNAP *snap)
+{
+  free(snap->links);
+  free(snap->clients);
+  memset(snap, 0, sizeof(*snap));
+  return;
+}
@@ -0,0 +1,272 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Connection groups. Several full-duplex links to the same network share
+ * one listening socket and one set of clients, held by the first link of
+ * the group, the owner. Each client message goes out the idle link with
+ * the fewest bytes waiting in its TTY output buffer; received messages are
+ * routed to clients by destination address whichever link they arrive on.
+ * A link that fails GROUP_MAX_FAILS transmissions in a row is taken out of
+ * service for GROUP_RETRY_MS, provided another link is still in service.
+ */
+
+#include "df1.h"
+
+#define GROUP_MAX_FAILS 2 /* Consecutive failures taking a link out. */
+#define GROUP_RETRY_MS 30000 /* Time a failed link is out of service. */
+
+static int grouped(const CONN *conn);
+static int in_service(const CONN *conn);
+
+/*
+ * Description : Adds a link to a group.
+ *
+ * Arguments : owner - First link of the group.
+ *             conn - Link joining the group.
+ *
+ * Return Value : None.
+ */
+extern void group_join(CONN *owner, CONN *conn)
+{
+  CONN *end;
+  for (end = owner; end->link != NULL; end = end->link);
+  end->link = conn;
+  conn->owner = owner;
+  log_msg(LOG_INFO, "%s:%d [%s] Joined group %s.\n", __FILE__, __LINE__,
+	  conn->name, owner->group);
+  return;
+}
+
+/*
+ * Description : Makes a link the owner of a group in place of a link that
+ *               took over when the previous owner closed. The new owner
+ *               takes the listening socket, unless it opened its own on a
+ *               new port, and the clients. The Modbus front end is closed,
+ *               the new owner's configuration starts its own.
+ *
+ * Arguments : owner - Current owner of the group.
+ *             conn - Link taking the group over.
+ *
+ * Return Value : None.
+ */
+extern void group_take_over(CONN *owner, CONN *conn)
+{
+  CONN *link;
+  mb_free(owner, owner->modbus);
+  if (conn->sock_fd < 0) conn->sock_fd = owner->sock_fd;
+  else
+    {
+      ring_forget(owner->sock_fd);
+      if ((owner->sock_fd >= 0) && close(owner->sock_fd))
+	log_msg(LOG_ERR, "%s:%d [%s] Error closing listening socket : %s\n",
+		__FILE__, __LINE__, owner->name, strerror(errno));
+    }
+  owner->sock_fd = -1;
+  conn->clients = owner->clients;
+  owner->clients = NULL;
+  conn->link = owner;
+  for (link = conn; link != NULL; link = link->link)
+    link->owner = conn;
+  log_msg(LOG_INFO, "%s:%d [%s] Link now owns group %s.\n", __FILE__,
+	  __LINE__, conn->name, conn->group);
+  return;
+}
+
+/*
+ * Description : Selects the link to carry the next client message: the
+ *               in-service link with an idle transmitter and the fewest
+ *               bytes waiting to be written to its TTY.
+ *
+ * Arguments : conn - Any link of the group, or an ungrouped connection.
+ *
+ * Return Value : The selected link, the connection itself if ungrouped.
+ *                NULL if every link of the group is busy.
+ */
+extern CONN *group_pick(CONN *conn)
+{
+  CONN *link;
+  CONN *best = NULL;
+  size_t best_out = 0;
+  if (!grouped(conn)) return conn;
+  for (link = conn->owner; link != NULL; link = link->link)
+    {
+      size_t out;
+      if (!in_service(link) || tx_busy(&link->tx)) continue;
+      out = rbuf_len(link->tty_out);
+      if ((best == NULL) || (out < best_out))
+	{
+	  best = link;
+	  best_out = out;
+	}
+    }
+  return best;
+}
+
+/*
+ * Description : Tracks transmission results and takes a link that keeps
+ *               failing out of service, unless it is the last link in
+ *               service.
+ *
+ * Arguments : conn - Link that transmitted the message.
+ *             ok - Non-zero if the message was acknowledged.
+ *
+ * Return Value : None.
+ */
+extern void group_tx_done(CONN *conn, int ok)
+{
+  CONN *link;
+  if (!grouped(conn)) return;
+  if (ok)
+    {
+      conn->link_fails = 0;
+      return;
+    }
+  for (link = conn->owner; (link != NULL) && (link != conn);
+       link = link->link);
+  if (link == NULL) return; /* Leaving the group. */
+  if (!in_service(conn) || (++conn->link_fails < GROUP_MAX_FAILS)) return;
+  for (link = conn->owner; link != NULL; link = link->link)
+    if ((link != conn) && in_service(link)) break;
+  if (link == NULL) return; /* Keep trying the only usable link. */
+  log_msg(LOG_ERR, "%s:%d [%s] Link taken out of group %s after %u failed"
+	  " transmissions.\n", __FILE__, __LINE__, conn->name,
+	  conn->owner->group, conn->link_fails);
+  conn->down_ticks = GROUP_RETRY_MS / (TICK_USEC / 1000);
+  conn->dcnts.link_downs++;
+  return;
+}
+
+/*
+ * Description : Checks if a client still holds an unacknowledged message
+ *               received on another link of the group. A client accepts
+ *               one received message at a time.
+ *
+ * Arguments : conn - Link that received a new message.
+ *             client - Destination client.
+ *
+ * Return Value : Non-zero if another link is waiting on the client.
+ */
+extern int group_rx_busy(const CONN *conn, const CLIENT *client)
+{
+  const CONN *link;
+  if (!grouped(conn)) return 0;
+  for (link = conn->owner; link != NULL; link = link->link)
+    if ((link != conn) && (link->rx.client == client)) return 1;
+  return 0;
+}
+
+/*
+ * Description : Group timer handler. Returns a failed link to service once
+ *               its retry time passes. One more failure takes it out again.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void group_tick(CONN *conn)
+{
+  if (!conn->down_ticks || --conn->down_ticks) return;
+  log_msg(LOG_INFO, "%s:%d [%s] Link returned to group %s.\n", __FILE__,
+	  __LINE__, conn->name, conn->owner->group);
+  conn->link_fails = GROUP_MAX_FAILS - 1;
+  client_next_tx(conn);
+  return;
+}
+
+/*
+ * Description : Removes a closing link from its group. If the owner is
+ *               closing, the next link takes over the listening socket,
+ *               the clients and the Modbus front end. A message the link
+ *               was transmitting is failed back to its client.
+ *
+ * Arguments : conn - Closing link.
+ *
+ * Return Value : None.
+ */
+extern void group_leave(CONN *conn)
+{
+  CONN *link;
+  if (!grouped(conn)) return;
+  if (conn->owner == conn)
+    {
+      CONN *owner = conn->link;
+      owner->sock_fd = conn->sock_fd;
+      owner->clients = conn->clients;
+      owner->modbus = conn->modbus;
+      conn->sock_fd = -1;
+      conn->clients = NULL;
+      conn->modbus = NULL;
+      for (link = owner; link != NULL; link = link->link)
+	link->owner = owner;
+      conn->owner = owner;
+      log_msg(LOG_INFO, "%s:%d [%s] Link now owns group %s.\n", __FILE__,
+	      __LINE__, owner->name, owner->group);
+    }
+  else
+    {
+      for (link = conn->owner; link->link != conn; link = link->link);
+      link->link = conn->link;
+    }
+  log_msg(LOG_INFO, "%s:%d [%s] Left group %s.\n", __FILE__, __LINE__,
+	  conn->name, conn->group);
+  /*
+   * Hand the message back while the link still refers to the group's
+   * clients, but can no longer be selected for the next message.
+   */
+  conn->link = NULL;
+  conn->down_ticks = 0;
+  if (tx_busy(&conn->tx))
+    {
+      conn->tx.state = TX_IDLE;
+      client_msg_tx_fail(conn);
+    }
+  conn->owner = conn;
+  return;
+}
+
+/*
+ * Description : Checks if a connection is a link of a group.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : Non-zero if the connection belongs to a group.
+ */
+static int grouped(const CONN *conn)
+{
+  return (conn->owner != conn) || (conn->link != NULL);
+}
+
+/*
+ * Description : Checks if a link may be given messages.
+ *
+ * Arguments : conn - Link pointer.
+ *
+ * Return Value : Non-zero if the link is in service.
+ */
+static int in_service(const CONN *conn)
+{
+  return !conn->down_ticks;
+}
@@ -0,0 +1,1068 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Handoff restart. On SIGUSR2 the running service execs a new df1d with
+ * -H and one end of a Unix socket pair, then sends it a record per
+ * connection, client and Modbus session along with their descriptors
+ * (SCM_RIGHTS). The new process reads the configuration as usual, except
+ * that connections whose name, device and ports are unchanged take over the
+ * descriptors instead of opening new ones, then resumes the transmitter and
+ * receiver state and the clients. Once it confirms, the old process exits
+ * without closing anything; if it does not, the old process carries on.
+ *
+ * Not carried over: the internal Modbus client and its queued writes, a
+ * half-duplex master's poll state, whose client message is failed back to
+ * the client instead, and a message partially received from the TTY, which
+ * is NAKed when the sender ENQs. With -u, data still held in io_uring
+ * buffers is lost and recovered the same way.
+ */
+
+#include "df1.h"
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define HO_VERSION 4 /* Change whenever HO_REC changes. */
+#define HO_BUFS 3 /* Buffers that may follow a record. */
+#define HO_DATA_MAX 8192 /* Total size of the buffers following a record. */
+#define HO_MAX_FDS 3 /* Descriptors sent with a record. */
+#define HO_WAIT_MS 10000 /* Time allowed for the new process to resume. */
+
+typedef enum /* Record types. */
+  {
+    HO_CONN, /* Connection: TTY, client and Modbus listeners, link state. */
+    HO_CLIENT, /* Client socket and state. */
+    HO_MB_SESS, /* Modbus TCP session socket. */
+    HO_END
+  } HO_TYPE_T;
+
+typedef enum /* Descriptors of a connection record, in the order sent. */
+  {
+    HO_FD_TTY,
+    HO_FD_LISTEN, /* Sent if port is non-zero. */
+    HO_FD_MODBUS /* Sent if mb_port is non-zero. */
+  } HO_FD_T;
+
+typedef struct _ho_rec /* Record, its buffers follow in the same packet. */
+{
+  unsigned int version;
+  HO_TYPE_T type;
+  char conn[CONN_NAME_LEN + 1]; /* Connection; for a client, its owner. */
+  size_t len[HO_BUFS]; /* Lengths of the buffers following the record. */
+  size_t index; /* Read position within the first buffer. */
+  /*
+   * Connection records. Buffers are the transmitter's message and the
+   * unwritten TTY output.
+   */
+  in_port_t port; /* Client listener port, 0 if the link has none. */
+  in_port_t mb_port; /* Modbus listener port, 0 if none. */
+  char owner[CONN_NAME_LEN + 1]; /* Group owner holding the clients. */
+  TX_STATE_T tx_state;
+  unsigned int nak_cnt;
+  unsigned int enq_cnt;
+  unsigned int tx_eticks;
+  uint8_t tx_stn;
+  int tx_client; /* Index of the transmitting client, -1 if none. */
+  RX_STATE_T rx_state;
+  int rx_client; /* Index of the client holding the message, -1 if none. */
+  int last_was_ack;
+  uint8_t dup[4];
+  uint8_t slave_tx_stn;
+  /*
+   * Client records. Buffers are the message for the link, unsent socket
+   * output and unparsed socket input; virtual clients only have the
+   * first. Modbus session records carry the session's input and unsent
+   * output.
+   */
+  int client; /* Position in the owner's list of clients. */
+  char name[PCCC_NAME_LEN + 1];
+  CLIENT_STATE_T state;
+  uint8_t addr;
+  uint8_t name_len;
+  uint8_t name_len_rcvd;
+  uint8_t new_msg_len;
+  uint16_t deadline;
+  unsigned int dl_ticks;
+  unsigned int acks_owed;
+  int local_pend; /* Set if a locally routed message is unanswered. */
+  int local_src; /* Index of its sender, -1 if none. */
+  int mux_sess; /* Set for a multiplexed session. */
+  MUX_STATE_T mux_state;
+  uint8_t mux_id;
+  int mux; /* Index of a virtual client's session, -1 if none. */
+  uint8_t vid;
+} HO_REC;
+
+typedef struct _ho_item /* Record received by the new process. */
+{
+  HO_REC rec;
+  uint8_t *data[HO_BUFS];
+  int fds[HO_MAX_FDS]; /* Descriptors not yet taken over, -1 if none. */
+  unsigned tty_taken : 1; /* Set once the connection took over its TTY. */
+  unsigned tx_taken : 1; /* Set if a transmitter resumed with the client. */
+  CLIENT *client; /* Client resumed from the record. */
+  struct _ho_item *next;
+} HO_ITEM;
+
+static void exec_new(int argc, char *const argv[], int sock);
+static void close_fds(int keep);
+static int send_all(int sock);
+static int send_conn(int sock, const CONN *conn);
+static int send_client(int sock, const CONN *owner, const CLIENT *client,
+		       int index);
+static int send_sess(int sock, const CONN *conn, const MB_SESS *sess);
+static int send_rec(int sock, HO_REC *rec, const uint8_t *data[],
+		    const int fds[], int num_fds);
+static void add_buf(HO_REC *rec, const uint8_t *data[], int i,
+		    const BUF *buf);
+static void add_rbuf(HO_REC *rec, const uint8_t *data[], int i, RBUF *rb);
+static int client_index(const CONN *owner, const CLIENT *client);
+static int recv_rec(int sock);
+static void resume_conn(HO_ITEM *item);
+static void resume_client(HO_ITEM *item);
+static void resume_local(HO_ITEM *item);
+static void resume_sess(HO_ITEM *item);
+static HO_ITEM *find_client(const char *owner, int index);
+static void restore_buf(BUF *dst, const uint8_t *src, size_t len,
+			size_t index);
+static void restore_rbuf(RBUF *dst, const uint8_t *src, size_t len);
+static void free_items(void);
+
+static HO_ITEM *items; /* Records received, in the order sent. */
+static int ho_sock = -1; /* Socket to the old process. */
+
+/*
+ * Description : Hands the service over to a newly executed df1d. The new
+ *               process is started with the same arguments plus -H.
+ *
+ * Arguments : argc - Argument count from main().
+ *             argv - Argument vector from main(). argv[0] is looked up in
+ *                    the PATH, so start df1d with an absolute path or from
+ *                    the PATH to be able to hand over when running as a
+ *                    daemon.
+ *
+ * Return Value : Zero if the new process took over, this one should exit
+ *                without closing any connection.
+ *                Non-zero if the handoff failed and this process continues.
+ */
+extern int handoff_start(int argc, char *const argv[])
+{
+  int sv[2];
+  int ring = ring_active();
+  pid_t pid;
+  struct pollfd pfd;
+  struct timeval tv;
+  char ok = 0;
+  log_msg(LOG_INFO, "%s:%d Handing over to a new process.\n", __FILE__,
+	  __LINE__);
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv))
+    {
+      log_msg(LOG_ERR, "%s:%d Error creating handoff socket : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      return -1;
+    }
+  /*
+   * No more reads may be outstanding on the TTYs, whatever they got would
+   * not reach the new process.
+   */
+  ring_stop();
+  pid = fork();
+  if (pid < 0)
+    {
+      log_msg(LOG_ERR, "%s:%d Failed to fork new process : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      close(sv[0]);
+      close(sv[1]);
+      if (ring) ring_start();
+      return -1;
+    }
+  if (pid == 0)
+    {
+      close(sv[0]);
+      exec_new(argc, argv, sv[1]);
+      _exit(1);
+    }
+  close(sv[1]);
+  /*
+   * A new process that stops reading must not hold this one up for good;
+   * if a record can't be sent in time the handoff is abandoned.
+   */
+  tv.tv_sec = HO_WAIT_MS / 1000;
+  tv.tv_usec = (HO_WAIT_MS % 1000) * 1000;
+  if (setsockopt(sv[0], SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)))
+    log_msg(LOG_ERR, "%s:%d Error setting handoff send timeout : %s\n",
+	    __FILE__, __LINE__, strerror(errno));
+  else if (!send_all(sv[0]))
+    {
+      pfd.fd = sv[0];
+      pfd.events = POLLIN;
+      if ((poll(&pfd, 1, HO_WAIT_MS) == 1) && (read(sv[0], &ok, 1) != 1))
+	ok = 0;
+    }
+  close(sv[0]);
+  if (ok)
+    {
+      log_msg(LOG_INFO, "%s:%d Process %d took over, exiting.\n", __FILE__,
+	      __LINE__, (int)pid);
+      return 0;
+    }
+  log_msg(LOG_ERR, "%s:%d New process did not take over, continuing.\n",
+	  __FILE__, __LINE__);
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+  if (ring) ring_start();
+  return -1;
+}
+
+/*
+ * Description : Receives the records of the process handing over, before
+ *               the configuration is read.
+ *
+ * Arguments : sock - Handoff socket given with -H.
+ *
+ * Return Value : Zero if all records were received.
+ *                Non-zero if the handoff failed, the process should exit.
+ */
+extern int handoff_recv(int sock)
+{
+  int ret;
+  ho_sock = sock;
+  fcntl(sock, F_SETFD, FD_CLOEXEC);
+  log_msg(LOG_INFO, "%s:%d Taking over from the previous process.\n",
+	  __FILE__, __LINE__);
+  while ((ret = recv_rec(sock)) > 0);
+  if (ret < 0)
+    {
+      free_items();
+      close(sock);
+      ho_sock = -1;
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Takes over a connection's TTY if it was handed over and is
+ *               still the configured device.
+ *
+ * Arguments : name - Connection name.
+ *             dev - Configured TTY device.
+ *
+ * Return Value : The TTY descriptor.
+ *                -1 if the TTY has to be opened.
+ */
+extern int handoff_tty(const char *name, const char *dev)
+{
+  HO_ITEM *item;
+  struct stat cur;
+  struct stat cfg;
+  int fd;
+  for (item = items; item != NULL; item = item->next)
+    if ((item->rec.type == HO_CONN) && !strcmp(item->rec.conn, name)) break;
+  if ((item == NULL) || (item->fds[HO_FD_TTY] < 0)) return -1;
+  if (stat(dev, &cfg) || fstat(item->fds[HO_FD_TTY], &cur)
+      || (cur.st_rdev != cfg.st_rdev))
+    {
+      log_msg(LOG_INFO, "%s:%d [%s] Device changed, reopening TTY.\n",
+	      __FILE__, __LINE__, name);
+      return -1;
+    }
+  fd = item->fds[HO_FD_TTY];
+  item->fds[HO_FD_TTY] = -1;
+  item->tty_taken = 1;
+  return fd;
+}
+
+/*
+ * Description : Takes over a connection's client or Modbus listening socket
+ *               if it was handed over and the port is unchanged.
+ *
+ * Arguments : name - Connection name.
+ *             modbus - Non-zero for the Modbus listener.
+ *             port - Configured port.
+ *
+ * Return Value : The listening socket.
+ *                -1 if a new socket has to be created.
+ */
+extern int handoff_listen(const char *name, int modbus, in_port_t port)
+{
+  HO_ITEM *item;
+  int i = modbus ? HO_FD_MODBUS : HO_FD_LISTEN;
+  int fd;
+  for (item = items; item != NULL; item = item->next)
+    if ((item->rec.type == HO_CONN) && !strcmp(item->rec.conn, name)) break;
+  if ((item == NULL) || (item->fds[i] < 0)
+      || ((modbus ? item->rec.mb_port : item->rec.port) != port))
+    return -1;
+  fd = item->fds[i];
+  item->fds[i] = -1;
+  return fd;
+}
+
+/*
+ * Description : Resumes the clients, sessions and link state handed over,
+ *               once the configuration has been read, and tells the old
+ *               process to exit. Descriptors no connection took over are
+ *               closed.
+ *
+ * Arguments : None.
+ *
+ * Return Value : Zero if the old process was told to exit.
+ *                Non-zero if no connection could be started, the old
+ *                process carries on.
+ */
+extern int handoff_resume(void)
+{
+  HO_ITEM *item;
+  CONN *conn;
+  char ok = 1;
+  int ret = 0;
+  if (ho_sock < 0) return 0;
+  if (conn_first() == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d No connections initialized, handoff"
+	      " abandoned.\n", __FILE__, __LINE__);
+      ret = -1;
+    }
+  else
+    {
+      for (item = items; item != NULL; item = item->next)
+	if (item->rec.type == HO_CLIENT) resume_client(item);
+      for (item = items; item != NULL; item = item->next)
+	if ((item->client != NULL) && item->rec.local_pend)
+	  resume_local(item);
+      for (item = items; item != NULL; item = item->next)
+	if (item->rec.type == HO_CONN) resume_conn(item);
+	else if (item->rec.type == HO_MB_SESS) resume_sess(item);
+      /*
+       * A message whose transmission could not be resumed is failed back
+       * to its client.
+       */
+      for (item = items; item != NULL; item = item->next)
+	if ((item->client != NULL) && !item->tx_taken
+	    && (item->client->state == CLIENT_MSG_PEND))
+	  {
+	    client_send(item->client, MSG_NAK, NULL);
+	    item->client->state = CLIENT_IDLE;
+	  }
+      for (conn = conn_first(); conn != NULL; conn = conn->next)
+	client_next_tx(conn);
+      if (write(ho_sock, &ok, 1) != 1) ret = -1;
+    }
+  if (!ret)
+    log_msg(LOG_INFO, "%s:%d Took over from the previous process.\n",
+	    __FILE__, __LINE__);
+  free_items();
+  close(ho_sock);
+  ho_sock = -1;
+  return ret;
+}
+
+/*
+ * Description : Executes the new process, in the child.
+ *
+ * Arguments : argc - Argument count.
+ *             argv - Argument vector.
+ *             sock - Handoff socket passed to the new process.
+ *
+ * Return Value : Only returns if exec failed.
+ */
+static void exec_new(int argc, char *const argv[], int sock)
+{
+  char **args;
+  char sock_s[16];
+  sigset_t set;
+  int i;
+  int n = 0;
+  /*
+   * Only the handoff socket is inherited; every other descriptor is sent,
+   * a stray copy would keep a closed client's socket open.
+   */
+  close_fds(sock);
+  sigemptyset(&set);
+  sigprocmask(SIG_SETMASK, &set, NULL);
+  args = (char **)calloc(argc + 3, sizeof(char *));
+  if (args == NULL) return;
+  snprintf(sock_s, sizeof(sock_s), "%d", sock);
+  args[n++] = argv[0];
+  args[n++] = "-H";
+  args[n++] = sock_s;
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp(argv[i], "-H")) i++; /* From an earlier handoff. */
+      else if (strncmp(argv[i], "-H", 2)) args[n++] = argv[i];
+    }
+  execvp(argv[0], args);
+  log_msg(LOG_ERR, "%s:%d Failed to execute %s : %s\n", __FILE__, __LINE__,
+	  argv[0], strerror(errno));
+  return;
+}
+
+/*
+ * Description : Closes every descriptor above standard error except one,
+ *               in the child. close_range() does it in one call; without
+ *               it only the descriptors listed in /proc/self/fd are closed,
+ *               rather than trying every possible one up to the limit.
+ *
+ * Arguments : keep - Descriptor left open.
+ *
+ * Return Value : None.
+ */
+static void close_fds(int keep)
+{
+  DIR *dir;
+  struct dirent *ent;
+  int fd;
+#ifdef SYS_close_range
+  if (((keep <= 3) || !syscall(SYS_close_range, 3, keep - 1, 0))
+      && !syscall(SYS_close_range, (keep < 3) ? 3 : keep + 1, ~0U, 0))
+    return;
+#endif
+  dir = opendir("/proc/self/fd");
+  if (dir == NULL)
+    {
+      for (fd = sysconf(_SC_OPEN_MAX) - 1; fd > 2; fd--)
+	if (fd != keep) close(fd);
+      return;
+    }
+  /*
+   * Entries are listed by descriptor number, so closing the ones already
+   * read doesn't disturb the listing.
+   */
+  while ((ent = readdir(dir)) != NULL)
+    {
+      fd = atoi(ent->d_name);
+      if ((fd > 2) && (fd != keep) && (fd != dirfd(dir))) close(fd);
+    }
+  closedir(dir);
+  return;
+}
+
+/*
+ * Description : Sends every connection, client and Modbus session.
+ *
+ * Arguments : sock - Handoff socket.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if sending failed.
+ */
+static int send_all(int sock)
+{
+  const CONN *conn;
+  HO_REC rec;
+  for (conn = conn_first(); conn != NULL; conn = conn->next)
+    if (send_conn(sock, conn)) return -1;
+  for (conn = conn_first(); conn != NULL; conn = conn->next)
+    {
+      const CLIENT *client;
+      int i = 0;
+      for (client = conn->clients; client != NULL; client = client->next)
+	if (((client->fd >= 0) || (client->mux != NULL))
+	    && send_client(sock, conn, client, i++))
+	  return -1;
+      if (conn->modbus != NULL)
+	{
+	  const MB_SESS *sess;
+	  for (sess = conn->modbus->sessions; sess != NULL; sess = sess->next)
+	    if (send_sess(sock, conn, sess)) return -1;
+	}
+    }
+  memset(&rec, 0, sizeof(rec));
+  rec.type = HO_END;
+  return send_rec(sock, &rec, NULL, NULL, 0);
+}
+
+/*
+ * Description : Sends a connection record.
+ *
+ * Arguments : sock - Handoff socket.
+ *             conn - Connection pointer.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if sending failed.
+ */
+static int send_conn(int sock, const CONN *conn)
+{
+  HO_REC rec;
+  const uint8_t *data[HO_BUFS] = {NULL, NULL, NULL};
+  int fds[HO_MAX_FDS];
+  int num_fds = 0;
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  memset(&rec, 0, sizeof(rec));
+  rec.type = HO_CONN;
+  strcpy(rec.conn, conn->name);
+  strcpy(rec.owner, conn->owner->name);
+  fds[num_fds++] = conn->tty_fd;
+  if ((conn->sock_fd >= 0)
+      && !getsockname(conn->sock_fd, (struct sockaddr *)&addr, &addr_len))
+    {
+      rec.port = ntohs(addr.sin_port);
+      fds[num_fds++] = conn->sock_fd;
+    }
+  if ((conn->modbus != NULL) && (conn->modbus->sock_fd >= 0))
+    {
+      rec.mb_port = conn->modbus->port;
+      fds[num_fds++] = conn->modbus->sock_fd;
+    }
+  add_buf(&rec, data, 0, conn->tx.msg);
+  add_rbuf(&rec, data, 1, conn->tty_out);
+  rec.tx_state = conn->tx.state;
+  rec.nak_cnt = conn->tx.nak_cnt;
+  rec.enq_cnt = conn->tx.enq_cnt;
+  rec.tx_eticks = conn->tx.eticks;
+  rec.tx_stn = conn->tx.stn;
+  rec.tx_client = client_index(conn->owner, conn->tx.client);
+  rec.rx_state = conn->rx.state;
+  rec.rx_client = client_index(conn->owner, conn->rx.client);
+  rec.last_was_ack = conn->rx.last_was_ack;
+  memcpy(rec.dup, conn->rx.dup, sizeof(rec.dup));
+  rec.slave_tx_stn = conn->slave.tx_stn;
+  return send_rec(sock, &rec, data, fds, num_fds);
+}
+
+/*
+ * Description : Sends a client record.
+ *
+ * Arguments : sock - Handoff socket.
+ *             owner - Connection holding the client.
+ *             client - Client pointer.
+ *             index - Position among the owner's clients.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if sending failed.
+ */
+static int send_client(int sock, const CONN *owner, const CLIENT *client,
+		       int index)
+{
+  HO_REC rec;
+  const uint8_t *data[HO_BUFS] = {NULL, NULL, NULL};
+  memset(&rec, 0, sizeof(rec));
+  rec.type = HO_CLIENT;
+  strcpy(rec.conn, owner->name);
+  rec.client = index;
+  strcpy(rec.name, client->name);
+  rec.state = client->state;
+  rec.addr = client->addr;
+  rec.name_len = client->name_len;
+  rec.name_len_rcvd = client->name_len_rcvd;
+  rec.new_msg_len = client->new_msg_len;
+  rec.deadline = client->deadline;
+  rec.dl_ticks = client->dl_ticks;
+  rec.acks_owed = client->acks_owed;
+  rec.local_pend = client->local_pend;
+  rec.local_src = client_index(owner, client->local_src);
+  rec.mux_sess = client->mux_sess;
+  rec.mux_state = client->mux_state;
+  rec.mux_id = client->mux_id;
+  rec.mux = client_index(owner, client->mux);
+  rec.vid = client->vid;
+  add_buf(&rec, data, 0, client->df1_tx);
+  /*
+   * A virtual client has no socket, its units are held by its session.
+   */
+  if (client->mux != NULL) return send_rec(sock, &rec, data, NULL, 0);
+  add_rbuf(&rec, data, 1, client->sock_out);
+  add_rbuf(&rec, data, 2, client->sock_in);
+  return send_rec(sock, &rec, data, &client->fd, 1);
+}
+
+/*
+ * Description : Sends a Modbus session record.
+ *
+ * Arguments : sock - Handoff socket.
+ *             conn - Connection with the Modbus front end.
+ *             sess - Session pointer.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if sending failed.
+ */
+static int send_sess(int sock, const CONN *conn, const MB_SESS *sess)
+{
+  HO_REC rec;
+  const uint8_t *data[HO_BUFS] = {NULL, NULL, NULL};
+  memset(&rec, 0, sizeof(rec));
+  rec.type = HO_MB_SESS;
+  strcpy(rec.conn, conn->name);
+  add_rbuf(&rec, data, 0, sess->in);
+  add_rbuf(&rec, data, 1, sess->out);
+  return send_rec(sock, &rec, data, &sess->fd, 1);
+}
+
+/*
+ * Description : Sends one record with its buffers and descriptors.
+ *
+ * Arguments : sock - Handoff socket.
+ *             rec - Record, its len[] gives the buffer lengths.
+ *             data - Buffers, NULL if none.
+ *             fds - Descriptors to pass.
+ *             num_fds - Number of descriptors.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if sendmsg() failed.
+ */
+static int send_rec(int sock, HO_REC *rec, const uint8_t *data[],
+		    const int fds[], int num_fds)
+{
+  struct msghdr msg;
+  struct iovec iov[HO_BUFS + 1];
+  union /* Aligned control message buffer. */
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(HO_MAX_FDS * sizeof(int))];
+  } ctl;
+  int i;
+  rec->version = HO_VERSION;
+  memset(&msg, 0, sizeof(msg));
+  iov[0].iov_base = rec;
+  iov[0].iov_len = sizeof(HO_REC);
+  for (i = 0; (data != NULL) && (i < HO_BUFS); i++)
+    {
+      iov[i + 1].iov_base = (void *)data[i];
+      iov[i + 1].iov_len = rec->len[i];
+    }
+  msg.msg_iov = iov;
+  msg.msg_iovlen = (data != NULL) ? HO_BUFS + 1 : 1;
+  if (num_fds)
+    {
+      struct cmsghdr *cmsg;
+      memset(&ctl, 0, sizeof(ctl));
+      msg.msg_control = ctl.buf;
+      msg.msg_controllen = CMSG_SPACE(num_fds * sizeof(int));
+      cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(num_fds * sizeof(int));
+      memcpy(CMSG_DATA(cmsg), fds, num_fds * sizeof(int));
+    }
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error sending handoff record : %s\n",
+	      __FILE__, __LINE__, rec->conn, strerror(errno));
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Adds a buffer to a record.
+ *
+ * Arguments : rec - Record.
+ *             data - Buffer pointers of the record.
+ *             i - Buffer number.
+ *             buf - Buffer to add. The read position of the first buffer
+ *                   is kept.
+ *
+ * Return Value : None.
+ */
+static void add_buf(HO_REC *rec, const uint8_t *data[], int i,
+		    const BUF *buf)
+{
+  data[i] = buf->data;
+  rec->len[i] = buf->len;
+  if (!i) rec->index = buf->index;
+  return;
+}
+
+/*
+ * Description : Adds the data held in a ring buffer to a record, moving it
+ *               so that it is contiguous.
+ *
+ * Arguments : rec - Record.
+ *             data - Buffer pointers of the record.
+ *             i - Buffer number.
+ *             rb - Ring buffer to add.
+ *
+ * Return Value : None.
+ */
+static void add_rbuf(HO_REC *rec, const uint8_t *data[], int i, RBUF *rb)
+{
+  data[i] = rbuf_linearize(rb);
+  rec->len[i] = rbuf_len(rb);
+  return;
+}
+
+/*
+ * Description : Finds a client's position among the clients of its owner,
+ *               internal clients are not counted.
+ *
+ * Arguments : owner - Connection holding the client.
+ *             client - Client pointer, may be NULL.
+ *
+ * Return Value : The client's position, -1 if NULL or internal.
+ */
+static int client_index(const CONN *owner, const CLIENT *client)
+{
+  const CLIENT *cur;
+  int i = 0;
+  if ((client == NULL) || ((client->fd < 0) && (client->mux == NULL)))
+    return -1;
+  for (cur = owner->clients; cur != NULL; cur = cur->next)
+    if (cur == client) return i;
+    else if ((cur->fd >= 0) || (cur->mux != NULL)) i++;
+  return -1;
+}
+
+/*
+ * Description : Receives one record.
+ *
+ * Arguments : sock - Handoff socket.
+ *
+ * Return Value : Positive if a record was received.
+ *                Zero once the end record is received.
+ *                Negative if an error occured.
+ */
+static int recv_rec(int sock)
+{
+  static uint8_t pkt[sizeof(HO_REC) + HO_DATA_MAX];
+  union /* Aligned control message buffer. */
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(HO_MAX_FDS * sizeof(int))];
+  } ctl;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  HO_ITEM *item;
+  HO_ITEM **end;
+  ssize_t len;
+  size_t total = 0;
+  int num_fds = 0;
+  int i;
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = pkt;
+  iov.iov_len = sizeof(pkt);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl.buf;
+  msg.msg_controllen = sizeof(ctl.buf);
+  do len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  while ((len < 0) && (errno == EINTR));
+  if (len <= 0)
+    {
+      log_msg(LOG_ERR, "%s:%d Error receiving handoff record : %s\n",
+	      __FILE__, __LINE__, len ? strerror(errno) : "closed");
+      return -1;
+    }
+  item = (HO_ITEM *)calloc(1, sizeof(HO_ITEM));
+  if (item == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d Error allocating memory for handoff : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      return -1;
+    }
+  for (end = &items; *end != NULL; end = &(*end)->next);
+  *end = item; /* Freed with the rest, descriptors included, on error. */
+  for (i = 0; i < HO_MAX_FDS; i++) item->fds[i] = -1;
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg))
+    if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+      {
+	num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	memcpy(item->fds, CMSG_DATA(cmsg), num_fds * sizeof(int));
+      }
+  if (len < (ssize_t)sizeof(HO_REC))
+    {
+      log_msg(LOG_ERR, "%s:%d Handoff record too short.\n", __FILE__,
+	      __LINE__);
+      return -1;
+    }
+  memcpy(&item->rec, pkt, sizeof(HO_REC));
+  if (item->rec.version != HO_VERSION)
+    {
+      log_msg(LOG_ERR, "%s:%d Handoff from an incompatible version.\n",
+	      __FILE__, __LINE__);
+      return -1;
+    }
+  for (i = 0; i < HO_BUFS; i++) total += item->rec.len[i];
+  if ((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+      || (total != (size_t)len - sizeof(HO_REC)))
+    {
+      log_msg(LOG_ERR, "%s:%d Handoff record truncated.\n", __FILE__,
+	      __LINE__);
+      return -1;
+    }
+  if (item->rec.type == HO_END) return 0;
+  if (item->rec.type == HO_CONN) /* Spread out to fixed positions. */
+    {
+      if (num_fds != 1 + !!item->rec.port + !!item->rec.mb_port)
+	{
+	  log_msg(LOG_ERR, "%s:%d [%s] Handoff descriptors missing.\n",
+		  __FILE__, __LINE__, item->rec.conn);
+	  return -1;
+	}
+      if (!item->rec.mb_port)
+	{
+	  item->fds[HO_FD_MODBUS] = -1;
+	  if (!item->rec.port) item->fds[HO_FD_LISTEN] = -1;
+	}
+      else if (!item->rec.port)
+	{
+	  item->fds[HO_FD_MODBUS] = item->fds[HO_FD_LISTEN];
+	  item->fds[HO_FD_LISTEN] = -1;
+	}
+    }
+  if (total)
+    {
+      uint8_t *p = (uint8_t *)malloc(total);
+      if (p == NULL) return -1;
+      memcpy(p, pkt + sizeof(HO_REC), total);
+      for (i = 0; i < HO_BUFS; i++)
+	{
+	  item->data[i] = p;
+	  p += item->rec.len[i];
+	}
+    }
+  return 1;
+}
+
+/*
+ * Description : Resumes a connection's link state, provided it took over
+ *               its TTY.
+ *
+ * Arguments : item - Connection record.
+ *
+ * Return Value : None.
+ */
+static void resume_conn(HO_ITEM *item)
+{
+  const HO_REC *rec = &item->rec;
+  CONN *conn = conn_find(rec->conn);
+  HO_ITEM *tx_item = find_client(rec->owner, rec->tx_client);
+  HO_ITEM *rx_item = find_client(rec->owner, rec->rx_client);
+  if ((conn == NULL) || !item->tty_taken) return;
+  conn->rx.last_was_ack = rec->last_was_ack;
+  memcpy(conn->rx.dup, rec->dup, sizeof(rec->dup));
+  if (rec->rx_state == RX_PEND)
+    {
+      /*
+       * An internal client has already answered, a client that was not
+       * resumed is gone; either way the message is ACKed.
+       */
+      if ((rx_item != NULL) && (rx_item->client != NULL))
+	{
+	  conn->rx.state = RX_PEND;
+	  conn->rx.client = rx_item->client;
+	}
+      else conn->rx.last_was_ack = 1;
+    }
+  else if (rec->rx_state != RX_IDLE) rx_set_nak(&conn->rx);
+  conn->slave.tx_stn = rec->slave_tx_stn;
+  /*
+   * A half-duplex master starts a new poll scan, which would collide with
+   * the output of the old one.
+   */
+  if (conn->duplex == DUPLEX_MASTER) return;
+  restore_rbuf(conn->tty_out, item->data[1], rec->len[1]);
+  if (rec->tx_state == TX_IDLE) return;
+  restore_buf(conn->tx.msg, item->data[0], rec->len[0], rec->index);
+  conn->tx.state = rec->tx_state;
+  conn->tx.nak_cnt = rec->nak_cnt;
+  conn->tx.enq_cnt = rec->enq_cnt;
+  conn->tx.eticks = rec->tx_eticks;
+  conn->tx.stn = rec->tx_stn;
+  if ((tx_item != NULL) && (tx_item->client != NULL))
+    {
+      conn->tx.client = tx_item->client;
+      tx_item->tx_taken = 1;
+    }
+  log_msg(LOG_DEBUG, "%s:%d [%s] Resumed transmission in progress.\n",
+	  __FILE__, __LINE__, conn->name);
+  return;
+}
+
+/*
+ * Description : Resumes a client on its connection.
+ *
+ * Arguments : item - Client record.
+ *
+ * Return Value : None.
+ */
+static void resume_client(HO_ITEM *item)
+{
+  const HO_REC *rec = &item->rec;
+  CONN *conn = conn_find(rec->conn);
+  HO_ITEM *sess_item = find_client(rec->conn, rec->mux);
+  CLIENT *client;
+  if (conn == NULL) return;
+  /*
+   * Sessions are sent before their virtual clients, so a resumed session
+   * already exists.
+   */
+  if (rec->mux >= 0)
+    {
+      if ((sess_item == NULL) || (sess_item->client == NULL)) return;
+      client = client_new_virtual(conn->owner, sess_item->client, rec->vid);
+    }
+  else client = client_adopt(conn->owner, item->fds[0]);
+  if (client == NULL) return;
+  if (rec->mux < 0) item->fds[0] = -1;
+  item->client = client;
+  strcpy(client->name, rec->name);
+  client->state = rec->state;
+  client->addr = rec->addr;
+  client->name_len = rec->name_len;
+  client->name_len_rcvd = rec->name_len_rcvd;
+  client->new_msg_len = rec->new_msg_len;
+  client->deadline = rec->deadline;
+  client->dl_ticks = rec->dl_ticks;
+  client->acks_owed = rec->acks_owed;
+  client->mux_sess = rec->mux_sess;
+  client->mux_state = rec->mux_state;
+  client->mux_id = rec->mux_id;
+  restore_buf(client->df1_tx, item->data[0], rec->len[0], rec->index);
+  if (client->state == CLIENT_MSG_READY)
+    client->prio = prio_class(client->df1_tx);
+  if (rec->mux < 0)
+    {
+      restore_rbuf(client->sock_out, item->data[1], rec->len[1]);
+      restore_rbuf(client->sock_in, item->data[2], rec->len[2]);
+    }
+  log_msg(LOG_INFO, "%s:%d [%s.%s] Client resumed.\n", __FILE__, __LINE__,
+	  conn->owner->name, client->name);
+  return;
+}
+
+/*
+ * Description : Resumes a locally routed message the client had yet to
+ *               answer, once all clients are resumed.
+ *
+ * Arguments : item - Client record of the destination.
+ *
+ * Return Value : None.
+ */
+static void resume_local(HO_ITEM *item)
+{
+  HO_ITEM *src_item = find_client(item->rec.conn, item->rec.local_src);
+  item->client->local_pend = 1;
+  if ((src_item == NULL) || (src_item->client == NULL)) return;
+  item->client->local_src = src_item->client;
+  src_item->tx_taken = 1; /* Answered by the destination. */
+  return;
+}
+
+/*
+ * Description : Resumes a Modbus TCP session.
+ *
+ * Arguments : item - Session record.
+ *
+ * Return Value : None.
+ */
+static void resume_sess(HO_ITEM *item)
+{
+  const HO_REC *rec = &item->rec;
+  CONN *conn = conn_find(rec->conn);
+  MB_SESS *sess;
+  if (conn == NULL) return;
+  sess = mb_adopt(conn, item->fds[0]);
+  if (sess == NULL) return;
+  item->fds[0] = -1;
+  restore_rbuf(sess->in, item->data[0], rec->len[0]);
+  restore_rbuf(sess->out, item->data[1], rec->len[1]);
+  return;
+}
+
+/*
+ * Description : Finds a client record.
+ *
+ * Arguments : owner - Name of the connection that held the client.
+ *             index - Position among its clients, -1 for none.
+ *
+ * Return Value : The record, NULL if not found.
+ */
+static HO_ITEM *find_client(const char *owner, int index)
+{
+  HO_ITEM *item;
+  if (index < 0) return NULL;
+  for (item = items; item != NULL; item = item->next)
+    if ((item->rec.type == HO_CLIENT) && (item->rec.client == index)
+	&& !strcmp(item->rec.conn, owner))
+      return item;
+  return NULL;
+}
+
+/*
+ * Description : Fills a buffer with handed over data.
+ *
+ * Arguments : dst - Buffer to fill.
+ *             src - Data.
+ *             len - Length of the data.
+ *             index - Read position to restore.
+ *
+ * Return Value : None.
+ */
+static void restore_buf(BUF *dst, const uint8_t *src, size_t len,
+			size_t index)
+{
+  buf_empty(dst);
+  if (!len) return;
+  if (len > dst->max) len = dst->max;
+  buf_append_blob(dst, (void *)src, len);
+  dst->index = (index < len) ? index : len;
+  return;
+}
+
+/*
+ * Description : Fills a ring buffer with handed over data.
+ *
+ * Arguments : dst - Buffer to fill.
+ *             src - Data.
+ *             len - Length of the data.
+ *
+ * Return Value : None.
+ */
+static void restore_rbuf(RBUF *dst, const uint8_t *src, size_t len)
+{
+  rbuf_empty(dst);
+  if (len > dst->max) len = dst->max;
+  rbuf_put(dst, src, len);
+  return;
+}
+
+/*
+ * Description : Frees the records received, closing every descriptor no
+ *               connection took over.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void free_items(void)
+{
+  while (items != NULL)
+    {
+      HO_ITEM *next = items->next;
+      int i;
+      for (i = 0; i < HO_MAX_FDS; i++)
+	if (items->fds[i] >= 0) close(items->fds[i]);
+      free(items->data[0]);
+      free(items);
+      items = next;
+    }
+  return;
+}
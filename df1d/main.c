@@ -33,20 +33,31 @@
  */
 #define OPT_FOREGROUND 1
 #define OPT_DEBUG 2
+#define OPT_RING 4
 
-static int cl_args(int argc, char * const argv[], char *cfg_file, int *opts);
+/*
+ * comm_loop() return values.
+ */
+#define LOOP_EXIT 0
+#define LOOP_RESTART 1
+#define LOOP_HANDOFF 2
+
+static int cl_args(int argc, char * const argv[], char *cfg_file, int *opts,
+		   int *ho_fd);
 static int become_daemon(void);
 static int comm_loop(void);
 static int set_signals(void);
 static void sig_alrm(int signo);
 static void sig_term(int signo);
 static void sig_hup(int signo);
+static void sig_usr2(int signo);
 static void sig_int(int signo);
 static void sig_segv(int signo);
 
 static volatile int timeout; /* Set by SIGARLM. */
 static volatile int terminate; /* Set by SIGTERM. */
 static volatile int restart; /* Set by SIGHUP. */
+static volatile int handoff; /* Set by SIGUSR2. */
 static volatile int terminate_int; /* Set by SIGINT. */
 
 /*
@@ -61,18 +72,27 @@ int main(int argc, char *argv[])
 {
   int opts = 0; /* Option mask from command line arguments. */
   int loop = 0; /* Zero if program should terminate after comm loop. */
+  int ho_fd = -1; /* Handoff socket from a restarting df1d, -1 if none. */
   char cfg_file[PATH_MAX];
-  if (cl_args(argc, argv, cfg_file, &opts)) exit(0);
+  if (cl_args(argc, argv, cfg_file, &opts, &ho_fd)) exit(0);
   log_open((opts & OPT_FOREGROUND),
 	   (opts & OPT_DEBUG) ? LOG_DEBUG : LOG_INFO);
   log_msg(LOG_INFO, "Starting DF1 link layer service v%s.%s\n", VER_MAJOR,
 	  VER_MINOR);
+  if ((ho_fd >= 0) && handoff_recv(ho_fd))
+    {
+      log_close();
+      exit(0);
+    }
   if (cfg_read(cfg_file))
     {
       log_close();
       exit(0);
     }
-  if (!(opts & OPT_FOREGROUND) && become_daemon())
+  /*
+   * A process taking over is already detached from the terminal.
+   */
+  if ((ho_fd < 0) && !(opts & OPT_FOREGROUND) && become_daemon())
     {
       conn_close_all();
       log_close();
@@ -84,15 +104,47 @@ int main(int argc, char *argv[])
       log_close();
       exit(0);
     }
+  if (handoff_resume())
+    {
+      conn_close_all();
+      log_close();
+      exit(0);
+    }
+  if (opts & OPT_RING) ring_start(); /* Falls back to pselect(). */
   do
     {
-      if (timer_start()) break;
+      /*
+       * The io_uring backend keeps its own tick.
+       */
+      if (!ring_active() && timer_start()) break;
+      rt_apply();
       loop = comm_loop();
-      conn_close_all();
-      if (timer_stop()) break;
-      if (loop && cfg_read(cfg_file)) break;
+      if (!ring_active() && timer_stop()) break;
+      if (loop == LOOP_HANDOFF)
+	{
+	  /*
+	   * The connections now belong to the new process, they are left
+	   * open for it.
+	   */
+	  stats_stop(); /* The new process opens its own. */
+	  if (!handoff_start(argc, argv))
+	    {
+	      log_close();
+	      return 0;
+	    }
+	  stats_start();
+	  continue;
+	}
+      /*
+       * Connections are kept across a reload, cfg_read() only reopens
+       * those whose settings require it.
+       */
+      if (loop && cfg_read(cfg_file))
+	log_msg(LOG_ERR, "%s:%d Configuration not reloaded, connections"
+		" left as they were.\n", __FILE__, __LINE__);
     } while (loop);
   conn_close_all();
+  ring_stop();
   log_close();
   return 0;
 }
@@ -104,19 +156,23 @@ int main(int argc, char *argv[])
  *             argv - Argument vector from main().
  *             cfg_file - Location to store config file name.
  *             opts - Option bit mask.
+ *             ho_fd - Location to store the handoff socket given with -H.
  *
  * Return Value : Zero if successful.
  *                Non-zero if the program should terminate.
  */
-static int cl_args(int argc, char * const argv[], char *cfg_file, int *opts)
+static int cl_args(int argc, char * const argv[], char *cfg_file, int *opts,
+		   int *ho_fd)
 {
   int i;
-  const char cl_opts[] = "dfhv";
+  const char cl_opts[] = "dfhH:uv";
   const char usage[] = \
     "Usage: df1d [options] <config file>\n"
     "   -d : Enable debug log messages.\n"
     "   -f : Run in foreground, log to standard error.\n"
     "   -h : Print this message and exit.\n"
+    "   -H <fd> : Take over from a df1d handing over on SIGUSR2, internal.\n"
+    "   -u : Use io_uring for I/O if the kernel supports it.\n"
     "   -v : Output version information and exit.\n";
   while ((i = getopt(argc, argv, cl_opts)) != -1)
     {
@@ -132,6 +188,12 @@ static int cl_args(int argc, char * const argv[], char *cfg_file, int *opts)
 	  printf("%s", usage);
 	  return -1;
 	  break;
+	case 'H':
+	  *ho_fd = atoi(optarg);
+	  break;
+	case 'u':
+	  *opts |= OPT_RING;
+	  break;
 	case 'v':
 	  printf("df1d version %s.%s\n", VER_MAJOR, VER_MINOR);
 	  return -1;
@@ -203,8 +265,9 @@ static int become_daemon(void)
  *
  * Arguments : None.
  *
- * Return Value : Zero if the program should terminate.
- *                Non-zero if it should restart.
+ * Return Value : LOOP_EXIT if the program should terminate.
+ *                LOOP_RESTART if it should reload its configuration.
+ *                LOOP_HANDOFF if it should hand over to a new process.
  */
 static int comm_loop(void)
 {
@@ -218,7 +281,7 @@ static int comm_loop(void)
       log_msg(LOG_ERR,
 	      "%s:%d No connections initialized, shutting down.\n",
 	      __FILE__, __LINE__);
-      return 0;
+      return LOOP_EXIT;
     }
   /*
    * Initialize the signal sets.
@@ -229,6 +292,7 @@ static int comm_loop(void)
   sigaddset(&block_set, SIGTERM);
   sigaddset(&block_set, SIGHUP);
   sigaddset(&block_set, SIGINT);
+  sigaddset(&block_set, SIGUSR2);
   for (;;)
     {
       fd_set read_test;
@@ -247,38 +311,51 @@ static int comm_loop(void)
 	{
 	  log_msg(LOG_INFO, "%s:%d Received SIGTERM, shutting down.\n",
 	      __FILE__, __LINE__);
-	  return 0;
+	  return LOOP_EXIT;
 	}
       if (restart)
 	{
-	  log_msg(LOG_INFO, "%s:%d Received SIGHUP, restarting.\n",
+	  log_msg(LOG_INFO, "%s:%d Received SIGHUP, reloading configuration.\n",
 		  __FILE__, __LINE__);
 	  restart = 0;
-	  return 1;
+	  return LOOP_RESTART;
+	}
+      if (handoff)
+	{
+	  log_msg(LOG_INFO, "%s:%d Received SIGUSR2, handing over.\n",
+		  __FILE__, __LINE__);
+	  handoff = 0;
+	  return LOOP_HANDOFF;
 	}
       if (terminate_int)
 	{
 	  log_msg(LOG_INFO, "%s:%d Received SIGINT, shutting down.\n",
 		  __FILE__, __LINE__);
-	  return 0;
+	  return LOOP_EXIT;
 	}
       /*
        * Check and service file descriptors.
        */
       read_test = read_fds;
       pwrite_test = conn_get_write_fds(&write_test) ? &write_test : NULL;
-      num_fds = pselect(high_fd, &read_test, pwrite_test, NULL, NULL,
-			&empty_set);
+      if (ring_active())
+	num_fds = ring_wait(high_fd, &read_test, pwrite_test, &empty_set,
+			    &timeout);
+      else num_fds = pselect(high_fd, &read_test, pwrite_test, NULL, NULL,
+			     &empty_set);
       if (num_fds < 0)
 	{
 	  if (errno == EINTR) continue;
 	  else
 	    {
-	      log_msg(LOG_ERR, "%s:%d pselect() failed : %s\n", __FILE__,
-		      __LINE__, strerror(errno));
-	      return 0;
+	      log_msg(LOG_ERR, "%s:%d %s failed : %s\n", __FILE__, __LINE__,
+		      ring_active() ? "io_uring_enter()" : "pselect()",
+		      strerror(errno));
+	      return LOOP_EXIT;
 	    }
 	}
+      if (!num_fds) continue; /* Only a tick elapsed. */
+      rt_wake();
       if (conn_service_fds(&read_test, pwrite_test, &num_fds))
 	{
 	  high_fd = conn_get_read_fds(&read_fds);
@@ -287,11 +364,11 @@ static int comm_loop(void)
 	      log_msg(LOG_INFO,
 		      "%s:%d No remaining connections, shutting down.\n",
 		      __FILE__, __LINE__);
-	      return 0;
+	      return LOOP_EXIT;
 	    }
 	}
     }
-  return 0; /* Should never get here. */
+  return LOOP_EXIT; /* Should never get here. */
 }
 
 /*
@@ -333,6 +410,14 @@ static int set_signals(void)
 	      __FILE__, __LINE__, strerror(errno));
       return -1;
     }
+  sa.sa_handler = sig_usr2;
+  if (sigaction(SIGUSR2, &sa, NULL))
+    {
+      log_msg(LOG_ERR,
+	      "%s:%d Error setting signal action for SIGUSR2 : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      return -1;
+    }
   sa.sa_handler = sig_int;
   if (sigaction(SIGINT, &sa, NULL))
     {
@@ -391,6 +476,19 @@ static void sig_hup(int signo)
   return;
 }
 
+/*
+ * Description : Signal handler for SIGUSR2.
+ *
+ * Arguments : signo - Signal number.
+ *
+ * Return Value : None.
+ */
+static void sig_usr2(int signo)
+{
+  handoff = 1;
+  return;
+}
+
 /*
  * Description : Signal handler for SIGINT.
  *
@@ -0,0 +1,465 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Half-duplex master. Slaves may only transmit when polled, so the master
+ * cycles through a poll list. Slaves that recently exchanged a message are
+ * active and polled every scan; idle slaves are polled a few per scan, so a
+ * long multidrop line of mostly quiet stations isn't spent polling all of
+ * them every time. A polled slave is polled again as long as it keeps
+ * returning messages. Client messages are sent in the gap after each poll.
+ */
+
+#include "df1.h"
+
+#define MASTER_MAX_MSGS 8 /* Messages accepted from a slave per poll. */
+#define MASTER_ACTIVE_MS 1000 /* Default time a slave stays active. */
+
+static void gap(CONN *conn, POLL_SLAVE *repoll);
+static void poll_next(CONN *conn, POLL_SLAVE *s);
+static POLL_SLAVE *pick_slave(MASTER *m);
+static POLL_SLAVE *find_slave(const MASTER *m, uint8_t addr);
+static void set_active(const MASTER *m, POLL_SLAVE *s);
+static void rsp_time(MASTER *m);
+
+/*
+ * Description : Allocates a half-duplex master to be configured with
+ *               master_add_slave() and started with master_start().
+ *
+ * Arguments : None.
+ *
+ * Return Value : A pointer to the new master.
+ *                NULL if a memory allocation error occured.
+ */
+extern MASTER *master_new(void)
+{
+  MASTER *m = (MASTER *)calloc(1, sizeof(MASTER));
+  if (m == NULL) return NULL;
+  m->mode = POLL_STANDARD;
+  m->idle_polls = 1;
+  m->active_ticks = MASTER_ACTIVE_MS / (TICK_USEC / 1000);
+  return m;
+}
+
+/*
+ * Description : Adds a slave station to the end of a master's poll list.
+ *
+ * Arguments : m - Master.
+ *             addr - Station address.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the station is already on the list or a memory
+ *                allocation error occured.
+ */
+extern int master_add_slave(MASTER *m, uint8_t addr)
+{
+  POLL_SLAVE *slaves;
+  if (find_slave(m, addr) != NULL) return -1;
+  slaves = (POLL_SLAVE *)realloc(m->slaves,
+				 (m->num_slaves + 1) * sizeof(POLL_SLAVE));
+  if (slaves == NULL) return -1;
+  m->slaves = slaves;
+  memset(slaves + m->num_slaves, 0, sizeof(POLL_SLAVE));
+  slaves[m->num_slaves++].addr = addr;
+  return 0;
+}
+
+/*
+ * Description : Starts a configured master on a connection and sends the
+ *               first poll. The master is freed if it could not be started.
+ *
+ * Arguments : conn - Connection pointer.
+ *             m - Configured master.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+extern int master_start(CONN *conn, MASTER *m)
+{
+  if (conn->duplex != DUPLEX_MASTER)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Poll list given for a connection that is"
+	      " not a half-duplex master.\n", __FILE__, __LINE__, conn->name);
+      master_free(conn, m);
+      return -1;
+    }
+  conn->master = m;
+  m->idle_left = m->idle_polls;
+  log_msg(LOG_INFO, "%s:%d [%s] Half-duplex master polling %u station(s),"
+	  " %s polling.\n", __FILE__, __LINE__, conn->name, m->num_slaves,
+	  (m->mode == POLL_STANDARD) ? "standard" : "message based");
+  gap(conn, NULL);
+  return 0;
+}
+
+/*
+ * Description : Determines if a client message may be handed to the
+ *               transmitter. A half-duplex master only sends messages
+ *               between polls.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : Non-zero if a message may be sent.
+ */
+extern int master_tx_window(const CONN *conn)
+{
+  const MASTER *m = conn->master;
+  if (m == NULL) return 1;
+  return (m->state == MASTER_GAP) || (m->state == MASTER_IDLE);
+}
+
+/*
+ * Description : Notifies the master that the transmitter finished with a
+ *               client message. The slave it was sent to is made active so
+ *               the reply is collected promptly, then polling resumes.
+ *
+ * Arguments : conn - Connection pointer.
+ *             ok - Non-zero if the slave acknowledged the message.
+ *
+ * Return Value : None.
+ */
+extern void master_tx_done(CONN *conn, int ok)
+{
+  MASTER *m = conn->master;
+  POLL_SLAVE *s;
+  if (m == NULL) return;
+  s = find_slave(m, conn->tx.stn);
+  if (ok && (s != NULL)) set_active(m, s);
+  /*
+   * A message that failed before leaving the gap is dealt with by gap().
+   */
+  if ((m->state == MASTER_MSG) || (m->state == MASTER_IDLE))
+    poll_next(conn, m->repoll);
+  return;
+}
+
+/*
+ * Description : Notifies the master that the TTY output buffer has been
+ *               written. Response time is measured from here.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void master_data_sent(CONN *conn)
+{
+  MASTER *m = conn->master;
+  if ((m == NULL) || (m->state != MASTER_POLL_TX)) return;
+  gettimeofday(&m->sent, NULL);
+  m->eticks = 0;
+  m->state = MASTER_POLL_WAIT;
+  return;
+}
+
+/*
+ * Description : Handles a DLE EOT, the polled slave has nothing to send.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void master_eot(CONN *conn)
+{
+  MASTER *m = conn->master;
+  log_msg(LOG_DEBUG, "%s:%d [%s] Received DLE EOT.\n", __FILE__, __LINE__,
+	  conn->name);
+  if ((m == NULL) || (m->state != MASTER_POLL_WAIT))
+    {
+      conn->dcnts.bytes_ignored += 2;
+      return;
+    }
+  rsp_time(m);
+  m->cur->eots++;
+  gap(conn, NULL);
+  return;
+}
+
+/*
+ * Description : Notifies the master that a message is arriving, called
+ *               before the receiver is handed the DLE STX.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void master_msg_start(CONN *conn)
+{
+  MASTER *m = conn->master;
+  if ((m == NULL) || (m->state != MASTER_POLL_WAIT)) return;
+  rsp_time(m);
+  m->eticks = 0;
+  m->state = MASTER_POLL_RX;
+  return;
+}
+
+/*
+ * Description : Notifies the master that the receiver answered the polled
+ *               slave's message with an ACK or NAK. The slave is polled
+ *               again for its next message, or to retransmit after a NAK.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void master_rx_done(CONN *conn)
+{
+  MASTER *m = conn->master;
+  if ((m == NULL) || (m->state != MASTER_POLL_RX)) return;
+  if (conn->rx.last_was_ack)
+    {
+      m->cur->msgs++;
+      /*
+       * With message based polling the reply has been collected; any
+       * further messages are picked up by polling it again right away.
+       */
+      if (m->mode == POLL_MESSAGE) m->cur->active = 0;
+      else set_active(m, m->cur);
+    }
+  gap(conn, (++m->msgs < MASTER_MAX_MSGS) ? m->cur : NULL);
+  return;
+}
+
+/*
+ * Description : Master timeout handler. Ages active slaves and handles
+ *               slaves that don't answer a poll.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void master_tick(CONN *conn)
+{
+  MASTER *m = conn->master;
+  unsigned int i;
+  if (m == NULL) return;
+  for (i = 0; i < m->num_slaves; i++)
+    if (m->slaves[i].active && !--m->slaves[i].active_ticks)
+      m->slaves[i].active = 0;
+  switch (m->state)
+    {
+    case MASTER_POLL_WAIT:
+      if (++m->eticks <= conn->tx.tticks) break;
+      log_msg(LOG_DEBUG, "%s:%d [%s] No response from station %u.\n",
+	      __FILE__, __LINE__, conn->name, m->cur->addr);
+      m->cur->timeouts++;
+      m->cur->active = 0;
+      conn->dcnts.resp_timeouts++;
+      gap(conn, NULL);
+      break;
+    case MASTER_POLL_RX:
+      /*
+       * The receiver gave up on an incomplete message.
+       */
+      if (conn->rx.state == RX_IDLE) gap(conn, NULL);
+      /*
+       * A client is sitting on the message; acknowledge it like a full
+       * duplex node would after an ENQ.
+       */
+      else if ((conn->rx.state == RX_PEND) && (++m->eticks > conn->tx.tticks))
+	rx_enq(conn);
+      break;
+    default:
+      break;
+    }
+  return;
+}
+
+/*
+ * Description : Logs a master's statistics and frees it.
+ *
+ * Arguments : conn - Connection pointer.
+ *             m - Master to free, may be NULL.
+ *
+ * Return Value : None.
+ */
+extern void master_free(CONN *conn, MASTER *m)
+{
+  unsigned int i;
+  if (m == NULL) return;
+  if (conn->master == m)
+    log_msg(LOG_INFO, "%s:%d [%s] Master stats: %u scans.\n", __FILE__,
+	    __LINE__, conn->name, m->scans);
+  for (i = 0; (conn->master == m) && (i < m->num_slaves); i++)
+    {
+      POLL_SLAVE *s = m->slaves + i;
+      log_msg(LOG_INFO, "%s:%d [%s] Station %u stats: %u polls; %u msgs;"
+	      " %u EOTs; %u timeouts; %ld/%ld/%ld uS min/avg/max response.\n",
+	      __FILE__, __LINE__, conn->name, s->addr, s->polls, s->msgs,
+	      s->eots, s->timeouts, s->rsp_min,
+	      s->rsp_cnt ? (long)(s->rsp_sum / s->rsp_cnt) : 0L, s->rsp_max);
+    }
+  if (conn->master == m) conn->master = NULL;
+  free(m->slaves);
+  free(m);
+  return;
+}
+
+/*
+ * Description : Ends a poll. Gives the clients a chance to send a message,
+ *               then polls the next slave.
+ *
+ * Arguments : conn - Connection pointer.
+ *             repoll - Slave to poll next, NULL for the next in the scan.
+ *
+ * Return Value : None.
+ */
+static void gap(CONN *conn, POLL_SLAVE *repoll)
+{
+  MASTER *m = conn->master;
+  m->state = MASTER_GAP;
+  m->repoll = repoll;
+  client_next_tx(conn);
+  /*
+   * Sending the message may have failed outright and started the next
+   * poll already.
+   */
+  if (m->state != MASTER_GAP) return;
+  if (tx_busy(&conn->tx)) m->state = MASTER_MSG;
+  else poll_next(conn, repoll);
+  return;
+}
+
+/*
+ * Description : Sends the next poll.
+ *
+ * Arguments : conn - Connection pointer.
+ *             s - Slave to poll, NULL for the next in the scan.
+ *
+ * Return Value : None.
+ */
+static void poll_next(CONN *conn, POLL_SLAVE *s)
+{
+  MASTER *m = conn->master;
+  if (s == NULL)
+    {
+      s = pick_slave(m);
+      m->msgs = 0;
+    }
+  m->repoll = NULL;
+  if (s == NULL) /* Nothing to poll. */
+    {
+      m->state = MASTER_IDLE;
+      return;
+    }
+  m->cur = s;
+  s->polls++;
+  m->state = MASTER_POLL_TX;
+  tx_poll(conn, s->addr);
+  return;
+}
+
+/*
+ * Description : Selects the next slave to poll. Each scan polls every active
+ *               slave followed by up to idle_polls idle slaves, taken round
+ *               robin so every idle slave is eventually polled. Idle slaves
+ *               are not polled with message based polling.
+ *
+ * Arguments : m - Master.
+ *
+ * Return Value : The slave to poll.
+ *                NULL if there is none.
+ */
+static POLL_SLAVE *pick_slave(MASTER *m)
+{
+  unsigned int pass;
+  unsigned int i;
+  for (pass = 0; pass < 2; pass++) /* Rest of this scan, then a new one. */
+    {
+      while (m->scan_pos < m->num_slaves)
+	{
+	  POLL_SLAVE *s = m->slaves + m->scan_pos++;
+	  if (s->active) return s;
+	}
+      for (i = 0; (m->mode == POLL_STANDARD) && m->idle_left
+	     && (i < m->num_slaves); i++)
+	{
+	  POLL_SLAVE *s = m->slaves + m->idle_pos;
+	  if (++m->idle_pos >= m->num_slaves) m->idle_pos = 0;
+	  if (!s->active)
+	    {
+	      m->idle_left--;
+	      return s;
+	    }
+	}
+      m->scan_pos = 0;
+      m->idle_left = m->idle_polls;
+      m->scans++;
+    }
+  return NULL;
+}
+
+/*
+ * Description : Finds a slave on the poll list.
+ *
+ * Arguments : m - Master.
+ *             addr - Station address.
+ *
+ * Return Value : A pointer to the slave.
+ *                NULL if the station is not on the poll list.
+ */
+static POLL_SLAVE *find_slave(const MASTER *m, uint8_t addr)
+{
+  unsigned int i;
+  for (i = 0; i < m->num_slaves; i++)
+    if (m->slaves[i].addr == addr) return m->slaves + i;
+  return NULL;
+}
+
+/*
+ * Description : Makes a slave active, or extends the time it stays active.
+ *
+ * Arguments : m - Master.
+ *             s - Slave.
+ *
+ * Return Value : None.
+ */
+static void set_active(const MASTER *m, POLL_SLAVE *s)
+{
+  s->active = 1;
+  s->active_ticks = m->active_ticks ? m->active_ticks : 1;
+  return;
+}
+
+/*
+ * Description : Records the response time of the polled slave.
+ *
+ * Arguments : m - Master.
+ *
+ * Return Value : None.
+ */
+static void rsp_time(MASTER *m)
+{
+  struct timeval now;
+  long usec;
+  POLL_SLAVE *s = m->cur;
+  gettimeofday(&now, NULL);
+  usec = (now.tv_sec - m->sent.tv_sec) * 1000000L
+    + (now.tv_usec - m->sent.tv_usec);
+  if (!s->rsp_cnt || (usec < s->rsp_min)) s->rsp_min = usec;
+  if (usec > s->rsp_max) s->rsp_max = usec;
+  s->rsp_sum += usec;
+  s->rsp_cnt++;
+  return;
+}
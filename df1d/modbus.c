@@ -0,0 +1,1167 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Modbus TCP front end. Configured data file ranges of one controller are
+ * periodically read into a cache by an internal client, and Modbus read
+ * requests are answered from the cache without touching the link. Modbus
+ * write requests are queued and turned into protected typed logical writes.
+ */
+
+#include "df1.h"
+
+#define MB_LISTEN_BACKLOG 5
+#define MB_SESS_IN_SIZE 300 /* Larger than the largest Modbus TCP ADU. */
+#define MB_SESS_OUT_SIZE 2048
+#define MB_REPLY_TIMEOUT 3000 /* mS to wait for a reply from the controller. */
+#define MB_MAX_BYTES 236 /* Largest protected typed logical read. */
+#define MB_SESS_WRITES 8 /* Write requests one session may have queued. */
+#define MB_MAX_WRITES 32 /* Write requests queued for all sessions. */
+
+/*
+ * Modbus TCP ADU offsets.
+ */
+#define MB_HDR_LEN 7 /* MBAP header length. */
+#define MB_LEN 4 /* Length field, counts the unit identifier and PDU. */
+#define MB_PDU 7 /* Function code. */
+
+/*
+ * Modbus exception codes.
+ */
+#define MB_EXC_FUNC 0x01 /* Illegal function. */
+#define MB_EXC_ADDR 0x02 /* Illegal data address. */
+#define MB_EXC_VALUE 0x03 /* Illegal data value. */
+#define MB_EXC_FAIL 0x04 /* Server device failure. */
+#define MB_EXC_BUSY 0x06 /* Server device busy. */
+#define MB_EXC_NO_DATA 0x0b /* Gateway target device failed to respond. */
+
+static int mb_listen(CONN *conn, MODBUS *mb);
+static void mb_accept(CONN *conn, MODBUS *mb);
+static int read_sess(CONN *conn, MODBUS *mb, MB_SESS *sess);
+static int parse_request(CONN *conn, MODBUS *mb, MB_SESS *sess,
+			 const uint8_t *adu);
+static int queue_write(CONN *conn, MODBUS *mb, MB_SESS *sess,
+		       const uint8_t *adu, MB_MAP *map);
+static void start_next(CONN *conn, MODBUS *mb);
+static int send_write(CONN *conn, MODBUS *mb);
+static void send_read(CONN *conn, MODBUS *mb, MB_MAP *map);
+static void begin_cmd(MODBUS *mb, uint8_t func, const MB_MAP *map,
+		      uint16_t element, uint16_t elements);
+static void op_done(CONN *conn, MODBUS *mb, int ok);
+static void respond(CONN *conn, MB_SESS *sess, const uint8_t *adu,
+		    const uint8_t *pdu, size_t len);
+static void respond_exc(CONN *conn, MB_SESS *sess, const uint8_t *adu,
+			uint8_t exc);
+static MB_MAP *find_map(const MODBUS *mb, MB_TABLE_T table,
+			unsigned int start, unsigned int count);
+static unsigned int reg_offset(const MB_MAP *map, unsigned int reg);
+static uint16_t get_reg(const MB_MAP *map, unsigned int reg);
+static uint16_t get_be(const uint8_t *src);
+static int enc_addr(BUF *dst, uint16_t addr);
+static MB_SESS *close_sess(CONN *conn, MODBUS *mb, MB_SESS *sess);
+
+/*
+ * Description : Allocates a Modbus front end to be configured with
+ *               mb_add_map() and started with mb_start().
+ *
+ * Arguments : None.
+ *
+ * Return Value : A pointer to the new front end.
+ *                NULL if a memory allocation error occured.
+ */
+extern MODBUS *mb_new(void)
+{
+  MODBUS *mb = (MODBUS *)calloc(1, sizeof(MODBUS));
+  if (mb == NULL) return NULL;
+  mb->sock_fd = -1;
+  mb->scan_ticks = 1000 / (TICK_USEC / 1000);
+  return mb;
+}
+
+/*
+ * Description : Maps a range of data file elements to a Modbus table.
+ *               Integer and binary elements are one register or sixteen
+ *               bits each, floating point elements are two registers with
+ *               the high word first. Bit tables can only be mapped to
+ *               integer or binary files.
+ *
+ * Arguments : mb - Modbus front end.
+ *             table - Modbus table.
+ *             start - First Modbus register or bit number.
+ *             file_type - 'N', 'B' or 'F'.
+ *             file - File number.
+ *             element - First element number.
+ *             elements - Number of elements, at most 236 bytes worth.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the map is invalid, overlaps another map of the
+ *                same table, or a memory allocation error occured.
+ */
+extern int mb_add_map(MODBUS *mb, MB_TABLE_T table, uint16_t start,
+		      char file_type, uint16_t file, uint16_t element,
+		      uint16_t elements)
+{
+  MB_MAP *new;
+  MB_MAP *map;
+  uint8_t type;
+  uint8_t size;
+  unsigned int count;
+  int bits = (table == MB_COIL) || (table == MB_DISCRETE);
+  switch (file_type)
+    {
+    case 'N':
+      type = 0x89;
+      size = 2;
+      break;
+    case 'B':
+      type = 0x85;
+      size = 2;
+      break;
+    case 'F':
+      if (bits) return -1;
+      type = 0x8a;
+      size = 4;
+      break;
+    default:
+      return -1;
+    }
+  if (!elements || (elements * size > MB_MAX_BYTES)) return -1;
+  count = bits ? elements * 16 : elements * size / 2;
+  if (start + count > 0x10000) return -1;
+  for (map = mb->maps; map != NULL; map = map->next)
+    if ((map->table == table) && (start < map->start + map->count)
+	&& (map->start < start + count))
+      return -1;
+  new = (MB_MAP *)calloc(1, sizeof(MB_MAP));
+  if (new == NULL) return -1;
+  new->table = table;
+  new->start = start;
+  new->count = count;
+  new->type = type;
+  new->elem_size = size;
+  new->file = file;
+  new->element = element;
+  new->elements = elements;
+  if (mb->maps == NULL) mb->maps = new;
+  else
+    {
+      for (map = mb->maps; map->next != NULL; map = map->next);
+      map->next = new;
+    }
+  return 0;
+}
+
+/*
+ * Description : Starts a configured Modbus front end on a connection. The
+ *               front end is freed if it could not be started.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Configured front end.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+extern int mb_start(CONN *conn, MODBUS *mb)
+{
+  if (mb->maps == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] No Modbus maps configured.\n", __FILE__,
+	      __LINE__, conn->name);
+      mb_free(conn, mb);
+      return -1;
+    }
+  if (mb_listen(conn, mb))
+    {
+      mb_free(conn, mb);
+      return -1;
+    }
+  mb->client = client_new_internal(conn, mb->addr, "modbus");
+  if (mb->client == NULL)
+    {
+      mb_free(conn, mb);
+      return -1;
+    }
+  mb->scan_eticks = mb->scan_ticks; /* Fill the cache right away. */
+  conn->modbus = mb;
+  log_msg(LOG_INFO, "%s:%d [%s] Modbus TCP listening on port %u for node"
+	  " %u.\n", __FILE__, __LINE__, conn->name, mb->port, mb->node);
+  return 0;
+}
+
+/*
+ * Description : Adds the Modbus listening socket and session sockets to a
+ *               descriptor set.
+ *
+ * Arguments : conn - Connection pointer.
+ *             set - Descriptor set to populate.
+ *
+ * Return Value : The highest numbered descriptor added, zero if none.
+ */
+extern int mb_get_read_fds(const CONN *conn, fd_set *set)
+{
+  MB_SESS *sess;
+  int high;
+  if (conn->modbus == NULL) return 0;
+  FD_SET(conn->modbus->sock_fd, set);
+  high = conn->modbus->sock_fd;
+  for (sess = conn->modbus->sessions; sess != NULL; sess = sess->next)
+    {
+      FD_SET(sess->fd, set);
+      if (sess->fd > high) high = sess->fd;
+    }
+  return high;
+}
+
+/*
+ * Description : Adds Modbus sessions with responses waiting to be written
+ *               to a descriptor set.
+ *
+ * Arguments : conn - Connection pointer.
+ *             set - Descriptor set being tested for writability.
+ *
+ * Return Value : Non-zero if any session has data waiting to be written.
+ */
+extern int mb_get_write_fds(const CONN *conn, fd_set *set)
+{
+  MB_SESS *sess;
+  int write_pend = 0;
+  if (conn->modbus == NULL) return 0;
+  for (sess = conn->modbus->sessions; sess != NULL; sess = sess->next)
+    if (rbuf_len(sess->out))
+      {
+	FD_SET(sess->fd, set);
+	write_pend = 1;
+      }
+  return write_pend;
+}
+
+/*
+ * Description : Services the Modbus listening socket and sessions.
+ *
+ * Arguments : conn - Connection pointer.
+ *             read - Descriptors that are readable.
+ *             write - Descriptors that are writable, NULL if none.
+ *             cnt - Number of descriptors still needing service.
+ *
+ * Return Value : Zero if no sessions were opened or closed.
+ *                Non-zero if the set of sessions changed.
+ */
+extern int mb_service_fds(CONN *conn, const fd_set *read,
+			  const fd_set *write, int *cnt)
+{
+  MODBUS *mb = conn->modbus;
+  MB_SESS *sess;
+  int ret = 0;
+  if (mb == NULL) return 0;
+  for (sess = mb->sessions; (sess != NULL) && (*cnt > 0);)
+    {
+      if (FD_ISSET(sess->fd, read))
+	{
+	  (*cnt)--;
+	  if (read_sess(conn, mb, sess))
+	    {
+	      sess = close_sess(conn, mb, sess);
+	      ret = 1;
+	      continue;
+	    }
+	}
+      if ((write != NULL) && FD_ISSET(sess->fd, write))
+	{
+	  (*cnt)--;
+	  if (ring_buf_write(sess->fd, sess->out) < 0)
+	    {
+	      log_msg(LOG_ERR, "%s:%d [%s] Failed to write to Modbus"
+		      " session : %s\n", __FILE__, __LINE__, conn->name,
+		      strerror(errno));
+	      sess = close_sess(conn, mb, sess);
+	      ret = 1;
+	      continue;
+	    }
+	}
+      sess = sess->next;
+    }
+  if ((*cnt > 0) && FD_ISSET(mb->sock_fd, read))
+    {
+      (*cnt)--;
+      mb_accept(conn, mb);
+      ret = 1;
+    }
+  return ret;
+}
+
+/*
+ * Description : Adds a session for a connected socket, accepted or handed
+ *               over by a restarting df1d.
+ *
+ * Arguments : conn - Connection pointer.
+ *             fd - Session socket.
+ *
+ * Return Value : The new session.
+ *                NULL if the connection has no Modbus front end or memory
+ *                allocation failed; the socket is left open.
+ */
+extern MB_SESS *mb_adopt(CONN *conn, int fd)
+{
+  MODBUS *mb = conn->modbus;
+  MB_SESS *new;
+  if (mb == NULL) return NULL;
+  new = (MB_SESS *)calloc(1, sizeof(MB_SESS));
+  if ((new == NULL) || ((new->in = rbuf_new(MB_SESS_IN_SIZE)) == NULL)
+      || ((new->out = rbuf_new(MB_SESS_OUT_SIZE)) == NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error allocating memory for Modbus"
+	      " session : %s\n", __FILE__, __LINE__, conn->name,
+	      strerror(errno));
+      if (new != NULL)
+	{
+	  if (new->in != NULL) rbuf_free(new->in);
+	  free(new);
+	}
+      return NULL;
+    }
+  new->fd = fd;
+  new->next = mb->sessions;
+  mb->sessions = new;
+  return new;
+}
+
+/*
+ * Description : Accepts a message received for the Modbus internal client,
+ *               the reply to the outstanding command. The message is always
+ *               acknowledged.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void mb_msg_rx(CONN *conn)
+{
+  MODBUS *mb = conn->owner->modbus; /* Any link of a group may receive. */
+  BUF *app = conn->rx.app;
+  uint16_t tns;
+  if ((mb == NULL) || (app->len < 6))
+    {
+      rx_ack(conn);
+      return;
+    }
+  tns = app->data[4] | (app->data[5] << 8);
+  if ((mb->op == MB_OP_NONE) || (app->data[2] != 0x4f) || (tns != mb->tns)
+      || (app->data[1] != mb->node))
+    {
+      log_msg(LOG_DEBUG, "%s:%d [%s] Ignoring unexpected message for Modbus"
+	      " client.\n", __FILE__, __LINE__, conn->name);
+      rx_ack(conn);
+      return;
+    }
+  if (app->data[3])
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Modbus %s of file %u failed, status"
+	      " 0x%02x 0x%02x.\n", __FILE__, __LINE__, conn->name,
+	      (mb->op == MB_OP_SCAN) ? "read" : "write",
+	      (mb->op == MB_OP_SCAN) ? mb->scan->file : mb->writes->map->file,
+	      app->data[3], (app->len > 6) ? app->data[6] : 0);
+      rx_ack(conn);
+      op_done(conn, mb, 0);
+      return;
+    }
+  if (mb->op == MB_OP_SCAN)
+    {
+      size_t bytes = mb->scan->elements * mb->scan->elem_size;
+      if (app->len - 6 != bytes)
+	{
+	  log_msg(LOG_ERR, "%s:%d [%s] Modbus read returned %u bytes,"
+		  " expected %u.\n", __FILE__, __LINE__, conn->name,
+		  (unsigned int)(app->len - 6), (unsigned int)bytes);
+	  rx_ack(conn);
+	  op_done(conn, mb, 0);
+	  return;
+	}
+      memcpy(mb->scan->image, app->data + 6, bytes);
+    }
+  rx_ack(conn);
+  op_done(conn, mb, 1);
+  return;
+}
+
+/*
+ * Description : Notifies the Modbus front end of the result of transmitting
+ *               its internal client's message. A successful transmission
+ *               still waits for the reply.
+ *
+ * Arguments : conn - Connection pointer.
+ *             ok - Non-zero if the message was transmitted.
+ *
+ * Return Value : None.
+ */
+extern void mb_tx_done(CONN *conn, int ok)
+{
+  MODBUS *mb = conn->owner->modbus;
+  if ((mb != NULL) && !ok && (mb->op != MB_OP_NONE)) op_done(conn, mb, 0);
+  return;
+}
+
+/*
+ * Description : Modbus timer handler. Times out replies and starts the next
+ *               write or cache refresh. New commands are only started from
+ *               here, never directly from a transmitter or receiver
+ *               notification.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void mb_tick(CONN *conn)
+{
+  MODBUS *mb = conn->modbus;
+  if (mb == NULL) return;
+  if (mb->scan_eticks < mb->scan_ticks) mb->scan_eticks++;
+  if (mb->reply_ticks && !--mb->reply_ticks)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Timed out awaiting reply to Modbus %s.\n",
+	      __FILE__, __LINE__, conn->name,
+	      (mb->op == MB_OP_SCAN) ? "read" : "write");
+      op_done(conn, mb, 0);
+    }
+  if ((mb->op == MB_OP_NONE) && (mb->client->state == CLIENT_IDLE))
+    start_next(conn, mb);
+  return;
+}
+
+/*
+ * Description : Closes a Modbus front end's sockets and frees it. The
+ *               internal client is closed along with the connection's
+ *               other clients.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Front end to free, may be NULL.
+ *
+ * Return Value : None.
+ */
+extern void mb_free(CONN *conn, MODBUS *mb)
+{
+  if (mb == NULL) return;
+  while (mb->sessions != NULL) close_sess(conn, mb, mb->sessions);
+  if (mb->client != NULL) client_free_internal(conn, mb->client);
+  while (mb->writes != NULL)
+    {
+      MB_WRITE *next = mb->writes->next_write;
+      free(mb->writes);
+      mb->writes = next;
+    }
+  mb->writes_end = NULL;
+  mb->num_writes = 0;
+  while (mb->maps != NULL)
+    {
+      MB_MAP *next = mb->maps->next;
+      free(mb->maps);
+      mb->maps = next;
+    }
+  ring_forget(mb->sock_fd);
+  if ((mb->sock_fd >= 0) && close(mb->sock_fd))
+    log_msg(LOG_ERR, "%s:%d [%s] Error closing Modbus listening socket :"
+	    " %s\n", __FILE__, __LINE__, conn->name, strerror(errno));
+  if (conn->modbus == mb) conn->modbus = NULL;
+  free(mb);
+  return;
+}
+
+/*
+ * Description : Creates the Modbus listening socket.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *
+ * Return Value : Zero upon success.
+ *                Non-zero if an error occured.
+ */
+static int mb_listen(CONN *conn, MODBUS *mb)
+{
+  int flags = 1;
+  struct sockaddr_in addr;
+  mb->sock_fd = handoff_listen(conn->name, 1, mb->port);
+  if (mb->sock_fd >= 0) return 0; /* Still listening from before. */
+  mb->sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (mb->sock_fd < 0)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Modbus socket creation failed : %s\n",
+	      __FILE__, __LINE__, conn->name, strerror(errno));
+      return -1;
+    }
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(mb->port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (setsockopt(mb->sock_fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(int))
+      || (flags = fcntl(mb->sock_fd, F_GETFL, 0)) < 0
+      || fcntl(mb->sock_fd, F_SETFL, flags | O_NONBLOCK)
+      || bind(mb->sock_fd, (struct sockaddr *)&addr, sizeof(addr))
+      || listen(mb->sock_fd, MB_LISTEN_BACKLOG))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error setting up Modbus listening socket"
+	      " : %s\n", __FILE__, __LINE__, conn->name, strerror(errno));
+      close(mb->sock_fd);
+      mb->sock_fd = -1;
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Accepts a new Modbus TCP session.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *
+ * Return Value : None.
+ */
+static void mb_accept(CONN *conn, MODBUS *mb)
+{
+  int fd;
+  socklen_t addr_len;
+  struct sockaddr_in addr;
+  char addr_p[INET_ADDRSTRLEN];
+  addr_len = sizeof(addr);
+ again:
+  fd = accept(mb->sock_fd, (struct sockaddr *)&addr, &addr_len);
+  if (fd < 0)
+    {
+      if (errno == EINTR) goto again;
+      if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) return;
+      log_msg(LOG_ERR, "%s:%d [%s] Failed to accept Modbus connection : %s\n",
+	      __FILE__, __LINE__, conn->name, strerror(errno));
+      return;
+    }
+  if (mb_adopt(conn, fd) == NULL)
+    {
+      close(fd);
+      return;
+    }
+  inet_ntop(AF_INET, &addr.sin_addr, addr_p, INET_ADDRSTRLEN);
+  log_msg(LOG_INFO, "%s:%d [%s] Modbus client connected from %s.\n",
+	  __FILE__, __LINE__, conn->name, addr_p);
+  return;
+}
+
+/*
+ * Description : Reads from a Modbus session and handles every complete
+ *               request received.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *             sess - Session to read.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the session closed or sent an invalid frame.
+ */
+static int read_sess(CONN *conn, MODBUS *mb, MB_SESS *sess)
+{
+  ssize_t len;
+  size_t adu_len;
+  RBUF *in = sess->in;
+  len = ring_buf_read(sess->fd, in);
+  if (len <= 0)
+    {
+      if (len < 0)
+	log_msg(LOG_ERR, "%s:%d [%s] Failed to read from Modbus session :"
+		" %s\n", __FILE__, __LINE__, conn->name, strerror(errno));
+      else
+	log_msg(LOG_INFO, "%s:%d [%s] Modbus client disconnected.\n",
+		__FILE__, __LINE__, conn->name);
+      return -1;
+    }
+  /*
+   * Requests may be pipelined and split across reads, so handle every
+   * complete ADU and keep any remainder for the next read. An ADU is only
+   * moved if it wraps around the end of the buffer.
+   */
+  while (rbuf_len(in) >= MB_HDR_LEN)
+    {
+      size_t span;
+      const uint8_t *adu = rbuf_peek(in, &span);
+      uint16_t mbap_len;
+      if (span < MB_HDR_LEN) adu = rbuf_linearize(in);
+      mbap_len = get_be(adu + MB_LEN);
+      if ((get_be(adu + 2) != 0) || (mbap_len < 2) || (mbap_len > 254))
+	{
+	  log_msg(LOG_ERR, "%s:%d [%s] Invalid Modbus TCP frame received.\n",
+		  __FILE__, __LINE__, conn->name);
+	  return -1;
+	}
+      adu_len = MB_LEN + 2 + mbap_len;
+      if (rbuf_len(in) < adu_len) break;
+      if (span < adu_len) adu = rbuf_linearize(in);
+      if (parse_request(conn, mb, sess, adu)) return -1;
+      rbuf_consume(in, adu_len);
+    }
+  return 0;
+}
+
+/*
+ * Description : Handles one Modbus request. Reads are answered from the
+ *               cache, writes are queued for the link.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *             sess - Requesting session.
+ *             adu - Complete request, starting with the MBAP header.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if a memory allocation error occured.
+ */
+static int parse_request(CONN *conn, MODBUS *mb, MB_SESS *sess,
+			 const uint8_t *adu)
+{
+  const uint8_t *pdu = adu + MB_PDU;
+  size_t pdu_len = get_be(adu + MB_LEN) - 1;
+  uint8_t rsp[MB_MAX_BYTES + 16];
+  unsigned int start, qty, max_qty, i;
+  MB_TABLE_T table;
+  MB_MAP *map;
+  if (pdu_len < 5)
+    {
+      respond_exc(conn, sess, adu, (pdu_len && (pdu[0] > 0 && pdu[0] < 17))
+		  ? MB_EXC_VALUE : MB_EXC_FUNC);
+      return 0;
+    }
+  start = get_be(pdu + 1);
+  qty = get_be(pdu + 3);
+  switch (pdu[0])
+    {
+    case 0x01: /* Read coils. */
+    case 0x02: /* Read discrete inputs. */
+    case 0x03: /* Read holding registers. */
+    case 0x04: /* Read input registers. */
+      table = (pdu[0] == 0x01) ? MB_COIL : (pdu[0] == 0x02) ? MB_DISCRETE
+	: (pdu[0] == 0x03) ? MB_HOLDING : MB_INPUT;
+      max_qty = (pdu[0] <= 0x02) ? 2000 : 125;
+      if (!qty || (qty > max_qty))
+	{
+	  respond_exc(conn, sess, adu, MB_EXC_VALUE);
+	  return 0;
+	}
+      map = find_map(mb, table, start, qty);
+      if (map == NULL)
+	{
+	  respond_exc(conn, sess, adu, MB_EXC_ADDR);
+	  return 0;
+	}
+      if (!map->valid)
+	{
+	  respond_exc(conn, sess, adu, MB_EXC_NO_DATA);
+	  return 0;
+	}
+      start -= map->start;
+      rsp[0] = pdu[0];
+      if (pdu[0] <= 0x02)
+	{
+	  rsp[1] = (qty + 7) / 8;
+	  memset(rsp + 2, 0, rsp[1]);
+	  for (i = 0; i < qty; i++)
+	    if ((get_reg(map, (start + i) / 16) >> ((start + i) % 16)) & 1)
+	      rsp[2 + i / 8] |= 1 << (i % 8);
+	}
+      else
+	{
+	  rsp[1] = qty * 2;
+	  for (i = 0; i < qty; i++)
+	    {
+	      uint16_t reg = get_reg(map, start + i);
+	      rsp[2 + i * 2] = reg >> 8;
+	      rsp[3 + i * 2] = reg & 0xff;
+	    }
+	}
+      respond(conn, sess, adu, rsp, 2 + rsp[1]);
+      return 0;
+    case 0x05: /* Write single coil. */
+      if ((qty != 0xff00) && qty)
+	{
+	  respond_exc(conn, sess, adu, MB_EXC_VALUE);
+	  return 0;
+	}
+      qty = 1;
+      table = MB_COIL;
+      break;
+    case 0x06: /* Write single register. */
+      qty = 1;
+      table = MB_HOLDING;
+      break;
+    case 0x0f: /* Write multiple coils. */
+      if (!qty || (qty > 1968) || (pdu_len < 6) || (pdu[5] != (qty + 7) / 8)
+	  || (pdu_len != 6 + pdu[5]))
+	{
+	  respond_exc(conn, sess, adu, MB_EXC_VALUE);
+	  return 0;
+	}
+      table = MB_COIL;
+      break;
+    case 0x10: /* Write multiple registers. */
+      if (!qty || (qty > 123) || (pdu_len < 6) || (pdu[5] != qty * 2)
+	  || (pdu_len != 6 + pdu[5]))
+	{
+	  respond_exc(conn, sess, adu, MB_EXC_VALUE);
+	  return 0;
+	}
+      table = MB_HOLDING;
+      break;
+    default:
+      respond_exc(conn, sess, adu, MB_EXC_FUNC);
+      return 0;
+    }
+  map = find_map(mb, table, start, qty);
+  if (map == NULL)
+    {
+      respond_exc(conn, sess, adu, MB_EXC_ADDR);
+      return 0;
+    }
+  /*
+   * Writing part of a floating point element needs the other half from the
+   * cache.
+   */
+  if ((map->elem_size == 4) && !map->valid
+      && (((start - map->start) & 1) || (qty & 1)))
+    {
+      respond_exc(conn, sess, adu, MB_EXC_NO_DATA);
+      return 0;
+    }
+  return queue_write(conn, mb, sess, adu, map);
+}
+
+/*
+ * Description : Appends a write request to the write queue. Requests beyond
+ *               the session's or the queue's limit are answered with a busy
+ *               exception so a flood of writes cannot exhaust memory.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *             sess - Requesting session.
+ *             adu - Complete request.
+ *             map - Map containing the written range.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if a memory allocation error occured.
+ */
+static int queue_write(CONN *conn, MODBUS *mb, MB_SESS *sess,
+		       const uint8_t *adu, MB_MAP *map)
+{
+  MB_WRITE *new;
+  if ((sess->writes >= MB_SESS_WRITES) || (mb->num_writes >= MB_MAX_WRITES))
+    {
+      log_msg(LOG_DEBUG, "%s:%d [%s] Modbus write refused because the %s"
+	      " write queue is full.\n", __FILE__, __LINE__, conn->name,
+	      (sess->writes >= MB_SESS_WRITES) ? "session" : "shared");
+      respond_exc(conn, sess, adu, MB_EXC_BUSY);
+      return 0;
+    }
+  new = (MB_WRITE *)calloc(1, sizeof(MB_WRITE));
+  if (new == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error allocating memory for Modbus write"
+	      " : %s\n", __FILE__, __LINE__, conn->name, strerror(errno));
+      return -1;
+    }
+  new->sess = sess;
+  new->map = map;
+  memcpy(new->adu, adu, MB_LEN + 2 + get_be(adu + MB_LEN));
+  if (mb->writes == NULL) mb->writes = new;
+  else mb->writes_end->next_write = new;
+  mb->writes_end = new;
+  mb->num_writes++;
+  sess->writes++;
+  return 0;
+}
+
+/*
+ * Description : Starts the next command of the internal client. Queued
+ *               writes take priority over cache refreshes, but while a
+ *               refresh is in progress writes and reads alternate so a
+ *               steady stream of writes cannot stall the cache.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *
+ * Return Value : None.
+ */
+static void start_next(CONN *conn, MODBUS *mb)
+{
+  if ((mb->scan == NULL) && (mb->scan_eticks >= mb->scan_ticks))
+    {
+      mb->scan = mb->maps;
+      mb->scan_eticks = 0;
+    }
+  if ((mb->writes != NULL) && ((mb->scan == NULL) || !mb->wrote)
+      && send_write(conn, mb))
+    {
+      mb->wrote = 1;
+      return;
+    }
+  mb->wrote = 0;
+  if (mb->scan != NULL) send_read(conn, mb, mb->scan);
+  return;
+}
+
+/*
+ * Description : Sends the next command of the oldest queued write request.
+ *               Register writes are sent as one protected typed logical
+ *               write. Coil writes are sent as one masked write per word so
+ *               other bits in the word are left alone.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *
+ * Return Value : Non-zero if a command was sent.
+ */
+static int send_write(CONN *conn, MODBUS *mb)
+{
+  MB_WRITE *w = mb->writes;
+  MB_MAP *map = w->map;
+  const uint8_t *pdu = w->adu + MB_PDU;
+  unsigned int start = get_be(pdu + 1) - map->start;
+  unsigned int qty = ((pdu[0] == 0x05) || (pdu[0] == 0x06)) ? 1
+    : get_be(pdu + 3);
+  unsigned int i;
+  int overflow = 0;
+  if ((pdu[0] == 0x05) || (pdu[0] == 0x0f))
+    {
+      unsigned int word = (start + w->next) / 16;
+      uint16_t data = 0;
+      mb->wr_mask = 0;
+      for (; (w->next < qty) && ((start + w->next) / 16 == word); w->next++)
+	{
+	  int bit = (pdu[0] == 0x05) ? (pdu[3] == 0xff)
+	    : (pdu[6 + w->next / 8] >> (w->next % 8)) & 1;
+	  mb->wr_mask |= 1 << ((start + w->next) % 16);
+	  if (bit) data |= 1 << ((start + w->next) % 16);
+	}
+      mb->wr_elem = map->element + word;
+      mb->wr_count = 1;
+      mb->wr_data[0] = data & 0xff;
+      mb->wr_data[1] = data >> 8;
+      begin_cmd(mb, 0xab, map, mb->wr_elem, 1);
+      overflow |= buf_append_word(mb->client->df1_tx, htols(mb->wr_mask));
+    }
+  else
+    {
+      unsigned int first = start / (map->elem_size / 2);
+      unsigned int last = (start + qty - 1) / (map->elem_size / 2);
+      mb->wr_elem = map->element + first;
+      mb->wr_count = last - first + 1;
+      mb->wr_mask = 0;
+      memcpy(mb->wr_data, map->image + first * map->elem_size,
+	     mb->wr_count * map->elem_size);
+      for (i = 0; i < qty; i++)
+	{
+	  uint16_t reg = (pdu[0] == 0x06) ? get_be(pdu + 3)
+	    : get_be(pdu + 6 + i * 2);
+	  unsigned int off = reg_offset(map, start + i)
+	    - first * map->elem_size;
+	  mb->wr_data[off] = reg & 0xff;
+	  mb->wr_data[off + 1] = reg >> 8;
+	}
+      w->next = qty;
+      begin_cmd(mb, 0xaa, map, mb->wr_elem, mb->wr_count);
+    }
+  overflow |= buf_append_blob(mb->client->df1_tx, mb->wr_data,
+			      mb->wr_count * map->elem_size);
+  if (overflow)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Modbus write command overflowed.\n",
+	      __FILE__, __LINE__, conn->name);
+      buf_empty(mb->client->df1_tx);
+      mb->op = MB_OP_WRITE;
+      op_done(conn, mb, 0);
+      return 0;
+    }
+  mb->op = MB_OP_WRITE;
+  mb->reply_ticks = MB_REPLY_TIMEOUT / (TICK_USEC / 1000);
+  client_internal_tx(conn, mb->client);
+  return 1;
+}
+
+/*
+ * Description : Sends a read of a map to refresh its cache.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *             map - Map to read.
+ *
+ * Return Value : None.
+ */
+static void send_read(CONN *conn, MODBUS *mb, MB_MAP *map)
+{
+  begin_cmd(mb, 0xa2, map, map->element, map->elements);
+  mb->op = MB_OP_SCAN;
+  mb->reply_ticks = MB_REPLY_TIMEOUT / (TICK_USEC / 1000);
+  client_internal_tx(conn, mb->client);
+  return;
+}
+
+/*
+ * Description : Starts a protected typed logical read or write command with
+ *               three address fields in the internal client's buffer.
+ *
+ * Arguments : mb - Modbus front end.
+ *             func - Function code.
+ *             map - Map being read or written.
+ *             element - First element.
+ *             elements - Number of elements.
+ *
+ * Return Value : None.
+ */
+static void begin_cmd(MODBUS *mb, uint8_t func, const MB_MAP *map,
+		      uint16_t element, uint16_t elements)
+{
+  BUF *msg = mb->client->df1_tx;
+  buf_empty(msg);
+  mb->tns++;
+  buf_append_byte(msg, mb->node);
+  buf_append_byte(msg, mb->addr);
+  buf_append_byte(msg, 0x0f);
+  buf_append_byte(msg, 0); /* STS */
+  buf_append_word(msg, htols(mb->tns));
+  buf_append_byte(msg, func);
+  buf_append_byte(msg, elements * map->elem_size);
+  enc_addr(msg, map->file);
+  buf_append_byte(msg, map->type);
+  enc_addr(msg, element);
+  enc_addr(msg, 0); /* Subelement. */
+  return;
+}
+
+/*
+ * Description : Completes the internal client's outstanding command.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *             ok - Non-zero if the command succeeded.
+ *
+ * Return Value : None.
+ */
+static void op_done(CONN *conn, MODBUS *mb, int ok)
+{
+  MB_OP_T op = mb->op;
+  mb->op = MB_OP_NONE;
+  mb->reply_ticks = 0;
+  if (op == MB_OP_SCAN)
+    {
+      /*
+       * Stale data is never served; requests get an exception until the
+       * next successful read.
+       */
+      mb->scan->valid = ok ? 1 : 0;
+      mb->scan = mb->scan->next;
+    }
+  else if (op == MB_OP_WRITE)
+    {
+      MB_WRITE *w = mb->writes;
+      const uint8_t *pdu = w->adu + MB_PDU;
+      unsigned int qty = ((pdu[0] == 0x05) || (pdu[0] == 0x06)) ? 1
+	: get_be(pdu + 3);
+      if (ok)
+	{
+	  /*
+	   * Keep the cache consistent with what was written until the next
+	   * refresh.
+	   */
+	  uint8_t *dst = w->map->image
+	    + (mb->wr_elem - w->map->element) * w->map->elem_size;
+	  if (mb->wr_mask)
+	    {
+	      uint16_t word = (dst[0] | (dst[1] << 8)) & ~mb->wr_mask;
+	      word |= (mb->wr_data[0] | (mb->wr_data[1] << 8)) & mb->wr_mask;
+	      dst[0] = word & 0xff;
+	      dst[1] = word >> 8;
+	    }
+	  else memcpy(dst, mb->wr_data, mb->wr_count * w->map->elem_size);
+	  if (w->next < qty) return; /* More words of a coil write to go. */
+	  if (w->sess != NULL) respond(conn, w->sess, w->adu, pdu, 5);
+	}
+      else if (w->sess != NULL) respond_exc(conn, w->sess, w->adu,
+					    MB_EXC_FAIL);
+      mb->writes = w->next_write;
+      if (mb->writes == NULL) mb->writes_end = NULL;
+      mb->num_writes--;
+      if (w->sess != NULL) w->sess->writes--;
+      free(w);
+    }
+  return;
+}
+
+/*
+ * Description : Queues a Modbus response to a session.
+ *
+ * Arguments : conn - Connection pointer.
+ *             sess - Target session.
+ *             adu - Request being answered.
+ *             pdu - Response PDU.
+ *             len - Length of the response PDU.
+ *
+ * Return Value : None.
+ */
+static void respond(CONN *conn, MB_SESS *sess, const uint8_t *adu,
+		    const uint8_t *pdu, size_t len)
+{
+  uint8_t hdr[MB_HDR_LEN];
+  memcpy(hdr, adu, MB_HDR_LEN); /* Transaction, protocol and unit. */
+  hdr[MB_LEN] = (len + 1) >> 8;
+  hdr[MB_LEN + 1] = (len + 1) & 0xff;
+  if ((MB_HDR_LEN + len > rbuf_room(sess->out))
+      || rbuf_put(sess->out, hdr, MB_HDR_LEN)
+      || rbuf_put(sess->out, pdu, len))
+    log_msg(LOG_ERR, "%s:%d [%s] Modbus response dropped because session"
+	    " buffer full.\n", __FILE__, __LINE__, conn->name);
+  return;
+}
+
+/*
+ * Description : Queues a Modbus exception response to a session.
+ *
+ * Arguments : conn - Connection pointer.
+ *             sess - Target session.
+ *             adu - Request being answered.
+ *             exc - Exception code.
+ *
+ * Return Value : None.
+ */
+static void respond_exc(CONN *conn, MB_SESS *sess, const uint8_t *adu,
+			uint8_t exc)
+{
+  uint8_t pdu[2];
+  pdu[0] = adu[MB_PDU] | 0x80;
+  pdu[1] = exc;
+  respond(conn, sess, adu, pdu, 2);
+  return;
+}
+
+/*
+ * Description : Finds the map of a table containing a whole range.
+ *
+ * Arguments : mb - Modbus front end.
+ *             table - Modbus table.
+ *             start - First register or bit.
+ *             count - Number of registers or bits.
+ *
+ * Return Value : A pointer to the map.
+ *                NULL if no single map contains the range.
+ */
+static MB_MAP *find_map(const MODBUS *mb, MB_TABLE_T table,
+			unsigned int start, unsigned int count)
+{
+  MB_MAP *map;
+  for (map = mb->maps; map != NULL; map = map->next)
+    if ((map->table == table) && (start >= map->start)
+	&& (start + count <= map->start + map->count))
+      break;
+  return map;
+}
+
+/*
+ * Description : Calculates the offset of a register in a map's image.
+ *               Floating point elements are presented high word first.
+ *
+ * Arguments : map - Map.
+ *             reg - Register number relative to the start of the map.
+ *
+ * Return Value : Byte offset of the register's low byte.
+ */
+static unsigned int reg_offset(const MB_MAP *map, unsigned int reg)
+{
+  if (map->elem_size == 4) return (reg / 2) * 4 + ((reg & 1) ? 0 : 2);
+  return reg * 2;
+}
+
+/*
+ * Description : Retrieves a register from a map's image.
+ *
+ * Arguments : map - Map.
+ *             reg - Register number relative to the start of the map.
+ *
+ * Return Value : Register value.
+ */
+static uint16_t get_reg(const MB_MAP *map, unsigned int reg)
+{
+  unsigned int off = reg_offset(map, reg);
+  return map->image[off] | (map->image[off + 1] << 8);
+}
+
+/*
+ * Description : Reads a big endian 16 bit value as used by Modbus.
+ *
+ * Arguments : src - Location of the value.
+ *
+ * Return Value : The value.
+ */
+static uint16_t get_be(const uint8_t *src)
+{
+  return (src[0] << 8) | src[1];
+}
+
+/*
+ * Description : Encodes a PCCC address field, values over 254 being
+ *               expanded to three bytes.
+ *
+ * Arguments : dst - Target buffer.
+ *             addr - Address field value.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the buffer would overflow.
+ */
+static int enc_addr(BUF *dst, uint16_t addr)
+{
+  if (addr > 254)
+    return buf_append_byte(dst, 0xff) || buf_append_word(dst, htols(addr));
+  return buf_append_byte(dst, addr);
+}
+
+/*
+ * Description : Closes a Modbus session. Queued writes from the session are
+ *               still carried out, but not answered.
+ *
+ * Arguments : conn - Connection pointer.
+ *             mb - Modbus front end.
+ *             sess - Session to close.
+ *
+ * Return Value : A pointer to the next session in the list.
+ */
+static MB_SESS *close_sess(CONN *conn, MODBUS *mb, MB_SESS *sess)
+{
+  MB_SESS *next = sess->next;
+  MB_WRITE *w;
+  for (w = mb->writes; w != NULL; w = w->next_write)
+    if (w->sess == sess) w->sess = NULL;
+  if (mb->sessions == sess) mb->sessions = next;
+  else
+    {
+      MB_SESS *prev;
+      for (prev = mb->sessions; prev->next != sess; prev = prev->next);
+      prev->next = next;
+    }
+  ring_forget(sess->fd);
+  if (close(sess->fd))
+    log_msg(LOG_ERR, "%s:%d [%s] Error closing Modbus session : %s\n",
+	    __FILE__, __LINE__, conn->name, strerror(errno));
+  rbuf_free(sess->in);
+  rbuf_free(sess->out);
+  free(sess);
+  return next;
+}
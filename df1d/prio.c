@@ -0,0 +1,199 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Content based message priority.
+ *
+ * With a 'message_priority' element in the configuration, every message a
+ * client queues for the link is classified by the first rule matching its
+ * command, function code, destination node and data file number. The
+ * transmitter serves the highest class first. A message left waiting rises
+ * one class for every aging period it has waited, so bulk traffic is delayed
+ * behind control traffic but never starved. Without rules every message is
+ * class zero and is served as before.
+ */
+
+#include "df1.h"
+
+#define PRIO_ANY -1 /* Rule field matching any value. */
+
+typedef struct _prio_rule /* Classification rule. */
+{
+  unsigned int cls; /* Class given to matching messages. */
+  int cmd; /* Command byte, PRIO_ANY for any. */
+  int fnc; /* Function code, PRIO_ANY for any. */
+  int dst; /* Destination node, PRIO_ANY for any. */
+  long file; /* Data file number, PRIO_ANY for any. */
+  struct _prio_rule *next;
+} PRIO_RULE;
+
+static PRIO_RULE *rules; /* Rules in configuration order. */
+static PRIO_RULE **rules_end = &rules; /* Where the next rule is linked. */
+static unsigned int aging_ticks = PRIO_AGING_DEF; /* Wait per class raised. */
+
+/*
+ * Description : Discards all rules and restores the default aging period,
+ *               before the configuration is read.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void prio_clear(void)
+{
+  PRIO_RULE *rule;
+  while (rules != NULL)
+    {
+      rule = rules;
+      rules = rule->next;
+      free(rule);
+    }
+  rules_end = &rules;
+  aging_ticks = PRIO_AGING_DEF;
+  return;
+}
+
+/*
+ * Description : Appends a classification rule. Rules are tried in the order
+ *               added and the first match decides the class.
+ *
+ * Arguments : cls - Class given to matching messages, up to PRIO_MAX.
+ *             cmd - Command byte to match, -1 for any.
+ *             fnc - Function code to match, -1 for any.
+ *             dst - Destination node to match, -1 for any.
+ *             file - Data file number to match, -1 for any.
+ *
+ * Return Value : Zero if the rule was added.
+ *                Non-zero if memory could not be allocated.
+ */
+extern int prio_add_rule(unsigned int cls, int cmd, int fnc, int dst,
+			 long file)
+{
+  PRIO_RULE *rule = (PRIO_RULE *)malloc(sizeof(PRIO_RULE));
+  if (rule == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d Error allocating memory for priority rule :"
+	      " %s\n", __FILE__, __LINE__, strerror(errno));
+      return -1;
+    }
+  rule->cls = cls;
+  rule->cmd = cmd;
+  rule->fnc = fnc;
+  rule->dst = dst;
+  rule->file = file;
+  rule->next = NULL;
+  *rules_end = rule;
+  rules_end = &rule->next;
+  return 0;
+}
+
+/*
+ * Description : Sets the time a waiting message spends in each class before
+ *               rising to the next.
+ *
+ * Arguments : ticks - Aging period in timer ticks, zero to disable aging.
+ *
+ * Return Value : None.
+ */
+extern void prio_set_aging(unsigned int ticks)
+{
+  aging_ticks = ticks;
+  return;
+}
+
+/*
+ * Description : Classifies an application layer message.
+ *
+ * Arguments : msg - Message as received from the client, starting with the
+ *                   destination node.
+ *
+ * Return Value : Class of the first matching rule, zero if none match.
+ */
+extern unsigned int prio_class(const BUF *msg)
+{
+  const PRIO_RULE *rule;
+  long file = PRIO_ANY - 1; /* Not yet decoded. */
+  if (msg->len < 4) return 0;
+  for (rule = rules; rule != NULL; rule = rule->next)
+    {
+      if ((rule->dst != PRIO_ANY) && (rule->dst != msg->data[0])) continue;
+      if ((rule->cmd != PRIO_ANY) && (rule->cmd != msg->data[2])) continue;
+      if ((rule->fnc != PRIO_ANY)
+	  && ((msg->len < 7) || (rule->fnc != msg->data[6])))
+	continue;
+      if (rule->file != PRIO_ANY)
+	{
+	  if (file == PRIO_ANY - 1) file = data_file_num(msg);
+	  if (rule->file != file) continue;
+	}
+      return rule->cls;
+    }
+  return 0;
+}
+
+/*
+ * Description : Computes the class a waiting message is currently served
+ *               at, its own class raised by the time it has waited.
+ *
+ * Arguments : client - Client with a message ready.
+ *
+ * Return Value : Effective class.
+ */
+extern unsigned int prio_rank(const CLIENT *client)
+{
+  unsigned int rank = client->prio;
+  if (aging_ticks) rank += client->prio_wait / aging_ticks;
+  return (rank > PRIO_MAX) ? PRIO_MAX : rank;
+}
+
+/*
+ * Description : Finds the data file number addressed by a typed logical read
+ *               or write command.
+ *
+ * Arguments : msg - Application layer message.
+ *
+ * Return Value : The file number.
+ *                -1 if the command does not address a data file.
+ */
+extern long data_file_num(const BUF *msg)
+{
+  if ((msg->len < 9) || (msg->data[2] != 0x0f)) return PRIO_ANY;
+  switch (msg->data[6])
+    {
+    case 0xa1: /* Protected typed logical read, two address fields. */
+    case 0xa2: /* Protected typed logical read, three address fields. */
+    case 0xa9: /* Protected typed logical write, two address fields. */
+    case 0xaa: /* Protected typed logical write, three address fields. */
+    case 0xab: /* Protected typed logical masked write. */
+      /*
+       * Byte size, then the file number; 0xff introduces a two byte number.
+       */
+      if (msg->data[8] != 0xff) return msg->data[8];
+      if (msg->len < 11) return PRIO_ANY;
+      return msg->data[9] | (msg->data[10] << 8);
+    default:
+      return PRIO_ANY;
+    }
+}
@@ -0,0 +1,807 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * io_uring I/O backend, an alternative to pselect() selected with -u.
+ *
+ * The rest of df1d still sees descriptor sets: ring_wait() takes the sets
+ * the main loop would pass to pselect() and returns those ready. A read is
+ * kept outstanding on every descriptor in the read set, into a buffer owned
+ * here, and a descriptor is ready once its read has completed; ring_read()
+ * then hands over the data instead of calling read(). Listening sockets get
+ * a poll instead, as accept() is still done by the caller. Writes are
+ * copied here and queued by ring_write(), so a descriptor is writable
+ * whenever it has no write in flight. The timer tick is an absolute timeout
+ * request rather than SIGALRM.
+ *
+ * Queued requests go to the kernel with the io_uring_enter() that waits for
+ * the next completion, so a busy loop makes one system call per pass in
+ * place of pselect() plus a read() or write() per descriptor.
+ */
+
+#include "df1.h"
+#include <sys/syscall.h>
+
+#ifdef __NR_io_uring_setup
+
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+
+#define RING_ENTRIES 256 /* Submission queue size. */
+#define RING_BUF_SIZE 2048 /* Read and write buffer size per descriptor. */
+
+/*
+ * Request user data. Descriptor requests carry the address of the RING_FD
+ * plus the request type; the low bits of an address are always clear.
+ */
+#define RING_UD_TICK 0 /* Tick timeout. */
+#define RING_UD_IGNORE 4 /* Cancellations, completion is of no interest. */
+#define RING_OP_READ 1
+#define RING_OP_WRITE 2
+#define RING_OP_MASK 3
+
+typedef struct _ring_fd /* I/O state of one descriptor. */
+{
+  int fd; /* Descriptor, -1 once forgotten. */
+  unsigned listen : 1; /* Set for a listening socket, polled not read. */
+  unsigned rd_busy : 1; /* Set while a read or poll is outstanding. */
+  unsigned rd_done : 1; /* Set if a completed read awaits ring_read(). */
+  unsigned wr_busy : 1; /* Set while a write is outstanding. */
+  int rd_res; /* Result of the completed read. */
+  size_t rd_off; /* Bytes of the completed read already handed over. */
+  int wr_err; /* Error of the last write, zero if none. */
+  size_t wr_off; /* Start of data not yet written. */
+  size_t wr_len; /* End of data queued for writing. */
+  uint8_t rd_buf[RING_BUF_SIZE];
+  uint8_t wr_buf[RING_BUF_SIZE];
+} RING_FD;
+
+static int submit(unsigned int min_complete, const sigset_t *mask);
+static struct io_uring_sqe *get_sqe(void);
+static void arm_read(RING_FD *rfd);
+static void arm_write(RING_FD *rfd);
+static void arm_tick(void);
+static void cancel(RING_FD *rfd, unsigned int op);
+static int reap(volatile int *tick);
+static RING_FD *get_fd(int fd);
+static int fd_ready(const RING_FD *rfd);
+
+static int ring_fd = -1; /* io_uring instance, -1 if not in use. */
+static unsigned int *sq_head;
+static unsigned int *sq_tail;
+static unsigned int *sq_mask;
+static unsigned int *sq_array;
+static unsigned int *cq_head;
+static unsigned int *cq_tail;
+static unsigned int *cq_mask;
+static struct io_uring_cqe *cqes;
+static struct io_uring_sqe *sqes;
+static unsigned int sq_entries; /* Submission queue size granted. */
+static size_t sqes_len; /* Mapped length of sqes. */
+static void *sq_ring; /* Mapped rings, for ring_stop(). */
+static size_t sq_ring_len;
+static void *cq_ring;
+static size_t cq_ring_len;
+static unsigned int queued; /* Requests queued but not yet submitted. */
+static RING_FD **fds; /* Descriptor state, indexed by descriptor. */
+static int num_fds; /* Length of fds. */
+static struct __kernel_timespec tick_at; /* Next tick, CLOCK_MONOTONIC. */
+static int tick_armed; /* Non-zero while the tick timeout is outstanding. */
+
+/*
+ * Description : Creates the io_uring instance and switches I/O to it.
+ *
+ * Arguments : None.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if io_uring is unavailable; pselect() is used.
+ */
+extern int ring_start(void)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  ring_fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+  if (ring_fd < 0)
+    {
+      log_msg(LOG_ERR, "%s:%d io_uring unavailable, using pselect() : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      ring_fd = -1;
+      return -1;
+    }
+  sq_entries = p.sq_entries;
+  sqes_len = sq_entries * sizeof(struct io_uring_sqe);
+  sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (cq_ring_len > sq_ring_len) sq_ring_len = cq_ring_len;
+      cq_ring_len = 0;
+    }
+  sq_ring = mmap(NULL, sq_ring_len, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  cq_ring = (sq_ring == MAP_FAILED) || !cq_ring_len ? sq_ring
+    : mmap(NULL, cq_ring_len, PROT_READ | PROT_WRITE,
+	   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+  sqes = (cq_ring == MAP_FAILED) ? MAP_FAILED
+    : mmap(NULL, sqes_len, PROT_READ | PROT_WRITE,
+	   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    {
+      log_msg(LOG_ERR, "%s:%d Failed to map io_uring, using pselect() : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      if ((cq_ring != MAP_FAILED) && cq_ring_len) munmap(cq_ring, cq_ring_len);
+      if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_len);
+      close(ring_fd);
+      ring_fd = -1;
+      return -1;
+    }
+  sq_head = (unsigned int *)((char *)sq_ring + p.sq_off.head);
+  sq_tail = (unsigned int *)((char *)sq_ring + p.sq_off.tail);
+  sq_mask = (unsigned int *)((char *)sq_ring + p.sq_off.ring_mask);
+  sq_array = (unsigned int *)((char *)sq_ring + p.sq_off.array);
+  cq_head = (unsigned int *)((char *)cq_ring + p.cq_off.head);
+  cq_tail = (unsigned int *)((char *)cq_ring + p.cq_off.tail);
+  cq_mask = (unsigned int *)((char *)cq_ring + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)((char *)cq_ring + p.cq_off.cqes);
+  log_msg(LOG_INFO, "%s:%d Using io_uring I/O backend.\n", __FILE__,
+	  __LINE__);
+  return 0;
+}
+
+/*
+ * Description : Checks if the io_uring backend is in use.
+ *
+ * Arguments : None.
+ *
+ * Return Value : Non-zero if I/O goes through io_uring.
+ */
+extern int ring_active(void)
+{
+  return ring_fd >= 0;
+}
+
+/*
+ * Description : Waits for descriptors to become ready, the io_uring
+ *               counterpart of pselect(). Also counts timer ticks.
+ *
+ * Arguments : nfds - One more than the highest descriptor in the sets.
+ *             read - Descriptors to test for reading, replaced by those
+ *                    readable.
+ *             write - Descriptors to test for writing, replaced by those
+ *                     writable. NULL if none.
+ *             mask - Signal mask while waiting.
+ *             tick - Set when a timer tick has elapsed.
+ *
+ * Return Value : The number of ready descriptors, zero if only a tick
+ *                elapsed. -1 with errno set if interrupted or failed.
+ */
+extern int ring_wait(int nfds, fd_set *read, fd_set *write,
+		     const sigset_t *mask, volatile int *tick)
+{
+  fd_set rd_in = *read;
+  fd_set wr_in;
+  int fd;
+  int cnt;
+  if (write != NULL) wr_in = *write;
+  for (fd = 0; fd < nfds; fd++)
+    {
+      RING_FD *rfd;
+      if (!FD_ISSET(fd, &rd_in) && ((write == NULL) || !FD_ISSET(fd, &wr_in)))
+	continue;
+      if ((rfd = get_fd(fd)) == NULL) return -1;
+      if (FD_ISSET(fd, &rd_in) && !rfd->rd_busy && !rfd->rd_done)
+	arm_read(rfd);
+    }
+  if (!tick_armed) arm_tick();
+  for (;;)
+    {
+      FD_ZERO(read);
+      if (write != NULL) FD_ZERO(write);
+      cnt = 0;
+      for (fd = 0; fd < nfds; fd++)
+	{
+	  RING_FD *rfd = (fd < num_fds) ? fds[fd] : NULL;
+	  if (rfd == NULL) continue;
+	  if (FD_ISSET(fd, &rd_in) && fd_ready(rfd))
+	    {
+	      FD_SET(fd, read);
+	      cnt++;
+	      /*
+	       * A poll is consumed by reporting it; the caller accepts.
+	       */
+	      if (rfd->listen) rfd->rd_done = 0;
+	    }
+	  if ((write != NULL) && FD_ISSET(fd, &wr_in) && !rfd->wr_busy)
+	    {
+	      FD_SET(fd, write);
+	      cnt++;
+	    }
+	}
+      /*
+       * Anything ready is returned at once, leaving queued requests for
+       * the io_uring_enter() that next waits.
+       */
+      if (cnt || *tick) return cnt;
+      if (submit(1, mask)) return -1;
+      if (reap(tick)) return -1;
+    }
+}
+
+/*
+ * Description : Reads from a descriptor, through io_uring when active.
+ *               Only called for descriptors ring_wait() found readable.
+ *
+ * Arguments : fd - Source descriptor.
+ *             dst - Destination.
+ *             len - Size of the destination.
+ *
+ * Return Value : Same as read().
+ */
+extern ssize_t ring_read(int fd, void *dst, size_t len)
+{
+  RING_FD *rfd;
+  ssize_t n;
+  if (ring_fd < 0)
+    {
+      do n = read(fd, dst, len);
+      while ((n < 0) && (errno == EINTR));
+      return n;
+    }
+  rfd = (fd < num_fds) ? fds[fd] : NULL;
+  if ((rfd == NULL) || !rfd->rd_done)
+    {
+      errno = ((rfd != NULL) && rfd->wr_err) ? rfd->wr_err : EAGAIN;
+      return -1;
+    }
+  if (rfd->rd_res <= 0)
+    {
+      n = rfd->rd_res;
+      rfd->rd_done = 0;
+      if (n < 0)
+	{
+	  errno = -n;
+	  return -1;
+	}
+      return 0;
+    }
+  n = rfd->rd_res - rfd->rd_off;
+  if ((size_t)n > len) n = len;
+  memcpy(dst, rfd->rd_buf + rfd->rd_off, n);
+  rfd->rd_off += n;
+  if (rfd->rd_off == (size_t)rfd->rd_res) rfd->rd_done = 0;
+  return n;
+}
+
+/*
+ * Description : Writes to a descriptor, through io_uring when active. Data
+ *               is copied and queued; errors of an earlier write are
+ *               reported here.
+ *
+ * Arguments : fd - Target descriptor.
+ *             src - Data to write.
+ *             len - Length of the data.
+ *
+ * Return Value : Same as write().
+ */
+extern ssize_t ring_write(int fd, const void *src, size_t len)
+{
+  RING_FD *rfd;
+  ssize_t n;
+  if (ring_fd < 0)
+    {
+      do n = write(fd, src, len);
+      while ((n < 0) && (errno == EINTR));
+      return n;
+    }
+  if ((rfd = get_fd(fd)) == NULL) return -1;
+  if (rfd->wr_err)
+    {
+      errno = rfd->wr_err;
+      return -1;
+    }
+  n = RING_BUF_SIZE - rfd->wr_len;
+  if ((size_t)n > len) n = len;
+  memcpy(rfd->wr_buf + rfd->wr_len, src, n);
+  rfd->wr_len += n;
+  if (!rfd->wr_busy) arm_write(rfd);
+  return n;
+}
+
+/*
+ * Description : Checks if data given to ring_write() has yet to be written
+ *               to the descriptor.
+ *
+ * Arguments : fd - Target descriptor.
+ *
+ * Return Value : Non-zero while a write is queued or outstanding.
+ */
+extern int ring_wr_pend(int fd)
+{
+  RING_FD *rfd;
+  if ((ring_fd < 0) || (fd < 0) || (fd >= num_fds)) return 0;
+  rfd = fds[fd];
+  return (rfd != NULL) && (rfd->wr_busy || rfd->wr_len);
+}
+
+/*
+ * Description : rbuf_read() through io_uring when active.
+ *
+ * Arguments : fd - Source descriptor.
+ *             dst - Destination buffer.
+ *
+ * Return Value : Same as rbuf_read().
+ */
+extern ssize_t ring_buf_read(int fd, RBUF *dst)
+{
+  ssize_t len;
+  ssize_t more;
+  size_t span;
+  uint8_t *to;
+  if (ring_fd < 0) return rbuf_read(fd, dst);
+  if (!rbuf_room(dst))
+    {
+      errno = ENOBUFS;
+      return -1;
+    }
+  to = rbuf_reserve(dst, &span);
+  len = ring_read(fd, to, span);
+  if (len <= 0) return len;
+  rbuf_commit(dst, len);
+  /*
+   * Free space wrapping to the start of the buffer takes the rest.
+   */
+  if (((size_t)len == span) && rbuf_room(dst))
+    {
+      to = rbuf_reserve(dst, &span);
+      more = ring_read(fd, to, span);
+      if (more > 0)
+	{
+	  rbuf_commit(dst, more);
+	  len += more;
+	}
+    }
+  return len;
+}
+
+/*
+ * Description : rbuf_write() through io_uring when active.
+ *
+ * Arguments : fd - Target descriptor.
+ *             src - Source buffer.
+ *
+ * Return Value : Same as rbuf_write().
+ */
+extern ssize_t ring_buf_write(int fd, RBUF *src)
+{
+  ssize_t bytes = 0;
+  if (ring_fd < 0) return rbuf_write(fd, src);
+  while (rbuf_len(src))
+    {
+      size_t span;
+      const uint8_t *from = rbuf_peek(src, &span);
+      ssize_t n = ring_write(fd, from, span);
+      if (n < 0) return -1;
+      rbuf_consume(src, n);
+      bytes += n;
+      if ((size_t)n < span) break; /* Write buffer full. */
+    }
+  return bytes;
+}
+
+/*
+ * Description : Drops a descriptor that is about to be closed, cancelling
+ *               its outstanding requests. Its state is freed once they
+ *               complete.
+ *
+ * Arguments : fd - Descriptor being closed.
+ *
+ * Return Value : None.
+ */
+extern void ring_forget(int fd)
+{
+  RING_FD *rfd;
+  if ((ring_fd < 0) || (fd < 0) || (fd >= num_fds)) return;
+  rfd = fds[fd];
+  if (rfd == NULL) return;
+  fds[fd] = NULL;
+  rfd->fd = -1;
+  if (rfd->rd_busy) cancel(rfd, RING_OP_READ);
+  if (rfd->wr_busy) cancel(rfd, RING_OP_WRITE);
+  if (!rfd->rd_busy && !rfd->wr_busy) free(rfd);
+  /*
+   * Requests still queued name the descriptor by number, which may be
+   * reused as soon as it is closed, so hand them to the kernel now.
+   */
+  if (queued) submit(0, NULL);
+  return;
+}
+
+/*
+ * Description : Shuts the io_uring instance down. The kernel cancels any
+ *               outstanding requests when it is closed.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void ring_stop(void)
+{
+  int fd;
+  if (ring_fd < 0) return;
+  close(ring_fd);
+  ring_fd = -1;
+  munmap(sqes, sqes_len);
+  if (cq_ring_len) munmap(cq_ring, cq_ring_len);
+  munmap(sq_ring, sq_ring_len);
+  for (fd = 0; fd < num_fds; fd++) free(fds[fd]);
+  free(fds);
+  fds = NULL;
+  num_fds = 0;
+  return;
+}
+
+/*
+ * Description : Submits queued requests and optionally waits for
+ *               completions.
+ *
+ * Arguments : min_complete - Completions to wait for.
+ *             mask - Signal mask while waiting, NULL to leave it.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero with errno set if interrupted or failed.
+ */
+static int submit(unsigned int min_complete, const sigset_t *mask)
+{
+  int ret;
+  ret = syscall(__NR_io_uring_enter, ring_fd, queued, min_complete,
+		min_complete ? IORING_ENTER_GETEVENTS : 0, mask, _NSIG / 8);
+  if (ret < 0)
+    {
+      if (errno != EINTR)
+	log_msg(LOG_ERR, "%s:%d io_uring_enter() failed : %s\n", __FILE__,
+		__LINE__, strerror(errno));
+      return -1;
+    }
+  queued -= ret;
+  return 0;
+}
+
+/*
+ * Description : Gets the next free submission queue entry, submitting the
+ *               queue first if it is full.
+ *
+ * Arguments : None.
+ *
+ * Return Value : A cleared submission queue entry.
+ */
+static struct io_uring_sqe *get_sqe(void)
+{
+  unsigned int tail = *sq_tail;
+  struct io_uring_sqe *sqe;
+  if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+    submit(0, NULL);
+  sqe = &sqes[tail & *sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array[tail & *sq_mask] = tail & *sq_mask;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  queued++;
+  return sqe;
+}
+
+/*
+ * Description : Queues a read, or a poll for a listening socket.
+ *
+ * Arguments : rfd - Descriptor state.
+ *
+ * Return Value : None.
+ */
+static void arm_read(RING_FD *rfd)
+{
+  struct io_uring_sqe *sqe;
+  rfd->rd_busy = 1;
+  sqe = get_sqe();
+  sqe->fd = rfd->fd;
+  sqe->user_data = (uintptr_t)rfd | RING_OP_READ;
+  if (rfd->listen)
+    {
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->poll32_events = POLLIN;
+    }
+  else
+    {
+      sqe->opcode = IORING_OP_READ;
+      sqe->addr = (uintptr_t)rfd->rd_buf;
+      sqe->len = RING_BUF_SIZE;
+      sqe->off = (uint64_t)-1; /* Current position, streams have none. */
+    }
+  return;
+}
+
+/*
+ * Description : Queues a write of the data waiting in a descriptor's
+ *               write buffer.
+ *
+ * Arguments : rfd - Descriptor state.
+ *
+ * Return Value : None.
+ */
+static void arm_write(RING_FD *rfd)
+{
+  struct io_uring_sqe *sqe;
+  rfd->wr_busy = 1;
+  sqe = get_sqe();
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = rfd->fd;
+  sqe->addr = (uintptr_t)(rfd->wr_buf + rfd->wr_off);
+  sqe->len = rfd->wr_len - rfd->wr_off;
+  sqe->off = (uint64_t)-1;
+  sqe->user_data = (uintptr_t)rfd | RING_OP_WRITE;
+  return;
+}
+
+/*
+ * Description : Queues the timeout for the next tick. Ticks are kept on
+ *               an absolute schedule so they do not drift.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void arm_tick(void)
+{
+  struct io_uring_sqe *sqe;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  tick_at.tv_nsec += TICK_USEC * 1000;
+  if (tick_at.tv_nsec >= 1000000000)
+    {
+      tick_at.tv_sec++;
+      tick_at.tv_nsec -= 1000000000;
+    }
+  /*
+   * Start over from now if behind by more than a tick, the way SIGALRM
+   * ticks missed while busy collapse into one.
+   */
+  if ((tick_at.tv_sec < now.tv_sec)
+      || ((tick_at.tv_sec == now.tv_sec) && (tick_at.tv_nsec < now.tv_nsec)))
+    {
+      tick_at.tv_sec = now.tv_sec;
+      tick_at.tv_nsec = now.tv_nsec + TICK_USEC * 1000;
+      if (tick_at.tv_nsec >= 1000000000)
+	{
+	  tick_at.tv_sec++;
+	  tick_at.tv_nsec -= 1000000000;
+	}
+    }
+  sqe = get_sqe();
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->fd = -1;
+  sqe->addr = (uintptr_t)&tick_at;
+  sqe->len = 1;
+  sqe->timeout_flags = IORING_TIMEOUT_ABS;
+  sqe->user_data = RING_UD_TICK;
+  tick_armed = 1;
+  return;
+}
+
+/*
+ * Description : Queues cancellation of a descriptor's outstanding request.
+ *
+ * Arguments : rfd - Descriptor state.
+ *             op - RING_OP_READ or RING_OP_WRITE.
+ *
+ * Return Value : None.
+ */
+static void cancel(RING_FD *rfd, unsigned int op)
+{
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (uintptr_t)rfd | op;
+  sqe->user_data = RING_UD_IGNORE;
+  return;
+}
+
+/*
+ * Description : Processes all completions.
+ *
+ * Arguments : tick - Set if the tick timeout completed.
+ *
+ * Return Value : Always zero.
+ */
+static int reap(volatile int *tick)
+{
+  unsigned int head = *cq_head;
+  while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+    {
+      struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+      uint64_t ud = cqe->user_data;
+      int res = cqe->res;
+      head++;
+      if (ud == RING_UD_TICK)
+	{
+	  *tick = 1;
+	  tick_armed = 0;
+	  arm_tick();
+	}
+      else if (ud != RING_UD_IGNORE)
+	{
+	  RING_FD *rfd = (RING_FD *)(uintptr_t)(ud & ~(uint64_t)RING_OP_MASK);
+	  /*
+	   * Interrupted requests are simply issued again.
+	   */
+	  if (((res == -EINTR) || (res == -EAGAIN)) && (rfd->fd >= 0))
+	    {
+	      if ((ud & RING_OP_MASK) == RING_OP_READ) arm_read(rfd);
+	      else arm_write(rfd);
+	    }
+	  else if ((ud & RING_OP_MASK) == RING_OP_READ)
+	    {
+	      rfd->rd_busy = 0;
+	      rfd->rd_done = 1;
+	      rfd->rd_res = res;
+	      rfd->rd_off = 0;
+	    }
+	  else if (res < 0)
+	    {
+	      rfd->wr_busy = 0;
+	      rfd->wr_err = -res;
+	    }
+	  else
+	    {
+	      rfd->wr_busy = 0;
+	      rfd->wr_off += res;
+	      if (rfd->wr_off == rfd->wr_len) rfd->wr_off = rfd->wr_len = 0;
+	      else if (rfd->fd >= 0) arm_write(rfd); /* Short write. */
+	    }
+	  /*
+	   * A forgotten descriptor is freed with its last request.
+	   */
+	  if ((rfd->fd < 0) && !rfd->rd_busy && !rfd->wr_busy) free(rfd);
+	}
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+  return 0;
+}
+
+/*
+ * Description : Finds or creates the state of a descriptor.
+ *
+ * Arguments : fd - Descriptor.
+ *
+ * Return Value : The descriptor state.
+ *                NULL if memory could not be allocated.
+ */
+static RING_FD *get_fd(int fd)
+{
+  RING_FD *rfd;
+  int acc = 0;
+  socklen_t len = sizeof(acc);
+  if (fd >= num_fds)
+    {
+      RING_FD **new_fds = (RING_FD **)realloc(fds, (fd + 1) * sizeof(*fds));
+      if (new_fds == NULL)
+	{
+	  log_msg(LOG_ERR, "%s:%d Failed to allocate io_uring descriptor"
+		  " table : %s\n", __FILE__, __LINE__, strerror(errno));
+	  return NULL;
+	}
+      memset(new_fds + num_fds, 0, (fd + 1 - num_fds) * sizeof(*fds));
+      fds = new_fds;
+      num_fds = fd + 1;
+    }
+  if (fds[fd] != NULL) return fds[fd];
+  rfd = (RING_FD *)calloc(1, sizeof(RING_FD));
+  if (rfd == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d Failed to allocate io_uring descriptor : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      return NULL;
+    }
+  rfd->fd = fd;
+  if (!getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &acc, &len) && acc)
+    rfd->listen = 1;
+  fds[fd] = rfd;
+  return rfd;
+}
+
+/*
+ * Description : Checks if a descriptor is readable: its read has completed,
+ *               or a write failed and the error should reach the caller.
+ *
+ * Arguments : rfd - Descriptor state.
+ *
+ * Return Value : Non-zero if readable.
+ */
+static int fd_ready(const RING_FD *rfd)
+{
+  return rfd->rd_done || (rfd->wr_err && !rfd->listen);
+}
+
+#else /* No io_uring in the kernel headers. */
+
+extern int ring_start(void)
+{
+  log_msg(LOG_ERR, "%s:%d Built without io_uring, using pselect().\n",
+	  __FILE__, __LINE__);
+  return -1;
+}
+
+extern int ring_active(void)
+{
+  return 0;
+}
+
+extern int ring_wait(int nfds, fd_set *read, fd_set *write,
+		     const sigset_t *mask, volatile int *tick)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+extern ssize_t ring_read(int fd, void *dst, size_t len)
+{
+  ssize_t n;
+  do n = read(fd, dst, len);
+  while ((n < 0) && (errno == EINTR));
+  return n;
+}
+
+extern ssize_t ring_write(int fd, const void *src, size_t len)
+{
+  ssize_t n;
+  do n = write(fd, src, len);
+  while ((n < 0) && (errno == EINTR));
+  return n;
+}
+
+extern int ring_wr_pend(int fd)
+{
+  return 0;
+}
+
+extern ssize_t ring_buf_read(int fd, RBUF *dst)
+{
+  return rbuf_read(fd, dst);
+}
+
+extern ssize_t ring_buf_write(int fd, RBUF *src)
+{
+  return rbuf_write(fd, src);
+}
+
+extern void ring_forget(int fd)
+{
+  return;
+}
+
+extern void ring_stop(void)
+{
+  return;
+}
+
+#endif /* __NR_io_uring_setup */
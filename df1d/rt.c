@@ -0,0 +1,280 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Real-time mode and ACK latency measurement.
+ *
+ * With a 'realtime' element in the configuration the whole service, which
+ * is a single event loop, runs under SCHED_FIFO at the configured priority,
+ * optionally pinned to a set of CPUs. All memory is locked and a stack and
+ * heap reserve are touched up front; the per-connection buffers are already
+ * allocated when a connection is opened, so with the heap never trimmed the
+ * message path does not page-fault.
+ *
+ * Independent of real-time mode, the time from the loop waking up with the
+ * last bytes of a message to the DLE ACK for that message being written to
+ * the TTY is measured for every connection and logged when it closes.
+ */
+
+#include "df1.h"
+#include <malloc.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define RT_STACK_RESERVE (256 * 1024) /* Stack touched before locking. */
+#define RT_HEAP_RESERVE (1024 * 1024) /* Heap touched before locking. */
+#define RT_PAGE 4096
+
+static void prefault_stack(void);
+static void prefault_heap(void);
+static unsigned long usec_since(const struct timespec *start);
+
+static int rt_prio; /* Configured priority, zero if real-time mode is off. */
+static int rt_pin; /* Set if rt_cpus was configured. */
+static cpu_set_t rt_cpus; /* CPUs the service is pinned to. */
+static int rt_on; /* Set while running in real-time mode. */
+static cpu_set_t orig_cpus; /* Affinity before real-time mode started. */
+static struct timespec wake; /* Time the event loop last woke up. */
+
+/*
+ * Description : Sets the real-time configuration, applied by rt_apply().
+ *
+ * Arguments : prio - SCHED_FIFO priority, zero to disable real-time mode.
+ *             cpus - CPUs to run on, NULL for no restriction.
+ *
+ * Return Value : None.
+ */
+extern void rt_config(int prio, const cpu_set_t *cpus)
+{
+  rt_prio = prio;
+  rt_pin = (cpus != NULL);
+  if (rt_pin) rt_cpus = *cpus;
+  return;
+}
+
+/*
+ * Description : Enters real-time mode if configured, or leaves it if the
+ *               configuration no longer asks for it. Failures are logged
+ *               and the service carries on with normal scheduling.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void rt_apply(void)
+{
+  struct sched_param sp;
+  if (!rt_prio)
+    {
+      if (!rt_on) return;
+      sp.sched_priority = 0;
+      if (sched_setscheduler(0, SCHED_OTHER, &sp))
+	log_msg(LOG_ERR, "%s:%d Error leaving SCHED_FIFO : %s\n", __FILE__,
+		__LINE__, strerror(errno));
+      sched_setaffinity(0, sizeof(orig_cpus), &orig_cpus);
+      munlockall();
+      rt_on = 0;
+      log_msg(LOG_INFO, "%s:%d Real-time mode off.\n", __FILE__, __LINE__);
+      return;
+    }
+  if (!rt_on && sched_getaffinity(0, sizeof(orig_cpus), &orig_cpus))
+    CPU_ZERO(&orig_cpus);
+  if (rt_pin && sched_setaffinity(0, sizeof(rt_cpus), &rt_cpus))
+    log_msg(LOG_ERR, "%s:%d Error setting CPU affinity : %s\n", __FILE__,
+	    __LINE__, strerror(errno));
+  else if (!rt_pin && rt_on)
+    sched_setaffinity(0, sizeof(orig_cpus), &orig_cpus);
+  /*
+   * Keep freed memory in the heap rather than returning it to the system,
+   * it would have to be faulted in again when next allocated.
+   */
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    log_msg(LOG_ERR, "%s:%d Error locking memory : %s\n", __FILE__,
+	    __LINE__, strerror(errno));
+  prefault_stack();
+  prefault_heap();
+  sp.sched_priority = rt_prio;
+  if (sched_setscheduler(0, SCHED_FIFO, &sp))
+    {
+      log_msg(LOG_ERR, "%s:%d Error setting SCHED_FIFO priority %d : %s\n",
+	      __FILE__, __LINE__, rt_prio, strerror(errno));
+      return;
+    }
+  rt_on = 1;
+  log_msg(LOG_INFO, "%s:%d Real-time mode on, SCHED_FIFO priority %d.\n",
+	  __FILE__, __LINE__, rt_prio);
+  return;
+}
+
+/*
+ * Description : Records the time the event loop woke up with descriptors
+ *               ready.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void rt_wake(void)
+{
+  clock_gettime(CLOCK_MONOTONIC, &wake);
+  return;
+}
+
+/*
+ * Description : Notes that a message was completely received during the
+ *               current pass of the event loop.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void rt_msg_rcvd(CONN *conn)
+{
+  conn->lat.msg = wake;
+  return;
+}
+
+/*
+ * Description : Notes that a DLE ACK for the last message received has been
+ *               placed in the TTY output buffer.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void rt_ack_queued(CONN *conn)
+{
+  /*
+   * A message received before a handoff has no reception time.
+   */
+  if (!conn->lat.msg.tv_sec && !conn->lat.msg.tv_nsec) return;
+  conn->lat.ack = conn->lat.msg;
+  conn->lat.ack_pend = 1;
+  return;
+}
+
+/*
+ * Description : Records the latency of a DLE ACK once the TTY output buffer
+ *               holding it has been written.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void rt_ack_sent(CONN *conn)
+{
+  ACK_LAT *lat = &conn->lat;
+  unsigned long usec;
+  unsigned int i;
+  if (!lat->ack_pend) return;
+  lat->ack_pend = 0;
+  usec = usec_since(&lat->ack);
+  if (!lat->samples || (usec < lat->min)) lat->min = usec;
+  if (usec > lat->max) lat->max = usec;
+  lat->sum += usec;
+  lat->samples++;
+  for (i = 0; (i < ACK_LAT_BUCKETS - 1) && (usec >> (i + 1)); i++);
+  lat->hist[i]++;
+  return;
+}
+
+/*
+ * Description : Logs a connection's ACK latency statistics.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void rt_close(CONN *conn)
+{
+  const ACK_LAT *lat = &conn->lat;
+  unsigned int i;
+  unsigned int n = 0;
+  if (!lat->samples) return;
+  /*
+   * Upper bound of the bucket holding the 99th percentile.
+   */
+  for (i = 0; i < ACK_LAT_BUCKETS - 1; i++)
+    {
+      n += lat->hist[i];
+      if (n >= lat->samples - lat->samples / 100) break;
+    }
+  log_msg(LOG_INFO, "%s:%d [%s] ACK latency: %u samples; min %lu uS;"
+	  " avg %lu uS; 99%% < %lu uS; max %lu uS.\n", __FILE__, __LINE__,
+	  conn->name, lat->samples, lat->min,
+	  (unsigned long)(lat->sum / lat->samples), 2UL << i, lat->max);
+  return;
+}
+
+/*
+ * Description : Touches the stack the event loop may use so the pages are
+ *               present and locked.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void prefault_stack(void)
+{
+  volatile uint8_t stack[RT_STACK_RESERVE];
+  size_t i;
+  for (i = 0; i < sizeof(stack); i += RT_PAGE) stack[i] = 0;
+  return;
+}
+
+/*
+ * Description : Grows the heap by a reserve and frees it again. As the heap
+ *               is not trimmed, later allocations reuse the locked pages.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void prefault_heap(void)
+{
+  volatile uint8_t *p = malloc(RT_HEAP_RESERVE);
+  size_t i;
+  if (p == NULL) return;
+  for (i = 0; i < RT_HEAP_RESERVE; i += RT_PAGE) p[i] = 0;
+  free((void *)p);
+  return;
+}
+
+/*
+ * Description : Computes the time elapsed since a monotonic clock reading.
+ *
+ * Arguments : start - Earlier reading.
+ *
+ * Return Value : Elapsed time in microseconds.
+ */
+static unsigned long usec_since(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000L
+    + (now.tv_nsec - start->tv_nsec) / 1000;
+}
@@ -41,14 +41,19 @@ static void embed_rsp(CONN *con, uint8_t rsp);
  *
  * Arguments : conn - Connection pointer.
  *             dup_detect - Duplicate message detection.
+ *             early_ack - Non-zero to ACK messages as soon as they are
+ *                         queued for a client rather than once the client
+ *                         accepts them.
  *
  * Return Value : Zero upon success.
  *                Non-zero if an error occured.
  */
-extern int rx_init(CONN *conn, int dup_detect)
+extern int rx_init(CONN *conn, int dup_detect, int early_ack)
 {
   if (alloc_bufs(conn)) return -1;
   conn->rx.dup_detect = dup_detect ? 1 : 0;
+  conn->rx.early_ack = early_ack ? 1 : 0;
+  conn->rx.stn = -1;
   rx_set_nak(&conn->rx);
   conn->rx.state = RX_IDLE;
   /*
@@ -58,8 +63,9 @@ extern int rx_init(CONN *conn, int dup_detect)
    */
   conn->rx.tticks = 5000000 / TICK_USEC + 1;
   log_msg(LOG_DEBUG, "%s:%d [%s] Receiver initialized with"
-	  " duplicate message detection %s.\n", __FILE__, __LINE__, conn->name,
-	  conn->rx.dup_detect ? "enabled" : "disabled");
+	  " duplicate message detection %s, early ACK %s.\n", __FILE__,
+	  __LINE__, conn->name, conn->rx.dup_detect ? "enabled" : "disabled",
+	  conn->rx.early_ack ? "enabled" : "disabled");
   return 0;
 }
 
@@ -81,9 +87,10 @@ extern void rx_msg(CONN *conn)
       conn->rx.prev_dle = 0;
       conn->rx.overflow = 0;
       cs_clear(conn);
+      if (conn->rx.stn >= 0) cs_add(conn, conn->rx.stn);
       conn->rx.state = RX_APP;
     }
-  while (!buf_get_byte(conn->tty_in, &byte))
+  while (!rbuf_get_byte(conn->tty_in, &byte))
     {
       switch (conn->rx.state)
 	{
@@ -131,8 +138,8 @@ extern void rx_ack(CONN *conn)
 {
   log_msg(LOG_DEBUG, "%s:%d [%s] Sending DLE ACK.\n", __FILE__, __LINE__,
 	  conn->name);
-  if (buf_append_byte(conn->tty_out, SYM_DLE) ||
-      buf_append_byte(conn->tty_out, SYM_ACK))
+  if (rbuf_put_byte(conn->tty_out, SYM_DLE) ||
+      rbuf_put_byte(conn->tty_out, SYM_ACK))
     log_msg(LOG_ERR,
 	    "%s:%d [%s] Failed to send ACK due to TTY buffer full.\n",
 	    __FILE__, __LINE__, conn->name);
@@ -140,6 +147,8 @@ extern void rx_ack(CONN *conn)
   conn->rx.state = RX_IDLE;
   conn->rx.client = NULL;
   conn->dcnts.acks_out++;
+  rt_ack_queued(conn);
+  master_rx_done(conn);
   return;
 }
 
@@ -154,8 +163,8 @@ extern void rx_nak(CONN *conn)
 {
   log_msg(LOG_DEBUG, "%s:%d [%s] Sending DLE NAK.\n", __FILE__, __LINE__,
 	  conn->name);
-  if (buf_append_byte(conn->tty_out, SYM_DLE) ||
-      buf_append_byte(conn->tty_out, SYM_NAK))
+  if (rbuf_put_byte(conn->tty_out, SYM_DLE) ||
+      rbuf_put_byte(conn->tty_out, SYM_NAK))
     log_msg(LOG_ERR,
 	    "%s:%d [%s] Failed to send NAK due to TTY buffer full.\n",
 	    __FILE__, __LINE__, conn->name);
@@ -163,6 +172,7 @@ extern void rx_nak(CONN *conn)
   conn->rx.state = RX_IDLE;
   conn->rx.client = NULL;
   conn->dcnts.naks_out++;
+  master_rx_done(conn);
   return;
 }
 
@@ -415,6 +425,11 @@ static void add_to_app(CONN *conn, uint8_t byte)
  */
 static void accept_msg(CONN *conn)
 {
+  if (conn->rx.ignore) /* Addressed to another half-duplex station. */
+    {
+      conn->rx.state = RX_IDLE;
+      return;
+    }
   if (conn->rx.app->len < 6)
     {
       log_msg(LOG_DEBUG, "%s:%d [%s] Received message is too small.\n",
@@ -424,8 +439,9 @@ static void accept_msg(CONN *conn)
     }
   else if (cs_ok(conn))
     {
+      rt_msg_rcvd(conn);
       if (msg_dup(conn)) rx_ack(conn); /* Duplicate messages are ACKed. */
-      else /* ACK/NAK will be sent after client accepts or rejects. */
+      else /* ACK/NAK sent once queued or after the client responds. */
 	{
 	  conn->dcnts.msg_rx++;
 	  conn->rx.state = RX_PEND;
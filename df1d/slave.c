@@ -0,0 +1,234 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Half-duplex slave. Each registered client is a slave station at its own
+ * address. The master addresses stations with DLE ENQ STN polls and
+ * DLE SOH STN DLE STX messages; polls and messages for stations without a
+ * client belong to other slaves on the line and are ignored. A client's
+ * message is held until its station is polled and goes out in answer to
+ * that poll, or DLE EOT is sent if there is nothing to send.
+ */
+
+#include "df1.h"
+
+static void poll_rcvd(CONN *conn);
+static int stn_byte(SLAVE *slave, uint8_t byte);
+
+/*
+ * Description : Consumes the station address and poll checksum bytes that
+ *               follow a DLE ENQ or DLE SOH.
+ *
+ * Arguments : conn - Connection pointer.
+ *             byte - Byte received from the TTY.
+ *
+ * Return Value : Non-zero if the byte was consumed.
+ *                Zero if it should be parsed as link layer data.
+ */
+extern int slave_byte(CONN *conn, uint8_t byte)
+{
+  SLAVE *slave = &conn->slave;
+  switch (slave->state)
+    {
+    case SLAVE_POLL_STN:
+      if (stn_byte(slave, byte)) slave->state = SLAVE_POLL_CS;
+      return 1;
+      break;
+    case SLAVE_POLL_CS:
+      slave->cs[slave->cs_len++] = byte;
+      if (slave->cs_len == (conn->use_crc ? 2 : 1))
+	{
+	  slave->state = SLAVE_LINK;
+	  poll_rcvd(conn);
+	}
+      return 1;
+      break;
+    case SLAVE_MSG_STN:
+      if (stn_byte(slave, byte)) slave->state = SLAVE_MSG_STX;
+      return 1;
+      break;
+    case SLAVE_LINK:
+    case SLAVE_MSG_STX: /* DLE STX is parsed as usual. */
+      break;
+    }
+  return 0;
+}
+
+/*
+ * Description : Handles a DLE ENQ, the start of a poll.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void slave_enq(CONN *conn)
+{
+  conn->slave.state = SLAVE_POLL_STN;
+  conn->slave.prev_dle = 0;
+  conn->slave.cs_len = 0;
+  return;
+}
+
+/*
+ * Description : Handles a DLE SOH, the start of a message from the master.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void slave_soh(CONN *conn)
+{
+  log_msg(LOG_DEBUG, "%s:%d [%s] Received DLE SOH.\n", __FILE__, __LINE__,
+	  conn->name);
+  conn->slave.state = SLAVE_MSG_STN;
+  conn->slave.prev_dle = 0;
+  return;
+}
+
+/*
+ * Description : Prepares the receiver for a message from the master, called
+ *               before the receiver is handed the DLE STX. The station
+ *               address is part of the checksum; messages for stations
+ *               without a client are received but not answered.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void slave_msg_start(CONN *conn)
+{
+  SLAVE *slave = &conn->slave;
+  if (conn->duplex != DUPLEX_SLAVE) return;
+  if (slave->state == SLAVE_MSG_STX)
+    {
+      conn->rx.stn = slave->stn;
+      conn->rx.ignore = (client_find(conn, slave->stn) == NULL) ? 1 : 0;
+    }
+  else /* A message from the master must be addressed with DLE SOH. */
+    {
+      conn->rx.stn = -1;
+      conn->rx.ignore = 1;
+    }
+  slave->state = SLAVE_LINK;
+  return;
+}
+
+/*
+ * Description : Logs a slave's statistics.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void slave_close(CONN *conn)
+{
+  if (conn->duplex != DUPLEX_SLAVE) return;
+  log_msg(LOG_INFO, "%s:%d [%s] Slave stats: %u polls; %u EOTs.\n", __FILE__,
+	  __LINE__, conn->name, conn->slave.polls, conn->slave.eots);
+  return;
+}
+
+/*
+ * Description : Answers a complete poll. A message still awaiting an ACK
+ *               from the same station is sent again, otherwise the
+ *               station's waiting client message is sent, otherwise EOT.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+static void poll_rcvd(CONN *conn)
+{
+  SLAVE *slave = &conn->slave;
+  int ok;
+  if (conn->use_crc)
+    {
+      register uint16_t crc = 0;
+      register unsigned int i;
+      CRC_ADD(i, crc, slave->stn);
+      CRC_ADD(i, crc, SYM_ENQ);
+      ok = (slave->cs[0] == (crc & 0xff)) && (slave->cs[1] == (crc >> 8));
+    }
+  else ok = slave->cs[0] == (uint8_t)(~slave->stn + 1);
+  if (!ok)
+    {
+      log_msg(LOG_DEBUG, "%s:%d [%s] Poll for station %u has a bad"
+	      " checksum.\n", __FILE__, __LINE__, conn->name, slave->stn);
+      conn->dcnts.bad_cs++;
+      return;
+    }
+  if (tx_busy(&conn->tx) && (slave->tx_stn == slave->stn))
+    {
+      slave->polls++;
+      if (!tx_resend(conn)) return;
+    }
+  else if (tx_busy(&conn->tx))
+    {
+      /*
+       * Another local station's message is still unacknowledged. Only
+       * one message can be outstanding, so this station has to wait.
+       */
+      if (client_find(conn, slave->stn) == NULL) return;
+      slave->polls++;
+    }
+  else
+    {
+      int ret = client_poll(conn, slave->stn);
+      if (ret < 0) return; /* Another slave's station. */
+      slave->polls++;
+      if (ret)
+	{
+	  log_msg(LOG_DEBUG, "%s:%d [%s] Answering poll for station %u with"
+		  " a message.\n", __FILE__, __LINE__, conn->name,
+		  slave->stn);
+	  slave->tx_stn = slave->stn;
+	  return;
+	}
+    }
+  slave->eots++;
+  tx_eot(conn);
+  return;
+}
+
+/*
+ * Description : Accumulates a station address byte. A station address equal
+ *               to DLE is received as DLE DLE.
+ *
+ * Arguments : slave - Slave data.
+ *             byte - Byte received.
+ *
+ * Return Value : Non-zero once the station address is complete.
+ */
+static int stn_byte(SLAVE *slave, uint8_t byte)
+{
+  if ((byte == SYM_DLE) && !slave->prev_dle)
+    {
+      slave->prev_dle = 1;
+      return 0;
+    }
+  slave->prev_dle = 0;
+  slave->stn = byte;
+  return 1;
+}
@@ -0,0 +1,381 @@
+/*
+ * This file is part of df1d.
+ * Allen Bradley DF1 link layer service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Statistics port.
+ *
+ * With a 'stats_port' element in the configuration, df1d listens on that
+ * TCP port and answers every connection with a text snapshot of its
+ * counters, then closes it. Monitors such as df1dtop poll it and compute
+ * rates from successive snapshots. Each line is a record type followed by
+ * space separated fields; names have whitespace replaced by underscores.
+ *
+ *   df1d_stats 1
+ *   time <monotonic seconds>
+ *   link <name> <byte uS> <bytes in> <bytes out> <msgs tx> <msgs rx>
+ *        <ACKs in> <NAKs in> <ENQs out> <ACKs out> <NAKs out> <ENQs in>
+ *        <bad checksums> <duplicates> <tx failures> <expired>
+ *   tx <link> <max NAKs> <max ENQs> <ACK timeout mS> <ACK wait buckets...>
+ *   node <link> <node> <msgs sent>
+ *   file <link> <file> <commands sent>
+ *   client <link> <name> <address> <queued> <sending> <backlog bytes>
+ *          <msgs tx> <msgs rx> <tx failures> <latency buckets...>
+ *   end
+ *
+ * Counters are unsigned 32 bit values that wrap. Client latency is the time
+ * from a message being queued to the link ACKing it, counted in power of
+ * two buckets of microseconds: bucket i holds times below 2^(i+1) uS, the
+ * last bucket everything longer. ACK wait is the time from the estimated end
+ * of a message on the line to its ACK, for messages ACKed without an ENQ,
+ * in the same buckets. A snapshot without the 'end' line was cut
+ * short and should be ignored.
+ */
+
+#include "df1.h"
+#include <time.h>
+
+#define STATS_VERSION 1
+#define STATS_LISTEN_BACKLOG 5
+
+static void send_snapshot(int fd);
+static void put_name(FILE *f, const char *name);
+
+static in_port_t stats_port; /* Configured port, zero if disabled. */
+static int stats_fd = -1; /* Listening socket. */
+
+/*
+ * Description : Sets the statistics port, reopening the listening socket if
+ *               it changed.
+ *
+ * Arguments : port - TCP port, zero to disable the statistics port.
+ *
+ * Return Value : None.
+ */
+extern void stats_config(in_port_t port)
+{
+  if (port != stats_port) stats_stop();
+  stats_port = port;
+  stats_start();
+  return;
+}
+
+/*
+ * Description : Opens the listening socket on the configured port, unless
+ *               it is already open. Failures are logged and the service
+ *               runs without statistics.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void stats_start(void)
+{
+  int flags = 1;
+  struct sockaddr_in addr;
+  if (!stats_port || (stats_fd >= 0)) return;
+  stats_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (stats_fd < 0)
+    {
+      log_msg(LOG_ERR, "%s:%d Statistics socket creation failed : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      return;
+    }
+  setsockopt(stats_fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(int));
+  flags = fcntl(stats_fd, F_GETFL, 0);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(stats_port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY); /* Bind to all interfaces. */
+  if ((flags < 0) || fcntl(stats_fd, F_SETFL, flags | O_NONBLOCK)
+      || bind(stats_fd, (struct sockaddr *)&addr, sizeof(addr))
+      || listen(stats_fd, STATS_LISTEN_BACKLOG))
+    {
+      log_msg(LOG_ERR, "%s:%d Error opening statistics port %u : %s\n",
+	      __FILE__, __LINE__, stats_port, strerror(errno));
+      close(stats_fd);
+      stats_fd = -1;
+      return;
+    }
+  log_msg(LOG_INFO, "%s:%d Statistics available on port %u.\n", __FILE__,
+	  __LINE__, stats_port);
+  return;
+}
+
+/*
+ * Description : Closes the listening socket, keeping the configured port so
+ *               stats_start() can reopen it. Used before handing over to a
+ *               new process, which opens its own.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void stats_stop(void)
+{
+  if (stats_fd < 0) return;
+  ring_forget(stats_fd);
+  close(stats_fd);
+  stats_fd = -1;
+  return;
+}
+
+/*
+ * Description : Adds the listening socket to a descriptor set.
+ *
+ * Arguments : set - Descriptor set.
+ *
+ * Return Value : The listening socket, zero if not listening.
+ */
+extern int stats_get_read_fds(fd_set *set)
+{
+  if (stats_fd < 0) return 0;
+  FD_SET(stats_fd, set);
+  return stats_fd;
+}
+
+/*
+ * Description : Answers a connection to the statistics port.
+ *
+ * Arguments : read - Descriptors ready for reading.
+ *             cnt - Number of descriptors ready, decremented if the
+ *                   listening socket was one of them.
+ *
+ * Return Value : None.
+ */
+extern void stats_service_fds(const fd_set *read, int *cnt)
+{
+  int fd;
+  if ((stats_fd < 0) || !FD_ISSET(stats_fd, read)) return;
+  --*cnt;
+  fd = accept(stats_fd, NULL, NULL);
+  if (fd < 0) return;
+  send_snapshot(fd);
+  close(fd);
+  return;
+}
+
+/*
+ * Description : Notes the time a client's message was queued for the link.
+ *
+ * Arguments : client - Client whose message is ready.
+ *
+ * Return Value : None.
+ */
+extern void stats_queued(CLIENT *client)
+{
+  clock_gettime(CLOCK_MONOTONIC, &client->queued);
+  return;
+}
+
+/*
+ * Description : Counts a message handed to the transmitter by destination
+ *               node and data file.
+ *
+ * Arguments : conn - Link the message is sent on.
+ *             client - Client sending the message.
+ *
+ * Return Value : None.
+ */
+extern void stats_tx_start(CONN *conn, const CLIENT *client)
+{
+  long file;
+  if (!client->df1_tx->len) return;
+  conn->node_cnt[client->df1_tx->data[0]]++;
+  file = data_file_num(client->df1_tx);
+  if (file >= 0) conn->file_cnt[(file < 255) ? file : 255]++;
+  return;
+}
+
+/*
+ * Description : Records the latency of a message the link has ACKed.
+ *
+ * Arguments : client - Client whose message was sent.
+ *
+ * Return Value : None.
+ */
+extern void stats_tx_ok(CLIENT *client)
+{
+  struct timespec now;
+  unsigned long usec;
+  unsigned int i;
+  if (!client->queued.tv_sec && !client->queued.tv_nsec) return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  usec = (now.tv_sec - client->queued.tv_sec) * 1000000L
+    + (now.tv_nsec - client->queued.tv_nsec) / 1000;
+  for (i = 0; (i < STATS_LAT_BUCKETS - 1) && (usec >> (i + 1)); i++);
+  client->dcnts.lat_hist[i]++;
+  return;
+}
+
+/*
+ * Description : Estimates when a message just queued for the TTY will have
+ *               been sent, from the bytes waiting ahead of and in it.
+ *
+ * Arguments : conn - Link the message is sent on.
+ *
+ * Return Value : None.
+ */
+extern void stats_msg_sent(CONN *conn)
+{
+  long usec = rbuf_len(conn->tty_out) * conn->byte_usec;
+  clock_gettime(CLOCK_MONOTONIC, &conn->tx_end);
+  conn->tx_end.tv_sec += usec / 1000000L;
+  conn->tx_end.tv_nsec += (usec % 1000000L) * 1000;
+  if (conn->tx_end.tv_nsec >= 1000000000L)
+    {
+      conn->tx_end.tv_sec++;
+      conn->tx_end.tv_nsec -= 1000000000L;
+    }
+  return;
+}
+
+/*
+ * Description : Records the time a link waited for the ACK of a message.
+ *
+ * Arguments : conn - Link the message was ACKed on.
+ *
+ * Return Value : None.
+ */
+extern void stats_msg_acked(CONN *conn)
+{
+  struct timespec now;
+  long usec;
+  unsigned int i;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  usec = (now.tv_sec - conn->tx_end.tv_sec) * 1000000L
+    + (now.tv_nsec - conn->tx_end.tv_nsec) / 1000;
+  if (usec < 0) usec = 0;
+  for (i = 0; (i < STATS_LAT_BUCKETS - 1) && (usec >> (i + 1)); i++);
+  conn->ack_wait[i]++;
+  return;
+}
+
+/*
+ * Description : Writes a snapshot of all counters to a statistics
+ *               connection. The event loop is not held up by a slow
+ *               reader, whatever does not fit in the socket buffer is
+ *               dropped.
+ *
+ * Arguments : fd - Accepted connection.
+ *
+ * Return Value : None.
+ */
+static void send_snapshot(int fd)
+{
+  char *text = NULL;
+  size_t len = 0;
+  size_t sent = 0;
+  ssize_t n;
+  FILE *f;
+  struct timespec now;
+  const CONN *conn;
+  const CLIENT *client;
+  unsigned int i;
+  f = open_memstream(&text, &len);
+  if (f == NULL) return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  fprintf(f, "df1d_stats %d\ntime %ld.%06ld\n", STATS_VERSION,
+	  (long)now.tv_sec, now.tv_nsec / 1000);
+  for (conn = conn_first(); conn != NULL; conn = conn->next)
+    {
+      const struct link_diag_cnt *d = &conn->dcnts;
+      fputs("link ", f);
+      put_name(f, conn->name);
+      fprintf(f, " %ld %u %u %u %u %u %u %u %u %u %u %u %u %u %u\n",
+	      conn->byte_usec, d->bytes_in, d->bytes_out, d->tx_success,
+	      d->msg_rx, d->acks_in, d->naks_in, d->enqs_out, d->acks_out,
+	      d->naks_out, d->enqs_in, d->bad_cs, d->dups, d->tx_fail,
+	      d->expired);
+      fputs("tx ", f);
+      put_name(f, conn->name);
+      fprintf(f, " %u %u %u", conn->tx.max_nak, conn->tx.max_enq,
+	      conn->tx.tticks * (TICK_USEC / 1000));
+      for (i = 0; i < STATS_LAT_BUCKETS; i++)
+	fprintf(f, " %u", conn->ack_wait[i]);
+      fputc('\n', f);
+      for (i = 0; i < 256; i++)
+	{
+	  if (conn->node_cnt[i])
+	    {
+	      fputs("node ", f);
+	      put_name(f, conn->name);
+	      fprintf(f, " %u %u\n", i, conn->node_cnt[i]);
+	    }
+	  if (conn->file_cnt[i])
+	    {
+	      fputs("file ", f);
+	      put_name(f, conn->name);
+	      fprintf(f, " %u %u\n", i, conn->file_cnt[i]);
+	    }
+	}
+      for (client = conn->clients; client != NULL; client = client->next)
+	{
+	  if (client->mux_sess || (client->state < CLIENT_IDLE)) continue;
+	  fputs("client ", f);
+	  put_name(f, conn->name);
+	  fputc(' ', f);
+	  put_name(f, client->name);
+	  fprintf(f, " %u %d %d %zu %u %u %u", client->addr,
+		  client->state == CLIENT_MSG_READY,
+		  client->state == CLIENT_MSG_PEND,
+		  (client->sock_in != NULL) ? rbuf_len(client->sock_in) : 0,
+		  client->dcnts.tx_success, client->dcnts.msg_rx,
+		  client->dcnts.tx_fail);
+	  for (i = 0; i < STATS_LAT_BUCKETS; i++)
+	    fprintf(f, " %u", client->dcnts.lat_hist[i]);
+	  fputc('\n', f);
+	}
+    }
+  fputs("end\n", f);
+  if (fclose(f))
+    {
+      free(text);
+      return;
+    }
+  while (sent < len)
+    {
+      n = send(fd, text + sent, len - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n <= 0) break;
+      sent += n;
+    }
+  free(text);
+  return;
+}
+
+/*
+ * Description : Writes a name as a single field, replacing whitespace and
+ *               control characters with underscores.
+ *
+ * Arguments : f - Output stream.
+ *             name - Name to write.
+ *
+ * Return Value : None.
+ */
+static void put_name(FILE *f, const char *name)
+{
+  if (!*name) fputc('-', f);
+  for (; *name; name++)
+    fputc(isgraph((unsigned char)*name) ? *name : '_', f);
+  return;
+}
@@ -29,6 +29,7 @@
 
 static int alloc_bufs(CONN *conn);
 static int set_topts(const CONN *conn, int rate);
+static const char *set_byte_usec(CONN *conn, int rate);
 
 /*
  * Description : Opens and configures a serial port.
@@ -42,7 +43,7 @@ static int set_topts(const CONN *conn, int rate);
  */
 extern int tty_open(CONN *conn, const char *dev, int rate)
 {
-  char rate_s[6];
+  const char *rate_s = "";
   if (alloc_bufs(conn)) return -1;
 #ifdef _WIN32
     conn->tty_fd = (int)CreateFile(dev, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -51,73 +52,70 @@ extern int tty_open(CONN *conn, const char *dev, int rate)
         return -1;
     }
 #else
-  conn->tty_fd = open(dev, O_FLAGS);
-  if (conn->tty_fd < 0)
+  /*
+   * A TTY handed over by a restarting df1d keeps the data in its buffers.
+   */
+  if ((conn->tty_fd = handoff_tty(conn->name, dev)) >= 0)
+    {
+      if (set_topts(conn, rate))
+	{
+	  close(conn->tty_fd);
+	  return -1;
+	}
+    }
+  else if ((conn->tty_fd = open(dev, O_FLAGS)) < 0)
     {
       log_msg(LOG_ERR, "%s:%d [%s] Error opening TTY device : %s\n",
 	      __FILE__, __LINE__, conn->name, strerror(errno));
       return -1;
     }
-  if (!isatty(conn->tty_fd)) /* Make sure device is a TTY. */
+  else if (!isatty(conn->tty_fd)) /* Make sure device is a TTY. */
     {
       log_msg(LOG_ERR, "%s:%d [%s] %s is not a TTY.\n",
 	      __FILE__, __LINE__, conn->name, dev);
       close(conn->tty_fd);
       return -1;
     }
-  if (set_topts(conn, rate))
+  else if (set_topts(conn, rate))
     {
       close(conn->tty_fd);
       return -1;
     }
-  if (tcflush(conn->tty_fd, TCIOFLUSH)) /* Flush the I/O buffers. */
+  else if (tcflush(conn->tty_fd, TCIOFLUSH)) /* Flush the I/O buffers. */
     {
       log_msg(LOG_ERR, "%s:%d [%s] Error flushing TTY I/O buffers : %s\n",
 	      __FILE__, __LINE__, conn->name, strerror(errno));
       close(conn->tty_fd);
       return -1;
     }
-  switch (rate)
-    {
-    case B110:
-      strcpy(rate_s, "110");
-      conn->byte_usec = 91000;
-      break;
-    case B300:
-      strcpy(rate_s, "300");
-      conn->byte_usec = 34000;
-      break;
-    case B600:
-      strcpy(rate_s, "600");
-      conn->byte_usec = 17000;
-      break;
-    case B1200:
-      strcpy(rate_s, "1200");
-      conn->byte_usec = 8400;
-      break;
-    case B2400:
-      strcpy(rate_s, "2400");
-      conn->byte_usec = 4200;
-      break;
-    case B9600:
-      strcpy(rate_s, "9600");
-      conn->byte_usec = 1100;
-      break;
-    case B19200:
-      strcpy(rate_s, "19200");
-      conn->byte_usec = 530;
-      break;
-    case B38400:
-      strcpy(rate_s, "38400");
-      conn->byte_usec = 270;
-      break;
-    }
+  rate_s = set_byte_usec(conn, rate);
+  conn->tty_rate = rate;
 #endif
   log_msg(LOG_DEBUG, "%s:%d [%s] %s initialized at %sbps 8N1.\n", __FILE__,
 	  __LINE__, conn->name, dev, rate_s);
   return 0;
 }
 
+/*
+ * Description : Changes the baud rate of an open serial port.
+ *
+ * Arguments : conn - Connection pointer.
+ *             rate - New baud rate.
+ *
+ * Return Value : Zero upon success.
+ *                Non-zero if an error occured.
+ */
+extern int tty_set_rate(CONN *conn, int rate)
+{
+  const char *rate_s;
+  if (set_topts(conn, rate)) return -1;
+  rate_s = set_byte_usec(conn, rate);
+  conn->tty_rate = rate;
+  log_msg(LOG_INFO, "%s:%d [%s] Baud rate changed to %sbps.\n", __FILE__,
+	  __LINE__, conn->name, rate_s);
+  return 0;
+}
+
 /*
  * Description : Read's data from a connection's TTY.
  *
@@ -128,14 +126,16 @@ extern int tty_open(CONN *conn, const char *dev, int rate)
  */
 extern int tty_read(CONN *conn)
 {
-  if (buf_read(conn->tty_fd, conn->tty_in) < 0)
+  ssize_t len = ring_buf_read(conn->tty_fd, conn->tty_in);
+  if (len < 0)
     {
       log_msg(LOG_ERR, "%s:%d [%s] Error reading from TTY : %s\n", __FILE__,
 	      __LINE__, conn->name, strerror(errno));
       return -1;
     }
+  conn->dcnts.bytes_in += len;
   log_msg(LOG_DEBUG, "%s:%d [%s] %u byte(s) received from TTY.\n", __FILE__,
-	  __LINE__, conn->name, conn->tty_in->len);
+	  __LINE__, conn->name, rbuf_len(conn->tty_in));
   return 0;
 }
 
@@ -149,7 +149,7 @@ extern int tty_read(CONN *conn)
  */
 extern int tty_write(CONN *conn)
 {
-  ssize_t len = buf_write(conn->tty_fd, conn->tty_out);
+  ssize_t len = ring_buf_write(conn->tty_fd, conn->tty_out);
   if (len < 0)
     {
       log_msg(LOG_ERR,
@@ -157,9 +157,19 @@ extern int tty_write(CONN *conn)
 	      conn->name, strerror(errno));
       return -1;
     }
+  conn->dcnts.bytes_out += len;
   log_msg(LOG_DEBUG, "%s:%d [%s] Wrote %u byte(s) to TTY.\n", __FILE__,
 	  __LINE__, conn->name, len);
-  if (!conn->tty_out->len) tx_data_sent(conn);
+  /*
+   * With io_uring the data is only copied here; the transmitter is told
+   * once the write completes.
+   */
+  if (!rbuf_len(conn->tty_out) && !ring_wr_pend(conn->tty_fd))
+    {
+      rt_ack_sent(conn);
+      tx_data_sent(conn);
+      master_data_sent(conn);
+    }
   return 0;
 }
 
@@ -174,8 +184,9 @@ extern void tty_close(CONN *conn)
 {
   log_msg(LOG_DEBUG, "%s:%d [%s] Closing TTY.\n", __FILE__, __LINE__,
 	  conn->name);
-  buf_free(conn->tty_in);
-  buf_free(conn->tty_out);
+  rbuf_free(conn->tty_in);
+  rbuf_free(conn->tty_out);
+  ring_forget(conn->tty_fd);
  again:
   if (close(conn->tty_fd))
     {
@@ -318,20 +329,60 @@ static int set_topts(const CONN *conn, int rate)
  */
 static int alloc_bufs(CONN *conn)
 {
-  conn->tty_in = buf_new(TTY_BUF_SIZE);
+  conn->tty_in = rbuf_new(TTY_BUF_SIZE);
   if (conn->tty_in == NULL)
     {
       log_msg(LOG_ERR, "%s:%d [%s] Error allocating TTY buffers : %s\n",
 	      __FILE__, __LINE__, conn->name, strerror(errno));
       return -1;
     }
-  conn->tty_out = buf_new(TTY_BUF_SIZE);
+  conn->tty_out = rbuf_new(TTY_BUF_SIZE);
   if (conn->tty_out == NULL)
     {
-      buf_free(conn->tty_in);
+      rbuf_free(conn->tty_in);
       log_msg(LOG_ERR, "%s:%d [%s] Error allocating TTY buffers : %s\n",
 	      __FILE__, __LINE__, conn->name, strerror(errno));
       return -1;
     }
   return 0;
 }
+
+/*
+ * Description : Sets the time needed to transmit one byte.
+ *
+ * Arguments : conn - Connection pointer.
+ *             rate - TTY baud rate.
+ *
+ * Return Value : The baud rate as text.
+ */
+static const char *set_byte_usec(CONN *conn, int rate)
+{
+  switch (rate)
+    {
+    case B110:
+      conn->byte_usec = 91000;
+      return "110";
+    case B300:
+      conn->byte_usec = 34000;
+      return "300";
+    case B600:
+      conn->byte_usec = 17000;
+      return "600";
+    case B1200:
+      conn->byte_usec = 8400;
+      return "1200";
+    case B2400:
+      conn->byte_usec = 4200;
+      return "2400";
+    case B9600:
+      conn->byte_usec = 1100;
+      return "9600";
+    case B19200:
+      conn->byte_usec = 530;
+      return "19200";
+    case B38400:
+      conn->byte_usec = 270;
+      return "38400";
+    }
+  return "";
+}
@@ -31,6 +31,7 @@ static int alloc_bufs(CONN *conn);
 static void send_msg(CONN *conn);
 static void send_enq(CONN *conn);
 static void flush_msg(TX *tx);
+static int append_stn(BUF *dst, uint8_t stn);
 
 /*
  * Description : Initializes a message transmitter.
@@ -46,10 +47,8 @@ extern int tx_init(CONN *conn, unsigned int max_nak, unsigned int max_enq,
 		   unsigned int ack_timeout)
 {
   if (alloc_bufs(conn)) return -1;
-  conn->tx.max_nak = max_nak;
-  conn->tx.max_enq = max_enq;
   conn->tx.state = TX_IDLE;
-  conn->tx.tticks = ack_timeout / (TICK_USEC / 1000);
+  tx_config(conn, max_nak, max_enq, ack_timeout);
   log_msg(LOG_DEBUG, "%s:%d [%s] Transmitter initialized."
 	  " Max NAKs - %u, Mak ENQs - %u, %u tick(s) ACK timeout.\n", __FILE__,
 	  __LINE__, conn->name, conn->tx.max_nak, conn->tx.max_enq,
@@ -57,6 +56,26 @@ extern int tx_init(CONN *conn, unsigned int max_nak, unsigned int max_enq,
   return 0;
 }
 
+/*
+ * Description : Sets the transmitter's retry limits and ACK timeout. New
+ *               values apply to a message already being transmitted.
+ *
+ * Arguments : conn - Connection pointer.
+ *             max_nak - Maximum NAKs before giving up.
+ *             max_enq - Maximum ENQs sent before giving up.
+ *             ack_timeout - Milliseconds to wait for an ACK.
+ *
+ * Return Value : None.
+ */
+extern void tx_config(CONN *conn, unsigned int max_nak, unsigned int max_enq,
+		      unsigned int ack_timeout)
+{
+  conn->tx.max_nak = max_nak;
+  conn->tx.max_enq = max_enq;
+  conn->tx.tticks = ack_timeout / (TICK_USEC / 1000);
+  return;
+}
+
 /*
  * Description : Accepts a message from a client for transmission over a DF1
  *               connection.
@@ -74,10 +93,32 @@ extern void tx_msg(CONN *conn, CLIENT *client)
   register uint8_t bcc = 0;
   log_msg(LOG_DEBUG, "%s:%d [%s.%s] Beginning message transmission.\n",
 	  __FILE__, __LINE__, conn->name, client->name);
+  /*
+   * The destination address is the first application layer byte.
+   */
+  conn->tx.stn = (client->df1_tx->index < client->df1_tx->len)
+    ? client->df1_tx->data[client->df1_tx->index] : 0;
+  overflow = 0;
+  /*
+   * A half-duplex master addresses the message to the slave with
+   * DLE SOH STN ahead of the DLE STX. The station is part of the checksum.
+   */
+  if (conn->duplex == DUPLEX_MASTER)
+    {
+      overflow |= buf_append_byte(conn->tx.msg, SYM_DLE);
+      overflow |= buf_append_byte(conn->tx.msg, SYM_SOH);
+      overflow |= append_stn(conn->tx.msg, conn->tx.stn);
+      if (conn->use_crc)
+	{
+	  register unsigned int i;
+	  CRC_ADD(i, crc, conn->tx.stn);
+	}
+      else bcc += conn->tx.stn;
+    }
   /*
    * Start the message with DLE STX.
    */
-  overflow = buf_append_byte(conn->tx.msg, SYM_DLE);
+  overflow |= buf_append_byte(conn->tx.msg, SYM_DLE);
   overflow |= buf_append_byte(conn->tx.msg, SYM_STX);
   /*
    * Add application layer message from the client.
@@ -157,6 +198,11 @@ extern void tx_tick(CONN *conn)
   * Pause TX timeouts while receiving.
   */
   if (!conn->embed_rsp && rx_active(&conn->rx)) return;
+  /*
+   * A half-duplex slave may only transmit when polled; an unacknowledged
+   * message is sent again in answer to the next poll, see tx_resend().
+   */
+  if (conn->duplex == DUPLEX_SLAVE) return;
   if ((conn->tx.state == TX_PEND_RESP)
       && (++conn->tx.eticks > conn->tx.tticks))
     {
@@ -173,7 +219,11 @@ extern void tx_tick(CONN *conn)
 	  client_msg_tx_fail(conn);
 	  return;
 	}
-      else send_enq(conn);
+      /*
+       * There is no ENQ in half-duplex, the message itself is sent again.
+       */
+      else if (conn->duplex == DUPLEX_FULL) send_enq(conn);
+      else send_msg(conn);
     }
   return;
 }
@@ -191,6 +241,7 @@ extern void tx_ack(CONN *conn)
 	  conn->name);
   if (conn->tx.state == TX_PEND_RESP)
     {
+      if (!conn->tx.enq_cnt) stats_msg_acked(conn);
       flush_msg(&conn->tx);
       conn->dcnts.tx_success++;
       client_msg_tx_ok(conn);
@@ -232,7 +283,10 @@ extern void tx_nak(CONN *conn)
 	  conn->dcnts.tx_fail++;
 	  client_msg_tx_fail(conn);
 	}
-      else send_msg(conn); /* Retransmission. */
+      /*
+       * Retransmission, a half-duplex slave waits to be polled again.
+       */
+      else if (conn->duplex != DUPLEX_SLAVE) send_msg(conn);
     }
   else
     {
@@ -244,6 +298,89 @@ extern void tx_nak(CONN *conn)
   return;
 }
 
+/*
+ * Description : Appends a half-duplex poll, DLE ENQ STN followed by the
+ *               checksum, to a connection's TTY output buffer. The BCC is
+ *               the two's complement of the station address; the CRC covers
+ *               the station address and the ENQ.
+ *
+ * Arguments : conn - Connection pointer.
+ *             stn - Station address of the polled slave.
+ *
+ * Return Value : None.
+ */
+extern void tx_poll(CONN *conn, uint8_t stn)
+{
+  uint8_t poll[6];
+  size_t len = 0;
+  log_msg(LOG_DEBUG, "%s:%d [%s] Polling station %u.\n", __FILE__,
+	  __LINE__, conn->name, stn);
+  poll[len++] = SYM_DLE;
+  poll[len++] = SYM_ENQ;
+  poll[len++] = stn;
+  if (stn == SYM_DLE) poll[len++] = SYM_DLE;
+  if (conn->use_crc)
+    {
+      register uint16_t crc = 0;
+      register unsigned int i;
+      CRC_ADD(i, crc, stn);
+      CRC_ADD(i, crc, SYM_ENQ);
+      poll[len++] = crc & 0xff;
+      poll[len++] = crc >> 8;
+    }
+  else poll[len++] = ~stn + 1;
+  if (rbuf_put(conn->tty_out, poll, len))
+    log_msg(LOG_ERR, "%s:%d [%s] Poll transmission failed because TTY"
+	    " output buffer full.\n", __FILE__, __LINE__, conn->name);
+  return;
+}
+
+/*
+ * Description : Appends a DLE EOT to a connection's TTY output buffer, a
+ *               half-duplex slave's answer to a poll when it has nothing to
+ *               send.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : None.
+ */
+extern void tx_eot(CONN *conn)
+{
+  log_msg(LOG_DEBUG, "%s:%d [%s] Sending DLE EOT.\n", __FILE__, __LINE__,
+	  conn->name);
+  if (rbuf_put_byte(conn->tty_out, SYM_DLE) ||
+      rbuf_put_byte(conn->tty_out, SYM_EOT))
+    log_msg(LOG_ERR, "%s:%d [%s] Failed to send EOT due to TTY buffer"
+	    " full.\n", __FILE__, __LINE__, conn->name);
+  return;
+}
+
+/*
+ * Description : Sends the current message again. Used by a half-duplex slave
+ *               polled again by a master that didn't acknowledge the
+ *               message. The ENQ limit bounds the retries.
+ *
+ * Arguments : conn - Connection pointer.
+ *
+ * Return Value : Zero if the message was sent again.
+ *                Non-zero if the message was given up on.
+ */
+extern int tx_resend(CONN *conn)
+{
+  conn->dcnts.resp_timeouts++;
+  if (++conn->tx.enq_cnt > conn->tx.max_enq)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Message transmission failed after %u"
+	      " retries.\n", __FILE__, __LINE__, conn->name, conn->tx.max_enq);
+      flush_msg(&conn->tx);
+      conn->dcnts.tx_fail++;
+      client_msg_tx_fail(conn);
+      return -1;
+    }
+  send_msg(conn);
+  return tx_busy(&conn->tx) ? 0 : -1;
+}
+
 /*
  * Description : Determines if a transmitter can accept a new message to send.
  *
@@ -305,7 +442,7 @@ static int alloc_bufs(CONN *conn)
 static void send_msg(CONN *conn)
 {
   conn->tx.state = TX_PEND_MSG_TX;
-  if (buf_append_buf(conn->tty_out, conn->tx.msg))
+  if (rbuf_put(conn->tty_out, conn->tx.msg->data, conn->tx.msg->len))
     {
       log_msg(LOG_ERR, "%s:%d [%s] Message transmission failed"
 	      " because TTY output buffer full.\n", __FILE__, __LINE__,
@@ -313,6 +450,7 @@ static void send_msg(CONN *conn)
       flush_msg(&conn->tx);
       client_msg_tx_fail(conn);
     }
+  else stats_msg_sent(conn);
   return;
 }
 
@@ -328,8 +466,8 @@ static void send_enq(CONN *conn)
   conn->tx.state = TX_PEND_MSG_TX;
   log_msg(LOG_DEBUG, "%s:%d [%s] Sending DLE ENQ.\n", __FILE__, __LINE__,
 	  conn->name);
-  if (buf_append_byte(conn->tty_out, SYM_DLE) ||
-      buf_append_byte(conn->tty_out, SYM_ENQ))
+  if (rbuf_put_byte(conn->tty_out, SYM_DLE) ||
+      rbuf_put_byte(conn->tty_out, SYM_ENQ))
     {
       log_msg(LOG_ERR, "%s:%d [%s] ENQ transmission failed"
 	      " because TTY output buffer full.\n", __FILE__, __LINE__,
@@ -356,3 +494,20 @@ static void flush_msg(TX *tx)
   tx->state = TX_IDLE;
   return;
 }
+
+/*
+ * Description : Appends a half-duplex station address to a buffer. A station
+ *               address equal to DLE is sent as DLE DLE.
+ *
+ * Arguments : dst - Target buffer.
+ *             stn - Station address.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the buffer overflowed.
+ */
+static int append_stn(BUF *dst, uint8_t stn)
+{
+  int overflow = buf_append_byte(dst, stn);
+  if (stn == SYM_DLE) overflow |= buf_append_byte(dst, SYM_DLE);
+  return overflow;
+}
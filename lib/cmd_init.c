@@ -71,6 +71,8 @@ sent, the reply has been received and parsed successfully.
 - PCCC_ENOCON if called with a NULL connection pointer.
 - PCCC_ENOBUF if no message buffers were available.
 - PCCC_ECMD_NODELIVER if the link layer service could not deliver the command.
+- PCCC_ECMD_EXPIRED if the link layer service discarded the command because
+the deadline set with pccc_set_deadline() passed before it could be sent.
 - PCCC_ECMD_TIMEOUT if a timeout occured while awaiting a reply.
 - PCCC_ECMD_REPLY if the received reply message contained an error.
 - PCCC_ELINK if a problem occured with the connection to the link layer
@@ -107,13 +109,17 @@ Available commands organized by function:
 - pccc_cmd_SetENQs()
 - pccc_cmd_ReadLinkParam()
 - pccc_cmd_SetLinkParam()
+- pccc_cmd_DiagnosticStatus()
+- pccc_cmd_DiagnosticRead()
+- pccc_cmd_ReadDiagCounters()
+- pccc_cmd_ResetDiagCounters()
 */
 
 #include "pccc.h"
 #include "private.h"
 
 static PCCC_RET_T send_oaat(PCCC *con, DF1MSG *cmd);
-static PCCC_RET_T oaat_timeout(PCCC *con, DF1MSG *cmd);
+static PCCC_RET_T oaat_timeout(PCCC *con, PCCC *via, DF1MSG *cmd);
 
 /*
 * Description : Finds and initializes a new command message. This function
@@ -192,6 +198,8 @@ extern PCCC_RET_T cmd_init(PCCC *con, DF1MSG **pm, UFUNC notify, RFUNC reply,
 *                             was successfully received and parsed.
 *                PCCC_ECMD_NODELIVER if the link layer service was
 *                                    unable to transmit the command.
+*                PCCC_ECMD_EXPIRED if the link layer service discarded
+*                                  the command after its deadline passed.
 *                PCCC_ECMD_REPLY if the received reply contained an error.
 *                PCCC_ECMD_TIMEOUT if a timeout occured awaiting a reply.
 *                PCCC_EFATAL if a fatal error occured.
@@ -215,6 +223,8 @@ extern PCCC_RET_T cmd_send(PCCC *con, DF1MSG *cmd)
 *                             was successfully received and parsed.
 *                PCCC_ECMD_NODELIVER if the link layer service was
 *                                    unable to transmit the command.
+*                PCCC_ECMD_EXPIRED if the link layer service discarded
+*                                  the command after its deadline passed.
 *                PCCC_ECMD_REPLY if the received reply contained an error.
 *                PCCC_ECMD_TIMEOUT if a timeout occured awaiting a reply.
 *                PCCC_EFATAL if a fatal error occured.
@@ -223,11 +233,26 @@ static PCCC_RET_T send_oaat(PCCC *con, DF1MSG *cmd)
 {
     PCCC_RET_T ret;
     PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    PCCC *via = con; /* Connection carrying the command. */
+    PCCC_PRIV *via_priv = con_priv;
+    /*
+    * A pooled connection sends the command on an idle sub-connection, but
+    * keeps servicing all of them while waiting.
+    */
+    if (con_priv->subs != NULL) {
+        via = pool_assign(con_priv, cmd);
+        if (via == NULL) {
+            strncpy(con_priv->errstr, "All sub-connections busy", PCCC_ERR_LEN);
+            msg_flush(cmd);
+            return PCCC_ECMD_NOBUF;
+        }
+        via_priv = (PCCC_PRIV *)via->priv_data;
+    }
     /*
     * Transmit the command to the link layer.
     */
-    con_priv->cur_msg = cmd;
-    ret = msg_send(con_priv);
+    via_priv->cur_msg = cmd;
+    ret = msg_send(via_priv);
     if (ret != PCCC_SUCCESS) return ret;
     ret = pccc_write(con);
     if (ret != PCCC_SUCCESS) return ret;
@@ -236,16 +261,16 @@ static PCCC_RET_T send_oaat(PCCC *con, DF1MSG *cmd)
     */
     for (;;) {
         int ack_sent = 0;
-        ret = oaat_timeout(con, cmd);
+        ret = oaat_timeout(con, via, cmd);
         if (ret != PCCC_SUCCESS) return ret;
         ret = pccc_read(con);
         if (ret != PCCC_SUCCESS) return ret;
         /*
         * If the command has been marked as unused, the link layer responded
         * to the command with a NAK, meaning it was unable to deliver
-        * the message.
+        * the message, or discarded it because its deadline passed.
         */
-        if (cmd->state == MSG_UNUSED) return PCCC_ECMD_NODELIVER;
+        if (cmd->state == MSG_UNUSED) return cmd->result;
         /*
         * Send an ACK to the link layer after the reply has been received.
         * The ACK byte has already been placed in the output buffer by
@@ -260,14 +285,16 @@ static PCCC_RET_T send_oaat(PCCC *con, DF1MSG *cmd)
         if (cmd->state == MSG_CMD_DONE) break;
     }
     msg_flush(cmd);
-    con_priv->msg_in->index = 6; /* Set buffer index to first byte of data. */
+    via_priv->msg_in->index = 6; /* Set buffer index to first byte of data. */
     /*
     * Check the returned STS and parse the reply.
     */
-    return
-        sts_check(con, con_priv->msg_in)
-        || (cmd->reply && cmd->reply(con_priv->msg_in, cmd, con_priv->errstr))
+    ret =
+        sts_check(via, via_priv->msg_in)
+        || (cmd->reply && cmd->reply(via_priv->msg_in, cmd, via_priv->errstr))
         ? PCCC_ECMD_REPLY : PCCC_SUCCESS;
+    if (via != con) strcpy(con_priv->errstr, via_priv->errstr);
+    return ret;
 }
 
 /*
@@ -276,6 +303,8 @@ static PCCC_RET_T send_oaat(PCCC *con, DF1MSG *cmd)
 *               operation.
 *
 * Arguments : con - Link layer connection pointer.
+*             via - Connection carrying the command, a sub-connection of
+*                   con if pooled, otherwise con itself.
 *             cmd - Pointer to the command current command being sent.
 *
 * Return Value : PCCC_SUCCESS when it is ok to read() from the link layer
@@ -285,9 +314,10 @@ static PCCC_RET_T send_oaat(PCCC *con, DF1MSG *cmd)
 *                                  message but still awaiting a reply.
 *                PCCC_EFATAL if the select() system call fails.
 */
-static PCCC_RET_T oaat_timeout(PCCC *con, DF1MSG *cmd)
+static PCCC_RET_T oaat_timeout(PCCC *con, PCCC *via, DF1MSG *cmd)
 {
     int num_fds;
+    int high;
     struct timeval timeout;
     PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
     fd_set read_test;
@@ -300,12 +330,13 @@ static PCCC_RET_T oaat_timeout(PCCC *con, DF1MSG *cmd)
     * Do not block with timeout if a message, which *SHOULD* be the awaited
     * reply, is currently being received from the link layer.
     */
-    if (con_priv->read_mode != READ_MODE_IDLE) return PCCC_SUCCESS;
+    if (((PCCC_PRIV *)via->priv_data)->read_mode != READ_MODE_IDLE)
+        return PCCC_SUCCESS;
     FD_ZERO(&read_test);
-    FD_SET(con->fd, &read_test);
+    high = pccc_pool_fds(con, &read_test, NULL);
     timeout.tv_sec = con->timeout;
     timeout.tv_usec = 0;
-    num_fds = select(con->fd + 1, &read_test, NULL, NULL, &timeout);
+    num_fds = select(high + 1, &read_test, NULL, NULL, &timeout);
     if (num_fds < 0) {
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "select() failed : %s", strerror(errno));
         return PCCC_EFATAL;
@@ -300,3 +300,152 @@ extern PCCC_RET_T pccc_cmd_SetLinkParam(PCCC *con, UFUNC notify, uint8_t dnode,
     }
     return cmd_send(con, cmd);
 }
+
+/**
+Reads the diagnostic status of a node. The reply identifies the processor or
+interface module, its mode, series and revision; see \ref PCCC_DIAG_STATUS_T.
+
+Compatibility as listed in Allen Bradley documentation:
+- PLC-5
+- SLC-500
+- SLC-5/03
+- SLC-5/04
+- MicroLogix 1000
+
+Tested with the following products:
+-
+
+\param udata Pointer to location to store the status.
+*/
+extern PCCC_RET_T pccc_cmd_DiagnosticStatus(PCCC *con, UFUNC notify, uint8_t dnode, PCCC_DIAG_STATUS_T *udata)
+{
+    DF1MSG *cmd;
+    PCCC_RET_T ret;
+    PCCC_PRIV *con_priv;
+    if (con == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if (udata == NULL) {
+        strncpy(con_priv->errstr, "Udata cannot be NULL", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    ret = cmd_init(con, &cmd, notify, reply_DiagnosticStatus, dnode, (void *)udata, 0x06, 0x03);
+    if (ret != PCCC_SUCCESS) return ret;
+    return cmd_send(con, cmd);
+}
+
+/**
+Reads bytes from a node's diagnostic area. What lives at each address is
+product specific; pccc_cmd_ReadDiagCounters() decodes the DF1 channel
+counters of SLC-500 and MicroLogix processors.
+
+Compatibility as listed in Allen Bradley documentation:
+- PLC-5
+- SLC-500
+- SLC-5/03
+- SLC-5/04
+- MicroLogix 1000
+
+Tested with the following products:
+-
+
+\param udata Pointer to location to store the bytes read.
+\param addr Diagnostic address of the first byte.
+\param bytes Number of bytes to read, 1 to 244.
+
+\return
+- PCCC_EPARAM if either the udata or bytes parameter was invalid.
+*/
+extern PCCC_RET_T pccc_cmd_DiagnosticRead(PCCC *con, UFUNC notify, uint8_t dnode, uint8_t *udata, uint16_t addr, size_t bytes)
+{
+    DF1MSG *cmd;
+    PCCC_RET_T ret;
+    PCCC_PRIV *con_priv;
+    if (con == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if (udata == NULL) {
+        strncpy(con_priv->errstr, "Udata cannot be NULL", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    if (!bytes || (bytes > 244)) {
+        strncpy(con_priv->errstr, "Number of bytes must be 1 to 244", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    ret = cmd_init(con, &cmd, notify, reply_DiagnosticRead, dnode, (void *)udata, 0x06, 0x01);
+    if (ret != PCCC_SUCCESS) return ret;
+    if (buf_append_word(cmd->buf, htols(addr)) /* Address */
+        || buf_append_byte(cmd->buf, bytes)) /* Size */
+    {
+        strncpy(con_priv->errstr, "pccc_cmd_DiagnosticRead()", PCCC_ERR_LEN);
+        msg_flush(cmd);
+        return PCCC_EOVERFLOW;
+    }
+    cmd->bytes = bytes;
+    return cmd_send(con, cmd);
+}
+
+/**
+Reads the DF1 full-duplex channel diagnostic counters of a node with a
+diagnostic read of \ref PCCC_DIAG_CNT_WORDS words. The counters complement
+the link counters df1d keeps for its own end of the link: comparing the
+two shows which direction of a noisy link loses frames.
+
+The address of the counter block differs between products and channels and
+is given by the product's documentation.
+
+Compatibility as listed in Allen Bradley documentation:
+- SLC-5/03
+- SLC-5/04
+- SLC-5/05
+- MicroLogix 1000
+
+Tested with the following products:
+-
+
+\param udata Pointer to location to store the counters.
+\param addr Diagnostic address of the counter block.
+*/
+extern PCCC_RET_T pccc_cmd_ReadDiagCounters(PCCC *con, UFUNC notify, uint8_t dnode, PCCC_DIAG_CNT_T *udata, uint16_t addr)
+{
+    DF1MSG *cmd;
+    PCCC_RET_T ret;
+    PCCC_PRIV *con_priv;
+    if (con == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if (udata == NULL) {
+        strncpy(con_priv->errstr, "Udata cannot be NULL", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    ret = cmd_init(con, &cmd, notify, reply_ReadDiagCounters, dnode, (void *)udata, 0x06, 0x01);
+    if (ret != PCCC_SUCCESS) return ret;
+    if (buf_append_word(cmd->buf, htols(addr)) /* Address */
+        || buf_append_byte(cmd->buf, PCCC_DIAG_CNT_WORDS * 2)) /* Size */
+    {
+        strncpy(con_priv->errstr, "pccc_cmd_ReadDiagCounters()", PCCC_ERR_LEN);
+        msg_flush(cmd);
+        return PCCC_EOVERFLOW;
+    }
+    return cmd_send(con, cmd);
+}
+
+/**
+Clears the diagnostic counters of a node.
+
+Compatibility as listed in Allen Bradley documentation:
+- PLC-5
+- SLC-500
+- SLC-5/03
+- SLC-5/04
+- MicroLogix 1000
+
+Tested with the following products:
+-
+*/
+extern PCCC_RET_T pccc_cmd_ResetDiagCounters(PCCC *con, UFUNC notify, uint8_t dnode)
+{
+    DF1MSG *cmd;
+    PCCC_RET_T ret;
+    if (con == NULL) return PCCC_ENOCON;
+    ret = cmd_init(con, &cmd, notify, NULL, dnode, NULL, 0x06, 0x07);
+    if (ret != PCCC_SUCCESS) return ret;
+    return cmd_send(con, cmd);
+}
@@ -680,6 +680,29 @@ extern PCCC_RET_T pccc_cmd_ReadModifyWrite(PCCC *con, UFUNC notify, uint8_t dnod
     return cmd_send(con, cmd);
 }
 
+/*
+* Description : Sends a protected typed logical read with three address
+*               fields whose reply data is copied as received into a buffer
+*               rather than decoded. Used by the polling layer, which keeps
+*               the data in this form until it is requested.
+*
+* Arguments : dst - Buffer receiving the data, passed to the notification
+*                   function as the user data.
+*
+* Return Value : Same as pccc_cmd_ProtectedTypedLogicalRead3AddressFields().
+*/
+extern PCCC_RET_T cmd_read_raw(PCCC *con, UFUNC notify, uint8_t dnode,
+                               BUF *dst, PCCC_FT_T file_type, uint16_t file,
+                               uint16_t element, size_t num_elements)
+{
+    DF1MSG *cmd;
+    PCCC_RET_T ret;
+    ret = ptl_init(con, &cmd, notify, dnode, dst, 0xa2, file_type, file, element, 0, num_elements);
+    if (ret != PCCC_SUCCESS) return ret;
+    cmd->reply = reply_Raw;
+    return cmd_send(con, cmd);
+}
+
 /*
 * Description : Initializes a 'protected typed logical read/write' command.
 *
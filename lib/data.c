@@ -61,6 +61,8 @@ static PCCC_RET_T enc_float(BUF *dest, const void *src, char *err);
 static PCCC_RET_T dec_float(BUF *src, void *dest, char *err);
 static PCCC_RET_T enc_str(BUF *dest, const void *src, char *err);
 static PCCC_RET_T dec_str(BUF *src, void *dest, char *err);
+static int enc_words(BUF *dest, const void *src, unsigned int n, size_t size);
+static int dec_words(BUF *src, void *dest, unsigned int n, size_t size);
 
 /*
 * Description : Encodes an array of data into a command message. The source
@@ -106,6 +108,15 @@ extern PCCC_RET_T data_enc_array(DF1MSG *msg, char *err)
             return -1;
             break;
     }
+    /* Packed integer and float arrays are converted in one pass. */
+    if (((encoder == enc_int) && (msg->usize == 2))
+        || ((encoder == enc_float) && (msg->usize == 4))) {
+        if (enc_words(msg->buf, udata, elements, msg->usize)) {
+            strncpy(err, "data_enc_array()", PCCC_ERR_LEN);
+            return PCCC_EOVERFLOW;
+        }
+        return 0;
+    }
     while (elements--) {
         PCCC_RET_T ret;
         ret = encoder(msg->buf, udata, err);
@@ -155,6 +166,14 @@ extern PCCC_RET_T data_dec_array(BUF *rply, DF1MSG *msg, char *err)
             return PCCC_EPARAM;
             break;
     }
+    if (((decoder == dec_int) && (msg->usize == 2))
+        || ((decoder == dec_float) && (msg->usize == 4))) {
+        if (dec_words(rply, udata, elements, msg->usize)) {
+            strncpy(err, "data_dec_array()", PCCC_ERR_LEN);
+            return PCCC_EOVERFLOW;
+        }
+        return PCCC_SUCCESS;
+    }
     while (elements--) {
         PCCC_RET_T ret;
         ret = decoder(rply, udata, err);
@@ -164,6 +183,58 @@ extern PCCC_RET_T data_dec_array(BUF *rply, DF1MSG *msg, char *err)
     return PCCC_SUCCESS;
 }
 
+/*
+* Description : Looks up the sizes of a data table element type.
+*
+* Arguments : type - Element type.
+*             usize - Location to store the host size of an element.
+*             bytes - Location to store the number of bytes used to transfer
+*                     an element.
+*
+* Return Value : Zero if successful.
+*                Non-zero if the type is not supported.
+*/
+extern int data_type_size(PCCC_FT_T type, size_t *usize, size_t *bytes)
+{
+    switch (type) {
+        case PCCC_FT_INT:
+            *usize = sizeof(PCCC_INT_T);
+            *bytes = PCCC_SO_INT;
+            break;
+        case PCCC_FT_BIN:
+            *usize = sizeof(PCCC_BIN_T);
+            *bytes = PCCC_SO_BIN;
+            break;
+        case PCCC_FT_TIMER:
+            *usize = sizeof(PCCC_TIMER_T);
+            *bytes = PCCC_SO_TIMER;
+            break;
+        case PCCC_FT_COUNT:
+            *usize = sizeof(PCCC_COUNT_T);
+            *bytes = PCCC_SO_COUNT;
+            break;
+        case PCCC_FT_CTL:
+            *usize = sizeof(PCCC_CTL_T);
+            *bytes = PCCC_SO_CTL;
+            break;
+        case PCCC_FT_FLOAT:
+            *usize = sizeof(PCCC_FLOAT_T);
+            *bytes = PCCC_SO_FLOAT;
+            break;
+        case PCCC_FT_STR:
+            *usize = sizeof(PCCC_STR_T);
+            *bytes = PCCC_SO_STR;
+            break;
+        case PCCC_FT_STAT:
+            *usize = sizeof(PCCC_STAT_T);
+            *bytes = PCCC_SO_STAT;
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
 /*
 * Description : Encodes a type/data parameter into a buffer. The type and size
 *               values must fit into a seven byte unsigned integer.
@@ -301,6 +372,50 @@ static int dec_td_param(BUF *src, uint64_t *x, int bytes)
     return 0;
 }
 
+/*
+* Description : Encodes an array of 16 or 32 bit words into a buffer.
+*
+* Arguments : dest - Target buffer.
+*             src - Words in host byte order.
+*             n - Number of words.
+*             size - Size of each word in bytes, 2 or 4.
+*
+* Return Value : Zero if successful.
+*                Non-zero if the buffer would overflow, no data is copied.
+*/
+static int enc_words(BUF *dest, const void *src, unsigned int n, size_t size)
+{
+    if (dest->len + n * size > dest->max) return -1;
+    if (size == 2)
+        htol16_array(dest->data + dest->len, (const uint16_t *)src, n);
+    else
+        htol32_array(dest->data + dest->len, (const uint32_t *)src, n);
+    dest->len += n * size;
+    return 0;
+}
+
+/*
+* Description : Decodes an array of 16 or 32 bit words from a buffer.
+*
+* Arguments : src - Source buffer.
+*             dest - Location for the words in host byte order.
+*             n - Number of words.
+*             size - Size of each word in bytes, 2 or 4.
+*
+* Return Value : Zero if successful.
+*                Non-zero if the buffer holds fewer words, none are decoded.
+*/
+static int dec_words(BUF *src, void *dest, unsigned int n, size_t size)
+{
+    if (src->index + n * size > src->len) return -1;
+    if (size == 2)
+        ltoh16_array((uint16_t *)dest, src->data + src->index, n);
+    else
+        ltoh32_array((uint32_t *)dest, src->data + src->index, n);
+    src->index += n * size;
+    return 0;
+}
+
 /*
 * Description : Encodes a sixteen bit signed integer into a buffer.
 *
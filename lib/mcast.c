@@ -0,0 +1,512 @@
+/*
+ * This file is part of libpccc.
+ * Allen Bradley PCCC message library.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/** \file mcast.c */
+
+/**
+\page mcast Multicast distribution of polled data
+
+When several hosts need the same data, one host can poll it and publish every
+block update to a UDP multicast group, so the load on the link stays the same
+regardless of the number of subscribers.
+
+- pccc_poll_publish() - Publishes a polling layer's blocks to a multicast
+group.
+- pccc_sub_new() - Joins a multicast group as a subscriber.
+- pccc_sub_fd() - Retrieves the subscriber socket for use with select().
+- pccc_sub_read() - Receives one block update.
+- pccc_sub_get_block() - Retrieves the latest data of a block.
+- pccc_sub_stats() - Retrieves the subscriber statistics.
+- pccc_sub_errstr() - Describes the last subscriber error.
+- pccc_sub_free() - Leaves the multicast group and frees a subscriber.
+
+Each time a block read completes, the publisher sends one datagram holding
+the block identifier, a sequence number, the time of the last good read, the
+block's quality and its raw link encoded data. Blocks are identified by the
+identifiers returned from pccc_poll_add_block() on the publisher, so
+subscribers must know the publisher's block layout.
+
+Datagrams can be lost, so the publisher also periodically resends every block
+as a full refresh. Subscribers use the sequence number to detect lost
+datagrams; after a gap, every block that hasn't been updated since is reported
+with PCCC_POLL_Q_STALE quality until it is sent again, at the latest by the
+next full refresh. A subscriber joining the group has every block within one
+refresh period.
+*/
+
+#include <fcntl.h>
+#include "pccc.h"
+#include "private.h"
+
+static int get_mcast_addr(struct sockaddr_in *addr, const char *group, in_port_t port);
+static int sub_parse(PCCC_SUB *sub, size_t len, unsigned int *block_id);
+static int sub_is_stale(const PCCC_SUB *sub, const SUB_BLOCK *b);
+
+/**
+Publishes a polling layer's block updates to a UDP multicast group. A
+datagram is sent each time a block read completes, and every block with data
+is resent every refresh period from pccc_poll_service().
+
+\param poll Pointer to the polling layer.
+\param group Multicast group address in dotted decimal notation.
+\param port UDP port.
+\param iface Address of the local interface to send from in dotted decimal
+notation, or NULL to use the default.
+\param ttl Multicast time to live. One restricts datagrams to the local
+network.
+\param refresh Full refresh period in milliseconds. Must be non-zero.
+
+\return
+- PCCC_SUCCESS if publishing was enabled.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if the group or interface was invalid, the polling layer is
+already publishing, or the refresh period was zero.
+- PCCC_EFATAL if the socket could not be created.
+*/
+extern PCCC_RET_T pccc_poll_publish(PCCC_POLL *poll, const char *group, in_port_t port, const char *iface, unsigned int ttl, unsigned int refresh)
+{
+    PCCC_PRIV *con_priv;
+    struct in_addr if_addr;
+    unsigned char opt;
+    struct timeval tv;
+    if (poll == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if ((poll->pub_fd >= 0) || !refresh) {
+        strncpy(con_priv->errstr, "Already publishing or invalid refresh period", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    if ((group == NULL) || get_mcast_addr(&poll->pub_addr, group, port)) {
+        strncpy(con_priv->errstr, "Invalid multicast group", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    if ((iface != NULL) && !inet_aton(iface, &if_addr)) {
+        strncpy(con_priv->errstr, "Invalid interface address", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    poll->pub_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (poll->pub_fd < 0) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "socket() failed : %s", strerror(errno));
+        return PCCC_EFATAL;
+    }
+    opt = (ttl > 255) ? 255 : ttl;
+    if (setsockopt(poll->pub_fd, IPPROTO_IP, IP_MULTICAST_TTL, &opt, sizeof(opt))
+        || ((iface != NULL) && setsockopt(poll->pub_fd, IPPROTO_IP, IP_MULTICAST_IF, &if_addr, sizeof(if_addr)))) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "setsockopt() failed : %s", strerror(errno));
+        pub_close(poll);
+        return PCCC_EFATAL;
+    }
+    /*
+     * Sending must never hold up the polling layer; datagrams that can't be
+     * queued are simply lost, which subscribers detect.
+     */
+    fcntl(poll->pub_fd, F_SETFL, fcntl(poll->pub_fd, F_GETFL) | O_NONBLOCK);
+    /*
+     * A new session identifier lets subscribers tell a restarted publisher
+     * from lost datagrams.
+     */
+    gettimeofday(&tv, NULL);
+    poll->pub_session = (uint32_t)(tv.tv_sec ^ (tv.tv_usec << 12) ^ getpid());
+    poll->pub_seq = 0;
+    poll->pub_refresh = refresh;
+    poll->next_refresh = 0;
+    return PCCC_SUCCESS;
+}
+
+/**
+Joins a multicast group to receive blocks published with
+pccc_poll_publish().
+
+\param group Multicast group address in dotted decimal notation.
+\param port UDP port.
+\param iface Address of the local interface to receive on in dotted decimal
+notation, or NULL to use the default.
+\param max_blocks Number of blocks on the publisher. Datagrams for a block
+identifier beyond it are discarded as invalid, so the block table can't be
+grown by stray or forged datagrams. Must be 1-65536.
+
+\return
+- A pointer to the new subscriber if successful.
+- NULL if a parameter was invalid, the group could not be joined, or a memory
+allocation error occured. errno describes the error.
+*/
+extern PCCC_SUB *pccc_sub_new(const char *group, in_port_t port, const char *iface, unsigned int max_blocks)
+{
+    PCCC_SUB *sub;
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    int opt = 1;
+    if ((group == NULL) || get_mcast_addr(&addr, group, port) || !max_blocks || (max_blocks > 0x10000)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    mreq.imr_multiaddr = addr.sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if ((iface != NULL) && !inet_aton(iface, &mreq.imr_interface)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    sub = (PCCC_SUB *)calloc(1, sizeof(PCCC_SUB));
+    if (sub == NULL) return NULL;
+    sub->max_blocks = max_blocks;
+    sub->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sub->fd < 0) {
+        free(sub);
+        return NULL;
+    }
+    /*
+     * Several subscribers may run on the same host.
+     */
+    if (setsockopt(sub->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))
+        || bind(sub->fd, (struct sockaddr *)&addr, sizeof(addr))
+        || setsockopt(sub->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))) {
+        int err = errno;
+        close(sub->fd);
+        free(sub);
+        errno = err;
+        return NULL;
+    }
+    return sub;
+}
+
+/**
+Retrieves a subscriber's socket so the user application can wait for
+datagrams with select() or similar.
+
+\param sub Pointer to the subscriber.
+
+\return The socket file descriptor, or -1 if the subscriber pointer was NULL.
+*/
+extern int pccc_sub_fd(const PCCC_SUB *sub)
+{
+    return (sub == NULL) ? -1 : sub->fd;
+}
+
+/**
+Receives one datagram. This blocks until a datagram arrives unless the
+socket from pccc_sub_fd() is readable or has been made non-blocking.
+
+\param sub Pointer to the subscriber.
+\param block_id Location to store the identifier of the updated block.
+
+\return
+- PCCC_SUCCESS if a block was updated.
+- PCCC_ENOCON if the subscriber pointer was NULL.
+- PCCC_EPARAM if the datagram was invalid or out of order and was discarded.
+- PCCC_ELINK if an error occured receiving from the socket, including
+EAGAIN on a non-blocking socket.
+- PCCC_EFATAL if a memory allocation error occured.
+*/
+extern PCCC_RET_T pccc_sub_read(PCCC_SUB *sub, unsigned int *block_id)
+{
+    ssize_t len;
+    if (sub == NULL) return PCCC_ENOCON;
+    do len = recv(sub->fd, sub->pkt, sizeof(sub->pkt), 0);
+    while ((len < 0) && (errno == EINTR));
+    if (len < 0) {
+        snprintf(sub->errstr, PCCC_ERR_LEN, "recv() failed : %s", strerror(errno));
+        return PCCC_ELINK;
+    }
+    switch (sub_parse(sub, len, block_id)) {
+        case 0:
+            return PCCC_SUCCESS;
+        case -1:
+            sub->invalid++;
+            return PCCC_EPARAM;
+        default:
+            snprintf(sub->errstr, PCCC_ERR_LEN, "realloc() failed : %s", strerror(errno));
+            return PCCC_EFATAL;
+    }
+}
+
+/**
+Retrieves the latest data of a block received by a subscriber, decoded into
+an array of the block's element type.
+
+\param sub Pointer to the subscriber.
+\param block_id Block identifier.
+\param udata Location to store the elements, or NULL to only retrieve the
+status. Must be large enough for the number of elements in the publisher's
+block. Left untouched if the block has not been received yet.
+\param info Location to store the block's status, or NULL if not required.
+The quality is PCCC_POLL_Q_NONE if the block has not been received, and
+PCCC_POLL_Q_STALE if datagrams were lost since it was last received.
+
+\return
+- PCCC_SUCCESS if successful.
+- PCCC_ENOCON if the subscriber pointer was NULL.
+- PCCC_EPARAM if the block's data could not be decoded.
+*/
+extern PCCC_RET_T pccc_sub_get_block(PCCC_SUB *sub, unsigned int block_id, void *udata, PCCC_POLL_INFO *info)
+{
+    SUB_BLOCK *b;
+    DF1MSG msg;
+    size_t usize, bytes;
+    if (sub == NULL) return PCCC_ENOCON;
+    b = (block_id < sub->num_blocks) ? sub->blocks + block_id : NULL;
+    if ((b == NULL) || (b->image == NULL)) {
+        if (info != NULL) {
+            memset(info, 0, sizeof(PCCC_POLL_INFO));
+            info->quality = PCCC_POLL_Q_NONE;
+        }
+        return PCCC_SUCCESS;
+    }
+    if (info != NULL) {
+        info->quality = sub_is_stale(sub, b) ? PCCC_POLL_Q_STALE : b->quality;
+        info->result = b->result;
+        info->time = b->time;
+    }
+    if ((udata == NULL) || (b->quality == PCCC_POLL_Q_NONE)) return PCCC_SUCCESS;
+    if (data_type_size(b->file_type, &usize, &bytes) || (b->image->len % bytes)) {
+        strncpy(sub->errstr, "Invalid block data", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    msg.elements = b->image->len / bytes;
+    msg.file_type = b->file_type;
+    msg.usize = usize;
+    msg.udata = udata;
+    b->image->index = 0;
+    return data_dec_array(b->image, &msg, sub->errstr);
+}
+
+/**
+Retrieves a subscriber's statistics.
+
+\param sub Pointer to the subscriber.
+\param stats Location to store the statistics.
+
+\return Does not return a value.
+*/
+extern void pccc_sub_stats(const PCCC_SUB *sub, PCCC_SUB_STATS *stats)
+{
+    if ((sub == NULL) || (stats == NULL)) return;
+    stats->rcvd = sub->rcvd;
+    stats->lost = sub->lost;
+    stats->gaps = sub->gaps;
+    stats->restarts = sub->restarts;
+    stats->invalid = sub->invalid;
+    return;
+}
+
+/**
+Describes the last error returned by a subscriber function.
+
+\param sub Pointer to the subscriber.
+
+\return A pointer to the error description.
+*/
+extern const char *pccc_sub_errstr(const PCCC_SUB *sub)
+{
+    return (sub == NULL) ? "Invalid subscriber" : sub->errstr;
+}
+
+/**
+Leaves the multicast group and frees a subscriber.
+
+\param sub Pointer to the subscriber to free.
+
+\return Does not return a value.
+*/
+extern void pccc_sub_free(PCCC_SUB *sub)
+{
+    size_t i;
+    if (sub == NULL) return;
+    close(sub->fd);
+    for (i = 0; i < sub->num_blocks; i++)
+        if (sub->blocks[i].image != NULL) buf_free(sub->blocks[i].image);
+    free(sub->blocks);
+    free(sub);
+    return;
+}
+
+/*
+* Description : Publishes a block's current data. Errors are ignored, the
+*               subscribers see them as lost datagrams.
+*
+* Arguments : poll - Polling layer.
+*             block_id - Block to publish.
+*             flags - Datagram flags.
+*
+* Return Value : None.
+*/
+extern void pub_block(PCCC_POLL *poll, unsigned int block_id, uint8_t flags)
+{
+    uint8_t pkt[PUB_HDR_LEN + PUB_DATA_MAX];
+    BUF out;
+    POLL_BLOCK *b = poll->blocks + block_id;
+    uint64_t sec = (uint64_t)b->time.tv_sec;
+    if ((poll->pub_fd < 0) || (b->quality == PCCC_POLL_Q_NONE)) return;
+    out.data = pkt;
+    out.max = sizeof(pkt);
+    buf_empty(&out);
+    buf_append_str(&out, PUB_MAGIC);
+    buf_append_byte(&out, PUB_VERSION);
+    buf_append_byte(&out, flags);
+    buf_append_long(&out, htoll(poll->pub_session));
+    buf_append_long(&out, htoll(poll->pub_seq++));
+    buf_append_word(&out, htols((uint16_t)block_id));
+    buf_append_byte(&out, (uint8_t)b->file_type);
+    buf_append_byte(&out, (uint8_t)b->quality);
+    buf_append_byte(&out, (uint8_t)b->result);
+    buf_append_byte(&out, (uint8_t)b->image->len);
+    buf_append_long(&out, htoll((uint32_t)sec));
+    buf_append_long(&out, htoll((uint32_t)(sec >> 32)));
+    buf_append_long(&out, htoll((uint32_t)b->time.tv_usec));
+    buf_append_blob(&out, b->image->data, b->image->len);
+    sendto(poll->pub_fd, out.data, out.len, 0, (struct sockaddr *)&poll->pub_addr, sizeof(poll->pub_addr));
+    return;
+}
+
+/*
+* Description : Stops publishing.
+*
+* Arguments : poll - Polling layer.
+*
+* Return Value : None.
+*/
+extern void pub_close(PCCC_POLL *poll)
+{
+    if (poll->pub_fd < 0) return;
+    close(poll->pub_fd);
+    poll->pub_fd = -1;
+    return;
+}
+
+/*
+* Description : Converts a multicast group address.
+*
+* Arguments : addr - Address structure to initialize.
+*             group - Group address in dotted decimal notation.
+*             port - UDP port.
+*
+* Return Value : Zero if successful.
+*                Non-zero if the address is invalid or not a multicast group.
+*/
+static int get_mcast_addr(struct sockaddr_in *addr, const char *group, in_port_t port)
+{
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    if (!inet_aton(group, &addr->sin_addr)) return -1;
+    return IN_MULTICAST(ntohl(addr->sin_addr.s_addr)) ? 0 : -1;
+}
+
+/*
+* Description : Parses a received datagram and updates the block it carries.
+*
+* Arguments : sub - Subscriber.
+*             len - Datagram length.
+*             block_id - Location to store the updated block identifier.
+*
+* Return Value : Zero if a block was updated.
+*                -1 if the datagram was invalid or out of order.
+*                -2 if a memory allocation error occured.
+*/
+static int sub_parse(PCCC_SUB *sub, size_t len, unsigned int *block_id)
+{
+    BUF in;
+    SUB_BLOCK *b;
+    uint8_t version, flags, type, quality, result, bytes;
+    uint16_t id;
+    uint32_t session, seq, sec_lo, sec_hi, usec;
+    in.data = sub->pkt;
+    in.max = sizeof(sub->pkt);
+    in.index = 0;
+    in.len = len;
+    if ((len < PUB_HDR_LEN) || memcmp(sub->pkt, PUB_MAGIC, 2)) return -1;
+    in.index = 2;
+    buf_get_byte(&in, &version);
+    buf_get_byte(&in, &flags);
+    buf_get_long(&in, &session);
+    buf_get_long(&in, &seq);
+    buf_get_word(&in, &id);
+    buf_get_byte(&in, &type);
+    buf_get_byte(&in, &quality);
+    buf_get_byte(&in, &result);
+    buf_get_byte(&in, &bytes);
+    buf_get_long(&in, &sec_lo);
+    buf_get_long(&in, &sec_hi);
+    buf_get_long(&in, &usec);
+    if ((version != PUB_VERSION) || (len != PUB_HDR_LEN + bytes)) return -1;
+    session = ltohl(session);
+    seq = ltohl(seq);
+    id = ltohs(id);
+    if (id >= sub->max_blocks) return -1;
+    if (!sub->synced || (session != sub->session)) {
+        /*
+         * Everything received from a previous publisher session is suspect
+         * until it is sent again.
+         */
+        size_t i;
+        if (sub->synced) sub->restarts++;
+        for (i = 0; i < sub->num_blocks; i++) sub->blocks[i].seq = seq - 1;
+        sub->synced = 1;
+        sub->session = session;
+        sub->gap_seq = seq;
+    } else if ((int32_t)(seq - sub->seq) <= 0) {
+        return -1; /* Duplicate or reordered. */
+    } else if (seq - sub->seq > 1) {
+        sub->lost += seq - sub->seq - 1;
+        sub->gaps++;
+        sub->gap_seq = seq;
+    }
+    sub->seq = seq;
+    if (id >= sub->num_blocks) {
+        b = (SUB_BLOCK *)realloc(sub->blocks, sizeof(SUB_BLOCK) * (id + 1));
+        if (b == NULL) return -2;
+        memset(b + sub->num_blocks, 0, sizeof(SUB_BLOCK) * (id + 1 - sub->num_blocks));
+        sub->blocks = b;
+        sub->num_blocks = id + 1;
+    }
+    b = sub->blocks + id;
+    if (b->image == NULL) {
+        b->image = buf_new(PUB_DATA_MAX);
+        if (b->image == NULL) return -2;
+    }
+    buf_empty(b->image);
+    buf_append_blob(b->image, sub->pkt + PUB_HDR_LEN, bytes);
+    b->file_type = (PCCC_FT_T)type;
+    b->quality = (PCCC_POLL_Q_T)quality;
+    b->result = (PCCC_RET_T)result;
+    b->seq = seq;
+    b->time.tv_sec = (time_t)(((uint64_t)ltohl(sec_hi) << 32) | ltohl(sec_lo));
+    b->time.tv_usec = ltohl(usec);
+    sub->rcvd++;
+    *block_id = id;
+    return 0;
+}
+
+/*
+* Description : Checks if a block may have missed updates, meaning it hasn't
+*               been received since the last gap or publisher restart.
+*
+* Arguments : sub - Subscriber.
+*             b - Block to check.
+*
+* Return Value : Non-zero if the block is stale.
+*/
+static int sub_is_stale(const PCCC_SUB *sub, const SUB_BLOCK *b)
+{
+    return (int32_t)(b->seq - sub->gap_seq) < 0;
+}
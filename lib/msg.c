@@ -72,7 +72,8 @@ extern DF1MSG *msg_get_free(PCCC_PRIV *p)
 
 /*
 * Description : Copies the current message to the socket transmission buffer
-*               prefixing a SOH and length byte.
+*               prefixing a SOH and length byte. If a deadline has been set
+*               for the connection, it is sent between the SOH and length.
 *
 * Arguments : p -
 *
@@ -81,12 +82,22 @@ extern DF1MSG *msg_get_free(PCCC_PRIV *p)
 */
 extern PCCC_RET_T msg_send(PCCC_PRIV *p)
 {
-    if (buf_append_byte(p->sock_out, MSG_SOH) ||
-        buf_append_byte(p->sock_out, p->cur_msg->buf->len) ||
-        buf_append_buf(p->sock_out, p->cur_msg->buf)) {
+    size_t len = 2 + p->cur_msg->buf->len;
+    RBUF *out;
+    if (p->deadline) len += 2;
+    /* Check the whole frame fits so a partial one is never queued. */
+    out = pool_unit_out(p, len);
+    if (out == NULL) {
         strncpy(p->errstr, "msg_send()", PCCC_ERR_LEN);
         return PCCC_EOVERFLOW;
     }
+    if (p->deadline) {
+        rbuf_put_byte(out, MSG_SOH_DL);
+        rbuf_put_le16(out, &p->deadline, 1);
+    } else
+        rbuf_put_byte(out, MSG_SOH);
+    rbuf_put_byte(out, p->cur_msg->buf->len);
+    rbuf_put(out, p->cur_msg->buf->data, p->cur_msg->buf->len);
     p->cur_msg->state = MSG_TX;
     return PCCC_SUCCESS;
 }
@@ -141,6 +152,8 @@ extern PCCC_RET_T msg_send_next(PCCC_PRIV *p)
 {
     register int i;
     DF1MSG *last = p->msgs + (p->num_msgs - 1);
+    if (p->subs != NULL) return pool_dispatch(p);
+    if (p->pool != NULL) return pool_dispatch((PCCC_PRIV *)p->pool->priv_data);
     /*
      * Do nothing if a message is already being transmitted.
      */
@@ -206,8 +219,7 @@ extern uint8_t msg_get_cmd(const BUF *msg)
 */
 extern uint16_t msg_get_tns(const BUF *msg)
 {
-    uint16_t *tns = (uint16_t *)(&msg->data[4]);
-    return ltohs(*tns);
+    return load_le16(&msg->data[4]);
 }
 
 /*
@@ -285,6 +297,7 @@ extern void msg_flush(DF1MSG *m)
 {
     m->state = MSG_UNUSED;
     m->expires = 0;
+    m->via = NULL;
     buf_empty(m->buf);
     return;
 }
@@ -42,6 +42,10 @@ link layer connection.
 - pccc_close() - Closes the connection to the link layer service.
 - pccc_free() - Frees memory allocated for a connection.
 - pccc_errstr() - Generates a string describing an error.
+- pccc_set_deadline() - Sets a transmission deadline for commands.
+
+All of these also accept a pooled connection created with pccc_pool_new()
+or pccc_mux_new(), see \ref pool.
 */
 
 #include "pccc.h"
@@ -51,10 +55,10 @@ static int alloc_bufs(PCCC_PRIV *p);
 static void free_bufs(PCCC_PRIV *p);
 static int get_addr(struct sockaddr_in *addr, const char *hostname, in_port_t port);
 static PCCC_RET_T send_reg(PCCC *con, const char *name);
-static PCCC_RET_T parse_link(PCCC *con);
 static void parse_msg(PCCC *con);
 static int rcv_ack(PCCC *con);
 static void rcv_nak(PCCC *con);
+static void rcv_expired(PCCC *con);
 
 /**
 Allocates and initializes a new PCCC connection. This must be called before
@@ -144,12 +148,14 @@ extern PCCC_RET_T pccc_connect(PCCC *con, const char *link_host, in_port_t link_
     PCCC_PRIV *con_priv;
     struct sockaddr_in addr;
     PCCC_RET_T ret;
+    int nodelay = 1;
     if (con == NULL) return PCCC_ENOCON;
     con_priv = (PCCC_PRIV *)con->priv_data;
     if (con_priv->connected) {
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "Already connected");
         return PCCC_ELINK;
     }
+    if (con_priv->subs != NULL) return pool_connect(con, link_host, link_port, client_name);
     if (get_addr(&addr, link_host, link_port)) {
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "Could not resolve hostname %s : %s", link_host, hstrerror(h_errno));
         return PCCC_EPARAM;
@@ -165,6 +171,11 @@ again:
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "Failed to connect : %s", strerror(errno));
         return PCCC_ELINK;
     }
+    /*
+    * Messages are a few bytes each; send them immediately rather than
+    * waiting for the previous segment to be acknowledged.
+    */
+    setsockopt(con->fd, IPPROTO_TCP, TCP_NODELAY, (char *)&nodelay, sizeof(nodelay));
     con_priv->connected = 1;
     ret = send_reg(con, client_name);
     if (ret != PCCC_SUCCESS) return ret;
@@ -196,7 +207,8 @@ extern PCCC_RET_T pccc_read(PCCC *con)
         strncpy(con_priv->errstr, "Not connected", PCCC_ERR_LEN);
         return PCCC_ELINK;
     }
-    len = buf_read(con->fd, con_priv->sock_in);
+    if (con_priv->subs != NULL) return pool_read(con);
+    len = rbuf_read(con->fd, con_priv->sock_in);
     if (len < 0)
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "Error reading : %s", strerror(errno));
     else if (!len)
@@ -228,7 +240,8 @@ extern PCCC_RET_T pccc_write_ready(const PCCC *con)
         strncpy(con_priv->errstr, "Not connected", PCCC_ERR_LEN);
         return PCCC_ELINK;
     }
-    return buf_write_ready(con_priv->sock_out) ? PCCC_WREADY : PCCC_SUCCESS;
+    if (con_priv->subs != NULL) return pool_write_ready(con);
+    return rbuf_len(con_priv->sock_out) ? PCCC_WREADY : PCCC_SUCCESS;
 }
 
 /**
@@ -255,7 +268,9 @@ extern PCCC_RET_T pccc_write(PCCC *con)
     if (!con_priv->connected) {
         strncpy(con_priv->errstr, "Not connected", PCCC_ERR_LEN);
         return PCCC_ELINK;
-    } else if (buf_write(con->fd, con_priv->sock_out) < 0) {
+    } else if (con_priv->subs != NULL)
+        return pool_write(con);
+    else if (rbuf_write(con->fd, con_priv->sock_out) < 0) {
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "Error writing : %s", strerror(errno));
         return PCCC_ELINK;
     }
@@ -329,15 +344,17 @@ extern PCCC_RET_T pccc_close(PCCC *con)
     if (con == NULL) return PCCC_ENOCON;
     con_priv = (PCCC_PRIV *)con->priv_data;
     if (!con_priv->connected) return PCCC_SUCCESS;
+    if (con_priv->subs != NULL) return pool_close(con);
     con_priv->connected = 0;
     msg_abort_all(con);
-    buf_empty(con_priv->sock_in);
-    buf_empty(con_priv->sock_out);
+    rbuf_empty(con_priv->sock_in);
+    rbuf_empty(con_priv->sock_out);
     buf_empty(con_priv->msg_in);
     con_priv->read_mode = READ_MODE_IDLE;
     con_priv->cur_msg = con_priv->msgs;
 again:
-    if (close(con->fd)) {
+    /* Virtual clients of a session have no socket of their own. */
+    if ((con->fd >= 0) && close(con->fd)) {
         if (errno == EINTR) goto again;
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "close() failed : %s", strerror(errno));
         return PCCC_EFATAL;
@@ -358,6 +375,7 @@ extern void pccc_free(PCCC *con)
     PCCC_PRIV *con_priv;
     if (con == NULL) return;
     con_priv = (PCCC_PRIV *)con->priv_data;
+    if (con_priv->subs != NULL) pool_free(con);
     free_bufs(con_priv);
     msg_free(con_priv);
     free(con->priv_data);
@@ -408,6 +426,9 @@ extern void pccc_errstr(PCCC *con, PCCC_RET_T err, char *buf, size_t len)
         case PCCC_ECMD_REPLY:
             sprintf(buf, "%s", "Reply contained an error");
             break;
+        case PCCC_ECMD_EXPIRED:
+            sprintf(buf, "%s", "Command deadline passed before transmission");
+            break;
         case PCCC_ECMD_NOBUF:
             sprintf(buf, "%s", "No message buffers available to process command");
             break;
@@ -441,6 +462,109 @@ extern void pccc_errstr(PCCC *con, PCCC_RET_T err, char *buf, size_t len)
     return;
 }
 
+/**
+Sets a deadline for the link layer service to transmit commands. Commands
+that are still queued in the link layer service when their deadline passes are
+discarded without being transmitted, and complete with PCCC_ECMD_EXPIRED. The
+deadline begins when the link layer service receives the command. Without a
+deadline, the link layer service transmits every command however long it has
+waited, even if the reply will arrive after the command has timed out.
+
+When the link layer service has several clients, commands with a deadline are
+transmitted earliest deadline first, ahead of commands without one.
+
+The link layer service must support deadlines. Older versions will close the
+connection upon receiving a command with a deadline.
+
+\param con Pointer to the link layer connection.
+\param msec Deadline in milliseconds, 1-65535. Zero disables the deadline,
+which is the default.
+
+\return
+- PCCC_SUCCESS if the deadline was set.
+- PCCC_ENOCON if the supplied connection pointer was NULL.
+- PCCC_EPARAM if the deadline was out of range.
+*/
+extern PCCC_RET_T pccc_set_deadline(PCCC *con, unsigned int msec)
+{
+    PCCC_PRIV *con_priv;
+    size_t i;
+    if (con == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if (msec > 0xffff) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "Deadline cannot exceed 65535 mS");
+        return PCCC_EPARAM;
+    }
+    con_priv->deadline = msec;
+    for (i = 0; i < con_priv->num_subs; i++)
+        ((PCCC_PRIV *)con_priv->subs[i]->priv_data)->deadline = msec;
+    return PCCC_SUCCESS;
+}
+
+/**
+Sets the retry limits and ACK timeout the link layer service uses on its link
+to the nodes, in place of the max_nak, max_enq and ack_timeout of its
+configuration. The settings apply to every link of a connection group and
+last until changed again or the link layer service reloads its
+configuration.
+
+The settings can only be sent while no message of the connection is waiting
+for the link layer service; a pooled connection sends them through its first
+registration. They are not acknowledged, the statistics port shows the
+settings in effect.
+
+The link layer service must support link settings. Older versions will close
+the connection upon receiving them. The link layer service ignores them
+unless its configuration allows link settings on every link of the
+connection.
+
+\param con Pointer to the link layer connection.
+\param naks Maximum NAKs received for a message before giving up, 1-255.
+\param enqs Maximum ENQs sent for a message before giving up, 1-255.
+\param ack_timeout Milliseconds to wait for an ACK, 10-10000.
+
+\return
+- PCCC_SUCCESS if the settings were queued to the link layer service.
+- PCCC_ENOCON if the supplied connection pointer was NULL.
+- PCCC_EPARAM if a setting was out of range.
+- PCCC_ECMD_NOBUF if a message is waiting for the link layer service.
+- PCCC_ELINK if the connection to the link layer service was interrupted.
+*/
+extern PCCC_RET_T pccc_link_config(PCCC *con, unsigned int naks, unsigned int enqs, unsigned int ack_timeout)
+{
+    PCCC_PRIV *con_priv;
+    PCCC_PRIV *p;
+    PCCC *via = con;
+    RBUF *out = NULL;
+    uint16_t tmo;
+    size_t i;
+    if (con == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if (!naks || (naks > 255) || !enqs || (enqs > 255) || (ack_timeout < 10) || (ack_timeout > 10000)) {
+        strncpy(con_priv->errstr, "Link setting out of range", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    if (con_priv->subs != NULL) via = con_priv->subs[0];
+    p = (PCCC_PRIV *)via->priv_data;
+    if (!p->connected) {
+        strncpy(con_priv->errstr, "Not connected", PCCC_ERR_LEN);
+        return PCCC_ELINK;
+    }
+    for (i = 0; i < con_priv->num_msgs; i++)
+        if ((con_priv->msgs[i].state == MSG_TX) && ((via == con) || (con_priv->msgs[i].via == via))) break;
+    if (i == con_priv->num_msgs) out = pool_unit_out(p, 5);
+    if (out == NULL) {
+        strncpy(con_priv->errstr, "A message is waiting for the link layer", PCCC_ERR_LEN);
+        return PCCC_ECMD_NOBUF;
+    }
+    tmo = ack_timeout;
+    rbuf_put_byte(out, MSG_LINK_CFG);
+    rbuf_put_byte(out, naks);
+    rbuf_put_byte(out, enqs);
+    rbuf_put_le16(out, &tmo, 1);
+    return pccc_write(con);
+}
+
 /*
  * Description : Allocates buffers for a new connection.
  *
@@ -450,17 +574,17 @@ extern void pccc_errstr(PCCC *con, PCCC_RET_T err, char *buf, size_t len)
  */
 static int alloc_bufs(PCCC_PRIV *p)
 {
-    p->sock_in = buf_new(BUF_SIZE);
+    p->sock_in = rbuf_new(BUF_SIZE);
     if (p->sock_in == NULL) return -1;
-    p->sock_out = buf_new(BUF_SIZE);
+    p->sock_out = rbuf_new(BUF_SIZE);
     if (p->sock_out == NULL) {
-        buf_free(p->sock_in);
+        rbuf_free(p->sock_in);
         return -1;
     }
     p->msg_in = buf_new(BUF_SIZE);
     if (p->msg_in == NULL) {
-        buf_free(p->sock_in);
-        buf_free(p->sock_out);
+        rbuf_free(p->sock_in);
+        rbuf_free(p->sock_out);
         return -1;
     }
     return 0;
@@ -475,8 +599,8 @@ static int alloc_bufs(PCCC_PRIV *p)
  */
 static void free_bufs(PCCC_PRIV *p)
 {
-    buf_free(p->sock_in);
-    buf_free(p->sock_out);
+    rbuf_free(p->sock_in);
+    rbuf_free(p->sock_out);
     buf_free(p->msg_in);
     return;
 }
@@ -517,7 +641,7 @@ static PCCC_RET_T send_reg(PCCC *con, const char *name)
 {
     size_t len;
     PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
-    buf_append_byte(con_priv->sock_out, con->src_addr);
+    rbuf_put_byte(con_priv->sock_out, con->src_addr);
     if (name == NULL) {
         sprintf(con_priv->errstr, "%s", "Invalid pointer(NULL) to client name");
         return PCCC_EPARAM;
@@ -531,8 +655,8 @@ static PCCC_RET_T send_reg(PCCC *con, const char *name)
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "Client name too long, %u characters max", PCCC_NAME_LEN);
         return PCCC_EPARAM;
     }
-    buf_append_byte(con_priv->sock_out, len);
-    buf_append_str(con_priv->sock_out, name);
+    rbuf_put_byte(con_priv->sock_out, len);
+    rbuf_put(con_priv->sock_out, name, len);
     if (pccc_write(con) != PCCC_SUCCESS) {
         snprintf(con_priv->errstr, PCCC_ERR_LEN, "Failed to send registration message : %s", strerror(errno));
         return PCCC_ELINK;
@@ -548,11 +672,11 @@ static PCCC_RET_T send_reg(PCCC *con, const char *name)
  * Return Value : PCCC_SUCCESS if no error occured.
  *                PCCC_EFATAL if a fatal error occured.
  */
-static PCCC_RET_T parse_link(PCCC *con)
+extern PCCC_RET_T parse_link(PCCC *con)
 {
     uint8_t byte;
     PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
-    while (!buf_get_byte(con_priv->sock_in, &byte)) {
+    while (!rbuf_get_byte(con_priv->sock_in, &byte)) {
         switch (con_priv->read_mode) {
             case READ_MODE_IDLE:
                 switch (byte) {
@@ -566,6 +690,9 @@ static PCCC_RET_T parse_link(PCCC *con)
                     case MSG_NAK:
                         rcv_nak(con);
                         break;
+                    case MSG_EXPIRED:
+                        rcv_expired(con);
+                        break;
                 }
                 break;
             case READ_MODE_MSG_LEN:
@@ -596,7 +723,8 @@ static void parse_msg(PCCC *con)
     PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
     if (msg_is_reply(con_priv)) {
         DF1MSG *msg = msg_find_cmd(con_priv);
-        buf_append_byte(con_priv->sock_out, MSG_ACK);
+        RBUF *out = pool_unit_out(con_priv, 1);
+        if (out != NULL) rbuf_put_byte(out, MSG_ACK);
         if (msg != NULL) {
             msg->state |= MSG_REPLY_RCVD;
             if (msg->notify == NULL) return;
@@ -608,7 +736,7 @@ static void parse_msg(PCCC *con)
                 ? PCCC_ECMD_REPLY : PCCC_SUCCESS;
             if (msg->state == MSG_CMD_DONE) {
                 msg_flush(msg);
-                msg->notify(con, msg->result, msg->udata);
+                msg->notify(pool_notify_con(con), msg->result, msg->udata);
             }
             /*
              * If the ACK for the command message hasn't been received yet, and
@@ -661,7 +789,7 @@ static int rcv_ack(PCCC *con)
             msg_flush(cur);
             if (cur->result != PCCC_SUCCESS)
                 strcpy(con_priv->errstr, cur->errstr);
-            cur->notify(con, cur->result, cur->udata);
+            cur->notify(pool_notify_con(con), cur->result, cur->udata);
         }
     }
     /*
@@ -683,8 +811,28 @@ static void rcv_nak(PCCC *con)
 {
     DF1MSG *cur = ((PCCC_PRIV *)con->priv_data)->cur_msg;
     msg_flush(cur);
+    cur->result = PCCC_ECMD_NODELIVER;
+    if (cur->is_cmd && (cur->notify != NULL))
+        cur->notify(pool_notify_con(con), PCCC_ECMD_NODELIVER, cur->udata);
+    msg_send_next((PCCC_PRIV *)con->priv_data);
+    return;
+}
+
+/*
+ * Description : Handles the link layer discarding a message because its
+ *               deadline passed before it could be transmitted.
+ *
+ * Arguments : con - Link layer connection pointer.
+ *
+ * Return Value : None.
+ */
+static void rcv_expired(PCCC *con)
+{
+    DF1MSG *cur = ((PCCC_PRIV *)con->priv_data)->cur_msg;
+    msg_flush(cur);
+    cur->result = PCCC_ECMD_EXPIRED;
     if (cur->is_cmd && (cur->notify != NULL))
-        cur->notify(con, PCCC_ECMD_NODELIVER, cur->udata);
+        cur->notify(pool_notify_con(con), PCCC_ECMD_EXPIRED, cur->udata);
     msg_send_next((PCCC_PRIV *)con->priv_data);
     return;
 }
@@ -44,12 +44,18 @@ serivce.
 - \subpage conn_mgmt "Connection setup and management"
 - \subpage cmd_init "Sending PCCC commands"
 - \subpage udata "Controller data types"
+- \subpage poll "Polling data tables"
+- \subpage mcast "Multicast distribution of polled data"
+- \subpage pool "Pooled connections"
+- \subpage probe "Link probing"
 */
 
 #ifdef _WIN32
 #include <winsock.h>
 #else
 #include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/time.h>
 #endif
 
 /**
@@ -78,7 +84,8 @@ typedef enum
     PCCC_ECMD_NOBUF,    //!< No message buffers were available to process command.
     PCCC_ECMD_NODELIVER,//!< Link layer could not deliver command.
     PCCC_ECMD_TIMEOUT,  //!< Command timed out awaiting a reply.
-    PCCC_ECMD_REPLY     //!< Reply contained an error.
+    PCCC_ECMD_REPLY,    //!< Reply contained an error.
+    PCCC_ECMD_EXPIRED   //!< Command deadline passed before the link layer could transmit it.
   } PCCC_RET_T;
 
 /**
@@ -119,6 +126,10 @@ Data table element types:
 Data table information:
 - \link pccc_slc_fi_t PCCC_SLC_FI_T \endlink
 
+Node diagnostics:
+- \link pccc_diag_status_t PCCC_DIAG_STATUS_T \endlink
+- \link pccc_diag_cnt_t PCCC_DIAG_CNT_T \endlink
+
 The following constants are #define'd to the number of bytes that each data
 type requires per element to transfer. This is *NOT* the same as the number
 of bytes required to store an element on the host machine(sizeof()).
@@ -358,6 +369,57 @@ struct pccc_slc_fi_t
 
 typedef struct pccc_slc_fi_t PCCC_SLC_FI_T;
 
+#define PCCC_DIAG_STATUS_MAX 244 /* Largest diagnostic status reply. */
+
+/**
+Diagnostic status of a node. The leading bytes common to PLC-5, SLC-500 and
+MicroLogix processors and their interface modules are decoded; the complete
+reply is kept since the remainder is product specific.
+
+\sa pccc_cmd_DiagnosticStatus
+
+Typedef'ed as PCCC_DIAG_STATUS_T.
+*/
+struct pccc_diag_status_t
+{
+  uint8_t mode;         //!< Mode/status byte.
+  uint8_t type;         //!< Type extender, 0xee for extended status.
+  uint8_t iface;        //!< Extended interface type.
+  uint8_t proc;         //!< Extended processor type.
+  char series;          //!< Series letter, 0 if not reported.
+  char revision;        //!< Revision letter, 0 if not reported.
+  char catalog[12];     //!< Catalog number with trailing spaces removed.
+  size_t len;           //!< Number of bytes in the reply.
+  uint8_t raw[PCCC_DIAG_STATUS_MAX]; //!< Complete reply.
+};
+
+typedef struct pccc_diag_status_t PCCC_DIAG_STATUS_T;
+
+/**
+DF1 full-duplex channel diagnostic counters of a node, in the order SLC-500
+and MicroLogix processors keep them. Counters are 16 bits and wrap.
+
+\sa pccc_cmd_ReadDiagCounters
+
+Typedef'ed as PCCC_DIAG_CNT_T.
+*/
+struct pccc_diag_cnt_t
+{
+  uint16_t msgs_sent;   //!< Messages sent and ACKed.
+  uint16_t msgs_rcvd;   //!< Messages received and ACKed.
+  uint16_t undelivered; //!< Messages that could not be delivered.
+  uint16_t enqs_sent;   //!< ENQs sent, ACK timeouts while sending.
+  uint16_t naks_rcvd;   //!< NAKs received for messages sent.
+  uint16_t enqs_rcvd;   //!< ENQs received.
+  uint16_t bad_rcvd;    //!< Corrupted messages received and NAKed.
+  uint16_t nobuf_naks;  //!< Messages NAKed for lack of a buffer.
+  uint16_t dups_rcvd;   //!< Duplicate messages received.
+};
+
+typedef struct pccc_diag_cnt_t PCCC_DIAG_CNT_T;
+
+#define PCCC_DIAG_CNT_WORDS 9 /* Words in a diagnostic counter block. */
+
 /**
 Node types. These identify what type of module/processor a node is.
 */
@@ -444,6 +506,145 @@ struct pccc_plc_addr
 
 typedef struct pccc_plc_addr PCCC_PLC_ADDR;
 
+/**
+Polling layer handle allocated by pccc_poll_new().
+
+\sa poll
+*/
+typedef struct pccc_poll PCCC_POLL;
+
+/**
+Pointer to a user function called by the polling layer each time a block
+read completes. The arguments are the polling layer, the block identifier and
+the outcome of the read.
+*/
+typedef void (* PFUNC)(PCCC_POLL *, unsigned int, PCCC_RET_T);
+
+/**
+Quality of a polled block's data.
+*/
+typedef enum
+  {
+    PCCC_POLL_Q_NONE,   //!< No data has been read yet.
+    PCCC_POLL_Q_GOOD,   //!< Data is from the most recent read.
+    PCCC_POLL_Q_BAD,    //!< The most recent read failed, data is from the last good read.
+    PCCC_POLL_Q_STALE   //!< Data was restored from a checkpoint and has not been read since.
+  } PCCC_POLL_Q_T;
+
+/**
+Status of a polled block.
+
+\sa pccc_poll_get_block()
+
+Typedef'ed as PCCC_POLL_INFO.
+*/
+struct pccc_poll_info
+{
+  PCCC_POLL_Q_T quality;  //!< Quality of the block's data.
+  PCCC_RET_T result;      //!< Outcome of the most recent read.
+  struct timeval time;    //!< Time of the last good read.
+};
+
+typedef struct pccc_poll_info PCCC_POLL_INFO;
+
+/**
+Scan class statistics.
+
+\sa pccc_poll_class_stats()
+
+Typedef'ed as PCCC_POLL_STATS.
+*/
+struct pccc_poll_stats
+{
+  unsigned int period;      //!< Configured scan period in milliseconds.
+  unsigned int eff_period;  //!< Scan period currently in effect in milliseconds.
+  unsigned int interval;    //!< Measured interval between scans in milliseconds.
+  unsigned long scans;      //!< Block reads issued.
+  unsigned long skips;      //!< Block reads skipped because the previous read was outstanding.
+  unsigned long errors;     //!< Block reads that failed.
+};
+
+typedef struct pccc_poll_stats PCCC_POLL_STATS;
+
+/**
+Link statistics as seen by the polling layer.
+
+\sa pccc_poll_link_stats()
+
+Typedef'ed as PCCC_POLL_LINK.
+*/
+struct pccc_poll_link
+{
+  unsigned int depth;       //!< Outstanding messages.
+  unsigned int latency;     //!< Smoothed read latency in milliseconds.
+  unsigned int min_latency; //!< Baseline read latency in milliseconds.
+  unsigned int util;        //!< Estimated link utilization in percent.
+  unsigned int stretch;     //!< Period stretch applied to the lowest priority class in percent.
+};
+
+typedef struct pccc_poll_link PCCC_POLL_LINK;
+
+/**
+One payload size of a link probe and its measurements.
+
+\sa pccc_echo_probe()
+
+Typedef'ed as PCCC_PROBE_PT.
+*/
+struct pccc_probe_pt
+{
+  size_t bytes;         //!< Echo payload size, set by the caller.
+  double rtt;           //!< Mean one-at-a-time round trip in seconds.
+  double rtt_min;       //!< Shortest one-at-a-time round trip in seconds.
+  double rate;          //!< Pipelined payload throughput in bytes per second.
+  unsigned int errors;  //!< Echo commands that failed.
+};
+
+typedef struct pccc_probe_pt PCCC_PROBE_PT;
+
+/**
+Latency model fitted by a link probe, round trip = turnaround + bytes *
+per_byte.
+
+\sa pccc_echo_probe()
+
+Typedef'ed as PCCC_PROBE_MODEL.
+*/
+struct pccc_probe_model
+{
+  double turnaround;    //!< Fixed time per command in seconds.
+  double per_byte;      //!< Time added per payload byte in seconds.
+  double r2;            //!< Coefficient of determination, one for a perfect fit.
+  unsigned int samples; //!< Round trips fitted.
+};
+
+typedef struct pccc_probe_model PCCC_PROBE_MODEL;
+
+/**
+Multicast subscriber handle allocated by pccc_sub_new().
+
+\sa mcast
+*/
+typedef struct pccc_sub PCCC_SUB;
+
+/**
+Multicast subscriber statistics.
+
+\sa pccc_sub_stats()
+
+Typedef'ed as PCCC_SUB_STATS.
+*/
+struct pccc_sub_stats
+{
+  unsigned long rcvd;       //!< Datagrams accepted.
+  unsigned long lost;       //!< Datagrams missing from the sequence.
+  unsigned long gaps;       //!< Sequence gaps detected.
+  unsigned long restarts;   //!< Publisher restarts detected.
+  unsigned long invalid;    //!< Datagrams discarded as invalid or out of order.
+};
+
+typedef struct pccc_sub_stats PCCC_SUB_STATS;
+
 #define PCCC_SE_TMR_BITS 0  /* Control bits */
 #define PCCC_SE_TMR_PRE 1   /* Preset */
 #define PCCC_SE_TMR_ACC 2   /* Accumulator */
@@ -468,6 +669,49 @@ extern PCCC_RET_T pccc_tick(PCCC *con);
 extern PCCC_RET_T pccc_close(PCCC *con);
 extern void pccc_free(PCCC *con);
 extern void pccc_errstr(PCCC *con, PCCC_RET_T err, char *buf, size_t len);
+extern PCCC_RET_T pccc_set_deadline(PCCC *con, unsigned int msec);
+extern PCCC_RET_T pccc_link_config(PCCC *con, unsigned int naks, unsigned int enqs, unsigned int ack_timeout);
+
+/*
+ * Pooled connection functions.
+ */
+extern PCCC *pccc_pool_new(uint8_t src_addr, unsigned int conns, unsigned int timeout, size_t msgs);
+extern PCCC *pccc_mux_new(uint8_t src_addr, unsigned int conns, unsigned int timeout, size_t msgs);
+extern int pccc_pool_fds(const PCCC *con, fd_set *read, fd_set *write);
+
+/*
+ * Link probing functions.
+ */
+extern PCCC_RET_T pccc_echo_probe(PCCC *con, uint8_t dnode, PCCC_PROBE_PT *pts, size_t num_pts, unsigned int reps, unsigned int window, PCCC_PROBE_MODEL *model);
+
+/*
+ * Polling layer functions.
+ */
+extern PCCC_POLL *pccc_poll_new(PCCC *con, PFUNC notify);
+extern PCCC_RET_T pccc_poll_add_class(PCCC_POLL *poll, unsigned int period, unsigned int priority, unsigned int *class_id);
+extern PCCC_RET_T pccc_poll_add_block(PCCC_POLL *poll, unsigned int class_id, uint8_t dnode, PCCC_FT_T file_type, uint16_t file, uint16_t element, size_t num_elements, unsigned int *block_id);
+extern PCCC_RET_T pccc_poll_service(PCCC_POLL *poll, unsigned int *next);
+extern PCCC_RET_T pccc_poll_get_block(PCCC_POLL *poll, unsigned int block_id, void *udata, PCCC_POLL_INFO *info);
+extern PCCC_RET_T pccc_poll_get_raw(PCCC_POLL *poll, unsigned int block_id, void *dst, size_t size, size_t *len, PCCC_POLL_INFO *info);
+extern PCCC_RET_T pccc_data_decode(PCCC_FT_T file_type, const void *src, size_t len, void *udata, size_t elements);
+extern PCCC_RET_T pccc_data_encode(PCCC_FT_T file_type, const void *udata, size_t elements, void *dst, size_t len);
+extern PCCC_RET_T pccc_poll_class_stats(PCCC_POLL *poll, unsigned int class_id, PCCC_POLL_STATS *stats);
+extern PCCC_RET_T pccc_poll_link_stats(PCCC_POLL *poll, PCCC_POLL_LINK *stats);
+extern PCCC_RET_T pccc_poll_persist(PCCC_POLL *poll, const char *path, unsigned int period);
+extern PCCC_RET_T pccc_poll_checkpoint(PCCC_POLL *poll);
+extern PCCC_RET_T pccc_poll_publish(PCCC_POLL *poll, const char *group, in_port_t port, const char *iface, unsigned int ttl, unsigned int refresh);
+extern void pccc_poll_free(PCCC_POLL *poll);
+
+/*
+ * Multicast subscriber functions.
+ */
+extern PCCC_SUB *pccc_sub_new(const char *group, in_port_t port, const char *iface, unsigned int max_blocks);
+extern int pccc_sub_fd(const PCCC_SUB *sub);
+extern PCCC_RET_T pccc_sub_read(PCCC_SUB *sub, unsigned int *block_id);
+extern PCCC_RET_T pccc_sub_get_block(PCCC_SUB *sub, unsigned int block_id, void *udata, PCCC_POLL_INFO *info);
+extern void pccc_sub_stats(const PCCC_SUB *sub, PCCC_SUB_STATS *stats);
+extern const char *pccc_sub_errstr(const PCCC_SUB *sub);
+extern void pccc_sub_free(PCCC_SUB *sub);
 
 /*
  * Functions to send PCCC commands.
@@ -479,6 +723,10 @@ extern PCCC_RET_T pccc_cmd_SetNAKs(PCCC *con, UFUNC notify, uint8_t dnode, uint8
 extern PCCC_RET_T pccc_cmd_SetENQs(PCCC *con, UFUNC notify, uint8_t dnode, uint8_t enqs);
 extern PCCC_RET_T pccc_cmd_ReadLinkParam(PCCC *con, UFUNC notify, uint8_t dnode, uint8_t *udata);
 extern PCCC_RET_T pccc_cmd_SetLinkParam(PCCC *con, UFUNC notify, uint8_t dnode, uint8_t max);
+extern PCCC_RET_T pccc_cmd_DiagnosticStatus(PCCC *con, UFUNC notify, uint8_t dnode, PCCC_DIAG_STATUS_T *udata);
+extern PCCC_RET_T pccc_cmd_DiagnosticRead(PCCC *con, UFUNC notify, uint8_t dnode, uint8_t *udata, uint16_t addr, size_t bytes);
+extern PCCC_RET_T pccc_cmd_ReadDiagCounters(PCCC *con, UFUNC notify, uint8_t dnode, PCCC_DIAG_CNT_T *udata, uint16_t addr);
+extern PCCC_RET_T pccc_cmd_ResetDiagCounters(PCCC *con, UFUNC notify, uint8_t dnode);
 extern PCCC_RET_T pccc_cmd_ChangeModeMicroLogix1000(PCCC *con, UFUNC notify, uint8_t dnode, PCCC_MODE_T mode);
 extern PCCC_RET_T pccc_cmd_ChangeModeSLC500(PCCC *con, UFUNC notify, uint8_t dnode, PCCC_MODE_T mode);
 extern PCCC_RET_T pccc_cmd_ProtectedTypedLogicalRead3AddressFields(PCCC *con, UFUNC notify, uint8_t dnode, void *udata, PCCC_FT_T file_type, uint16_t file, uint16_t element, uint16_t sub_element, size_t num_elements);
@@ -0,0 +1,286 @@
+/*
+ * This file is part of libpccc.
+ * Allen Bradley PCCC message library.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/** \file persist.c */
+
+#include <limits.h>
+#include <stdio.h>
+#include "pccc.h"
+#include "private.h"
+
+/*
+ * Checkpoint file layout, all values little endian:
+ *
+ * Header : "PCCP", version byte, three reserved bytes, 32 bit record count.
+ * Record : dnode, file type, 16 bit file, 16 bit element, 16 bit number of
+ *          elements, 32 bit seconds low word, 32 bit seconds high word,
+ *          32 bit microseconds, data length byte, link encoded data.
+ */
+#define CKPT_MAGIC "PCCP"
+#define CKPT_VERSION 1
+#define CKPT_HDR_LEN 12
+#define CKPT_REC_LEN 21 /* Record size excluding the data. */
+#define CKPT_DATA_MAX 236 /* Largest block image. */
+
+static PCCC_RET_T ckpt_load(PCCC_POLL *poll);
+static void ckpt_restore(PCCC_POLL *poll, BUF *src);
+
+/**
+Enables warm-start persistence of a polling layer's data. The latest data of
+every block is periodically written to a checkpoint file. When persistence is
+enabled, data saved by a previous instance is loaded from the file
+immediately, so pccc_poll_get_block() can serve it with PCCC_POLL_Q_STALE
+quality until the block is read again. This should be called after every
+block has been added; saved blocks are matched by node, file type, file,
+element and number of elements, and saved blocks that no longer exist are
+ignored.
+
+The checkpoint is replaced atomically by writing a temporary file alongside
+it and renaming it, so a crash never leaves a partially written checkpoint.
+Checkpoints are written from pccc_poll_service() when the period elapses and
+a block has been read since the last one, and once more by pccc_poll_free().
+
+\param poll Pointer to the polling layer.
+\param path Checkpoint file name. It does not need to exist.
+\param period Checkpoint period in milliseconds. Must be non-zero.
+
+\return
+- PCCC_SUCCESS if persistence was enabled. This includes the case where the
+checkpoint file did not exist yet.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if the path was NULL, the period was zero, or the checkpoint
+file exists but is not valid. Persistence is still enabled in the last case
+and the file will be overwritten by the next checkpoint.
+- PCCC_EFATAL if a memory allocation error occured.
+*/
+extern PCCC_RET_T pccc_poll_persist(PCCC_POLL *poll, const char *path, unsigned int period)
+{
+    PCCC_PRIV *con_priv;
+    char *p;
+    if (poll == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if ((path == NULL) || !period) {
+        strncpy(con_priv->errstr, "Invalid checkpoint file or period", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    p = strdup(path);
+    if (p == NULL) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "strdup() failed : %s", strerror(errno));
+        return PCCC_EFATAL;
+    }
+    free(poll->ckpt_path);
+    poll->ckpt_path = p;
+    poll->ckpt_period = period;
+    poll->next_ckpt = 0;
+    return ckpt_load(poll);
+}
+
+/**
+Writes a checkpoint immediately, regardless of the checkpoint period.
+pccc_poll_persist() must have been called first.
+
+\param poll Pointer to the polling layer.
+
+\return
+- PCCC_SUCCESS if the checkpoint was written.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if persistence has not been enabled.
+- PCCC_EFATAL if the checkpoint could not be written. The previous checkpoint,
+if any, is left intact.
+*/
+extern PCCC_RET_T pccc_poll_checkpoint(PCCC_POLL *poll)
+{
+    PCCC_PRIV *con_priv;
+    unsigned int i, n = 0;
+    char tmp[PATH_MAX];
+    FILE *f;
+    BUF *out;
+    int err;
+    if (poll == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if (poll->ckpt_path == NULL) {
+        strncpy(con_priv->errstr, "Persistence not enabled", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    if (snprintf(tmp, PATH_MAX, "%s.tmp", poll->ckpt_path) >= PATH_MAX) {
+        strncpy(con_priv->errstr, "Checkpoint file name too long", PCCC_ERR_LEN);
+        return PCCC_EFATAL;
+    }
+    out = buf_new(CKPT_HDR_LEN + poll->num_blocks * (CKPT_REC_LEN + CKPT_DATA_MAX));
+    if (out == NULL) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "buf_new() failed : %s", strerror(errno));
+        return PCCC_EFATAL;
+    }
+    buf_append_str(out, CKPT_MAGIC);
+    buf_append_byte(out, CKPT_VERSION);
+    buf_append_byte(out, 0);
+    buf_append_word(out, 0);
+    buf_append_long(out, 0); /* Record count, filled in below. */
+    for (i = 0; i < poll->num_blocks; i++) {
+        POLL_BLOCK *b = poll->blocks + i;
+        uint64_t sec;
+        if (b->quality == PCCC_POLL_Q_NONE) continue;
+        sec = (uint64_t)b->time.tv_sec;
+        buf_append_byte(out, b->dnode);
+        buf_append_byte(out, (uint8_t)b->file_type);
+        buf_append_word(out, htols(b->file));
+        buf_append_word(out, htols(b->element));
+        buf_append_word(out, htols((uint16_t)b->elements));
+        buf_append_long(out, htoll((uint32_t)sec));
+        buf_append_long(out, htoll((uint32_t)(sec >> 32)));
+        buf_append_long(out, htoll((uint32_t)b->time.tv_usec));
+        buf_append_byte(out, (uint8_t)b->image->len);
+        buf_append_blob(out, b->image->data, b->image->len);
+        n++;
+    }
+    store_le32(out->data + 8, n);
+    f = fopen(tmp, "wb");
+    if (f == NULL) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "fopen() failed : %s", strerror(errno));
+        buf_free(out);
+        return PCCC_EFATAL;
+    }
+    err = (fwrite(out->data, 1, out->len, f) != out->len) || fflush(f) || fsync(fileno(f));
+    if (err) snprintf(con_priv->errstr, PCCC_ERR_LEN, "Checkpoint write failed : %s", strerror(errno));
+    if (fclose(f) && !err) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "fclose() failed : %s", strerror(errno));
+        err = 1;
+    }
+    buf_free(out);
+    if (!err && rename(tmp, poll->ckpt_path)) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "rename() failed : %s", strerror(errno));
+        err = 1;
+    }
+    if (err) {
+        unlink(tmp);
+        return PCCC_EFATAL;
+    }
+    poll->ckpt_dirty = 0;
+    return PCCC_SUCCESS;
+}
+
+/*
+* Description : Loads the checkpoint file and restores the saved data of
+*               matching blocks.
+*
+* Arguments : poll - Polling layer.
+*
+* Return Value : PCCC_SUCCESS if the file was loaded or did not exist.
+*                PCCC_EPARAM if the file is invalid.
+*                PCCC_EFATAL if a memory allocation error occured.
+*/
+static PCCC_RET_T ckpt_load(PCCC_POLL *poll)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    uint8_t hdr[CKPT_HDR_LEN];
+    uint32_t count;
+    BUF *rec;
+    FILE *f;
+    f = fopen(poll->ckpt_path, "rb");
+    if (f == NULL) {
+        if (errno == ENOENT) return PCCC_SUCCESS; /* First run. */
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "fopen() failed : %s", strerror(errno));
+        return PCCC_EPARAM;
+    }
+    if ((fread(hdr, 1, CKPT_HDR_LEN, f) != CKPT_HDR_LEN)
+        || memcmp(hdr, CKPT_MAGIC, 4) || (hdr[4] != CKPT_VERSION)) {
+        strncpy(con_priv->errstr, "Invalid checkpoint file", PCCC_ERR_LEN);
+        fclose(f);
+        return PCCC_EPARAM;
+    }
+    rec = buf_new(CKPT_REC_LEN + CKPT_DATA_MAX);
+    if (rec == NULL) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "buf_new() failed : %s", strerror(errno));
+        fclose(f);
+        return PCCC_EFATAL;
+    }
+    count = load_le32(hdr + 8);
+    while (count--) {
+        uint8_t len;
+        if (fread(rec->data, 1, CKPT_REC_LEN, f) != CKPT_REC_LEN) break;
+        len = rec->data[CKPT_REC_LEN - 1];
+        if ((len > CKPT_DATA_MAX) || (fread(rec->data + CKPT_REC_LEN, 1, len, f) != len)) break;
+        rec->index = 0;
+        rec->len = CKPT_REC_LEN + len;
+        ckpt_restore(poll, rec);
+    }
+    buf_free(rec);
+    fclose(f);
+    if (count != (uint32_t)-1) {
+        strncpy(con_priv->errstr, "Truncated checkpoint file", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    return PCCC_SUCCESS;
+}
+
+/*
+* Description : Restores one checkpoint record into the first block without
+*               data that has the same address and size.
+*
+* Arguments : poll - Polling layer.
+*             src - Buffer containing the record.
+*
+* Return Value : None.
+*/
+static void ckpt_restore(PCCC_POLL *poll, BUF *src)
+{
+    unsigned int i;
+    uint8_t dnode, type, len;
+    uint16_t file, element, elements;
+    uint32_t sec_lo, sec_hi, usec;
+    buf_get_byte(src, &dnode);
+    buf_get_byte(src, &type);
+    buf_get_word(src, &file);
+    buf_get_word(src, &element);
+    buf_get_word(src, &elements);
+    buf_get_long(src, &sec_lo);
+    buf_get_long(src, &sec_hi);
+    buf_get_long(src, &usec);
+    buf_get_byte(src, &len);
+    file = ltohs(file);
+    element = ltohs(element);
+    elements = ltohs(elements);
+    for (i = 0; i < poll->num_blocks; i++) {
+        POLL_BLOCK *b = poll->blocks + i;
+        size_t usize, bytes;
+        if ((b->quality != PCCC_POLL_Q_NONE) || (b->dnode != dnode)
+            || (b->file_type != (PCCC_FT_T)type) || (b->file != file)
+            || (b->element != element) || (b->elements != elements))
+            continue;
+        /*
+         * Only whole images are restored; anything else is from an
+         * incompatible version of the data table.
+         */
+        if (data_type_size(b->file_type, &usize, &bytes) || (bytes * b->elements != len))
+            return;
+        buf_empty(b->image);
+        buf_append_blob(b->image, src->data + src->index, len);
+        b->time.tv_sec = (time_t)(((uint64_t)ltohl(sec_hi) << 32) | ltohl(sec_lo));
+        b->time.tv_usec = ltohl(usec);
+        b->quality = PCCC_POLL_Q_STALE;
+        return;
+    }
+    return;
+}
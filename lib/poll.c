@@ -0,0 +1,759 @@
+/*
+ * This file is part of libpccc.
+ * Allen Bradley PCCC message library.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/** \file poll.c */
+
+/**
+\page poll Polling data tables
+
+The polling layer repeatedly reads blocks of data table elements from one or
+more nodes and keeps the most recent data of each block. Blocks are grouped
+into scan classes, each with its own scan period and priority. The polling
+layer uses non-blocking commands, so the user application must service the
+connection with pccc_read(), pccc_write() and pccc_tick() as usual, and call
+pccc_poll_service() regularly to start the scans that are due.
+
+- pccc_poll_new() - Creates a polling layer for a connection.
+- pccc_poll_add_class() - Adds a scan class.
+- pccc_poll_add_block() - Adds a block of elements to a scan class.
+- pccc_poll_service() - Starts scans that are due.
+- pccc_poll_get_block() - Retrieves the latest data of a block.
+- pccc_poll_get_raw() - Retrieves the latest data of a block undecoded.
+- pccc_data_decode() - Decodes data retrieved with pccc_poll_get_raw().
+- pccc_data_encode() - Encodes elements into the form sent on the link.
+- pccc_poll_class_stats() - Retrieves the effective rate of a scan class.
+- pccc_poll_link_stats() - Retrieves the link load seen by the polling layer.
+- pccc_poll_persist() - Enables warm-start persistence of block data.
+- pccc_poll_checkpoint() - Writes a checkpoint immediately.
+- pccc_poll_publish() - Publishes block updates to a multicast group, see
+\ref mcast.
+- pccc_poll_free() - Frees a polling layer.
+
+When the link cannot keep up with every scan class, the polling layer degrades
+gracefully rather than letting every class fall behind together. Twice a
+second it compares the number of outstanding messages and the smoothed read
+latency against the latency observed on an idle link. If the link is
+congested, or reads have been timing out or running out of message buffers,
+the periods of the lower priority scan classes are stretched; as the
+congestion clears they are brought back to their configured periods. Priority
+zero classes are never stretched. A block whose previous read is still
+outstanding is skipped rather than read again. The periods actually in effect
+are reported by pccc_poll_class_stats().
+
+Without persistence, every block has PCCC_POLL_Q_NONE quality after a restart
+until its first read completes, which on a slow link may take several scan
+cycles. With pccc_poll_persist(), the latest data of every block is
+periodically checkpointed to a file and loaded again when the application
+restarts. Restored data is served immediately with PCCC_POLL_Q_STALE quality,
+along with the time of the read it came from, until the first live read of the
+block succeeds.
+*/
+
+#include "pccc.h"
+#include "private.h"
+
+#define POLL_MAX_BYTES 236 /* Largest protected typed logical read. */
+#define POLL_CTRL_PERIOD 500 /* Congestion controller update period in mS. */
+#define POLL_STRETCH_MAX 3200 /* Largest period stretch in percent. */
+#define POLL_STRETCH_DEC 25 /* Stretch removed each uncongested update. */
+#define POLL_LAT_MARGIN 50 /* Latency tolerated above twice the baseline. */
+#define POLL_LAT_NONE ((unsigned int)-1) /* No latency measured yet. */
+
+static int64_t poll_ms(void);
+static PCCC_RET_T issue_class(PCCC_POLL *poll, unsigned int class_id, int64_t now);
+static void read_done(PCCC *con, PCCC_RET_T result, void *udata);
+static void read_dropped(PCCC *con, PCCC_RET_T result, void *udata);
+static void update_ctrl(PCCC_POLL *poll, int64_t now);
+static unsigned int stretch_period(const PCCC_POLL *poll, const POLL_CLASS *c);
+static unsigned int msgs_outstanding(const PCCC_PRIV *p);
+
+/**
+Creates a polling layer for a connection. Only one polling layer may be
+created per connection. The connection should have enough message buffers,
+see pccc_new(), for several reads to be outstanding at once.
+
+\param con Pointer to the link layer connection used to read blocks.
+\param notify Pointer to a user function called each time a block read
+completes, or NULL if not required.
+
+\return
+- A pointer to the new polling layer if successful.
+- NULL if the connection pointer was NULL, the connection already has a
+polling layer, or a memory allocation error occured.
+*/
+extern PCCC_POLL *pccc_poll_new(PCCC *con, PFUNC notify)
+{
+    PCCC_POLL *poll;
+    PCCC_PRIV *con_priv;
+    if (con == NULL) return NULL;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if (con_priv->poll != NULL) {
+        strncpy(con_priv->errstr, "Connection already has a polling layer", PCCC_ERR_LEN);
+        return NULL;
+    }
+    poll = (PCCC_POLL *)calloc(1, sizeof(PCCC_POLL));
+    if (poll == NULL) return NULL;
+    poll->con = con;
+    poll->notify = notify;
+    poll->stretch = 100;
+    poll->lat_min = POLL_LAT_NONE;
+    poll->pub_fd = -1;
+    poll->next_ctrl = poll_ms() + POLL_CTRL_PERIOD;
+    con_priv->poll = poll;
+    return poll;
+}
+
+/**
+Adds a scan class. Every block in a scan class is read once per period.
+
+\param poll Pointer to the polling layer.
+\param period Scan period in milliseconds. Must be non-zero.
+\param priority Scan class priority. Zero is the highest priority; these
+classes are always scanned at their configured period. Under congestion, the
+periods of other classes are stretched in proportion to their priority value,
+the largest value being stretched the most.
+\param class_id Location to store the new scan class identifier. May be NULL.
+
+\return
+- PCCC_SUCCESS if the scan class was added.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if the period was zero.
+- PCCC_EFATAL if a memory allocation error occured.
+*/
+extern PCCC_RET_T pccc_poll_add_class(PCCC_POLL *poll, unsigned int period, unsigned int priority, unsigned int *class_id)
+{
+    POLL_CLASS *c;
+    PCCC_PRIV *con_priv;
+    if (poll == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if (!period) {
+        strncpy(con_priv->errstr, "Scan period must be non-zero", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    c = (POLL_CLASS *)realloc(poll->classes, sizeof(POLL_CLASS) * (poll->num_classes + 1));
+    if (c == NULL) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "realloc() failed : %s", strerror(errno));
+        return PCCC_EFATAL;
+    }
+    poll->classes = c;
+    c += poll->num_classes;
+    memset(c, 0, sizeof(POLL_CLASS));
+    c->period = period;
+    c->priority = priority;
+    c->next_due = poll_ms();
+    if (priority > poll->max_priority) poll->max_priority = priority;
+    c->eff_period = stretch_period(poll, c);
+    if (class_id != NULL) *class_id = poll->num_classes;
+    poll->num_classes++;
+    return PCCC_SUCCESS;
+}
+
+/**
+Adds a block of elements to a scan class. Blocks are read with protected
+typed logical reads with three address fields.
+
+\param poll Pointer to the polling layer.
+\param class_id Scan class identifier from pccc_poll_add_class().
+\param dnode Destination node address.
+\param file_type One of the file types supported by
+pccc_cmd_ProtectedTypedLogicalRead3AddressFields().
+\param file File number.
+\param element First element number.
+\param num_elements Number of elements. The block may not exceed 236 bytes.
+\param block_id Location to store the new block identifier. May be NULL.
+
+\return
+- PCCC_SUCCESS if the block was added.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if one of the parameters was invalid.
+- PCCC_EFATAL if a memory allocation error occured.
+*/
+extern PCCC_RET_T pccc_poll_add_block(PCCC_POLL *poll, unsigned int class_id, uint8_t dnode, PCCC_FT_T file_type, uint16_t file, uint16_t element, size_t num_elements, unsigned int *block_id)
+{
+    POLL_BLOCK *b;
+    PCCC_PRIV *con_priv;
+    size_t usize, bytes;
+    if (poll == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if (class_id >= poll->num_classes) {
+        strncpy(con_priv->errstr, "Invalid scan class", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    if (data_type_size(file_type, &usize, &bytes)) {
+        strncpy(con_priv->errstr, "File type not supported", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    if (!num_elements || (bytes * num_elements > POLL_MAX_BYTES)) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "Number of elements must be 1-%zu", POLL_MAX_BYTES / bytes);
+        return PCCC_EPARAM;
+    }
+    b = (POLL_BLOCK *)realloc(poll->blocks, sizeof(POLL_BLOCK) * (poll->num_blocks + 1));
+    if (b == NULL) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "realloc() failed : %s", strerror(errno));
+        return PCCC_EFATAL;
+    }
+    poll->blocks = b;
+    b += poll->num_blocks;
+    memset(b, 0, sizeof(POLL_BLOCK));
+    b->image = buf_new(POLL_MAX_BYTES);
+    if (b->image == NULL) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "buf_new() failed : %s", strerror(errno));
+        return PCCC_EFATAL;
+    }
+    b->class_id = class_id;
+    b->dnode = dnode;
+    b->file_type = file_type;
+    b->file = file;
+    b->element = element;
+    b->elements = num_elements;
+    b->usize = usize;
+    b->quality = PCCC_POLL_Q_NONE;
+    b->result = PCCC_SUCCESS;
+    if (block_id != NULL) *block_id = poll->num_blocks;
+    poll->num_blocks++;
+    return PCCC_SUCCESS;
+}
+
+/**
+Starts the scans that are due and updates the congestion controller. This
+should be called whenever the user application wakes up, and no later than
+the time returned in the next argument.
+
+\param poll Pointer to the polling layer.
+\param next Location to store the number of milliseconds until this function
+next needs to be called. May be NULL.
+
+\return
+- PCCC_SUCCESS if no errors occured.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_ELINK if an error occured with the connection to the link layer service.
+- PCCC_EOVERFLOW if an internal buffer overflow occured.
+- PCCC_EFATAL if a fatal error occured.
+
+Failing to write a checkpoint is not reported here; it is retried at the next
+checkpoint period. Use pccc_poll_checkpoint() to detect checkpoint errors.
+*/
+extern PCCC_RET_T pccc_poll_service(PCCC_POLL *poll, unsigned int *next)
+{
+    unsigned int i;
+    int64_t now, wait;
+    if (poll == NULL) return PCCC_ENOCON;
+    now = poll_ms();
+    if (now >= poll->next_ctrl) update_ctrl(poll, now);
+    wait = poll->next_ctrl - now;
+    if (poll->ckpt_path != NULL) {
+        if (!poll->next_ckpt) poll->next_ckpt = now + poll->ckpt_period;
+        if (now >= poll->next_ckpt) {
+            if (poll->ckpt_dirty) pccc_poll_checkpoint(poll);
+            poll->next_ckpt = now + poll->ckpt_period;
+        }
+        if (poll->next_ckpt - now < wait) wait = poll->next_ckpt - now;
+    }
+    if (poll->pub_fd >= 0) {
+        if (!poll->next_refresh) poll->next_refresh = now + poll->pub_refresh;
+        if (now >= poll->next_refresh) {
+            for (i = 0; i < poll->num_blocks; i++) pub_block(poll, i, PUB_FLAG_REFRESH);
+            poll->next_refresh = now + poll->pub_refresh;
+        }
+        if (poll->next_refresh - now < wait) wait = poll->next_refresh - now;
+    }
+    for (i = 0; i < poll->num_classes; i++) {
+        POLL_CLASS *c = poll->classes + i;
+        if (now >= c->next_due) {
+            PCCC_RET_T ret = issue_class(poll, i, now);
+            if (ret != PCCC_SUCCESS) return ret;
+            c->next_due += c->eff_period;
+            /*
+             * Don't try to catch up with a burst of scans after falling
+             * behind.
+             */
+            if (c->next_due <= now) c->next_due = now + c->eff_period;
+        }
+        if (c->next_due - now < wait) wait = c->next_due - now;
+    }
+    if (next != NULL) *next = (wait > 0) ? (unsigned int)wait : 0;
+    return PCCC_SUCCESS;
+}
+
+/**
+Retrieves the latest data of a block, decoded into an array of the block's
+element type.
+
+\param poll Pointer to the polling layer.
+\param block_id Block identifier from pccc_poll_add_block().
+\param udata Location to store the elements, or NULL to only retrieve the
+status. Left untouched if no data has been read yet.
+\param info Location to store the block's status, or NULL if not required.
+
+\return
+- PCCC_SUCCESS if successful.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if the block identifier was invalid.
+*/
+extern PCCC_RET_T pccc_poll_get_block(PCCC_POLL *poll, unsigned int block_id, void *udata, PCCC_POLL_INFO *info)
+{
+    POLL_BLOCK *b;
+    PCCC_PRIV *con_priv;
+    if (poll == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if (block_id >= poll->num_blocks) {
+        strncpy(con_priv->errstr, "Invalid block", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    b = poll->blocks + block_id;
+    if (info != NULL) {
+        info->quality = b->quality;
+        info->result = b->result;
+        info->time = b->time;
+    }
+    if ((udata != NULL) && (b->quality != PCCC_POLL_Q_NONE)) {
+        DF1MSG msg;
+        msg.elements = b->elements;
+        msg.file_type = b->file_type;
+        msg.usize = b->usize;
+        msg.udata = udata;
+        b->image->index = 0;
+        return data_dec_array(b->image, &msg, con_priv->errstr);
+    }
+    return PCCC_SUCCESS;
+}
+
+/**
+Retrieves the latest data of a block as received from the link, without
+decoding it. The polling layer is not thread safe, so a multithreaded
+application can copy the data out with this function from the thread that
+services the connection, typically from the notification function, and decode
+it elsewhere with pccc_data_decode().
+
+\param poll Pointer to the polling layer.
+\param block_id Block identifier from pccc_poll_add_block().
+\param dst Location to store the data, or NULL to only retrieve the status.
+Left untouched if no data has been read yet.
+\param size Size of the location pointed to by dst, in bytes.
+\param len Location to store the number of bytes stored, zero if no data
+has been read yet. May be NULL.
+\param info Location to store the block's status, or NULL if not required.
+
+\return
+- PCCC_SUCCESS if successful.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if the block identifier was invalid.
+- PCCC_EOVERFLOW if the data would not fit in size bytes.
+*/
+extern PCCC_RET_T pccc_poll_get_raw(PCCC_POLL *poll, unsigned int block_id, void *dst, size_t size, size_t *len, PCCC_POLL_INFO *info)
+{
+    POLL_BLOCK *b;
+    PCCC_PRIV *con_priv;
+    size_t bytes;
+    if (poll == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if (block_id >= poll->num_blocks) {
+        strncpy(con_priv->errstr, "Invalid block", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    b = poll->blocks + block_id;
+    if (info != NULL) {
+        info->quality = b->quality;
+        info->result = b->result;
+        info->time = b->time;
+    }
+    bytes = (b->quality == PCCC_POLL_Q_NONE) ? 0 : b->image->len;
+    if (len != NULL) *len = bytes;
+    if ((dst != NULL) && bytes) {
+        if (bytes > size) {
+            strncpy(con_priv->errstr, "Block data too large", PCCC_ERR_LEN);
+            return PCCC_EOVERFLOW;
+        }
+        memcpy(dst, b->image->data, bytes);
+    }
+    return PCCC_SUCCESS;
+}
+
+/**
+Decodes data retrieved with pccc_poll_get_raw() into an array of the given
+element type. Unlike the rest of the library, this function does not use any
+connection or polling layer and may be called from any thread.
+
+\param file_type Element type of the data.
+\param src Pointer to the data.
+\param len Number of bytes of data.
+\param udata Location to store the elements.
+\param elements Number of elements expected.
+
+\return
+- PCCC_SUCCESS if successful.
+- PCCC_EPARAM if the file type is unsupported or the length does not match
+the number of elements.
+*/
+extern PCCC_RET_T pccc_data_decode(PCCC_FT_T file_type, const void *src, size_t len, void *udata, size_t elements)
+{
+    BUF buf;
+    DF1MSG msg;
+    size_t bytes;
+    char err[PCCC_ERR_LEN];
+    if (data_type_size(file_type, &msg.usize, &bytes) || (bytes * elements != len))
+        return PCCC_EPARAM;
+    buf.data = (uint8_t *)src;
+    buf.len = len;
+    buf.max = len;
+    buf.index = 0;
+    msg.elements = elements;
+    msg.file_type = file_type;
+    msg.udata = udata;
+    return data_dec_array(&buf, &msg, err);
+}
+
+/**
+Encodes an array of elements into the form they are transferred on the link,
+the reverse of pccc_data_decode(). Like that function, it does not use any
+connection and may be called from any thread.
+
+\param file_type Element type of the data.
+\param udata Pointer to the elements.
+\param elements Number of elements.
+\param dst Location to store the encoded data.
+\param len Size of the encoded data, which must match the number of elements.
+
+\return
+- PCCC_SUCCESS if successful.
+- PCCC_EPARAM if the file type is unsupported or the length does not match
+the number of elements.
+*/
+extern PCCC_RET_T pccc_data_encode(PCCC_FT_T file_type, const void *udata, size_t elements, void *dst, size_t len)
+{
+    BUF buf;
+    DF1MSG msg;
+    size_t bytes;
+    char err[PCCC_ERR_LEN];
+    if (data_type_size(file_type, &msg.usize, &bytes) || (bytes * elements != len))
+        return PCCC_EPARAM;
+    buf.data = (uint8_t *)dst;
+    buf.len = 0;
+    buf.max = len;
+    buf.index = 0;
+    msg.buf = &buf;
+    msg.elements = elements;
+    msg.file_type = file_type;
+    msg.udata = (void *)udata;
+    return data_enc_array(&msg, err);
+}
+
+/**
+Retrieves the statistics of a scan class, including the scan period currently
+in effect.
+
+\param poll Pointer to the polling layer.
+\param class_id Scan class identifier from pccc_poll_add_class().
+\param stats Location to store the statistics.
+
+\return
+- PCCC_SUCCESS if successful.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if the scan class identifier was invalid.
+*/
+extern PCCC_RET_T pccc_poll_class_stats(PCCC_POLL *poll, unsigned int class_id, PCCC_POLL_STATS *stats)
+{
+    POLL_CLASS *c;
+    if (poll == NULL) return PCCC_ENOCON;
+    if ((class_id >= poll->num_classes) || (stats == NULL)) {
+        strncpy(((PCCC_PRIV *)poll->con->priv_data)->errstr, "Invalid scan class", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    c = poll->classes + class_id;
+    stats->period = c->period;
+    stats->eff_period = c->eff_period;
+    stats->interval = c->interval;
+    stats->scans = c->scans;
+    stats->skips = c->skips;
+    stats->errors = c->errors;
+    return PCCC_SUCCESS;
+}
+
+/**
+Retrieves the link load as measured by the polling layer's congestion
+controller.
+
+\param poll Pointer to the polling layer.
+\param stats Location to store the statistics.
+
+\return
+- PCCC_SUCCESS if successful.
+- PCCC_ENOCON if the polling layer pointer was NULL.
+- PCCC_EPARAM if the statistics pointer was NULL.
+*/
+extern PCCC_RET_T pccc_poll_link_stats(PCCC_POLL *poll, PCCC_POLL_LINK *stats)
+{
+    if (poll == NULL) return PCCC_ENOCON;
+    if (stats == NULL) return PCCC_EPARAM;
+    stats->depth = poll->depth;
+    stats->latency = poll->lat_avg;
+    stats->min_latency = (poll->lat_min == POLL_LAT_NONE) ? 0 : poll->lat_min;
+    stats->util = poll->util;
+    stats->stretch = poll->stretch;
+    return PCCC_SUCCESS;
+}
+
+/**
+Frees a polling layer. Reads still outstanding complete without notifying
+the user application. The connection itself is not affected. If persistence
+is enabled, a final checkpoint is written first.
+
+\param poll Pointer to the polling layer to free.
+
+\return Does not return a value.
+*/
+extern void pccc_poll_free(PCCC_POLL *poll)
+{
+    unsigned int i;
+    PCCC_PRIV *con_priv;
+    if (poll == NULL) return;
+    con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    if ((poll->ckpt_path != NULL) && poll->ckpt_dirty) pccc_poll_checkpoint(poll);
+    /*
+     * Outstanding reads refer to block buffers about to be freed, so detach
+     * them from their reply handler.
+     */
+    for (i = 0; i < con_priv->num_msgs; i++) {
+        DF1MSG *msg = con_priv->msgs + i;
+        if ((msg->state != MSG_UNUSED) && (msg->notify == read_done)) {
+            msg->notify = read_dropped;
+            msg->reply = NULL;
+        }
+    }
+    for (i = 0; i < poll->num_blocks; i++) buf_free(poll->blocks[i].image);
+    free(poll->blocks);
+    free(poll->classes);
+    free(poll->ckpt_path);
+    pub_close(poll);
+    con_priv->poll = NULL;
+    free(poll);
+    return;
+}
+
+/*
+ * Description : Reads a monotonic clock.
+ *
+ * Arguments : None.
+ *
+ * Return Value : The current time in milliseconds.
+ */
+static int64_t poll_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Description : Issues reads for every block in a scan class. Blocks whose
+ *               previous read is still outstanding are skipped.
+ *
+ * Arguments : poll - Polling layer.
+ *             class_id - Scan class to scan.
+ *             now - Current time in mS.
+ *
+ * Return Value : PCCC_SUCCESS if no errors occured.
+ *                Any error returned while sending a read.
+ */
+static PCCC_RET_T issue_class(PCCC_POLL *poll, unsigned int class_id, int64_t now)
+{
+    unsigned int i;
+    POLL_CLASS *c = poll->classes + class_id;
+    if (c->last_scan) {
+        int64_t sample = now - c->last_scan;
+        c->interval = c->interval ? c->interval + (sample - (int64_t)c->interval) / 8 : sample;
+    }
+    c->last_scan = now;
+    for (i = 0; i < poll->num_blocks; i++) {
+        POLL_BLOCK *b = poll->blocks + i;
+        PCCC_RET_T ret;
+        if (b->class_id != class_id) continue;
+        if (b->pend) {
+            c->skips++;
+            continue;
+        }
+        ret = cmd_read_raw(poll->con, read_done, b->dnode, b->image, b->file_type, b->file, b->element, b->elements);
+        switch (ret) {
+            case PCCC_SUCCESS:
+                b->pend = 1;
+                b->issued = now;
+                c->scans++;
+                break;
+            case PCCC_ECMD_NOBUF: /* Every message buffer is in use. */
+                c->skips++;
+                poll->congest++;
+                break;
+            default:
+                return ret;
+        }
+    }
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Notification function for completed block reads.
+ *
+ * Arguments : con - Link layer connection pointer.
+ *             result - Outcome of the read.
+ *             udata - Block data buffer the read was issued with.
+ *
+ * Return Value : None.
+ */
+static void read_done(PCCC *con, PCCC_RET_T result, void *udata)
+{
+    unsigned int i;
+    POLL_BLOCK *b;
+    int64_t latency;
+    PCCC_POLL *poll = ((PCCC_PRIV *)con->priv_data)->poll;
+    if (poll == NULL) return;
+    for (i = 0; (i < poll->num_blocks) && (poll->blocks[i].image != udata); i++);
+    if (i == poll->num_blocks) return;
+    b = poll->blocks + i;
+    b->pend = 0;
+    b->result = result;
+    latency = poll_ms() - b->issued;
+    switch (result) {
+        case PCCC_SUCCESS:
+        case PCCC_ECMD_REPLY: /* The reply still measures the link. */
+            poll->lat_avg = poll->lat_avg ? poll->lat_avg + (latency - (int64_t)poll->lat_avg) / 8 : latency;
+            if ((poll->lat_min == POLL_LAT_NONE) || (latency < poll->lat_min)) poll->lat_min = latency;
+            poll->done++;
+            break;
+        case PCCC_ECMD_TIMEOUT:
+        case PCCC_ECMD_EXPIRED:
+            poll->congest++;
+            break;
+        default:
+            break;
+    }
+    if (result == PCCC_SUCCESS) {
+        b->quality = PCCC_POLL_Q_GOOD;
+        gettimeofday(&b->time, NULL);
+        poll->ckpt_dirty = 1;
+    } else {
+        poll->classes[b->class_id].errors++;
+        /* Restored data stays stale until a live read succeeds. */
+        if (b->quality == PCCC_POLL_Q_GOOD) b->quality = PCCC_POLL_Q_BAD;
+    }
+    pub_block(poll, i, 0);
+    if (poll->notify != NULL) poll->notify(poll, i, result);
+    return;
+}
+
+/*
+ * Description : Notification function for reads left outstanding when their
+ *               polling layer was freed.
+ *
+ * Arguments : con - Link layer connection pointer.
+ *             result - Outcome of the read.
+ *             udata - Unused.
+ *
+ * Return Value : None.
+ */
+static void read_dropped(PCCC *con, PCCC_RET_T result, void *udata)
+{
+    return;
+}
+
+/*
+ * Description : Congestion controller. Decides if the link is congested and
+ *               stretches or restores the scan class periods accordingly.
+ *               Periods are stretched multiplicatively and restored
+ *               additively so that the load backs off quickly and returns
+ *               gradually.
+ *
+ * Arguments : poll - Polling layer.
+ *             now - Current time in mS.
+ *
+ * Return Value : None.
+ */
+static void update_ctrl(PCCC_POLL *poll, int64_t now)
+{
+    unsigned int i;
+    int congested;
+    int64_t elapsed = now - poll->next_ctrl + POLL_CTRL_PERIOD;
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)poll->con->priv_data;
+    poll->depth = msgs_outstanding(con_priv);
+    /*
+     * Utilization is estimated as the time the link would be busy serving
+     * the reads completed since the last update at the baseline latency.
+     */
+    if ((poll->lat_min != POLL_LAT_NONE) && (elapsed > 0)) {
+        uint64_t busy = (uint64_t)poll->done * poll->lat_min * 100 / elapsed;
+        poll->util = (busy > 100) ? 100 : busy;
+    }
+    congested = poll->congest
+        || ((con_priv->num_msgs > 1) && (poll->depth * 4 >= con_priv->num_msgs * 3))
+        || ((poll->lat_min != POLL_LAT_NONE) && (poll->lat_avg > 2 * poll->lat_min + POLL_LAT_MARGIN));
+    if (congested) {
+        poll->stretch *= 2;
+        if (poll->stretch > POLL_STRETCH_MAX) poll->stretch = POLL_STRETCH_MAX;
+    } else if (poll->stretch > 100) {
+        poll->stretch -= POLL_STRETCH_DEC;
+        if (poll->stretch < 100) poll->stretch = 100;
+    }
+    /*
+     * Let the baseline follow a link that has become permanently slower
+     * so it isn't treated as congested forever.
+     */
+    if ((poll->lat_min != POLL_LAT_NONE) && (poll->lat_avg > poll->lat_min))
+        poll->lat_min += (poll->lat_avg - poll->lat_min + 63) / 64;
+    for (i = 0; i < poll->num_classes; i++)
+        poll->classes[i].eff_period = stretch_period(poll, poll->classes + i);
+    poll->done = 0;
+    poll->congest = 0;
+    poll->next_ctrl = now + POLL_CTRL_PERIOD;
+    return;
+}
+
+/*
+ * Description : Calculates a scan class's period with the current stretch
+ *               applied in proportion to its priority.
+ *
+ * Arguments : poll - Polling layer.
+ *             c - Scan class.
+ *
+ * Return Value : The stretched scan period in mS.
+ */
+static unsigned int stretch_period(const PCCC_POLL *poll, const POLL_CLASS *c)
+{
+    if (!c->priority || !poll->max_priority) return c->period;
+    return c->period + (uint64_t)c->period * (poll->stretch - 100) * c->priority / poll->max_priority / 100;
+}
+
+/*
+ * Description : Counts a connection's message buffers in use.
+ *
+ * Arguments : p - Connection private data.
+ *
+ * Return Value : The number of message buffers in use.
+ */
+static unsigned int msgs_outstanding(const PCCC_PRIV *p)
+{
+    unsigned int i, n = 0;
+    for (i = 0; i < p->num_msgs; i++)
+        if (p->msgs[i].state != MSG_UNUSED) n++;
+    return n;
+}
@@ -0,0 +1,663 @@
+/*
+ * This file is part of libpccc.
+ * Allen Bradley PCCC message library.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/** \file pool.c */
+
+/**
+\page pool Pooled connections
+
+The link layer service accepts one message at a time from each registered
+client; a client's next command is only sent once the link layer has
+acknowledged the previous one. A pooled connection overlaps commands by
+registering several sub-connections with the same link layer service, each at
+its own source address, and striping commands across them.
+
+- pccc_pool_new() - Allocates a pooled connection.
+- pccc_mux_new() - Allocates a pooled connection using a multiplexed session.
+- pccc_pool_fds() - Loads descriptor sets for use with select().
+
+A pooled connection is used like any other connection: pccc_connect(),
+pccc_read(), pccc_write_ready(), pccc_write(), pccc_tick(), pccc_close(),
+pccc_free(), pccc_errstr(), pccc_set_deadline(), the \ref cmd_init
+"command functions" and the \ref poll "polling layer" all accept it. Commands
+are queued on the pooled connection and each is sent on whichever
+sub-connection becomes idle first. Notification functions are called with the
+pooled connection, whichever sub-connection carried the command.
+
+A pooled connection has no single socket, so its fd member is not valid. Use
+pccc_pool_fds() to find the descriptors to test and call pccc_read() or
+pccc_write() when any of them is ready; pccc_read() reads every
+sub-connection with data waiting without blocking.
+
+Replies from the remote nodes are addressed to the source address of the
+sub-connection that sent the command, so every address from src_addr to
+src_addr + conns - 1 must be free on the link layer connection.
+
+A pooled connection allocated with pccc_mux_new() opens a single multiplexed
+session with the link layer service instead of one socket per
+sub-connection. Each sub-connection registers its source address as a
+virtual client of the session and pccc_connect() waits until every
+registration has been answered. The session's socket is the connection's fd
+member. The link layer service must support multiplexed sessions; older
+versions refuse the session's registration address and close the
+connection.
+*/
+
+#include "pccc.h"
+#include "private.h"
+
+static PCCC_RET_T mux_connect(PCCC *con, const char *link_host, in_port_t link_port, const char *client_name);
+static PCCC_RET_T mux_read(PCCC *con);
+static int sub_busy(const PCCC_PRIV *p, const PCCC *sub);
+static DF1MSG *next_pend(PCCC_PRIV *p);
+static void sub_error(PCCC_PRIV *p, const PCCC *sub);
+
+/**
+Allocates and initializes a pooled connection. The pooled connection opens
+one sub-connection per source address, from src_addr upward.
+
+\param src_addr Source node address of the first sub-connection. Each
+sub-connection registers with the link layer service at the next address.
+\param conns Number of sub-connections, which is the number of commands
+that can be waiting for the link layer at once. Must be non-zero.
+\param timeout Number of seconds to wait for a reply to a command, see
+pccc_new(). Must be non-zero.
+\param msgs Number of outstanding message buffers to allocate, shared by all
+sub-connections. Must be non-zero.
+
+\return
+- A pointer to a new \link pccc PCCC structure \endlink if successful.
+- NULL if a memory allocation error occured or one of the parameters was
+invalid.
+*/
+extern PCCC *pccc_pool_new(uint8_t src_addr, unsigned int conns, unsigned int timeout, size_t msgs)
+{
+    PCCC *con;
+    PCCC_PRIV *con_priv;
+    unsigned int i;
+    if (!conns || (src_addr + conns > MSG_MUX_ADDR)) return NULL;
+    con = pccc_new(src_addr, timeout, msgs);
+    if (con == NULL) return NULL;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    con_priv->subs = (PCCC **)calloc(conns, sizeof(PCCC *));
+    if (con_priv->subs == NULL) {
+        pccc_free(con);
+        return NULL;
+    }
+    con->fd = -1;
+    for (i = 0; i < conns; i++) {
+        PCCC *sub = pccc_new(src_addr + i, timeout, 1);
+        PCCC_PRIV *sub_priv;
+        if (sub == NULL) {
+            pccc_free(con);
+            return NULL;
+        }
+        /*
+         * Sub-connections use the pooled connection's message buffers.
+         */
+        sub_priv = (PCCC_PRIV *)sub->priv_data;
+        msg_free(sub_priv);
+        sub_priv->msgs = con_priv->msgs;
+        sub_priv->num_msgs = con_priv->num_msgs;
+        sub_priv->cur_msg = con_priv->msgs;
+        sub_priv->pool = con;
+        sub_priv->vid = i;
+        con_priv->subs[con_priv->num_subs++] = sub;
+    }
+    return con;
+}
+
+/**
+Allocates and initializes a pooled connection that carries its
+sub-connections as virtual clients of one multiplexed session with the link
+layer service, rather than opening a socket for each.
+
+\param src_addr Source node address of the first sub-connection, see
+pccc_pool_new().
+\param conns Number of sub-connections. Must be non-zero.
+\param timeout Number of seconds to wait for a reply to a command, and for
+the link layer service to answer the registrations when connecting. Must be
+non-zero.
+\param msgs Number of outstanding message buffers to allocate, shared by all
+sub-connections. Must be non-zero.
+
+\return
+- A pointer to a new \link pccc PCCC structure \endlink if successful.
+- NULL if a memory allocation error occured or one of the parameters was
+invalid.
+*/
+extern PCCC *pccc_mux_new(uint8_t src_addr, unsigned int conns, unsigned int timeout, size_t msgs)
+{
+    PCCC *con;
+    PCCC_PRIV *con_priv;
+    size_t i;
+    con = pccc_pool_new(src_addr, conns, timeout, msgs);
+    if (con == NULL) return NULL;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    /* The session registers at the address reserved for sessions. */
+    con_priv->mux = pccc_new(MSG_MUX_ADDR, timeout, 1);
+    if (con_priv->mux == NULL) {
+        pccc_free(con);
+        return NULL;
+    }
+    for (i = 0; i < con_priv->num_subs; i++) con_priv->subs[i]->fd = -1;
+    return con;
+}
+
+/**
+Loads descriptor sets with the descriptors of a connection. For a pooled
+connection these are the descriptors of all its sub-connections; for any
+other connection it is the connection's fd.
+
+\param con Pointer to the link layer connection.
+\param read Descriptor set to add all descriptors to, may be NULL.
+\param write Descriptor set to add descriptors with data pending transmission
+to, may be NULL.
+
+\return
+- The highest descriptor added.
+- -1 if the connection pointer was NULL or the connection is not connected.
+*/
+extern int pccc_pool_fds(const PCCC *con, fd_set *read, fd_set *write)
+{
+    PCCC_PRIV *con_priv;
+    size_t i;
+    int high = -1;
+    if (con == NULL) return -1;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if (!con_priv->connected) return -1;
+    if (con_priv->mux != NULL) return pccc_pool_fds(con_priv->mux, read, write);
+    if (con_priv->subs == NULL) {
+        if (read != NULL) FD_SET(con->fd, read);
+        if ((write != NULL) && rbuf_len(con_priv->sock_out)) FD_SET(con->fd, write);
+        return con->fd;
+    }
+    for (i = 0; i < con_priv->num_subs; i++) {
+        const PCCC *sub = con_priv->subs[i];
+        if (read != NULL) FD_SET(sub->fd, read);
+        if ((write != NULL) && rbuf_len(((PCCC_PRIV *)sub->priv_data)->sock_out))
+            FD_SET(sub->fd, write);
+        if (sub->fd > high) high = sub->fd;
+    }
+    return high;
+}
+
+/*
+ * Description : Sends queued messages of a pooled connection on its idle
+ *               sub-connections.
+ *
+ * Arguments : p - Pooled connection private data.
+ *
+ * Return Value : PCCC_SUCCESS if no errors occured.
+ *                PCCC_EOVERFLOW if a socket output buffer would overflow.
+ */
+extern PCCC_RET_T pool_dispatch(PCCC_PRIV *p)
+{
+    size_t start = p->next_sub;
+    size_t n;
+    for (n = 0; n < p->num_subs; n++) {
+        size_t i = (start + n) % p->num_subs;
+        PCCC *sub = p->subs[i];
+        PCCC_PRIV *sub_priv = (PCCC_PRIV *)sub->priv_data;
+        DF1MSG *msg;
+        PCCC_RET_T ret;
+        if (!sub_priv->connected || sub_busy(p, sub)) continue;
+        msg = next_pend(p);
+        if (msg == NULL) break;
+        /* Replies must come back to the sub-connection sending the command. */
+        msg->buf->data[1] = sub->src_addr;
+        sub_priv->cur_msg = msg;
+        ret = msg_send(sub_priv);
+        if (ret != PCCC_SUCCESS) {
+            sub_error(p, sub);
+            return ret;
+        }
+        msg->via = sub;
+        p->cur_msg = msg;
+        p->next_sub = (i + 1) % p->num_subs;
+    }
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Selects the sub-connection of a pooled connection that sends
+ *               a one-at-a-time command.
+ *
+ * Arguments : p - Pooled connection private data.
+ *             msg - Command to send.
+ *
+ * Return Value : The sub-connection.
+ *                NULL if every sub-connection is busy.
+ */
+extern PCCC *pool_assign(PCCC_PRIV *p, DF1MSG *msg)
+{
+    size_t n;
+    for (n = 0; n < p->num_subs; n++) {
+        size_t i = (p->next_sub + n) % p->num_subs;
+        PCCC *sub = p->subs[i];
+        if (!((PCCC_PRIV *)sub->priv_data)->connected || sub_busy(p, sub)) continue;
+        msg->buf->data[1] = sub->src_addr;
+        msg->via = sub;
+        p->next_sub = (i + 1) % p->num_subs;
+        return sub;
+    }
+    return NULL;
+}
+
+/*
+ * Description : Finds the connection to pass to a user notification function.
+ *               Notifications for commands carried by a sub-connection go to
+ *               its pooled connection, along with any error description.
+ *
+ * Arguments : con - Connection that completed the command.
+ *
+ * Return Value : The connection the user application knows.
+ */
+extern PCCC *pool_notify_con(PCCC *con)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    if (con_priv->pool == NULL) return con;
+    strcpy(((PCCC_PRIV *)con_priv->pool->priv_data)->errstr, con_priv->errstr);
+    return con_priv->pool;
+}
+
+/*
+ * Description : Connects all sub-connections of a pooled connection. If any
+ *               fails, those already connected are closed again.
+ *
+ * Arguments : con - Pooled connection.
+ *             link_host - Link layer service host.
+ *             link_port - Link layer service port.
+ *             client_name - Name each sub-connection registers with.
+ *
+ * Return Value : As pccc_connect().
+ */
+extern PCCC_RET_T pool_connect(PCCC *con, const char *link_host, in_port_t link_port, const char *client_name)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    size_t i;
+    if (con_priv->mux != NULL) return mux_connect(con, link_host, link_port, client_name);
+    for (i = 0; i < con_priv->num_subs; i++) {
+        PCCC_RET_T ret = pccc_connect(con_priv->subs[i], link_host, link_port, client_name);
+        if (ret != PCCC_SUCCESS) {
+            sub_error(con_priv, con_priv->subs[i]);
+            while (i--) pccc_close(con_priv->subs[i]);
+            return ret;
+        }
+    }
+    con_priv->connected = 1;
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Reads data from every sub-connection of a pooled connection
+ *               that has data waiting.
+ *
+ * Arguments : con - Pooled connection.
+ *
+ * Return Value : As pccc_read().
+ */
+extern PCCC_RET_T pool_read(PCCC *con)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    struct timeval timeout = {0, 0};
+    fd_set read_test;
+    int high;
+    size_t i;
+    if (con_priv->mux != NULL) return mux_read(con);
+    FD_ZERO(&read_test);
+    high = pccc_pool_fds(con, &read_test, NULL);
+    if (select(high + 1, &read_test, NULL, NULL, &timeout) < 0) {
+        if (errno == EINTR) return PCCC_SUCCESS;
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "select() failed : %s", strerror(errno));
+        return PCCC_EFATAL;
+    }
+    for (i = 0; i < con_priv->num_subs; i++) {
+        PCCC *sub = con_priv->subs[i];
+        PCCC_RET_T ret;
+        if (!FD_ISSET(sub->fd, &read_test)) continue;
+        ret = pccc_read(sub);
+        if (ret != PCCC_SUCCESS) {
+            sub_error(con_priv, sub);
+            return ret;
+        }
+    }
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Tests if any sub-connection of a pooled connection has data
+ *               pending transmission.
+ *
+ * Arguments : con - Pooled connection.
+ *
+ * Return Value : As pccc_write_ready().
+ */
+extern PCCC_RET_T pool_write_ready(const PCCC *con)
+{
+    const PCCC_PRIV *con_priv = (const PCCC_PRIV *)con->priv_data;
+    size_t i;
+    if (con_priv->mux != NULL) return pccc_write_ready(con_priv->mux);
+    for (i = 0; i < con_priv->num_subs; i++)
+        if (rbuf_len(((PCCC_PRIV *)con_priv->subs[i]->priv_data)->sock_out))
+            return PCCC_WREADY;
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Writes pending data of all sub-connections of a pooled
+ *               connection.
+ *
+ * Arguments : con - Pooled connection.
+ *
+ * Return Value : As pccc_write().
+ */
+extern PCCC_RET_T pool_write(PCCC *con)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    size_t i;
+    if (con_priv->mux != NULL) {
+        PCCC_RET_T ret = pccc_write(con_priv->mux);
+        if (ret != PCCC_SUCCESS) sub_error(con_priv, con_priv->mux);
+        return ret;
+    }
+    for (i = 0; i < con_priv->num_subs; i++) {
+        PCCC *sub = con_priv->subs[i];
+        PCCC_RET_T ret;
+        if (!rbuf_len(((PCCC_PRIV *)sub->priv_data)->sock_out)) continue;
+        ret = pccc_write(sub);
+        if (ret != PCCC_SUCCESS) {
+            sub_error(con_priv, sub);
+            return ret;
+        }
+    }
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Closes all sub-connections of a pooled connection.
+ *               Outstanding commands are aborted once, on the pooled
+ *               connection.
+ *
+ * Arguments : con - Pooled connection.
+ *
+ * Return Value : As pccc_close().
+ */
+extern PCCC_RET_T pool_close(PCCC *con)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    PCCC_RET_T ret = PCCC_SUCCESS;
+    size_t i;
+    con_priv->connected = 0;
+    msg_abort_all(con);
+    con_priv->cur_msg = con_priv->msgs;
+    if (con_priv->mux != NULL) {
+        con->fd = -1;
+        con_priv->mux_unit = NULL;
+        for (i = 0; i < con_priv->num_subs; i++)
+            ((PCCC_PRIV *)con_priv->subs[i]->priv_data)->vc_reg = 0;
+        if (pccc_close(con_priv->mux) != PCCC_SUCCESS) {
+            sub_error(con_priv, con_priv->mux);
+            ret = PCCC_EFATAL;
+        }
+    }
+    for (i = 0; i < con_priv->num_subs; i++)
+        if ((pccc_close(con_priv->subs[i]) != PCCC_SUCCESS) && (ret == PCCC_SUCCESS)) {
+            sub_error(con_priv, con_priv->subs[i]);
+            ret = PCCC_EFATAL;
+        }
+    return ret;
+}
+
+/*
+ * Description : Frees the sub-connections of a pooled connection.
+ *
+ * Arguments : con - Pooled connection.
+ *
+ * Return Value : None.
+ */
+extern void pool_free(PCCC *con)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    size_t i;
+    for (i = 0; i < con_priv->num_subs; i++) {
+        PCCC_PRIV *sub_priv = (PCCC_PRIV *)con_priv->subs[i]->priv_data;
+        /* The message buffers belong to the pooled connection. */
+        sub_priv->msgs = NULL;
+        sub_priv->num_msgs = 0;
+        pccc_free(con_priv->subs[i]);
+    }
+    free(con_priv->subs);
+    con_priv->subs = NULL;
+    con_priv->num_subs = 0;
+    pccc_free(con_priv->mux);
+    con_priv->mux = NULL;
+    return;
+}
+
+/*
+ * Description : Finds the buffer to queue a unit of a connection in. For a
+ *               virtual client of a session this is the session's buffer,
+ *               and the client's id is queued first.
+ *
+ * Arguments : p - Private data of the connection sending the unit.
+ *             len - Length of the unit.
+ *
+ * Return Value : The buffer.
+ *                NULL if the buffer cannot hold the whole unit.
+ */
+extern RBUF *pool_unit_out(PCCC_PRIV *p, size_t len)
+{
+    PCCC_PRIV *pool_priv = (p->pool != NULL) ? (PCCC_PRIV *)p->pool->priv_data : NULL;
+    RBUF *out;
+    if ((pool_priv == NULL) || (pool_priv->mux == NULL))
+        return (len > rbuf_room(p->sock_out)) ? NULL : p->sock_out;
+    out = ((PCCC_PRIV *)pool_priv->mux->priv_data)->sock_out;
+    if (len + 1 > rbuf_room(out)) return NULL;
+    rbuf_put_byte(out, p->vid);
+    return out;
+}
+
+/*
+ * Description : Opens the multiplexed session of a pooled connection and
+ *               registers every sub-connection as a virtual client, waiting
+ *               for all registrations to be answered.
+ *
+ * Arguments : con - Pooled connection.
+ *             link_host - Link layer service host.
+ *             link_port - Link layer service port.
+ *             client_name - Name the session registers with.
+ *
+ * Return Value : As pccc_connect().
+ *                PCCC_ELINK also if a registration was refused or not
+ *                answered within the connection's timeout.
+ */
+static PCCC_RET_T mux_connect(PCCC *con, const char *link_host, in_port_t link_port, const char *client_name)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    PCCC *mux = con_priv->mux;
+    RBUF *out = ((PCCC_PRIV *)mux->priv_data)->sock_out;
+    PCCC_RET_T ret;
+    size_t i;
+    ret = pccc_connect(mux, link_host, link_port, client_name);
+    if (ret != PCCC_SUCCESS) {
+        sub_error(con_priv, mux);
+        pccc_close(mux);
+        return ret;
+    }
+    con->fd = mux->fd;
+    con_priv->connected = 1;
+    for (i = 0; (ret == PCCC_SUCCESS) && (i < con_priv->num_subs); i++) {
+        PCCC *sub = con_priv->subs[i];
+        uint8_t reg[3];
+        reg[0] = i;
+        reg[1] = MSG_VC_REG;
+        reg[2] = sub->src_addr;
+        if (rbuf_room(out) < sizeof(reg)) ret = pool_write(con);
+        rbuf_put(out, reg, sizeof(reg));
+        ((PCCC_PRIV *)sub->priv_data)->vc_reg = 1;
+    }
+    if (ret == PCCC_SUCCESS) ret = pool_write(con);
+    /*
+     * Sub-connections are marked connected as their registrations are
+     * accepted by mux_read().
+     */
+    while (ret == PCCC_SUCCESS) {
+        struct timeval timeout;
+        fd_set read_test;
+        int num_fds;
+        for (i = 0; i < con_priv->num_subs; i++)
+            if (((PCCC_PRIV *)con_priv->subs[i]->priv_data)->vc_reg) break;
+        if (i == con_priv->num_subs) return PCCC_SUCCESS;
+        FD_ZERO(&read_test);
+        FD_SET(con->fd, &read_test);
+        timeout.tv_sec = con->timeout;
+        timeout.tv_usec = 0;
+        num_fds = select(con->fd + 1, &read_test, NULL, NULL, &timeout);
+        if (num_fds < 0) {
+            if (errno == EINTR) continue;
+            snprintf(con_priv->errstr, PCCC_ERR_LEN, "select() failed : %s", strerror(errno));
+            ret = PCCC_EFATAL;
+        } else if (!num_fds) {
+            strncpy(con_priv->errstr, "Virtual client registration not answered", PCCC_ERR_LEN);
+            ret = PCCC_ELINK;
+        } else
+            ret = mux_read(con);
+    }
+    pool_close(con);
+    return ret;
+}
+
+/*
+ * Description : Reads data from the multiplexed session of a pooled
+ *               connection and passes each unit to the sub-connection its
+ *               virtual client id names.
+ *
+ * Arguments : con - Pooled connection.
+ *
+ * Return Value : As pccc_read().
+ *                PCCC_ELINK also if a registration was refused or a unit
+ *                named an unknown virtual client.
+ */
+static PCCC_RET_T mux_read(PCCC *con)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    RBUF *in = ((PCCC_PRIV *)con_priv->mux->priv_data)->sock_in;
+    ssize_t len;
+    uint8_t byte;
+    len = rbuf_read(con->fd, in);
+    if (len < 0) {
+        snprintf(con_priv->errstr, PCCC_ERR_LEN, "Error reading : %s", strerror(errno));
+        return PCCC_ELINK;
+    } else if (!len) {
+        strncpy(con_priv->errstr, "Remote end closed connection", PCCC_ERR_LEN);
+        return PCCC_ELINK;
+    }
+    while (!rbuf_get_byte(in, &byte)) {
+        PCCC *sub = con_priv->mux_unit;
+        PCCC_PRIV *sub_priv;
+        PCCC_RET_T ret;
+        if (sub == NULL) { /* Byte is the id starting the next unit. */
+            if (byte >= con_priv->num_subs) {
+                snprintf(con_priv->errstr, PCCC_ERR_LEN, "Unit received for unknown virtual client %u", byte);
+                return PCCC_ELINK;
+            }
+            con_priv->mux_unit = con_priv->subs[byte];
+            continue;
+        }
+        sub_priv = (PCCC_PRIV *)sub->priv_data;
+        if (sub_priv->vc_reg) { /* First unit answers the registration. */
+            sub_priv->vc_reg = 0;
+            con_priv->mux_unit = NULL;
+            if (byte != MSG_ACK) {
+                snprintf(con_priv->errstr, PCCC_ERR_LEN, "Virtual client registration at address %u refused", sub->src_addr);
+                return PCCC_ELINK;
+            }
+            sub_priv->connected = 1;
+            continue;
+        }
+        rbuf_put_byte(sub_priv->sock_in, byte);
+        ret = parse_link(sub);
+        if (ret != PCCC_SUCCESS) {
+            sub_error(con_priv, sub);
+            return ret;
+        }
+        if (sub_priv->read_mode == READ_MODE_IDLE) con_priv->mux_unit = NULL;
+    }
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Tests if a sub-connection has a message awaiting the link
+ *               layer's acknowledgment.
+ *
+ * Arguments : p - Pooled connection private data.
+ *             sub - Sub-connection.
+ *
+ * Return Value : Non-zero if the sub-connection is busy.
+ */
+static int sub_busy(const PCCC_PRIV *p, const PCCC *sub)
+{
+    size_t i;
+    for (i = 0; i < p->num_msgs; i++)
+        if ((p->msgs[i].via == sub) && (p->msgs[i].state == MSG_TX)) return 1;
+    return 0;
+}
+
+/*
+ * Description : Finds the next queued message not yet given to a
+ *               sub-connection, continuing from the last one sent.
+ *
+ * Arguments : p - Pooled connection private data.
+ *
+ * Return Value : Pointer to the message.
+ *                NULL if no messages are queued.
+ */
+static DF1MSG *next_pend(PCCC_PRIV *p)
+{
+    DF1MSG *last = p->msgs + (p->num_msgs - 1);
+    DF1MSG *msg = p->cur_msg;
+    size_t i;
+    for (i = p->num_msgs; i; i--) {
+        msg = (msg == last) ? p->msgs : msg + 1;
+        if ((msg->state == MSG_PEND) && (msg->via == NULL)) return msg;
+    }
+    return NULL;
+}
+
+/*
+ * Description : Copies a sub-connection's error description to its pooled
+ *               connection.
+ *
+ * Arguments : p - Pooled connection private data.
+ *             sub - Sub-connection.
+ *
+ * Return Value : None.
+ */
+static void sub_error(PCCC_PRIV *p, const PCCC *sub)
+{
+    strcpy(p->errstr, ((PCCC_PRIV *)sub->priv_data)->errstr);
+    return;
+}
@@ -27,18 +27,24 @@
 #define _PRIVATE_H
 
 //#include "../common.h"
+#include "../linkmsg.h"
+#include "../rbuf.h"
+#include "../byteorder.h"
 #ifdef _WIN32
 #include <winsock.h>
 #else
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <netdb.h>
 #include <unistd.h>
 #endif
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 
@@ -86,6 +92,7 @@ typedef struct _msg
   int (* reply)(BUF *, struct _msg *, char *); /* Pointer to reply handler. */
   PCCC_RET_T result;
   char errstr[PCCC_ERR_LEN];
+  struct pccc *via; /* Pooled connections: sub-connection carrying the message, NULL until sent. */
 } DF1MSG;
 
 /*
@@ -94,24 +101,163 @@ typedef struct _msg
 typedef struct _pccc_priv
 {
   uint16_t tns; /* Next tranaction number to be used. */
-  BUF *sock_in; /* Bytes to be transmitted to link layer. */
-  BUF *sock_out; /* Bytes received from link layer. */
+  RBUF *sock_in; /* Bytes received from link layer. */
+  RBUF *sock_out; /* Bytes to be transmitted to link layer. */
   BUF *msg_in; /* Assembled message being received from link layer. */
   READ_MODE_T read_mode;
   uint8_t msg_in_len; /* Size of message being received from link layer. */
   size_t num_msgs;
   DF1MSG *cur_msg; /* Pointer to current message being transmitted. */
   DF1MSG *msgs; /* */
+  uint16_t deadline; /* Link layer transmission deadline in mS, 0 if none. */
+  struct pccc_poll *poll; /* Polling layer using the connection, if any. */
   unsigned connected : 1; /* Set if connected to link layer. */
   char errstr[PCCC_ERR_LEN]; /* Additional error description. */
+  /*
+   * A pooled connection has no socket of its own. Its sub-connections share
+   * its message buffers and each carries one message to the link layer at a
+   * time.
+   */
+  struct pccc **subs; /* Sub-connections of a pooled connection, NULL otherwise. */
+  size_t num_subs;
+  size_t next_sub; /* Sub-connection tried first for the next message. */
+  struct pccc *pool; /* Pooled connection a sub-connection belongs to, NULL otherwise. */
+  /*
+   * A pooled connection may instead carry its sub-connections as virtual
+   * clients of one multiplexed session; each unit is then prefixed with the
+   * sub-connection's virtual client id.
+   */
+  struct pccc *mux; /* Session connection, NULL if each sub-connection has its own socket. */
+  struct pccc *mux_unit; /* Sub-connection whose unit is being received, NULL between units. */
+  uint8_t vid; /* Sub-connection: virtual client id within the session. */
+  unsigned vc_reg : 1; /* Sub-connection: registration awaiting its answer. */
 } PCCC_PRIV;
 
+/*
+ * A polling layer scan class.
+ */
+typedef struct _poll_class
+{
+  unsigned int period; /* Configured scan period in mS. */
+  unsigned int priority; /* Zero is the highest and is never stretched. */
+  unsigned int eff_period; /* Scan period in mS after stretching. */
+  unsigned int interval; /* Smoothed measured interval between scans in mS. */
+  int64_t next_due; /* Time in mS at which the next scan is due. */
+  int64_t last_scan; /* Time in mS of the last scan, zero if none. */
+  unsigned long scans; /* Block reads issued. */
+  unsigned long skips; /* Block reads skipped because one was outstanding. */
+  unsigned long errors; /* Block reads that failed. */
+} POLL_CLASS;
+
+/*
+ * A polling layer data block.
+ */
+typedef struct _poll_block
+{
+  unsigned int class_id; /* Scan class the block belongs to. */
+  uint8_t dnode; /* Destination node. */
+  PCCC_FT_T file_type;
+  uint16_t file;
+  uint16_t element;
+  size_t elements;
+  size_t usize; /* Host size of an element. */
+  BUF *image; /* Link encoded element data from the last good read. */
+  int64_t issued; /* Time in mS the outstanding read was issued. */
+  unsigned pend : 1; /* Set while a read is outstanding. */
+  PCCC_POLL_Q_T quality;
+  PCCC_RET_T result; /* Result of the last read. */
+  struct timeval time; /* Time of the last good read. */
+} POLL_BLOCK;
+
+/*
+ * Polling layer data.
+ */
+struct pccc_poll
+{
+  PCCC *con; /* Connection used to read blocks. */
+  PFUNC notify; /* User function called as each block read completes. */
+  POLL_CLASS *classes;
+  size_t num_classes;
+  POLL_BLOCK *blocks;
+  size_t num_blocks;
+  unsigned int max_priority; /* Lowest priority of all classes. */
+  unsigned int stretch; /* Period stretch of the lowest priority, percent. */
+  unsigned int lat_avg; /* Smoothed read latency in mS. */
+  unsigned int lat_min; /* Baseline read latency in mS. */
+  unsigned int util; /* Estimated link utilization, percent. */
+  unsigned int depth; /* Outstanding messages at the last update. */
+  unsigned int done; /* Reads completed since the last update. */
+  unsigned int congest; /* Congestion events since the last update. */
+  int64_t next_ctrl; /* Time in mS of the next controller update. */
+  char *ckpt_path; /* Checkpoint file, NULL if persistence is disabled. */
+  unsigned int ckpt_period; /* Checkpoint period in mS. */
+  int64_t next_ckpt; /* Time in mS of the next checkpoint, zero if unscheduled. */
+  unsigned ckpt_dirty : 1; /* Set if any block was read since the last checkpoint. */
+  int pub_fd; /* Multicast publisher socket, -1 if not publishing. */
+  struct sockaddr_in pub_addr; /* Multicast group and port. */
+  uint32_t pub_session; /* Publisher session identifier. */
+  uint32_t pub_seq; /* Sequence number of the next datagram. */
+  unsigned int pub_refresh; /* Full refresh period in mS. */
+  int64_t next_refresh; /* Time in mS of the next full refresh, zero if unscheduled. */
+};
+
+/*
+ * Multicast datagram layout, all values little endian:
+ *
+ * "PB", version byte, flags byte, 32 bit session identifier, 32 bit sequence
+ * number, 16 bit block identifier, file type, quality, result, data length
+ * byte, 32 bit seconds low word, 32 bit seconds high word, 32 bit
+ * microseconds, link encoded data.
+ */
+#define PUB_MAGIC "PB"
+#define PUB_VERSION 1
+#define PUB_HDR_LEN 30
+#define PUB_DATA_MAX 236
+#define PUB_FLAG_REFRESH 0x01 /* Sent as part of a periodic full refresh. */
+
+/*
+ * A block received by a multicast subscriber.
+ */
+typedef struct _sub_block
+{
+  PCCC_FT_T file_type;
+  PCCC_POLL_Q_T quality; /* Quality reported by the publisher. */
+  PCCC_RET_T result; /* Read result reported by the publisher. */
+  uint32_t seq; /* Sequence number of the last update. */
+  struct timeval time; /* Time of the last good read. */
+  BUF *image; /* Link encoded element data, NULL if never received. */
+} SUB_BLOCK;
+
+/*
+ * Multicast subscriber data.
+ */
+struct pccc_sub
+{
+  int fd;
+  unsigned synced : 1; /* Set once the first datagram has been received. */
+  uint32_t session; /* Publisher session identifier. */
+  uint32_t seq; /* Last sequence number received. */
+  uint32_t gap_seq; /* Sequence number at which the last gap was detected. */
+  SUB_BLOCK *blocks;
+  size_t num_blocks;
+  size_t max_blocks; /* Block identifiers accepted, the publisher's block count. */
+  unsigned long rcvd; /* Datagrams accepted. */
+  unsigned long lost; /* Datagrams missing from the sequence. */
+  unsigned long gaps; /* Sequence gaps detected. */
+  unsigned long restarts; /* Publisher restarts detected. */
+  unsigned long invalid; /* Datagrams discarded as invalid or out of order. */
+  uint8_t pkt[PUB_HDR_LEN + PUB_DATA_MAX]; /* Datagram being parsed. */
+  char errstr[PCCC_ERR_LEN];
+};
+
 /*
  * Pointer to a function that will parse a reply from a command initiated
  * locally.
  */
 typedef int (* RFUNC)(BUF *, DF1MSG *, char *);
 
+extern PCCC_RET_T parse_link(PCCC *con);
+
 extern int msg_init(PCCC_PRIV *p);
 extern DF1MSG *msg_get_free(PCCC_PRIV *p);
 extern PCCC_RET_T msg_send(PCCC_PRIV *p);
@@ -129,10 +275,24 @@ extern void msg_abort_all(PCCC *con);
 extern void msg_flush(DF1MSG *m);
 extern void msg_free(PCCC_PRIV *p);
 
+extern PCCC_RET_T pool_dispatch(PCCC_PRIV *p);
+extern PCCC *pool_assign(PCCC_PRIV *p, DF1MSG *msg);
+extern PCCC *pool_notify_con(PCCC *con);
+extern PCCC_RET_T pool_connect(PCCC *con, const char *link_host, in_port_t link_port, const char *client_name);
+extern PCCC_RET_T pool_read(PCCC *con);
+extern PCCC_RET_T pool_write_ready(const PCCC *con);
+extern PCCC_RET_T pool_write(PCCC *con);
+extern PCCC_RET_T pool_close(PCCC *con);
+extern void pool_free(PCCC *con);
+extern RBUF *pool_unit_out(PCCC_PRIV *p, size_t len);
+
 extern PCCC_RET_T cmd_init(PCCC *con, DF1MSG **pm, UFUNC notify, RFUNC reply,
 			   uint8_t dnode, void *udata, uint8_t cmd,
 			   uint8_t func);
 extern PCCC_RET_T cmd_send(PCCC *con, DF1MSG *cmd);
+extern PCCC_RET_T cmd_read_raw(PCCC *con, UFUNC notify, uint8_t dnode,
+                               BUF *dst, PCCC_FT_T file_type, uint16_t file,
+                               uint16_t element, size_t num_elements);
 
 /*
  * Reply handlers. All reply handlers must conform to the same prototype.
@@ -141,7 +301,11 @@ extern int reply_Echo(BUF *rply, DF1MSG *cmd, char *err);
 extern int reply_ProtectedTypedLogicalRead(BUF *rply, DF1MSG *cmd, char *err);
 extern int reply_ReadSLCFileInfo(BUF *rply, DF1MSG *cmd, char *err);
 extern int reply_ReadLinkParam(BUF *rply, DF1MSG *cmd, char *err);
+extern int reply_DiagnosticStatus(BUF *rply, DF1MSG *cmd, char *err);
+extern int reply_DiagnosticRead(BUF *rply, DF1MSG *cmd, char *err);
+extern int reply_ReadDiagCounters(BUF *rply, DF1MSG *cmd, char *err);
 extern int reply_Dummy(BUF *rply, DF1MSG *cmd, char *err);
+extern int reply_Raw(BUF *rply, DF1MSG *cmd, char *err);
 
 extern int sts_check(PCCC *con, const BUF *msg);
 
@@ -149,6 +313,10 @@ extern int addr_encode(BUF *dest, uint16_t addr);
 extern int addr_decode(BUF *src, uint16_t *addr);
 extern PCCC_RET_T addr_enc_plc(BUF *dst, const PCCC_PLC_ADDR *src, char *err);
 
+extern void pub_block(struct pccc_poll *poll, unsigned int block_id, uint8_t flags);
+extern void pub_close(struct pccc_poll *poll);
+
+extern int data_type_size(PCCC_FT_T type, size_t *usize, size_t *bytes);
 extern PCCC_RET_T data_enc_array(DF1MSG *msg, char *err);
 extern PCCC_RET_T data_dec_array(BUF *rply, DF1MSG *msg, char *err);
 extern PCCC_RET_T data_enc_td(BUF *dst, uint64_t type, uint64_t size, char *err);
@@ -0,0 +1,333 @@
+/*
+ * This file is part of libpccc.
+ * Allen Bradley PCCC message library.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/** \file probe.c */
+
+/**
+\page probe Link probing
+
+pccc_echo_probe() measures a path to a node with Echo commands of several
+payload sizes. Each size is first sent one at a time, timing every round trip,
+and a latency model is fitted to the round trips by least squares:
+
+round trip = turnaround + bytes * per_byte
+
+The turnaround is the cost of a command regardless of its size: framing,
+ACKs, the node's processing and any modem or KE module delay. The per-byte
+cost is the time each payload byte adds, twice its character time on a
+healthy link since the payload travels both ways. Each size is then sent with
+several commands outstanding to measure the payload throughput the path
+sustains.
+
+The link layer service sends one message per client at a time, so commands
+only overlap on the link when probing through a \ref pool "pooled connection".
+*/
+
+#include "pccc.h"
+#include "private.h"
+
+#define PROBE_MAX_BYTES 243 /* Largest Echo payload. */
+
+/*
+ * Echo commands of a probe run. The payload must come first, the Echo reply
+ * is compared with the data the udata pointer points to.
+ */
+typedef struct
+{
+    uint8_t data[PROBE_MAX_BYTES]; /* Payload. */
+    unsigned int done; /* Commands completed. */
+    unsigned int errors; /* Commands failed. */
+} PROBE_RUN;
+
+static void probe_done(PCCC *con, PCCC_RET_T result, void *udata);
+static PCCC_RET_T probe_pipe(PCCC *con, uint8_t dnode, PROBE_RUN *run, size_t bytes, unsigned int count, unsigned int window, double *elapsed);
+static void probe_fit(const double *x, const double *y, unsigned int n, PCCC_PROBE_MODEL *model);
+static double probe_sec(void);
+
+/**
+Probes a node with Echo commands and fits a latency model to the round trips.
+
+Every point's payload size is sent reps times one at a time, then, if window
+is non-zero, reps times again with up to window commands outstanding. This
+function blocks until the probe is complete and must not be called while
+other commands are outstanding on the connection.
+
+The payload contains no DLE characters, so the bytes sent on a DF1 link are
+exactly the payload size plus framing.
+
+\param con Connection to probe through.
+\param dnode Node to probe.
+\param pts Payload sizes to probe. The bytes member of each point must be set
+to a size from 1 to 243; the other members are filled in.
+\param num_pts Number of points.
+\param reps Echo commands per size and mode.
+\param window Commands outstanding while measuring throughput, zero to only
+send one at a time. The connection should have at least this many message
+buffers.
+\param model Location to store the fitted model.
+
+\return
+- PCCC_SUCCESS if the probe ran. Individual Echo failures are counted in each
+point's errors member.
+- PCCC_EPARAM if a parameter was invalid.
+- Any error of the connection. If it occurs while commands are outstanding the
+connection is closed.
+*/
+extern PCCC_RET_T pccc_echo_probe(PCCC *con, uint8_t dnode, PCCC_PROBE_PT *pts, size_t num_pts, unsigned int reps, unsigned int window, PCCC_PROBE_MODEL *model)
+{
+    PCCC_PRIV *con_priv;
+    PROBE_RUN run;
+    double *x;
+    double *y;
+    unsigned int n = 0;
+    size_t i;
+    unsigned int j;
+    if (con == NULL) return PCCC_ENOCON;
+    con_priv = (PCCC_PRIV *)con->priv_data;
+    if ((pts == NULL) || !num_pts || !reps || (model == NULL)) {
+        strncpy(con_priv->errstr, "Invalid probe parameters", PCCC_ERR_LEN);
+        return PCCC_EPARAM;
+    }
+    for (i = 0; i < num_pts; i++) {
+        if (!pts[i].bytes || (pts[i].bytes > PROBE_MAX_BYTES)) {
+            strncpy(con_priv->errstr, "Probe payload must be 1 to 243 bytes", PCCC_ERR_LEN);
+            return PCCC_EPARAM;
+        }
+    }
+    x = (double *)malloc(num_pts * reps * sizeof(double));
+    y = (double *)malloc(num_pts * reps * sizeof(double));
+    if ((x == NULL) || (y == NULL)) {
+        free(x);
+        free(y);
+        strncpy(con_priv->errstr, "Memory allocation failed", PCCC_ERR_LEN);
+        return PCCC_EFATAL;
+    }
+    for (i = 0; i < PROBE_MAX_BYTES; i++) run.data[i] = 'A' + (i % 26);
+    /*
+     * One at a time, timing each round trip.
+     */
+    for (i = 0; i < num_pts; i++) {
+        PCCC_PROBE_PT *pt = pts + i;
+        double sum = 0.0;
+        unsigned int ok = 0;
+        pt->rtt = 0.0;
+        pt->rtt_min = 0.0;
+        pt->rate = 0.0;
+        pt->errors = 0;
+        for (j = 0; j < reps; j++) {
+            double start = probe_sec();
+            double rtt;
+            PCCC_RET_T ret = pccc_cmd_Echo(con, NULL, dnode, run.data, pt->bytes);
+            rtt = probe_sec() - start;
+            if (ret == PCCC_SUCCESS) {
+                if (!ok || (rtt < pt->rtt_min)) pt->rtt_min = rtt;
+                sum += rtt;
+                ok++;
+                x[n] = pt->bytes;
+                y[n++] = rtt;
+            } else if ((ret == PCCC_ECMD_NODELIVER) || (ret == PCCC_ECMD_TIMEOUT) || (ret == PCCC_ECMD_REPLY)
+                || (ret == PCCC_ECMD_EXPIRED))
+                pt->errors++;
+            else {
+                free(x);
+                free(y);
+                return ret;
+            }
+        }
+        if (ok) pt->rtt = sum / ok;
+    }
+    probe_fit(x, y, n, model);
+    free(x);
+    free(y);
+    if (!window) return PCCC_SUCCESS;
+    /*
+     * Pipelined, timing the whole run.
+     */
+    for (i = 0; i < num_pts; i++) {
+        PCCC_PROBE_PT *pt = pts + i;
+        double elapsed;
+        PCCC_RET_T ret = probe_pipe(con, dnode, &run, pt->bytes, reps, window, &elapsed);
+        if (ret != PCCC_SUCCESS) return ret;
+        pt->errors += run.errors;
+        if (elapsed > 0.0) pt->rate = (run.done - run.errors) * pt->bytes / elapsed;
+    }
+    return PCCC_SUCCESS;
+}
+
+/*
+ * Description : Notification function of pipelined Echo commands.
+ *
+ * Arguments : con - Connection.
+ *             result - Command result.
+ *             udata - Probe run.
+ *
+ * Return Value : None.
+ */
+static void probe_done(PCCC *con, PCCC_RET_T result, void *udata)
+{
+    PROBE_RUN *run = (PROBE_RUN *)udata;
+    run->done++;
+    if (result != PCCC_SUCCESS) run->errors++;
+    return;
+}
+
+/*
+ * Description : Sends Echo commands with up to a window of them outstanding
+ *               until all have completed.
+ *
+ * Arguments : con - Connection.
+ *             dnode - Node to probe.
+ *             run - Probe run.
+ *             bytes - Payload size.
+ *             count - Number of commands.
+ *             window - Commands outstanding.
+ *             elapsed - Location to store the time taken in seconds.
+ *
+ * Return Value : PCCC_SUCCESS if all commands completed.
+ *                Any connection error, after closing the connection so no
+ *                outstanding command refers to the run.
+ */
+static PCCC_RET_T probe_pipe(PCCC *con, uint8_t dnode, PROBE_RUN *run, size_t bytes, unsigned int count, unsigned int window, double *elapsed)
+{
+    PCCC_PRIV *con_priv = (PCCC_PRIV *)con->priv_data;
+    unsigned int sent = 0;
+    double start = probe_sec();
+    double last_tick = start;
+    PCCC_RET_T ret = PCCC_SUCCESS;
+    run->done = 0;
+    run->errors = 0;
+    while (run->done < count) {
+        struct timeval tv = {0, 100000};
+        fd_set read_fds;
+        fd_set write_fds;
+        int high;
+        int ready;
+        int fd;
+        double now;
+        while ((sent < count) && (sent - run->done < window)) {
+            ret = pccc_cmd_Echo(con, probe_done, dnode, run, bytes);
+            if (ret != PCCC_SUCCESS) break;
+            sent++;
+        }
+        if (ret == PCCC_ECMD_NOBUF) ret = PCCC_SUCCESS; /* Wait for a reply. */
+        if (ret != PCCC_SUCCESS) break;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        high = pccc_pool_fds(con, &read_fds, &write_fds);
+        ready = select(high + 1, &read_fds, &write_fds, NULL, &tv);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            snprintf(con_priv->errstr, PCCC_ERR_LEN, "select() failed : %s", strerror(errno));
+            ret = PCCC_EFATAL;
+            break;
+        }
+        if (pccc_write_ready(con) == PCCC_WREADY) {
+            ret = pccc_write(con);
+            if (ret != PCCC_SUCCESS) break;
+        }
+        /*
+         * pccc_read() waits for data on a single connection.
+         */
+        for (fd = 0; ready && (fd <= high) && !FD_ISSET(fd, &read_fds); fd++);
+        if (ready && (fd <= high)) {
+            ret = pccc_read(con);
+            if (ret != PCCC_SUCCESS) break;
+        }
+        now = probe_sec();
+        if (now - last_tick >= 1.0) {
+            pccc_tick(con);
+            last_tick = now;
+        }
+    }
+    *elapsed = probe_sec() - start;
+    if (ret != PCCC_SUCCESS) {
+        char errstr[PCCC_ERR_LEN];
+        strcpy(errstr, con_priv->errstr);
+        pccc_close(con);
+        strcpy(con_priv->errstr, errstr);
+    }
+    return ret;
+}
+
+/*
+ * Description : Fits round trip = turnaround + bytes * per_byte by least
+ *               squares.
+ *
+ * Arguments : x - Payload sizes.
+ *             y - Round trips.
+ *             n - Number of samples.
+ *             model - Location to store the model.
+ *
+ * Return Value : None.
+ */
+static void probe_fit(const double *x, const double *y, unsigned int n, PCCC_PROBE_MODEL *model)
+{
+    double mx = 0.0;
+    double my = 0.0;
+    double sxx = 0.0;
+    double sxy = 0.0;
+    double syy = 0.0;
+    double res = 0.0;
+    unsigned int i;
+    memset(model, 0, sizeof(PCCC_PROBE_MODEL));
+    model->samples = n;
+    if (!n) return;
+    for (i = 0; i < n; i++) {
+        mx += x[i];
+        my += y[i];
+    }
+    mx /= n;
+    my /= n;
+    for (i = 0; i < n; i++) {
+        sxx += (x[i] - mx) * (x[i] - mx);
+        sxy += (x[i] - mx) * (y[i] - my);
+        syy += (y[i] - my) * (y[i] - my);
+    }
+    /*
+     * A single payload size only gives the turnaround.
+     */
+    if (sxx > 0.0) model->per_byte = sxy / sxx;
+    model->turnaround = my - model->per_byte * mx;
+    for (i = 0; i < n; i++) {
+        double e = y[i] - model->turnaround - model->per_byte * x[i];
+        res += e * e;
+    }
+    model->r2 = (syy > 0.0) ? 1.0 - res / syy : 1.0;
+    return;
+}
+
+/*
+ * Description : Reads a monotonic clock.
+ *
+ * Arguments : None.
+ *
+ * Return Value : The current time in seconds.
+ */
+static double probe_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
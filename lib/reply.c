@@ -70,6 +70,35 @@ extern int reply_ProtectedTypedLogicalRead(BUF *rply, DF1MSG *cmd, char *err)
     return data_dec_array(rply, cmd, err);
 }
 
+/*
+* Description : Reply handler for reads whose data is kept in the encoding
+*               used on the link instead of being decoded. The data is copied
+*               into the buffer given as the command's user data.
+*
+* Arguments : rply - Pointer to a buffer containing the reply.
+*             cmd - Pointer to the original command message.
+*             err - Pointer to a string to hold any possible error messages.
+*
+* Return Value : Zero if the reply was parsed successfully.
+*                Non-zero if an error occured.
+*/
+extern int reply_Raw(BUF *rply, DF1MSG *cmd, char *err)
+{
+    BUF *dst = (BUF *)cmd->udata;
+    uint8_t byte;
+    if (cmd->bytes != msg_get_len(rply)) {
+        strncpy(err, "Received unexpected amount of data", PCCC_ERR_LEN);
+        return -1;
+    }
+    buf_empty(dst);
+    while (!buf_get_byte(rply, &byte))
+        if (buf_append_byte(dst, byte)) {
+            strncpy(err, "reply_Raw()", PCCC_ERR_LEN);
+            return -1;
+        }
+    return 0;
+}
+
 /*
 * Description : Reply handler for read SLC file info.
 *
@@ -161,6 +190,106 @@ extern int reply_ReadLinkParam(BUF *rply, DF1MSG *cmd, char *err)
     return 0;
 }
 
+/*
+* Description : Reply handler for diagnostic status.
+*
+* Arguments : rply - Pointer to a buffer containing the reply.
+*             cmd - Pointer to the original command message.
+*             err - Pointer to a string to hold any possible error messages.
+*
+* Return Value : Zero if the reply was parsed successfully.
+*                Non-zero if an error occured.
+*/
+extern int reply_DiagnosticStatus(BUF *rply, DF1MSG *cmd, char *err)
+{
+    PCCC_DIAG_STATUS_T *p = (PCCC_DIAG_STATUS_T *)cmd->udata;
+    size_t len = msg_get_len(rply);
+    size_t i;
+    if (!len || (len > PCCC_DIAG_STATUS_MAX)) {
+        strncpy(err, "Received unexpected amount of data", PCCC_ERR_LEN);
+        return -1;
+    }
+    memset(p, 0, sizeof(PCCC_DIAG_STATUS_T));
+    p->len = len;
+    for (i = 0; i < len; i++)
+        buf_get_byte(rply, &p->raw[i]);
+    p->mode = p->raw[0];
+    if (len > 1) p->type = p->raw[1];
+    if (len > 2) p->iface = p->raw[2];
+    if (len > 3) p->proc = p->raw[3];
+    /*
+     * Series in the upper three bits, revision in the lower five, zero
+     * meaning A.
+     */
+    if (len > 4) {
+        p->series = 'A' + (p->raw[4] >> 5);
+        p->revision = 'A' + (p->raw[4] & 0x1f);
+    }
+    for (i = 0; (i < sizeof(p->catalog) - 1) && (i + 5 < len); i++)
+        p->catalog[i] = isprint(p->raw[i + 5]) ? p->raw[i + 5] : ' ';
+    while (i && (p->catalog[i - 1] == ' '))
+        p->catalog[--i] = 0;
+    return 0;
+}
+
+/*
+* Description : Reply handler for diagnostic reads. The bytes are copied
+*               unchanged into the command's user data.
+*
+* Arguments : rply - Pointer to a buffer containing the reply.
+*             cmd - Pointer to the original command message.
+*             err - Pointer to a string to hold any possible error messages.
+*
+* Return Value : Zero if the reply was parsed successfully.
+*                Non-zero if an error occured.
+*/
+extern int reply_DiagnosticRead(BUF *rply, DF1MSG *cmd, char *err)
+{
+    uint8_t *dst = (uint8_t *)cmd->udata;
+    if (cmd->bytes != msg_get_len(rply)) {
+        strncpy(err, "Received unexpected amount of data", PCCC_ERR_LEN);
+        return -1;
+    }
+    while (!buf_get_byte(rply, dst))
+        dst++;
+    return 0;
+}
+
+/*
+* Description : Reply handler for the DF1 channel diagnostic counters.
+*
+* Arguments : rply - Pointer to a buffer containing the reply.
+*             cmd - Pointer to the original command message.
+*             err - Pointer to a string to hold any possible error messages.
+*
+* Return Value : Zero if the reply was parsed successfully.
+*                Non-zero if an error occured.
+*/
+extern int reply_ReadDiagCounters(BUF *rply, DF1MSG *cmd, char *err)
+{
+    PCCC_DIAG_CNT_T *p = (PCCC_DIAG_CNT_T *)cmd->udata;
+    uint16_t w[PCCC_DIAG_CNT_WORDS];
+    int i;
+    if (msg_get_len(rply) != PCCC_DIAG_CNT_WORDS * 2) {
+        strncpy(err, "Received unexpected amount of data", PCCC_ERR_LEN);
+        return -1;
+    }
+    for (i = 0; i < PCCC_DIAG_CNT_WORDS; i++) {
+        buf_get_word(rply, &w[i]);
+        w[i] = ltohs(w[i]);
+    }
+    p->msgs_sent = w[0];
+    p->msgs_rcvd = w[1];
+    p->undelivered = w[2];
+    p->enqs_sent = w[3];
+    p->naks_rcvd = w[4];
+    p->enqs_rcvd = w[5];
+    p->bad_rcvd = w[6];
+    p->nobuf_naks = w[7];
+    p->dups_rcvd = w[8];
+    return 0;
+}
+
 /*
 * Description : Reply handler that prints out the data from a reply. Only used
 *               for troubleshooting and creating new reply handlers.
@@ -0,0 +1,78 @@
+/*
+ * Link layer service client message definitions.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+#ifndef _LINKMSG_H
+#define _LINKMSG_H
+
+/*
+ * Message types exchanged between the link layer service and its clients
+ * in addition to the basic MSG_SOH, MSG_ACK and MSG_NAK.
+ */
+
+/*
+ * Application layer message with a transmission deadline, client to link
+ * layer. Followed by the deadline in milliseconds as a 16 bit little endian
+ * value, then the length byte and message as with MSG_SOH. A deadline of
+ * zero means no deadline.
+ */
+#define MSG_SOH_DL 0x12
+
+/*
+ * The link layer discarded the client's message because its deadline passed
+ * before it could be transmitted, link layer to client.
+ */
+#define MSG_EXPIRED 0x18
+
+/*
+ * Registration address that opens a multiplexed session rather than
+ * registering a client. Every unit sent afterwards, in either direction, is
+ * prefixed with a virtual client id byte. Each virtual client registers its
+ * own source address and otherwise uses the units of an ordinary client,
+ * with its own pending message and ACK/NAK reporting.
+ */
+#define MSG_MUX_ADDR 0xff
+
+/*
+ * Registers a virtual client, client to link layer. Followed by its source
+ * address. Answered with MSG_ACK, or MSG_NAK if the id or address is
+ * already in use.
+ */
+#define MSG_VC_REG 0x13
+
+/*
+ * Removes a virtual client, client to link layer. Not answered.
+ */
+#define MSG_VC_UNREG 0x14
+
+/*
+ * Sets the link's retry limits and ACK timeout, client to link layer.
+ * Followed by the maximum NAKs, the maximum ENQs and the ACK timeout in
+ * milliseconds as a 16 bit little endian value. Only accepted while the
+ * client has no message pending, and ignored unless the connection allows
+ * link settings and they are in range; applies to every link of a group
+ * until changed again or the configuration is reloaded. Not answered.
+ */
+#define MSG_LINK_CFG 0x16
+
+#endif /* _LINKMSG_H */
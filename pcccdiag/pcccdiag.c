@@ -0,0 +1,490 @@
+/*
+ * This file is part of pcccdiag.
+ * Remote node link diagnostic collector.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Periodically reads a node's DF1 channel diagnostic counters with
+ * pccc_cmd_ReadDiagCounters() and df1d's link counters from its statistics
+ * port, and prints both ends' view of each direction of the link side by
+ * side:
+ *
+ *   df1d->node : ACKed by the node as counted by df1d and received as
+ *                counted by the node, NAKs, corrupted frames seen by the
+ *                node, df1d's ACK timeouts, duplicates and failures.
+ *   node->df1d : the same the other way round.
+ *
+ * A direction whose transmissions are NAKed or time out is the one losing
+ * frames; counts that disagree between the ends point at lost NAKs, ENQs
+ * or ACKs. df1d counts its whole link, so the comparison assumes a point to
+ * point link with the node as its only station.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../lib/pccc.h"
+
+#define CLIENT_NAME "pcccdiag" /* Name registered with df1d. */
+#define NAME_LEN 64
+
+enum /* df1d link counters, in snapshot order. */
+  {
+    L_BYTES_IN, L_BYTES_OUT, L_MSGS_TX, L_MSGS_RX, L_ACKS_IN, L_NAKS_IN,
+    L_ENQS_OUT, L_ACKS_OUT, L_NAKS_OUT, L_ENQS_IN, L_BAD_CS, L_DUPS,
+    L_TX_FAIL, L_EXPIRED, L_COUNTERS
+  };
+
+typedef struct _sample /* Both ends' counters at one time. */
+{
+  char link[NAME_LEN];
+  unsigned int cnt[L_COUNTERS];
+  PCCC_DIAG_CNT_T node;
+} SAMPLE;
+
+typedef struct _dir /* One direction of the link over an interval. */
+{
+  unsigned long sent; /* ACKed, as counted by the sender. */
+  unsigned long rcvd; /* Received, as counted by the receiver. */
+  unsigned long naks; /* NAKs seen by the sender. */
+  unsigned long bad; /* Corrupted frames seen by the receiver. */
+  unsigned long timeouts; /* ENQs sent by the sender. */
+  unsigned long enqs; /* ENQs seen by the receiver. */
+  unsigned long dups; /* Duplicates seen by the receiver. */
+  unsigned long failed; /* Messages the sender gave up on. */
+} DIR;
+
+static void usage(void);
+static int sample(PCCC *con, uint8_t node, uint16_t addr, const char *host,
+		  const char *port, const char *link, SAMPLE *s);
+static int fetch_link(const char *host, const char *port, const char *link,
+		      SAMPLE *s);
+static void report(const SAMPLE *prev, const SAMPLE *cur, uint8_t node,
+		   unsigned int interval);
+static void show_dir(const char *name, const DIR *d);
+static double err_pct(const DIR *d);
+static void show_status(PCCC *con, uint8_t node);
+
+/*
+ * Description : Program entry point.
+ *
+ * Arguments : argc - Number of arguments.
+ *             argv - Argument vector.
+ *
+ * Return Value : Zero if successful, one if an error occured.
+ */
+int main(int argc, char *argv[])
+{
+  const char *host = "localhost";
+  const char *stats_port = "10600";
+  const char *link = NULL;
+  in_port_t port = 10505;
+  int src_addr = -1;
+  uint8_t node = 1;
+  uint16_t addr = 0;
+  unsigned int interval = 10;
+  unsigned int timeout = 5;
+  long count = -1;
+  int reset = 0;
+  SAMPLE prev;
+  SAMPLE cur;
+  char err[256];
+  PCCC_RET_T ret;
+  PCCC *con;
+  int i;
+  while ((i = getopt(argc, argv, "a:A:c:h:i:l:n:p:s:t:z")) != -1)
+    {
+      switch (i)
+	{
+	case 'a':
+	  src_addr = atoi(optarg) & 0xff;
+	  break;
+	case 'A':
+	  addr = strtoul(optarg, NULL, 0);
+	  break;
+	case 'c':
+	  count = atol(optarg);
+	  break;
+	case 'h':
+	  host = optarg;
+	  break;
+	case 'i':
+	  interval = atoi(optarg);
+	  if (!interval) interval = 1;
+	  break;
+	case 'l':
+	  link = optarg;
+	  break;
+	case 'n':
+	  node = atoi(optarg);
+	  break;
+	case 'p':
+	  port = atoi(optarg);
+	  break;
+	case 's':
+	  stats_port = optarg;
+	  break;
+	case 't':
+	  timeout = atoi(optarg);
+	  break;
+	case 'z':
+	  reset = 1;
+	  break;
+	default:
+	  usage();
+	  return 1;
+	}
+    }
+  if (src_addr < 0) src_addr = (node + 1) & 0xff;
+  if (src_addr == node)
+    {
+      fprintf(stderr, "pcccdiag: Link address %d is node %u.\n", src_addr,
+	      node);
+      return 1;
+    }
+  con = pccc_new(src_addr, timeout, 1);
+  if (con == NULL)
+    {
+      fprintf(stderr, "pcccdiag: Cannot create connection.\n");
+      return 1;
+    }
+  ret = pccc_connect(con, host, port, CLIENT_NAME);
+  if (ret == PCCC_SUCCESS)
+    {
+      show_status(con, node);
+      if (reset) ret = pccc_cmd_ResetDiagCounters(con, NULL, node);
+    }
+  if (ret != PCCC_SUCCESS)
+    {
+      pccc_errstr(con, ret, err, sizeof(err));
+      fprintf(stderr, "pcccdiag: %s\n", err);
+      pccc_close(con);
+      pccc_free(con);
+      return 1;
+    }
+  if (sample(con, node, addr, host, stats_port, link, &prev))
+    {
+      pccc_close(con);
+      pccc_free(con);
+      return 1;
+    }
+  printf("Link %s, node %u, counters at diagnostic address 0x%04x\n",
+	 prev.link, node, addr);
+  while (count < 0 || count--)
+    {
+      sleep(interval);
+      if (sample(con, node, addr, host, stats_port, prev.link, &cur))
+	{
+	  pccc_close(con);
+	  pccc_free(con);
+	  return 1;
+	}
+      report(&prev, &cur, node, interval);
+      prev = cur;
+    }
+  pccc_close(con);
+  pccc_free(con);
+  return 0;
+}
+
+/*
+ * Description : Prints the usage message.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void usage(void)
+{
+  printf("Usage: pcccdiag [options]\n"
+	 "   -a <addr> : Link address, default node + 1.\n"
+	 "   -A <addr> : Diagnostic address of the node's channel counters,"
+	 " default 0.\n"
+	 "   -c <count> : Exit after this many reports.\n"
+	 "   -h <host> : Host running df1d, default localhost.\n"
+	 "   -i <sec> : Report interval, default 10.\n"
+	 "   -l <link> : df1d link the node is on, default the first.\n"
+	 "   -n <node> : Node to read, default 1.\n"
+	 "   -p <port> : df1d client port, default 10505.\n"
+	 "   -s <port> : df1d statistics port, default 10600.\n"
+	 "   -t <sec> : Reply timeout, default 5.\n"
+	 "   -z : Clear the node's counters first.\n");
+  return;
+}
+
+/*
+ * Description : Reads the node's and df1d's counters.
+ *
+ * Arguments : con - Connection to the node.
+ *             node - Node to read.
+ *             addr - Diagnostic address of the node's counters.
+ *             host - Host running df1d.
+ *             port - df1d statistics port.
+ *             link - Link name, NULL for the first link.
+ *             s - Sample to fill in.
+ *
+ * Return Value : Zero if successful, non-zero after printing an error.
+ */
+static int sample(PCCC *con, uint8_t node, uint16_t addr, const char *host,
+		  const char *port, const char *link, SAMPLE *s)
+{
+  PCCC_RET_T ret = pccc_cmd_ReadDiagCounters(con, NULL, node, &s->node, addr);
+  if (ret != PCCC_SUCCESS)
+    {
+      char err[256];
+      pccc_errstr(con, ret, err, sizeof(err));
+      fprintf(stderr, "pcccdiag: Reading node %u counters : %s\n", node, err);
+      return -1;
+    }
+  return fetch_link(host, port, link, s);
+}
+
+/*
+ * Description : Reads a link's counters from df1d's statistics port.
+ *
+ * Arguments : host - Host running df1d.
+ *             port - Statistics port.
+ *             link - Link name, NULL for the first link.
+ *             s - Sample to store the link name and counters in.
+ *
+ * Return Value : Zero if successful, non-zero after printing an error.
+ */
+static int fetch_link(const char *host, const char *port, const char *link,
+		      SAMPLE *s)
+{
+  struct addrinfo hints = {0};
+  struct addrinfo *res;
+  struct addrinfo *ai;
+  char line[1024];
+  FILE *f;
+  int found = 0;
+  int done = 0;
+  int fd = -1;
+  int err;
+  hints.ai_socktype = SOCK_STREAM;
+  err = getaddrinfo(host, port, &hints, &res);
+  if (err)
+    {
+      fprintf(stderr, "pcccdiag: %s : %s\n", host, gai_strerror(err));
+      return -1;
+    }
+  for (ai = res; ai != NULL; ai = ai->ai_next)
+    {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      if (!connect(fd, ai->ai_addr, ai->ai_addrlen)) break;
+      close(fd);
+      fd = -1;
+    }
+  freeaddrinfo(res);
+  if ((fd < 0) || ((f = fdopen(fd, "r")) == NULL))
+    {
+      fprintf(stderr, "pcccdiag: Cannot connect to %s statistics port %s :"
+	      " %s\n", host, port, strerror(errno));
+      if (fd >= 0) close(fd);
+      return -1;
+    }
+  while (fgets(line, sizeof(line), f) != NULL)
+    {
+      char name[NAME_LEN];
+      long byte_usec;
+      unsigned int *c = s->cnt;
+      if (!strcmp(line, "end\n")) done = 1;
+      if (found || strncmp(line, "link ", 5)) continue;
+      if ((sscanf(line, "link %63s %ld %u %u %u %u %u %u %u %u %u %u %u %u"
+		  " %u %u", name, &byte_usec, &c[0], &c[1], &c[2], &c[3],
+		  &c[4], &c[5], &c[6], &c[7], &c[8], &c[9], &c[10], &c[11],
+		  &c[12], &c[13]) == 2 + L_COUNTERS)
+	  && ((link == NULL) || !strcmp(name, link)))
+	{
+	  strcpy(s->link, name);
+	  found = 1;
+	}
+    }
+  fclose(f);
+  if (!done)
+    fprintf(stderr, "pcccdiag: Incomplete statistics from %s port %s.\n",
+	    host, port);
+  else if (!found)
+    fprintf(stderr, "pcccdiag: No link %s on %s.\n",
+	    link == NULL ? "" : link, host);
+  return !(done && found);
+}
+
+/*
+ * Description : Prints both directions of the link over an interval, then
+ *               notes on where frames are being lost.
+ *
+ * Arguments : prev - Sample at the start of the interval.
+ *             cur - Sample at the end of the interval.
+ *             node - Node read.
+ *             interval - Interval in seconds.
+ *
+ * Return Value : None.
+ */
+static void report(const SAMPLE *prev, const SAMPLE *cur, uint8_t node,
+		   unsigned int interval)
+{
+  const PCCC_DIAG_CNT_T *np = &prev->node;
+  const PCCC_DIAG_CNT_T *nc = &cur->node;
+  DIR out; /* df1d->node */
+  DIR in; /* node->df1d */
+  unsigned long nobuf = (uint16_t)(nc->nobuf_naks - np->nobuf_naks);
+  unsigned long naks_out;
+  char stamp[16];
+  time_t now = time(NULL);
+  double out_pct;
+  double in_pct;
+#define DF1D(i) ((unsigned long)(cur->cnt[i] - prev->cnt[i]))
+#define NODE(m) ((unsigned long)(uint16_t)(nc->m - np->m))
+  out.sent = DF1D(L_MSGS_TX);
+  out.rcvd = NODE(msgs_rcvd);
+  out.naks = DF1D(L_NAKS_IN);
+  out.bad = NODE(bad_rcvd);
+  out.timeouts = DF1D(L_ENQS_OUT);
+  out.enqs = NODE(enqs_rcvd);
+  out.dups = NODE(dups_rcvd);
+  out.failed = DF1D(L_TX_FAIL);
+  in.sent = NODE(msgs_sent);
+  in.rcvd = DF1D(L_MSGS_RX);
+  in.naks = NODE(naks_rcvd);
+  in.bad = DF1D(L_BAD_CS);
+  in.timeouts = NODE(enqs_sent);
+  in.enqs = DF1D(L_ENQS_IN);
+  in.dups = DF1D(L_DUPS);
+  in.failed = NODE(undelivered);
+  naks_out = DF1D(L_NAKS_OUT);
+#undef DF1D
+#undef NODE
+  strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+  printf("\n%s  %u s\n", stamp, interval);
+  printf("              Sent   Rcvd  NAKed    Bad  Tmout   ENQs   Dups"
+	 "   Fail   Err%%\n");
+  /*
+   * NAKs for lack of a buffer are not line errors.
+   */
+  out.naks = (out.naks > nobuf) ? out.naks - nobuf : 0;
+  show_dir("df1d->node", &out);
+  show_dir("node->df1d", &in);
+  out_pct = err_pct(&out);
+  in_pct = err_pct(&in);
+  if (nobuf)
+    printf("  Node %u NAKed %lu message(s) for lack of a buffer.\n", node,
+	   nobuf);
+  if (out.bad > out.naks)
+    printf("  %lu NAK(s) sent by the node were not seen by df1d.\n",
+	   out.bad - out.naks);
+  if (naks_out > in.naks)
+    printf("  %lu NAK(s) sent by df1d were not seen by the node.\n",
+	   naks_out - in.naks);
+  if (out.timeouts > out.enqs)
+    printf("  %lu ENQ(s) sent by df1d were not seen by the node.\n",
+	   out.timeouts - out.enqs);
+  if (in.timeouts > in.enqs)
+    printf("  %lu ENQ(s) sent by the node were not seen by df1d.\n",
+	   in.timeouts - in.enqs);
+  if (out.timeouts && !out.bad && (out.dups >= out.timeouts))
+    printf("  df1d timeouts with duplicates at the node: ACKs are being"
+	   " lost on the way back to df1d.\n");
+  if (in.timeouts && !in.bad && (in.dups >= in.timeouts))
+    printf("  Node timeouts with duplicates at df1d: ACKs are being lost on"
+	   " the way to the node.\n");
+  if ((out_pct > 0.0) || (in_pct > 0.0))
+    {
+      if (out_pct > 2.0 * in_pct)
+	printf("  Most errors are towards the node: check the host"
+	       " transmitter, the line and the node's receiver.\n");
+      else if (in_pct > 2.0 * out_pct)
+	printf("  Most errors are towards df1d: check the node's"
+	       " transmitter, the line and the host receiver.\n");
+      else
+	printf("  Errors in both directions: check the line, baud rate and"
+	       " grounding.\n");
+    }
+  fflush(stdout);
+  return;
+}
+
+/*
+ * Description : Prints one direction's counts.
+ *
+ * Arguments : name - Direction name.
+ *             d - Counts.
+ *
+ * Return Value : None.
+ */
+static void show_dir(const char *name, const DIR *d)
+{
+  printf("%-10s %7lu %6lu %6lu %6lu %6lu %6lu %6lu %6lu %6.1f\n", name,
+	 d->sent, d->rcvd, d->naks, d->bad, d->timeouts, d->enqs, d->dups,
+	 d->failed, err_pct(d));
+  return;
+}
+
+/*
+ * Description : Computes the share of transmissions in a direction that
+ *               were NAKed or timed out instead of being ACKed.
+ *
+ * Arguments : d - Counts.
+ *
+ * Return Value : Percentage, zero if nothing was sent.
+ */
+static double err_pct(const DIR *d)
+{
+  unsigned long errors = d->naks + d->timeouts;
+  if (!(d->sent + errors)) return 0.0;
+  return errors * 100.0 / (d->sent + errors);
+}
+
+/*
+ * Description : Prints the node's diagnostic status. Nodes that do not
+ *               support the command are only noted.
+ *
+ * Arguments : con - Connection to the node.
+ *             node - Node to read.
+ *
+ * Return Value : None.
+ */
+static void show_status(PCCC *con, uint8_t node)
+{
+  PCCC_DIAG_STATUS_T status;
+  PCCC_RET_T ret = pccc_cmd_DiagnosticStatus(con, NULL, node, &status);
+  if (ret != PCCC_SUCCESS)
+    {
+      char err[256];
+      pccc_errstr(con, ret, err, sizeof(err));
+      printf("Node %u diagnostic status unavailable : %s\n", node, err);
+      return;
+    }
+  printf("Node %u : %s", node, status.catalog[0] ? status.catalog : "?");
+  if (status.series) printf(" series %c revision %c", status.series,
+			    status.revision);
+  printf(", mode/status 0x%02x, interface 0x%02x, processor 0x%02x\n",
+	 status.mode, status.iface, status.proc);
+  return;
+}
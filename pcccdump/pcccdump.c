@@ -0,0 +1,971 @@
+/*
+ * This file is part of pcccdump.
+ * Data table backup and restore tool.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Saves data table files of a SLC 500 family processor to a dump file and
+ * writes them back. Files are named on the command line, e.g. N7 or F8:20
+ * for the first 20 elements; without any, every data file the processor
+ * reports with ReadSLCFileInfo is saved. Files are transferred in chunks of
+ * up to 236 bytes, with as many commands outstanding as the window allows.
+ * A pooled connection, -c, lets that many be outstanding at df1d, which
+ * otherwise sends one command per client at a time.
+ *
+ * The dump file holds the data as it is transferred on the link, so it is
+ * independent of the host:
+ *
+ *   "PCCCDUMP" version(1) node(1) files(2)
+ *   per file: file(2) type(1) reserved(1) elements(2) bytes(4) data(bytes)
+ *
+ * with multibyte values little endian and type the PCCC file type code,
+ * e.g. 0x89 for integer.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include "../lib/pccc.h"
+
+#define CLIENT_NAME "pcccdump" /* Name registered with df1d. */
+#define MAX_CHUNK 236 /* Largest data size of one command. */
+#define DUMP_MAGIC "PCCCDUMP"
+#define DUMP_VERSION 1
+
+typedef struct _ftype /* Supported data file type. */
+{
+  const char *prefix; /* Address prefix, e.g. "N". */
+  PCCC_FT_T type;
+  uint8_t code; /* PCCC file type code. */
+  size_t usize; /* Host size of an element. */
+  size_t bytes; /* Link size of an element. */
+} FTYPE;
+
+typedef struct _dfile /* A data file being saved or restored. */
+{
+  uint16_t file;
+  const FTYPE *ft;
+  size_t elements;
+  void *udata; /* Elements in host form. */
+  uint8_t *image; /* Elements as transferred on the link. */
+  struct _dfile *next;
+} DFILE;
+
+typedef enum /* Job states. */
+  {
+    JOB_WAIT, /* Not yet sent. */
+    JOB_SENT, /* Awaiting the reply. */
+    JOB_DONE
+  } JOB_STATE_T;
+
+typedef enum /* Operation of a job. */
+  {
+    OP_INFO, /* ReadSLCFileInfo. */
+    OP_READ,
+    OP_WRITE
+  } OP_T;
+
+typedef struct _job /* A command of a pipelined run. */
+{
+  OP_T op;
+  JOB_STATE_T state;
+  PCCC_RET_T result;
+  DFILE *df; /* File, NULL for OP_INFO. */
+  size_t first; /* First element. */
+  size_t count; /* Number of elements. */
+  void *udata; /* Data read or written, identifies the job on completion. */
+  PCCC_SLC_FI_T info; /* OP_INFO result. */
+  uint8_t file_num; /* OP_INFO file number. */
+} JOB;
+
+static const FTYPE ftypes[] =
+  {
+    {"ST", PCCC_FT_STR, 0x8d, sizeof(PCCC_STR_T), PCCC_SO_STR},
+    {"S", PCCC_FT_STAT, 0x84, sizeof(PCCC_STAT_T), PCCC_SO_STAT},
+    {"B", PCCC_FT_BIN, 0x85, sizeof(PCCC_BIN_T), PCCC_SO_BIN},
+    {"T", PCCC_FT_TIMER, 0x86, sizeof(PCCC_TIMER_T), PCCC_SO_TIMER},
+    {"C", PCCC_FT_COUNT, 0x87, sizeof(PCCC_COUNT_T), PCCC_SO_COUNT},
+    {"R", PCCC_FT_CTL, 0x88, sizeof(PCCC_CTL_T), PCCC_SO_CTL},
+    {"N", PCCC_FT_INT, 0x89, sizeof(PCCC_INT_T), PCCC_SO_INT},
+    {"F", PCCC_FT_FLOAT, 0x8a, sizeof(PCCC_FLOAT_T), PCCC_SO_FLOAT},
+    {NULL}
+  };
+
+static void usage(void);
+static PCCC *open_con(void);
+static int scan_files(PCCC *con, int argc, char *const argv[]);
+static int parse_spec(const char *spec, const FTYPE **ft, unsigned int *file,
+		      long *elements);
+static DFILE *add_file(uint16_t file, const FTYPE *ft, size_t elements);
+static int run(PCCC *con, JOB *jobs, size_t num_jobs, const char *what);
+static void job_done(PCCC *con, PCCC_RET_T result, void *udata);
+static PCCC_RET_T job_send(PCCC *con, JOB *job);
+static JOB *chunk_jobs(OP_T op, size_t *num_jobs);
+static int save(const char *path);
+static int load(const char *path, int argc, char *const argv[]);
+static int verify(PCCC *con);
+static const FTYPE *find_type(PCCC_FT_T type);
+static const FTYPE *find_code(uint8_t code);
+static void put_le(uint8_t *dst, unsigned long x, int bytes);
+static unsigned long get_le(const uint8_t *src, int bytes);
+static double now_sec(void);
+
+static const char *host = "localhost";
+static in_port_t port = 10505;
+static uint8_t node = 1; /* Processor node address. */
+static int src_addr = -1; /* Our link address, first of a pool. */
+static unsigned int conns = 1; /* Registrations, more than one pools. */
+static unsigned int window; /* Commands outstanding, 0 for 4 per conn. */
+static unsigned int timeout = 5; /* Reply timeout in seconds. */
+static size_t chunk = MAX_CHUNK; /* Data bytes per command. */
+static int quiet;
+static DFILE *files; /* Files in address order. */
+static JOB *cur_jobs; /* Jobs of the run in progress. */
+static size_t cur_num_jobs;
+static size_t jobs_sent; /* Jobs awaiting replies. */
+static size_t jobs_done;
+static size_t bytes_done; /* Data transferred by completed jobs. */
+static JOB *failed_job; /* First data transfer that failed. */
+
+/*
+ * Description : Program entry point.
+ *
+ * Arguments : argc - Number of arguments.
+ *             argv - Argument vector.
+ *
+ * Return Value : Zero if successful, one if an error occured.
+ */
+int main(int argc, char *argv[])
+{
+  int verify_write = 0;
+  const char *cmd;
+  const char *path;
+  PCCC *con;
+  JOB *jobs;
+  size_t num_jobs;
+  int i;
+  int ret;
+  while ((i = getopt(argc, argv, "a:b:c:h:n:p:qt:vw:")) != -1)
+    {
+      switch (i)
+	{
+	case 'a':
+	  src_addr = atoi(optarg) & 0xff;
+	  break;
+	case 'b':
+	  chunk = atoi(optarg);
+	  if ((chunk < PCCC_SO_STR) || (chunk > MAX_CHUNK)) chunk = MAX_CHUNK;
+	  break;
+	case 'c':
+	  conns = atoi(optarg);
+	  if (!conns) conns = 1;
+	  break;
+	case 'h':
+	  host = optarg;
+	  break;
+	case 'n':
+	  node = atoi(optarg);
+	  break;
+	case 'p':
+	  port = atoi(optarg);
+	  break;
+	case 'q':
+	  quiet = 1;
+	  break;
+	case 't':
+	  timeout = atoi(optarg);
+	  break;
+	case 'v':
+	  verify_write = 1;
+	  break;
+	case 'w':
+	  window = atoi(optarg);
+	  break;
+	default:
+	  usage();
+	  return 1;
+	}
+    }
+  if (argc - optind < 2)
+    {
+      usage();
+      return 1;
+    }
+  if (!window) window = 4 * conns;
+  if (src_addr < 0) src_addr = (node + 1) & 0xff;
+  if ((conns > 255) || ((uint8_t)(node - src_addr) < conns))
+    {
+      /*
+       * df1d would route commands to the node to our own registration.
+       */
+      fprintf(stderr, "pcccdump: Link addresses %d-%d include node %u.\n",
+	      src_addr, (src_addr + conns - 1) & 0xff, node);
+      return 1;
+    }
+  cmd = argv[optind];
+  path = argv[optind + 1];
+  argc -= optind + 2;
+  argv += optind + 2;
+  if (!strcmp(cmd, "list")) return load(path, argc, argv) ? 1 : 0;
+  if (strcmp(cmd, "save") && strcmp(cmd, "restore"))
+    {
+      usage();
+      return 1;
+    }
+  if ((*cmd == 'r') && load(path, argc, argv)) return 1;
+  con = open_con();
+  if (con == NULL) return 1;
+  if (*cmd == 's')
+    {
+      ret = scan_files(con, argc, argv);
+      if (!ret)
+	{
+	  jobs = chunk_jobs(OP_READ, &num_jobs);
+	  ret = (jobs == NULL) || run(con, jobs, num_jobs, "Saved");
+	  free(jobs);
+	}
+      if (!ret) ret = save(path);
+    }
+  else
+    {
+      jobs = chunk_jobs(OP_WRITE, &num_jobs);
+      ret = (jobs == NULL) || run(con, jobs, num_jobs, "Restored");
+      free(jobs);
+      if (!ret && verify_write) ret = verify(con);
+    }
+  pccc_close(con);
+  pccc_free(con);
+  return ret ? 1 : 0;
+}
+
+/*
+ * Description : Prints the usage message.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void usage(void)
+{
+  printf("Usage: pcccdump [options] save <dump file> [files...]\n"
+	 "       pcccdump [options] restore <dump file> [files...]\n"
+	 "       pcccdump list <dump file>\n"
+	 "Files are given as e.g. N7, or F8:20 for the first 20 elements. By\n"
+	 "default every data file of the processor is saved, or every file in\n"
+	 "the dump restored.\n"
+	 "   -a <addr> : Link address, first of -c addresses, default node + 1.\n"
+	 "   -b <bytes> : Data bytes per command, default 236.\n"
+	 "   -c <conns> : Registrations with df1d, default 1.\n"
+	 "   -h <host> : Host running df1d, default localhost.\n"
+	 "   -n <node> : Processor node address, default 1.\n"
+	 "   -p <port> : df1d client port, default 10505.\n"
+	 "   -q : Do not report progress.\n"
+	 "   -t <sec> : Reply timeout, default 5.\n"
+	 "   -v : Read back and compare after restoring.\n"
+	 "   -w <cmds> : Commands outstanding, default 4 per registration.\n");
+  return;
+}
+
+/*
+ * Description : Connects to df1d.
+ *
+ * Arguments : None.
+ *
+ * Return Value : The connection, NULL if it could not be made.
+ */
+static PCCC *open_con(void)
+{
+  char err[256];
+  PCCC_RET_T ret;
+  PCCC *con = (conns > 1) ? pccc_pool_new(src_addr, conns, timeout, window)
+    : pccc_new(src_addr, timeout, window);
+  if (con == NULL)
+    {
+      fprintf(stderr, "pcccdump: Cannot create connection.\n");
+      return NULL;
+    }
+  ret = pccc_connect(con, host, port, CLIENT_NAME);
+  if (ret != PCCC_SUCCESS)
+    {
+      pccc_errstr(con, ret, err, sizeof(err));
+      fprintf(stderr, "pcccdump: %s\n", err);
+      pccc_free(con);
+      return NULL;
+    }
+  return con;
+}
+
+/*
+ * Description : Builds the list of files to save. Files given with an
+ *               element count are used as they are; the others, or every
+ *               file number if none are given, are looked up with
+ *               ReadSLCFileInfo.
+ *
+ * Arguments : con - Connection.
+ *             argc - Number of file arguments.
+ *             argv - File arguments.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an argument was invalid or a lookup failed.
+ */
+static int scan_files(PCCC *con, int argc, char *const argv[])
+{
+  JOB *jobs = (JOB *)calloc(argc ? argc : 256, sizeof(JOB));
+  const FTYPE *want[256] = {NULL};
+  size_t num_jobs = 0;
+  size_t i;
+  if (jobs == NULL) return -1;
+  for (i = 0; i < (size_t)argc; i++)
+    {
+      const FTYPE *ft;
+      unsigned int file;
+      long elements;
+      if (parse_spec(argv[i], &ft, &file, &elements)) break;
+      if (elements > 0)
+	{
+	  if (add_file(file, ft, elements) == NULL) break;
+	  continue;
+	}
+      if (file > 255)
+	{
+	  fprintf(stderr, "pcccdump: Give the element count of %s.\n",
+		  argv[i]);
+	  break;
+	}
+      want[file] = ft;
+      jobs[num_jobs].op = OP_INFO;
+      jobs[num_jobs].file_num = file;
+      jobs[num_jobs].udata = &jobs[num_jobs].info;
+      num_jobs++;
+    }
+  if (i < (size_t)argc)
+    {
+      free(jobs);
+      return -1;
+    }
+  if (!argc)
+    for (; num_jobs < 256; num_jobs++)
+      {
+	jobs[num_jobs].op = OP_INFO;
+	jobs[num_jobs].file_num = num_jobs;
+	jobs[num_jobs].udata = &jobs[num_jobs].info;
+      }
+  if (num_jobs && run(con, jobs, num_jobs, "Scanned"))
+    {
+      free(jobs);
+      return -1;
+    }
+  for (i = 0; i < num_jobs; i++)
+    {
+      const JOB *j = jobs + i;
+      const FTYPE *ft;
+      if (j->result != PCCC_SUCCESS) /* No such file. */
+	{
+	  if (!argc) continue;
+	  fprintf(stderr, "pcccdump: File %u does not exist.\n", j->file_num);
+	  break;
+	}
+      ft = find_type(j->info.type);
+      if ((ft == NULL) || ((want[j->file_num] != NULL)
+			   && (want[j->file_num] != ft)))
+	{
+	  if (!argc) continue; /* I/O image or unsupported type. */
+	  fprintf(stderr, "pcccdump: File %u is not of the type given or is"
+		  " not supported.\n", j->file_num);
+	  break;
+	}
+      if (j->info.elements && (add_file(j->file_num, ft,
+					j->info.elements) == NULL))
+	break;
+    }
+  free(jobs);
+  return (i < num_jobs) ? -1 : 0;
+}
+
+/*
+ * Description : Parses a file argument, e.g. N7 or N7:100.
+ *
+ * Arguments : spec - Argument.
+ *             ft - Location to store the file type.
+ *             file - Location to store the file number.
+ *             elements - Location to store the element count, zero if not
+ *                        given.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the argument is invalid.
+ */
+static int parse_spec(const char *spec, const FTYPE **ft, unsigned int *file,
+		      long *elements)
+{
+  const FTYPE *t;
+  char *end;
+  for (t = ftypes; t->prefix != NULL; t++)
+    if (!strncasecmp(spec, t->prefix, strlen(t->prefix))
+	&& isdigit((unsigned char)spec[strlen(t->prefix)]))
+      break;
+  *ft = t;
+  *elements = 0;
+  if (t->prefix != NULL)
+    {
+      *file = strtoul(spec + strlen(t->prefix), &end, 10);
+      if (*end == ':') *elements = strtol(end + 1, &end, 10);
+    }
+  if ((t->prefix == NULL) || *end || (*file > 65535) || (*elements < 0)
+      || (*elements > 65535))
+    {
+      fprintf(stderr, "pcccdump: Invalid file %s.\n", spec);
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Adds a file to the list, in file number order.
+ *
+ * Arguments : file - File number.
+ *             ft - File type.
+ *             elements - Number of elements.
+ *
+ * Return Value : The new file, NULL if out of memory.
+ */
+static DFILE *add_file(uint16_t file, const FTYPE *ft, size_t elements)
+{
+  DFILE **p;
+  DFILE *df = (DFILE *)calloc(1, sizeof(DFILE));
+  if (df != NULL)
+    {
+      df->udata = calloc(elements, ft->usize);
+      df->image = (uint8_t *)calloc(elements, ft->bytes);
+    }
+  if ((df == NULL) || (df->udata == NULL) || (df->image == NULL))
+    {
+      fprintf(stderr, "pcccdump: Out of memory.\n");
+      if (df != NULL)
+	{
+	  free(df->udata);
+	  free(df->image);
+	  free(df);
+	}
+      return NULL;
+    }
+  df->file = file;
+  df->ft = ft;
+  df->elements = elements;
+  for (p = &files; (*p != NULL) && ((*p)->file < file); p = &(*p)->next);
+  df->next = *p;
+  *p = df;
+  return df;
+}
+
+/*
+ * Description : Splits every file into chunks of at most the configured
+ *               size, one job each.
+ *
+ * Arguments : op - Operation of the jobs.
+ *             num_jobs - Location to store the number of jobs.
+ *
+ * Return Value : The jobs, NULL if out of memory.
+ */
+static JOB *chunk_jobs(OP_T op, size_t *num_jobs)
+{
+  DFILE *df;
+  JOB *jobs;
+  size_t n = 0;
+  for (df = files; df != NULL; df = df->next)
+    {
+      size_t per = chunk / df->ft->bytes;
+      n += (df->elements + per - 1) / per;
+    }
+  jobs = (JOB *)calloc(n ? n : 1, sizeof(JOB));
+  if (jobs == NULL)
+    {
+      fprintf(stderr, "pcccdump: Out of memory.\n");
+      return NULL;
+    }
+  *num_jobs = n;
+  for (n = 0, df = files; df != NULL; df = df->next)
+    {
+      size_t per = chunk / df->ft->bytes;
+      size_t first;
+      for (first = 0; first < df->elements; first += per, n++)
+	{
+	  jobs[n].op = op;
+	  jobs[n].df = df;
+	  jobs[n].first = first;
+	  jobs[n].count = (df->elements - first < per) ? df->elements - first
+	    : per;
+	  jobs[n].udata = (char *)df->udata + first * df->ft->usize;
+	}
+    }
+  return jobs;
+}
+
+
+/*
+ * Description : Runs jobs with up to the window of commands outstanding,
+ *               reporting progress.
+ *
+ * Arguments : con - Connection.
+ *             jobs - Jobs to run.
+ *             num_jobs - Number of jobs.
+ *             what - Verb used in progress reports.
+ *
+ * Return Value : Zero if every data transfer succeeded. Failed file info
+ *                lookups are left for the caller to judge.
+ *                Non-zero if a transfer or the connection failed.
+ */
+static int run(PCCC *con, JOB *jobs, size_t num_jobs, const char *what)
+{
+  char err[256];
+  size_t next = 0; /* Next job to send. */
+  size_t total = 0;
+  double start = now_sec();
+  double last_report = start;
+  double last_tick = start;
+  double now;
+  PCCC_RET_T ret = PCCC_SUCCESS;
+  size_t i;
+  cur_jobs = jobs;
+  cur_num_jobs = num_jobs;
+  jobs_sent = 0;
+  jobs_done = 0;
+  bytes_done = 0;
+  failed_job = NULL;
+  for (i = 0; i < num_jobs; i++)
+    if (jobs[i].df != NULL) total += jobs[i].count * jobs[i].df->ft->bytes;
+  while (jobs_done < num_jobs)
+    {
+      fd_set read_fds;
+      fd_set write_fds;
+      struct timeval tv = {0, 200000};
+      int high;
+      int ready;
+      int fd;
+      /*
+       * Keep the window full until a transfer fails, then only drain.
+       */
+      while ((failed_job == NULL) && (next < num_jobs)
+	     && (jobs_sent < window))
+	{
+	  ret = job_send(con, jobs + next);
+	  if (ret != PCCC_SUCCESS) break;
+	  jobs[next++].state = JOB_SENT;
+	  jobs_sent++;
+	}
+      if (ret == PCCC_ECMD_NOBUF) ret = PCCC_SUCCESS; /* Wait for replies. */
+      if ((ret != PCCC_SUCCESS) || ((failed_job != NULL) && !jobs_sent))
+	break;
+      FD_ZERO(&read_fds);
+      FD_ZERO(&write_fds);
+      high = pccc_pool_fds(con, &read_fds, &write_fds);
+      ready = select(high + 1, &read_fds, &write_fds, NULL, &tv);
+      if (ready < 0)
+	{
+	  if (errno == EINTR) continue;
+	  perror("pcccdump: select()");
+	  break;
+	}
+      if (pccc_write_ready(con) == PCCC_WREADY)
+	{
+	  ret = pccc_write(con);
+	  if (ret != PCCC_SUCCESS) break;
+	}
+      /*
+       * pccc_read() blocks on a single connection with nothing to read.
+       */
+      for (fd = 0; ready && (fd <= high) && !FD_ISSET(fd, &read_fds); fd++);
+      if (ready && (fd <= high))
+	{
+	  ret = pccc_read(con);
+	  if (ret != PCCC_SUCCESS) break;
+	}
+      now = now_sec();
+      if (now - last_tick >= 1.0)
+	{
+	  pccc_tick(con);
+	  last_tick = now;
+	}
+      if (!quiet && (now - last_report >= 0.5))
+	{
+	  if (total)
+	    fprintf(stderr, "\r%s %zu/%zu bytes (%zu%%), %.0f bytes/s   ", what,
+		    bytes_done, total, bytes_done * 100 / total,
+		    bytes_done / (now - start));
+	  else
+	    fprintf(stderr, "\r%s %zu/%zu files   ", what, jobs_done,
+		    num_jobs);
+	  last_report = now;
+	}
+    }
+  cur_jobs = NULL;
+  if (ret != PCCC_SUCCESS)
+    {
+      pccc_errstr(con, ret, err, sizeof(err));
+      fprintf(stderr, "\npcccdump: %s\n", err);
+      return -1;
+    }
+  if (jobs_done < num_jobs) return -1; /* select() failed. */
+  if (failed_job != NULL)
+    {
+      pccc_errstr(con, failed_job->result, err, sizeof(err));
+      fprintf(stderr, "\npcccdump: %s%u:%zu failed : %s\n",
+	      failed_job->df->ft->prefix, failed_job->df->file,
+	      failed_job->first, err);
+      return -1;
+    }
+  if (!quiet && total)
+    {
+      now = now_sec() - start;
+      fprintf(stderr, "\r%s %zu bytes in %.2f s, %.0f bytes/s          \n",
+	      what, total, now, (now > 0.0) ? total / now : 0.0);
+    }
+  return 0;
+}
+
+/*
+ * Description : Notification function of every command, marks the job it
+ *               belongs to complete.
+ *
+ * Arguments : con - Connection.
+ *             result - Command result.
+ *             udata - Data pointer given with the command.
+ *
+ * Return Value : None.
+ */
+static void job_done(PCCC *con, PCCC_RET_T result, void *udata)
+{
+  size_t i;
+  for (i = 0; i < cur_num_jobs; i++)
+    {
+      JOB *j = cur_jobs + i;
+      if ((j->state != JOB_SENT) || (j->udata != udata)) continue;
+      j->state = JOB_DONE;
+      j->result = result;
+      jobs_sent--;
+      jobs_done++;
+      if (j->op == OP_INFO) return;
+      if (result != PCCC_SUCCESS)
+	{
+	  if (failed_job == NULL) failed_job = j;
+	  return;
+	}
+      bytes_done += j->count * j->df->ft->bytes;
+      return;
+    }
+  return;
+}
+
+/*
+ * Description : Sends the command of a job.
+ *
+ * Arguments : con - Connection.
+ *             job - Job to send.
+ *
+ * Return Value : Result of initiating the command.
+ */
+static PCCC_RET_T job_send(PCCC *con, JOB *job)
+{
+  switch (job->op)
+    {
+    case OP_INFO:
+      return pccc_cmd_ReadSLCFileInfo(con, job_done, node, &job->info,
+				      job->file_num);
+    case OP_READ:
+      return pccc_cmd_ProtectedTypedLogicalRead3AddressFields
+	(con, job_done, node, job->udata, job->df->ft->type, job->df->file,
+	 job->first, 0, job->count);
+    default:
+      return pccc_cmd_ProtectedTypedLogicalWrite3AddressFields
+	(con, job_done, node, job->udata, job->df->ft->type, job->df->file,
+	 job->first, 0, job->count);
+    }
+}
+
+/*
+ * Description : Encodes the files read and writes them to the dump file.
+ *
+ * Arguments : path - Dump file.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the dump file could not be written.
+ */
+static int save(const char *path)
+{
+  uint8_t hdr[12];
+  const DFILE *df;
+  FILE *f;
+  size_t n = 0;
+  for (df = files; df != NULL; df = df->next) n++;
+  f = fopen(path, "wb");
+  if (f == NULL)
+    {
+      fprintf(stderr, "pcccdump: Cannot create %s : %s\n", path,
+	      strerror(errno));
+      return -1;
+    }
+  memcpy(hdr, DUMP_MAGIC, 8);
+  hdr[8] = DUMP_VERSION;
+  hdr[9] = node;
+  put_le(hdr + 10, n, 2);
+  fwrite(hdr, 1, 12, f);
+  for (df = files; df != NULL; df = df->next)
+    {
+      size_t len = df->elements * df->ft->bytes;
+      pccc_data_encode(df->ft->type, df->udata, df->elements, df->image, len);
+      put_le(hdr, df->file, 2);
+      hdr[2] = df->ft->code;
+      hdr[3] = 0;
+      put_le(hdr + 4, df->elements, 2);
+      put_le(hdr + 6, len, 4);
+      fwrite(hdr, 1, 10, f);
+      fwrite(df->image, 1, len, f);
+      if (!quiet)
+	fprintf(stderr, "%s%u : %zu elements\n", df->ft->prefix, df->file,
+		df->elements);
+    }
+  if (ferror(f) | fclose(f))
+    {
+      fprintf(stderr, "pcccdump: Error writing %s.\n", path);
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Reads a dump file, keeping the files selected, and lists
+ *               them unless quiet.
+ *
+ * Arguments : path - Dump file.
+ *             argc - Number of file arguments, zero for all files.
+ *             argv - File arguments. An element count limits the number
+ *                    of elements restored.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the dump file is invalid or a file given was
+ *                not in it.
+ */
+static int load(const char *path, int argc, char *const argv[])
+{
+  uint8_t hdr[12];
+  char *found = (char *)calloc(argc ? argc : 1, 1);
+  FILE *f = fopen(path, "rb");
+  unsigned long n;
+  int ret = -1;
+  int i;
+  if ((f == NULL) || (found == NULL))
+    {
+      fprintf(stderr, "pcccdump: Cannot open %s : %s\n", path,
+	      strerror(errno));
+      goto out;
+    }
+  if ((fread(hdr, 1, 12, f) != 12) || memcmp(hdr, DUMP_MAGIC, 8)
+      || (hdr[8] != DUMP_VERSION))
+    {
+      fprintf(stderr, "pcccdump: %s is not a dump file.\n", path);
+      goto out;
+    }
+  if (!quiet) fprintf(stderr, "Node %u, %lu files\n", hdr[9],
+		      get_le(hdr + 10, 2));
+  for (n = get_le(hdr + 10, 2); n; n--)
+    {
+      const FTYPE *ft;
+      unsigned int file;
+      size_t elements;
+      size_t len;
+      long want = 0; /* Elements to restore, zero for all. */
+      DFILE *df;
+      if (fread(hdr, 1, 10, f) != 10) break;
+      file = get_le(hdr, 2);
+      ft = find_code(hdr[2]);
+      elements = get_le(hdr + 4, 2);
+      len = get_le(hdr + 6, 4);
+      if ((ft == NULL) || (len != elements * ft->bytes)) break;
+      for (i = 0; i < argc; i++)
+	{
+	  const FTYPE *aft;
+	  unsigned int afile;
+	  long aelements;
+	  if (parse_spec(argv[i], &aft, &afile, &aelements)) goto out;
+	  if ((aft == ft) && (afile == file))
+	    {
+	      found[i] = 1;
+	      want = aelements ? aelements : -1;
+	    }
+	}
+      if (argc && !want)
+	{
+	  if (fseek(f, len, SEEK_CUR)) break;
+	  continue;
+	}
+      if (!quiet) fprintf(stderr, "%s%u : %zu elements\n", ft->prefix, file,
+			  elements);
+      df = add_file(file, ft, elements);
+      if (df == NULL) goto out;
+      if (fread(df->image, 1, len, f) != len) break;
+      if (pccc_data_decode(ft->type, df->image, len, df->udata, elements)
+	  != PCCC_SUCCESS)
+	break;
+      if ((want > 0) && ((size_t)want < elements)) df->elements = want;
+    }
+  if (n)
+    {
+      fprintf(stderr, "pcccdump: %s is truncated or corrupt.\n", path);
+      goto out;
+    }
+  for (i = 0; i < argc; i++)
+    if (!found[i])
+      {
+	fprintf(stderr, "pcccdump: %s is not in %s.\n", argv[i], path);
+	goto out;
+      }
+  ret = 0;
+ out:
+  if (f != NULL) fclose(f);
+  free(found);
+  return ret;
+}
+
+/*
+ * Description : Reads back the files restored and compares them with the
+ *               dump.
+ *
+ * Arguments : con - Connection.
+ *
+ * Return Value : Zero if the processor holds the data restored.
+ *                Non-zero if the files differ or could not be read.
+ */
+static int verify(PCCC *con)
+{
+  uint8_t *image;
+  DFILE *df;
+  JOB *jobs;
+  size_t num_jobs;
+  size_t i;
+  int ret;
+  jobs = chunk_jobs(OP_READ, &num_jobs);
+  if (jobs == NULL) return -1;
+  ret = run(con, jobs, num_jobs, "Verified");
+  free(jobs);
+  for (df = files; !ret && (df != NULL); df = df->next)
+    {
+      size_t len = df->elements * df->ft->bytes;
+      image = (uint8_t *)malloc(len);
+      if (image == NULL)
+	{
+	  fprintf(stderr, "pcccdump: Out of memory.\n");
+	  return -1;
+	}
+      pccc_data_encode(df->ft->type, df->udata, df->elements, image, len);
+      for (i = 0; (i < len) && (image[i] == df->image[i]); i++);
+      if (i < len)
+	{
+	  fprintf(stderr, "pcccdump: %s%u:%zu differs from the dump.\n",
+		  df->ft->prefix, df->file, i / df->ft->bytes);
+	  ret = -1;
+	}
+      free(image);
+    }
+  return ret;
+}
+
+/*
+ * Description : Finds a supported file type.
+ *
+ * Arguments : type - File type.
+ *
+ * Return Value : The type, NULL if not supported.
+ */
+static const FTYPE *find_type(PCCC_FT_T type)
+{
+  const FTYPE *ft;
+  for (ft = ftypes; ft->prefix != NULL; ft++)
+    if (ft->type == type) return ft;
+  return NULL;
+}
+
+/*
+ * Description : Finds a supported file type by its PCCC type code.
+ *
+ * Arguments : code - File type code.
+ *
+ * Return Value : The type, NULL if not supported.
+ */
+static const FTYPE *find_code(uint8_t code)
+{
+  const FTYPE *ft;
+  for (ft = ftypes; ft->prefix != NULL; ft++)
+    if (ft->code == code) return ft;
+  return NULL;
+}
+
+/*
+ * Description : Stores a value little endian.
+ *
+ * Arguments : dst - Destination.
+ *             x - Value.
+ *             bytes - Number of bytes to store.
+ *
+ * Return Value : None.
+ */
+static void put_le(uint8_t *dst, unsigned long x, int bytes)
+{
+  for (; bytes; bytes--, x >>= 8) *dst++ = x & 0xff;
+  return;
+}
+
+/*
+ * Description : Loads a little endian value.
+ *
+ * Arguments : src - Source.
+ *             bytes - Number of bytes to load.
+ *
+ * Return Value : The value.
+ */
+static unsigned long get_le(const uint8_t *src, int bytes)
+{
+  unsigned long x = 0;
+  while (bytes--) x = (x << 8) | src[bytes];
+  return x;
+}
+
+/*
+ * Description : Reads the monotonic clock.
+ *
+ * Arguments : None.
+ *
+ * Return Value : Seconds.
+ */
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
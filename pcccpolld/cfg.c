@@ -0,0 +1,547 @@
+/*
+ * This file is part of pcccpolld.
+ * Multi-controller PCCC polling service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+#include "pcccpolld.h"
+
+#define DEF_THREADS 4
+#define DEF_TIMEOUT 5 /* Default command timeout in seconds. */
+#define DEF_MSGS 32 /* Default message buffers per endpoint. */
+
+ENDPOINT *endpoints;
+unsigned int num_tags;
+unsigned int num_threads;
+
+static xmlDocPtr doc;
+static iconv_t utf8_conv; /* To convert UTF-8 returned from libxml to char. */
+
+static int xml_parse_root(void);
+static int xml_parse_endpoint(xmlNode *ep_node);
+static int xml_parse_node(ENDPOINT *ep, xmlNode *node_node);
+static int xml_parse_class(ENDPOINT *ep, uint8_t node, xmlNode *class_node);
+static int xml_parse_tag(ENDPOINT *ep, uint8_t node, unsigned int class_id,
+			 xmlNode *tag_node);
+static int xml_parse_sink(xmlNode *sink_node);
+static int get_param_val(xmlNodePtr src, char *dst);
+static int get_attr_val(xmlNodePtr src, const char *attr, char *dst);
+static int get_attr_uint(xmlNodePtr src, const char *attr, unsigned int max,
+			 unsigned int *dst);
+static int get_file_type(const char *val, PCCC_FT_T *dst);
+static int is_element(const xmlNode *node, const char *name);
+
+/*
+ * Description : Reads the XML configuration file, creates the endpoints and
+ *               their polling layers, and opens the sinks.
+ *
+ * Arguments : file - Configuration file name.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the configuration is invalid or an error
+ *                occured. Nothing is left allocated in that case.
+ */
+extern int cfg_read(const char *file)
+{
+  int ret;
+  xmlLineNumbersDefault(1);
+  /*
+   * libXML returns all text in UTF-8 encoding. Setup iconv to convert
+   * from UTF-8 to char.
+   */
+  utf8_conv = iconv_open("", "UTF-8");
+  if (utf8_conv == (iconv_t)-1)
+    {
+      log_msg(LOG_ERR, "%s:%d Error opening UTF-8 converter : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      return -1;
+    }
+  num_threads = DEF_THREADS;
+  doc = xmlReadFile(file, NULL, 0);
+  if (doc == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d Unable to read configuration file.\n",
+	      __FILE__, __LINE__);
+      ret = -1;
+    }
+  else
+    {
+      ret = xml_parse_root();
+      xmlFreeDoc(doc);
+    }
+  xmlCleanupParser();
+  if (iconv_close(utf8_conv))
+    log_msg(LOG_ERR, "%s:%d Error closing UTF-8 converter : %s\n", __FILE__,
+	    __LINE__, strerror(errno));
+  if (!ret && !num_tags)
+    {
+      log_msg(LOG_ERR, "%s:%d No tags configured.\n", __FILE__, __LINE__);
+      ret = -1;
+    }
+  if (!ret && (sinks == NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d No sinks configured.\n", __FILE__, __LINE__);
+      ret = -1;
+    }
+  if (ret) cfg_free();
+  return ret;
+}
+
+/*
+ * Description : Frees every endpoint, its tags and polling layer, and every
+ *               sink.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void cfg_free(void)
+{
+  while (endpoints != NULL)
+    {
+      ENDPOINT *next = endpoints->next;
+      size_t i;
+      pccc_poll_free(endpoints->poll);
+      pccc_close(endpoints->con);
+      pccc_free(endpoints->con);
+      for (i = 0; i < endpoints->num_tags; i++) free(endpoints->tags[i]);
+      free(endpoints->tags);
+      free(endpoints);
+      endpoints = next;
+    }
+  num_tags = 0;
+  sink_free_all();
+  return;
+}
+
+/*
+ * Description : Parses the root element. Sinks are parsed last as the
+ *               shared memory sink needs the number of tags.
+ *
+ * Arguments : None.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+static int xml_parse_root(void)
+{
+  xmlNode *root = xmlDocGetRootElement(doc);
+  xmlNode *node;
+  char val[PATH_MAX];
+  for (node = root->xmlChildrenNode; node != NULL; node = node->next)
+    {
+      if (is_element(node, "threads"))
+	{
+	  if (get_param_val(node, val) || (sscanf(val, "%u", &num_threads) != 1)
+	      || !num_threads)
+	    {
+	      log_msg(LOG_ERR, "%s:%d Invalid number of threads at line %ld.\n",
+		      __FILE__, __LINE__, xmlGetLineNo(node));
+	      return -1;
+	    }
+	}
+      else if (is_element(node, "endpoint") && xml_parse_endpoint(node))
+	return -1;
+    }
+  for (node = root->xmlChildrenNode; node != NULL; node = node->next)
+    if (is_element(node, "sink") && xml_parse_sink(node)) return -1;
+  return 0;
+}
+
+/*
+ * Description : Parses an endpoint element and creates its connection and
+ *               polling layer.
+ *
+ * Arguments : ep_node - Pointer to the endpoint element.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+static int xml_parse_endpoint(xmlNode *ep_node)
+{
+  ENDPOINT *ep;
+  ENDPOINT **end;
+  xmlNode *node;
+  unsigned int port, addr;
+  unsigned int timeout = DEF_TIMEOUT;
+  unsigned int msgs = DEF_MSGS;
+  char val[PATH_MAX];
+  ep = (ENDPOINT *)calloc(1, sizeof(ENDPOINT));
+  if (ep == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d Error allocating endpoint : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      return -1;
+    }
+  /*
+   * Link the endpoint first so cfg_free() cleans up after any error below.
+   */
+  for (end = &endpoints; *end != NULL; end = &(*end)->next);
+  *end = ep;
+  if (get_attr_val(ep_node, "name", val) || !strlen(val)
+      || (strlen(val) > NAME_LEN))
+    {
+      log_msg(LOG_ERR, "%s:%d Endpoint name missing or too long at line"
+	      " %ld.\n", __FILE__, __LINE__, xmlGetLineNo(ep_node));
+      return -1;
+    }
+  strcpy(ep->name, val);
+  if (get_attr_val(ep_node, "host", val)) strcpy(val, "localhost");
+  if (!strlen(val) || (strlen(val) > NAME_MAX))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Endpoint host empty or too long at line"
+	      " %ld.\n", __FILE__, __LINE__, ep->name, xmlGetLineNo(ep_node));
+      return -1;
+    }
+  strcpy(ep->host, val);
+  if (get_attr_uint(ep_node, "port", 65535, &port)
+      || get_attr_uint(ep_node, "address", 254, &addr))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Endpoint port and address must be"
+	      " specified.\n", __FILE__, __LINE__, ep->name);
+      return -1;
+    }
+  ep->port = port;
+  if (((xmlHasProp(ep_node, (const xmlChar *)"timeout") != NULL)
+       && get_attr_uint(ep_node, "timeout", 3600, &timeout))
+      || ((xmlHasProp(ep_node, (const xmlChar *)"msgs") != NULL)
+	  && get_attr_uint(ep_node, "msgs", 1024, &msgs)))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Invalid endpoint timeout or msgs.\n",
+	      __FILE__, __LINE__, ep->name);
+      return -1;
+    }
+  ep->con = pccc_new(addr, timeout, msgs);
+  if (ep->con == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error creating connection.\n", __FILE__,
+	      __LINE__, ep->name);
+      return -1;
+    }
+  ep->poll = pccc_poll_new(ep->con, tag_done);
+  if (ep->poll == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error creating polling layer.\n",
+	      __FILE__, __LINE__, ep->name);
+      return -1;
+    }
+  for (node = ep_node->xmlChildrenNode; node != NULL; node = node->next)
+    if (is_element(node, "node") && xml_parse_node(ep, node)) return -1;
+  return 0;
+}
+
+/*
+ * Description : Parses a node element, one controller on an endpoint.
+ *
+ * Arguments : ep - Endpoint.
+ *             node_node - Pointer to the node element.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+static int xml_parse_node(ENDPOINT *ep, xmlNode *node_node)
+{
+  xmlNode *node;
+  unsigned int addr;
+  if (get_attr_uint(node_node, "address", 254, &addr))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Invalid node address at line %ld.\n",
+	      __FILE__, __LINE__, ep->name, xmlGetLineNo(node_node));
+      return -1;
+    }
+  for (node = node_node->xmlChildrenNode; node != NULL; node = node->next)
+    if (is_element(node, "class") && xml_parse_class(ep, addr, node))
+      return -1;
+  return 0;
+}
+
+/*
+ * Description : Parses a class element. Every class element is its own scan
+ *               class, so each node is scanned independently.
+ *
+ * Arguments : ep - Endpoint.
+ *             node - Controller node address.
+ *             class_node - Pointer to the class element.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+static int xml_parse_class(ENDPOINT *ep, uint8_t node, xmlNode *class_node)
+{
+  xmlNode *tag_node;
+  unsigned int period;
+  unsigned int priority = 0;
+  unsigned int class_id;
+  if (get_attr_uint(class_node, "period", UINT_MAX, &period) || !period
+      || ((xmlHasProp(class_node, (const xmlChar *)"priority") != NULL)
+	  && get_attr_uint(class_node, "priority", UINT_MAX, &priority))
+      || (pccc_poll_add_class(ep->poll, period, priority, &class_id)
+	  != PCCC_SUCCESS))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Invalid scan class at line %ld.\n",
+	      __FILE__, __LINE__, ep->name, xmlGetLineNo(class_node));
+      return -1;
+    }
+  for (tag_node = class_node->xmlChildrenNode; tag_node != NULL;
+       tag_node = tag_node->next)
+    if (is_element(tag_node, "tag")
+	&& xml_parse_tag(ep, node, class_id, tag_node))
+      return -1;
+  return 0;
+}
+
+/*
+ * Description : Parses a tag element and adds it to the polling layer, e.g.
+ *               <tag name="speed" file="N7:0" elements="4"/>.
+ *
+ * Arguments : ep - Endpoint.
+ *             node - Controller node address.
+ *             class_id - Scan class.
+ *             tag_node - Pointer to the tag element.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+static int xml_parse_tag(ENDPOINT *ep, uint8_t node, unsigned int class_id,
+			 xmlNode *tag_node)
+{
+  TAG *tag;
+  TAG **tags;
+  char val[PATH_MAX];
+  char type[3];
+  unsigned int file, element, elements = 1;
+  tag = (TAG *)calloc(1, sizeof(TAG));
+  tags = (TAG **)realloc(ep->tags, (ep->num_tags + 1) * sizeof(TAG *));
+  if ((tag == NULL) || (tags == NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Error allocating tag : %s\n", __FILE__,
+	      __LINE__, ep->name, strerror(errno));
+      free(tag);
+      if (tags != NULL) ep->tags = tags;
+      return -1;
+    }
+  ep->tags = tags;
+  if (get_attr_val(tag_node, "name", val) || !strlen(val)
+      || (strlen(val) > NAME_LEN))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Tag name missing or too long at line"
+	      " %ld.\n", __FILE__, __LINE__, ep->name, xmlGetLineNo(tag_node));
+      free(tag);
+      return -1;
+    }
+  strcpy(tag->name, val);
+  if (get_attr_val(tag_node, "file", val)
+      || (sscanf(val, "%2[A-Za-z]%u:%u", type, &file, &element) != 3)
+      || get_file_type(type, &tag->file_type) || (file > 65535)
+      || (element > 65535)
+      || ((xmlHasProp(tag_node, (const xmlChar *)"elements") != NULL)
+	  && get_attr_uint(tag_node, "elements", TAG_VALUES_MAX, &elements))
+      || (pccc_poll_add_block(ep->poll, class_id, node, tag->file_type, file,
+			      element, elements, &tag->block_id)
+	  != PCCC_SUCCESS))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Invalid address for tag %s.\n", __FILE__,
+	      __LINE__, ep->name, tag->name);
+      free(tag);
+      return -1;
+    }
+  tag->ep = ep;
+  tag->node = node;
+  tag->file = file;
+  tag->element = element;
+  tag->elements = elements;
+  tag->index = num_tags++;
+  ep->tags[ep->num_tags++] = tag; /* Block identifiers count up from zero. */
+  return 0;
+}
+
+/*
+ * Description : Parses a sink element and opens the sink, e.g.
+ *               <sink type="udp" host="10.0.0.5" port="5000"/>.
+ *
+ * Arguments : sink_node - Pointer to the sink element.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if an error occured.
+ */
+static int xml_parse_sink(xmlNode *sink_node)
+{
+  char type[PATH_MAX];
+  char val[PATH_MAX];
+  unsigned int port;
+  if (get_attr_val(sink_node, "type", type)) type[0] = 0;
+  if (!strcasecmp(type, "file"))
+    {
+      if (!get_attr_val(sink_node, "path", val))
+	return (sink_file_new(val) == NULL) ? -1 : 0;
+    }
+  else if (!strcasecmp(type, "udp"))
+    {
+      if (!get_attr_val(sink_node, "host", val)
+	  && !get_attr_uint(sink_node, "port", 65535, &port))
+	return (sink_udp_new(val, port) == NULL) ? -1 : 0;
+    }
+  else if (!strcasecmp(type, "shm"))
+    {
+      if (!get_attr_val(sink_node, "name", val))
+	return (sink_shm_new(val, num_tags) == NULL) ? -1 : 0;
+    }
+  log_msg(LOG_ERR, "%s:%d Invalid sink at line %ld. Valid types are 'file',"
+	  " 'udp' and 'shm'.\n", __FILE__, __LINE__, xmlGetLineNo(sink_node));
+  return -1;
+}
+
+/*
+ * Description : Retrieves the text content of a node and converts it from
+ *               UTF-8 to char. The converted string will be NULL terminated.
+ *
+ * Arguments : src - The source node from which to extract the content.
+ *             dst - Location to store the retrieved text content.
+ *
+ * Return Value : Zero if the parameter was retrieved and converted
+ *                successfully.
+ *                Non-zero if an error occured.
+ */
+static int get_param_val(xmlNodePtr src, char *dst)
+{
+  size_t i, val_max;
+  size_t dst_max = PATH_MAX - 1;
+  xmlChar *val;
+  const char *p;
+  val = xmlNodeListGetString(doc, src->xmlChildrenNode, 1);
+  if (val == NULL) return -1;
+  /*
+   * The original string starting location must be saved as iconv()
+   * will modify its value.
+   */
+  p = (char *)val;
+  val_max = xmlStrlen(val);
+  i = iconv(utf8_conv, (char **)&p, &val_max, &dst, &dst_max);
+  xmlFree(val);
+  if (i == (size_t)-1)
+    {
+      log_msg(LOG_ERR, "%s:%d Error converting configuration"
+	      " parameter at line %ld : %s\n", __FILE__, __LINE__,
+	      xmlGetLineNo(src), strerror(errno));
+      return -1;
+    }
+  *dst = 0; /* Null terminate the converted string. */
+  return 0;
+}
+
+/*
+ * Description : Retrieves the value of an attribute and converts it from
+ *               UTF-8 to char. The converted string will be NULL terminated.
+ *
+ * Arguments : src - The node containing the attribute.
+ *             attr - Attribute name.
+ *             dst - Location to store the retrieved value.
+ *
+ * Return Value : Zero if the attribute was retrieved and converted
+ *                successfully.
+ *                Non-zero if the attribute is missing or an error occured.
+ */
+static int get_attr_val(xmlNodePtr src, const char *attr, char *dst)
+{
+  size_t i, val_max;
+  size_t dst_max = PATH_MAX - 1;
+  xmlChar *val;
+  const char *p;
+  val = xmlGetProp(src, (const xmlChar *)attr);
+  if (val == NULL) return -1;
+  p = (char *)val;
+  val_max = xmlStrlen(val);
+  i = iconv(utf8_conv, (char **)&p, &val_max, &dst, &dst_max);
+  xmlFree(val);
+  if (i == (size_t)-1)
+    {
+      log_msg(LOG_ERR, "%s:%d Error converting configuration"
+	      " attribute at line %ld : %s\n", __FILE__, __LINE__,
+	      xmlGetLineNo(src), strerror(errno));
+      return -1;
+    }
+  *dst = 0; /* Null terminate the converted string. */
+  return 0;
+}
+
+/*
+ * Description : Retrieves an unsigned integer attribute.
+ *
+ * Arguments : src - The node containing the attribute.
+ *             attr - Attribute name.
+ *             max - Largest value allowed.
+ *             dst - Location to store the value.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the attribute is missing or invalid.
+ */
+static int get_attr_uint(xmlNodePtr src, const char *attr, unsigned int max,
+			 unsigned int *dst)
+{
+  char val[PATH_MAX];
+  if (get_attr_val(src, attr, val) || (sscanf(val, "%u", dst) != 1)
+      || (*dst > max))
+    return -1;
+  return 0;
+}
+
+/*
+ * Description : Converts a data file type letter to a file type.
+ *
+ * Arguments : val - File type letter(s).
+ *             dst - Location to store the file type.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the file type is not supported.
+ */
+static int get_file_type(const char *val, PCCC_FT_T *dst)
+{
+  static const struct
+  {
+    const char *letter;
+    PCCC_FT_T type;
+  } types[] = {{"N", PCCC_FT_INT}, {"B", PCCC_FT_BIN}, {"F", PCCC_FT_FLOAT},
+	       {"S", PCCC_FT_STAT}, {"T", PCCC_FT_TIMER},
+	       {"C", PCCC_FT_COUNT}, {"R", PCCC_FT_CTL}};
+  unsigned int i;
+  for (i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    if (!strcasecmp(val, types[i].letter))
+      {
+	*dst = types[i].type;
+	return 0;
+      }
+  return -1;
+}
+
+/*
+ * Description : Tests if a node is an element with a given name.
+ *
+ * Arguments : node - Node to test.
+ *             name - Element name.
+ *
+ * Return Value : Non-zero if the node is a matching element.
+ */
+static int is_element(const xmlNode *node, const char *name)
+{
+  return (node->type == XML_ELEMENT_NODE)
+    && xmlStrEqual(node->name, (const xmlChar *)name);
+}
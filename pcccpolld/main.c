@@ -0,0 +1,394 @@
+/*
+ * This file is part of pcccpolld.
+ * Multi-controller PCCC polling service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * The main thread is the reactor. It owns every link layer connection and
+ * polling layer, as libpccc is not thread safe, and does nothing but move
+ * bytes and start scans. Each completed read is copied out undecoded and
+ * handed to the thread pool, where it is decoded and written to the sinks.
+ */
+
+#include "pcccpolld.h"
+
+#define VER_MAJOR "1"
+#define VER_MINOR "0"
+
+#define CLIENT_NAME "pcccpolld" /* Name registered with df1d. */
+#define TICK_MSEC 1000 /* Longest wait, pccc_tick() is due every second. */
+
+/*
+ * Option bits set by command line arguments.
+ */
+#define OPT_FOREGROUND 1
+#define OPT_DEBUG 2
+
+static int cl_args(int argc, char * const argv[], char *cfg_file, int *opts);
+static int become_daemon(void);
+static void reactor(void);
+static void ep_connect(ENDPOINT *ep, time_t now);
+static void ep_fail(ENDPOINT *ep, PCCC_RET_T err, time_t now);
+static int set_signals(void);
+static void sig_term(int signo);
+
+static volatile int terminate; /* Set by SIGTERM and SIGINT. */
+static POOL *pool;
+
+/*
+ * Description : Main program entry point.
+ *
+ * Arguments : argc - Number of arguments.
+ *             argv - Argument vector.
+ *
+ * Return Value - Zero.
+ */
+int main(int argc, char *argv[])
+{
+  int opts = 0; /* Option mask from command line arguments. */
+  char cfg_file[PATH_MAX];
+  if (cl_args(argc, argv, cfg_file, &opts)) exit(0);
+  log_open((opts & OPT_FOREGROUND),
+	   (opts & OPT_DEBUG) ? LOG_DEBUG : LOG_INFO);
+  log_msg(LOG_INFO, "Starting PCCC polling service v%s.%s\n", VER_MAJOR,
+	  VER_MINOR);
+  if (cfg_read(cfg_file))
+    {
+      log_close();
+      exit(0);
+    }
+  if ((!(opts & OPT_FOREGROUND) && become_daemon()) || set_signals())
+    {
+      cfg_free();
+      log_close();
+      exit(0);
+    }
+  pool = pool_new(num_threads);
+  if (pool != NULL)
+    {
+      log_msg(LOG_INFO, "%s:%d Polling %u tags with %u threads.\n", __FILE__,
+	      __LINE__, num_tags, num_threads);
+      reactor();
+      /*
+       * Let the workers finish the updates already queued before the tags
+       * and sinks they refer to are freed. The polling layers are freed
+       * before the connections are closed, so no more updates are made.
+       */
+      pool_free(pool);
+      cfg_free();
+    }
+  else cfg_free();
+  log_close();
+  return 0;
+}
+
+/*
+ * Description : Polling layer notification for every completed read. Runs
+ *               in the reactor thread; copies the data out and queues it for
+ *               the pool.
+ *
+ * Arguments : poll - Polling layer.
+ *             block_id - Block that was read.
+ *             result - Outcome of the read.
+ *
+ * Return Value : None.
+ */
+extern void tag_done(PCCC_POLL *poll, unsigned int block_id,
+		     PCCC_RET_T result)
+{
+  ENDPOINT *ep;
+  UPDATE *u;
+  for (ep = endpoints; (ep != NULL) && (ep->poll != poll); ep = ep->next);
+  if ((ep == NULL) || (block_id >= ep->num_tags)) return;
+  u = (UPDATE *)malloc(sizeof(UPDATE));
+  if (u == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Dropped update, out of memory.\n",
+	      __FILE__, __LINE__, ep->name);
+      return;
+    }
+  u->tag = ep->tags[block_id];
+  u->seq = ++u->tag->seq;
+  if ((pccc_poll_get_raw(poll, block_id, u->data, sizeof(u->data), &u->len,
+			 &u->info) != PCCC_SUCCESS)
+      || pool_submit(pool, sink_update, u))
+    {
+      log_msg(LOG_ERR, "%s:%d [%s] Dropped update of tag %s.\n", __FILE__,
+	      __LINE__, ep->name, u->tag->name);
+      free(u);
+    }
+  return;
+}
+
+/*
+ * Description : Parses command line arguments.
+ *
+ * Arguments : argc - Argument count from main().
+ *             argv - Argument vector from main().
+ *             cfg_file - Location to store config file name.
+ *             opts - Option bit mask.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the program should terminate.
+ */
+static int cl_args(int argc, char * const argv[], char *cfg_file, int *opts)
+{
+  int i;
+  const char cl_opts[] = "dfhv";
+  const char usage[] = \
+    "Usage: pcccpolld [options] <config file>\n"
+    "   -d : Enable debug log messages.\n"
+    "   -f : Run in foreground, log to standard error.\n"
+    "   -h : Print this message and exit.\n"
+    "   -v : Output version information and exit.\n";
+  while ((i = getopt(argc, argv, cl_opts)) != -1)
+    {
+      switch (i)
+	{
+	case 'd':
+	  *opts |= OPT_DEBUG;
+	  break;
+	case 'f':
+	  *opts |= OPT_FOREGROUND;
+	  break;
+	case 'h':
+	  printf("%s", usage);
+	  return -1;
+	  break;
+	case 'v':
+	  printf("pcccpolld version %s.%s\n", VER_MAJOR, VER_MINOR);
+	  return -1;
+	  break;
+	case '?':
+	  return -1;
+	  break;
+	}
+    }
+  if (optind < argc) /* Get configuration file name after options. */
+    {
+      strncpy(cfg_file, argv[optind], PATH_MAX - 1);
+      cfg_file[PATH_MAX - 1] = 0;
+      return 0;
+    }
+  else fprintf(stderr, "No configuration file specified.\n%s", usage);
+  return -1;
+}
+
+/*
+ * Description : Converts the process into background.
+ *
+ * Arguments : None.
+ *
+ * Return Value : Zero upon success.
+ *                Non-zero if an error occured.
+ */
+static int become_daemon(void)
+{
+  pid_t pid;
+  pid = fork();
+  if (pid < 0)
+    {
+      log_msg(LOG_ERR, "%s:%d Failed to fork daemon process : %s\n",
+	      __FILE__, __LINE__, strerror(errno));
+      return -1;
+    }
+  else if (pid != 0) /* Parent terminates. */
+    _exit(0);
+  if ((setsid() < 0) || chdir("/")
+      || (freopen("/dev/null", "r", stdin) == NULL)
+      || (freopen("/dev/null", "w", stdout) == NULL)
+      || (freopen("/dev/null", "w", stderr) == NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d Failed to become daemon : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : Reactor loop. Services every endpoint's connection and
+ *               polling layer until terminated.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void reactor(void)
+{
+  sigset_t block_set;
+  sigset_t empty_set;
+  time_t last_tick = 0;
+  sigemptyset(&block_set);
+  sigemptyset(&empty_set);
+  sigaddset(&block_set, SIGTERM);
+  sigaddset(&block_set, SIGINT);
+  sigprocmask(SIG_BLOCK, &block_set, NULL);
+  while (!terminate)
+    {
+      ENDPOINT *ep;
+      fd_set read_fds;
+      fd_set write_fds;
+      struct timespec ts;
+      unsigned int wait = TICK_MSEC;
+      time_t now = time(NULL);
+      int high_fd = -1;
+      int num_fds;
+      FD_ZERO(&read_fds);
+      FD_ZERO(&write_fds);
+      for (ep = endpoints; ep != NULL; ep = ep->next)
+	{
+	  unsigned int next;
+	  PCCC_RET_T ret;
+	  if (!ep->connected && (now >= ep->retry)) ep_connect(ep, now);
+	  if (!ep->connected) continue;
+	  ret = pccc_poll_service(ep->poll, &next);
+	  if (ret != PCCC_SUCCESS)
+	    {
+	      ep_fail(ep, ret, now);
+	      continue;
+	    }
+	  if (next < wait) wait = next;
+	  FD_SET(ep->con->fd, &read_fds);
+	  if (pccc_write_ready(ep->con) == PCCC_WREADY)
+	    FD_SET(ep->con->fd, &write_fds);
+	  if (ep->con->fd > high_fd) high_fd = ep->con->fd;
+	}
+      ts.tv_sec = wait / 1000;
+      ts.tv_nsec = (wait % 1000) * 1000000;
+      num_fds = pselect(high_fd + 1, &read_fds, &write_fds, NULL, &ts,
+			&empty_set);
+      if (num_fds < 0)
+	{
+	  if (errno == EINTR) continue;
+	  log_msg(LOG_ERR, "%s:%d pselect() failed : %s\n", __FILE__,
+		  __LINE__, strerror(errno));
+	  break;
+	}
+      now = time(NULL);
+      for (ep = endpoints; ep != NULL; ep = ep->next)
+	{
+	  PCCC_RET_T ret = PCCC_SUCCESS;
+	  if (!ep->connected) continue;
+	  if (FD_ISSET(ep->con->fd, &write_fds)) ret = pccc_write(ep->con);
+	  if ((ret == PCCC_SUCCESS) && FD_ISSET(ep->con->fd, &read_fds))
+	    ret = pccc_read(ep->con);
+	  if ((ret == PCCC_SUCCESS) && (now != last_tick))
+	    ret = pccc_tick(ep->con);
+	  if (ret != PCCC_SUCCESS) ep_fail(ep, ret, now);
+	}
+      last_tick = now;
+    }
+  if (terminate)
+    log_msg(LOG_INFO, "%s:%d Received termination signal, shutting down.\n",
+	    __FILE__, __LINE__);
+  return;
+}
+
+/*
+ * Description : Connects an endpoint to its link layer service.
+ *
+ * Arguments : ep - Endpoint.
+ *             now - Current time.
+ *
+ * Return Value : None.
+ */
+static void ep_connect(ENDPOINT *ep, time_t now)
+{
+  PCCC_RET_T ret = pccc_connect(ep->con, ep->host, ep->port, CLIENT_NAME);
+  if (ret != PCCC_SUCCESS)
+    {
+      ep_fail(ep, ret, now);
+      return;
+    }
+  ep->connected = 1;
+  log_msg(LOG_INFO, "%s:%d [%s] Connected to %s:%u.\n", __FILE__, __LINE__,
+	  ep->name, ep->host, ep->port);
+  return;
+}
+
+/*
+ * Description : Closes an endpoint's connection after an error and
+ *               schedules a reconnection. Outstanding reads complete with an
+ *               error, so every affected tag gets a bad quality update.
+ *
+ * Arguments : ep - Endpoint.
+ *             err - Error returned by libpccc.
+ *             now - Current time.
+ *
+ * Return Value : None.
+ */
+static void ep_fail(ENDPOINT *ep, PCCC_RET_T err, time_t now)
+{
+  char errstr[256];
+  pccc_errstr(ep->con, err, errstr, sizeof(errstr));
+  log_msg(LOG_ERR, "%s:%d [%s] Link layer connection failed : %s\n",
+	  __FILE__, __LINE__, ep->name, errstr);
+  pccc_close(ep->con);
+  ep->connected = 0;
+  ep->retry = now + RETRY_SEC;
+  return;
+}
+
+/*
+ * Description : Sets up signal handlers.
+ *
+ * Arguments : None.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if sigaction() fails.
+ */
+static int set_signals(void)
+{
+  struct sigaction sa;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = 0;
+  sa.sa_handler = sig_term;
+  if (sigaction(SIGTERM, &sa, NULL) || sigaction(SIGINT, &sa, NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d Error setting signal action : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      return -1;
+    }
+  sa.sa_handler = SIG_IGN;
+  if (sigaction(SIGPIPE, &sa, NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d Error ignoring SIGPIPE : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * Description : SIGTERM and SIGINT handler.
+ *
+ * Arguments : signo - Signal number.
+ *
+ * Return Value : None.
+ */
+static void sig_term(int signo)
+{
+  terminate = 1;
+  return;
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is part of pcccpolld.
+ * Multi-controller PCCC polling service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+#ifndef _PCCCPOLLD_H
+#define _PCCCPOLLD_H
+
+/*
+ * Definitions for required for pselect() on some systems.
+ */
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 601
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iconv.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../common.h"
+#include "../lib/pccc.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <libxml/parser.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define NAME_LEN 32 /* Maximum length of endpoint and tag names. */
+#define TAG_DATA_MAX 236 /* Largest protected typed logical read. */
+#define TAG_VALUES_MAX (TAG_DATA_MAX / 2) /* Most elements in one tag. */
+#define RETRY_SEC 5 /* Delay before reconnecting to a link layer service. */
+
+struct _endpoint;
+
+typedef struct _tag /* A block of data table elements read as one unit. */
+{
+  char name[NAME_LEN + 1];
+  struct _endpoint *ep; /* Endpoint the tag is read through. */
+  uint8_t node; /* Controller node address. */
+  PCCC_FT_T file_type;
+  uint16_t file;
+  uint16_t element;
+  size_t elements;
+  unsigned int block_id; /* Polling layer block identifier. */
+  unsigned int index; /* Position among all tags, shared memory slot. */
+  uint32_t seq; /* Updates generated, only used by the reactor. */
+} TAG;
+
+typedef struct _endpoint /* A df1d link layer service and its controllers. */
+{
+  char name[NAME_LEN + 1];
+  char host[NAME_MAX + 1];
+  in_port_t port;
+  PCCC *con;
+  PCCC_POLL *poll;
+  TAG **tags; /* Tags indexed by block identifier. */
+  size_t num_tags;
+  unsigned connected : 1;
+  time_t retry; /* Time of the next connection attempt. */
+  struct _endpoint *next;
+} ENDPOINT;
+
+typedef struct _update /* A completed read handed from the reactor to the pool. */
+{
+  TAG *tag;
+  uint32_t seq; /* Tag update sequence number. */
+  PCCC_POLL_INFO info;
+  size_t len;
+  uint8_t data[TAG_DATA_MAX]; /* Undecoded element data. */
+} UPDATE;
+
+typedef struct _values /* Decoded tag data, shared by every sink. */
+{
+  size_t count;
+  double val[TAG_VALUES_MAX];
+  char line[TAG_VALUES_MAX * 16 + NAME_LEN + 64]; /* Text representation. */
+  size_t line_len;
+} VALUES;
+
+/*
+ * An output sink. Sinks are called concurrently from every pool worker, each
+ * must do its own locking.
+ */
+typedef struct _sink
+{
+  const char *type;
+  void (* write)(struct _sink *, const UPDATE *, const VALUES *);
+  void (* close)(struct _sink *);
+  void *priv; /* Sink specific data. */
+  struct _sink *next;
+} SINK;
+
+/*
+ * Shared memory sink layout. A header followed by one slot per tag in
+ * configuration order. Each slot is protected by a sequence lock; readers
+ * copy the slot and retry if lock was odd or changed while copying.
+ */
+#define SHM_MAGIC 0x44504350 /* "PCPD" */
+#define SHM_VERSION 1
+
+typedef struct _shm_hdr
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_slots;
+  uint32_t slot_size;
+} SHM_HDR;
+
+typedef struct _shm_slot
+{
+  uint32_t lock; /* Odd while the slot is being written. */
+  uint32_t seq; /* Tag update sequence number. */
+  int32_t quality; /* PCCC_POLL_Q_T */
+  int32_t result; /* PCCC_RET_T */
+  int64_t sec; /* Time of the last good read. */
+  int32_t usec;
+  uint32_t count; /* Number of valid values. */
+  char name[NAME_LEN + 1];
+  double val[TAG_VALUES_MAX];
+} SHM_SLOT;
+
+typedef void (* JFUNC)(void *);
+
+typedef struct _pool POOL;
+
+extern ENDPOINT *endpoints;
+extern SINK *sinks;
+extern unsigned int num_tags;
+extern unsigned int num_threads;
+
+extern void tag_done(PCCC_POLL *poll, unsigned int block_id, PCCC_RET_T result);
+
+extern int cfg_read(const char *file);
+extern void cfg_free(void);
+
+extern POOL *pool_new(unsigned int workers);
+extern int pool_submit(POOL *pool, JFUNC fn, void *arg);
+extern void pool_free(POOL *pool);
+
+extern SINK *sink_file_new(const char *path);
+extern SINK *sink_udp_new(const char *host, in_port_t port);
+extern SINK *sink_shm_new(const char *name, unsigned int slots);
+extern void sink_update(void *arg);
+extern void sink_free_all(void);
+
+extern void log_open(int log_to_console, int lev);
+extern void log_msg(int lev, const char *fmt, ...);
+extern void log_close(void);
+
+#endif /* _PCCCPOLLD_H */
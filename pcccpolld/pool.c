@@ -0,0 +1,363 @@
+/*
+ * This file is part of pcccpolld.
+ * Multi-controller PCCC polling service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Work-stealing thread pool. Every worker has its own queue of jobs. Jobs are
+ * handed out to the queues round robin; a worker runs the newest job from its
+ * own queue and, when that is empty, steals the oldest job from another
+ * worker's queue. A worker held up by a slow sink therefore doesn't leave its
+ * backlog waiting while other workers are idle.
+ */
+
+#include "pcccpolld.h"
+
+#define QUEUE_INIT_SIZE 64 /* Initial job capacity of each queue. */
+
+typedef struct _job
+{
+  JFUNC fn;
+  void *arg;
+} JOB;
+
+typedef struct _queue /* A worker's job queue, a ring of jobs. */
+{
+  pthread_mutex_t lock;
+  JOB *jobs;
+  size_t size; /* Capacity. */
+  size_t head; /* Oldest job. */
+  size_t count;
+  unsigned long runs; /* Jobs run by the owning worker. */
+  unsigned long steals; /* Jobs the owning worker stole from others. */
+} QUEUE;
+
+typedef struct _worker
+{
+  POOL *pool;
+  unsigned int id;
+  pthread_t thread;
+} WORKER;
+
+struct _pool
+{
+  unsigned int num_workers;
+  WORKER *workers;
+  QUEUE *queues;
+  unsigned int next; /* Queue receiving the next job. */
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_cond; /* Signaled when jobs are added. */
+  size_t pending; /* Jobs queued and not yet taken by a worker. */
+  int stop;
+};
+
+static void *worker_main(void *arg);
+static int queue_push(QUEUE *q, JFUNC fn, void *arg);
+static int queue_pop(QUEUE *q, JOB *job);
+static int queue_steal(QUEUE *q, JOB *job, int wait);
+static int take_job(POOL *pool, unsigned int id, JOB *job);
+
+/*
+ * Description : Creates a thread pool and starts its workers.
+ *
+ * Arguments : workers - Number of worker threads.
+ *
+ * Return Value : A pointer to the pool.
+ *                NULL if an error occured.
+ */
+extern POOL *pool_new(unsigned int workers)
+{
+  POOL *pool;
+  unsigned int i;
+  int ret;
+  pool = (POOL *)calloc(1, sizeof(POOL));
+  if (pool == NULL) return NULL;
+  pool->workers = (WORKER *)calloc(workers, sizeof(WORKER));
+  pool->queues = (QUEUE *)calloc(workers, sizeof(QUEUE));
+  if ((pool->workers == NULL) || (pool->queues == NULL))
+    {
+      log_msg(LOG_ERR, "%s:%d Error allocating thread pool : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      free(pool->workers);
+      free(pool->queues);
+      free(pool);
+      return NULL;
+    }
+  pthread_mutex_init(&pool->idle_lock, NULL);
+  pthread_cond_init(&pool->idle_cond, NULL);
+  for (i = 0; i < workers; i++)
+    pthread_mutex_init(&pool->queues[i].lock, NULL);
+  for (i = 0; i < workers; i++)
+    {
+      pool->workers[i].pool = pool;
+      pool->workers[i].id = i;
+      ret = pthread_create(&pool->workers[i].thread, NULL, worker_main,
+			   pool->workers + i);
+      if (ret)
+	{
+	  log_msg(LOG_ERR, "%s:%d Error starting pool worker : %s\n",
+		  __FILE__, __LINE__, strerror(ret));
+	  break;
+	}
+      pool->num_workers++;
+    }
+  if (!pool->num_workers)
+    {
+      pool_free(pool);
+      return NULL;
+    }
+  log_msg(LOG_DEBUG, "%s:%d Started %u pool workers.\n", __FILE__, __LINE__,
+	  pool->num_workers);
+  return pool;
+}
+
+/*
+ * Description : Queues a job. Only called from the reactor thread.
+ *
+ * Arguments : pool - Thread pool.
+ *             fn - Job function.
+ *             arg - Argument passed to the job function.
+ *
+ * Return Value : Zero if the job was queued.
+ *                Non-zero if a memory allocation error occured.
+ */
+extern int pool_submit(POOL *pool, JFUNC fn, void *arg)
+{
+  QUEUE *q = pool->queues + pool->next;
+  int ret;
+  if (++pool->next >= pool->num_workers) pool->next = 0;
+  /*
+   * Counted before it is queued so a worker taking it right away never
+   * sees the count go negative.
+   */
+  pthread_mutex_lock(&pool->idle_lock);
+  pool->pending++;
+  pthread_mutex_unlock(&pool->idle_lock);
+  ret = queue_push(q, fn, arg);
+  pthread_mutex_lock(&pool->idle_lock);
+  if (ret) pool->pending--;
+  else pthread_cond_signal(&pool->idle_cond);
+  pthread_mutex_unlock(&pool->idle_lock);
+  return ret;
+}
+
+/*
+ * Description : Runs every queued job, stops the workers and frees the
+ *               pool.
+ *
+ * Arguments : pool - Thread pool.
+ *
+ * Return Value : None.
+ */
+extern void pool_free(POOL *pool)
+{
+  unsigned int i;
+  pthread_mutex_lock(&pool->idle_lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->idle_cond);
+  pthread_mutex_unlock(&pool->idle_lock);
+  for (i = 0; i < pool->num_workers; i++)
+    {
+      pthread_join(pool->workers[i].thread, NULL);
+      log_msg(LOG_INFO, "%s:%d Pool worker %u stats: %lu jobs run; %lu"
+	      " stolen.\n", __FILE__, __LINE__, i, pool->queues[i].runs,
+	      pool->queues[i].steals);
+    }
+  for (i = 0; i < pool->num_workers; i++)
+    {
+      pthread_mutex_destroy(&pool->queues[i].lock);
+      free(pool->queues[i].jobs);
+    }
+  pthread_cond_destroy(&pool->idle_cond);
+  pthread_mutex_destroy(&pool->idle_lock);
+  free(pool->queues);
+  free(pool->workers);
+  free(pool);
+  return;
+}
+
+/*
+ * Description : Worker thread entry point. Runs jobs until the pool is
+ *               stopped and every queue is empty.
+ *
+ * Arguments : arg - The worker.
+ *
+ * Return Value : NULL.
+ */
+static void *worker_main(void *arg)
+{
+  WORKER *w = (WORKER *)arg;
+  POOL *pool = w->pool;
+  JOB job;
+  sigset_t set;
+  /*
+   * Signals are handled by the reactor thread only.
+   */
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  for (;;)
+    {
+      if (take_job(pool, w->id, &job))
+	{
+	  job.fn(job.arg);
+	  continue;
+	}
+      pthread_mutex_lock(&pool->idle_lock);
+      while (!pool->pending && !pool->stop)
+	pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+      if (!pool->pending && pool->stop)
+	{
+	  pthread_mutex_unlock(&pool->idle_lock);
+	  break;
+	}
+      pthread_mutex_unlock(&pool->idle_lock);
+    }
+  return NULL;
+}
+
+/*
+ * Description : Takes the next job for a worker, from its own queue if
+ *               possible, otherwise from another worker's queue.
+ *
+ * Arguments : pool - Thread pool.
+ *             id - Worker taking the job.
+ *             job - Location to store the job.
+ *
+ * Return Value : Non-zero if a job was taken.
+ */
+static int take_job(POOL *pool, unsigned int id, JOB *job)
+{
+  unsigned int i;
+  int wait;
+  QUEUE *own = pool->queues + id;
+  int found = queue_pop(own, job);
+  /*
+   * Start with the next worker's queue so thieves spread out rather than
+   * all hitting the first queue. Busy queues are skipped at first; the
+   * second pass waits for their locks, otherwise a worker could keep
+   * missing a queued job and spin without ever sleeping on idle_cond.
+   */
+  for (wait = 0; !found && (wait < 2); wait++)
+    for (i = 1; !found && (i < pool->num_workers); i++)
+      if (queue_steal(pool->queues + (id + i) % pool->num_workers, job,
+		      wait))
+	{
+	  own->steals++;
+	  found = 1;
+	}
+  if (!found) return 0;
+  own->runs++;
+  pthread_mutex_lock(&pool->idle_lock);
+  pool->pending--;
+  pthread_mutex_unlock(&pool->idle_lock);
+  return 1;
+}
+
+/*
+ * Description : Adds a job to the newest end of a queue, growing it if
+ *               full.
+ *
+ * Arguments : q - Queue.
+ *             fn - Job function.
+ *             arg - Job argument.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if a memory allocation error occured.
+ */
+static int queue_push(QUEUE *q, JFUNC fn, void *arg)
+{
+  JOB *slot;
+  pthread_mutex_lock(&q->lock);
+  if (q->count == q->size)
+    {
+      size_t size = q->size ? q->size * 2 : QUEUE_INIT_SIZE;
+      JOB *jobs = (JOB *)malloc(size * sizeof(JOB));
+      size_t i;
+      if (jobs == NULL)
+	{
+	  pthread_mutex_unlock(&q->lock);
+	  log_msg(LOG_ERR, "%s:%d Error growing job queue : %s\n", __FILE__,
+		  __LINE__, strerror(errno));
+	  return -1;
+	}
+      for (i = 0; i < q->count; i++)
+	jobs[i] = q->jobs[(q->head + i) % q->size];
+      free(q->jobs);
+      q->jobs = jobs;
+      q->size = size;
+      q->head = 0;
+    }
+  slot = q->jobs + (q->head + q->count) % q->size;
+  slot->fn = fn;
+  slot->arg = arg;
+  q->count++;
+  pthread_mutex_unlock(&q->lock);
+  return 0;
+}
+
+/*
+ * Description : Removes the newest job from a queue, used by its owner.
+ *
+ * Arguments : q - Queue.
+ *             job - Location to store the job.
+ *
+ * Return Value : Non-zero if a job was removed.
+ */
+static int queue_pop(QUEUE *q, JOB *job)
+{
+  int found = 0;
+  pthread_mutex_lock(&q->lock);
+  if (q->count)
+    {
+      q->count--;
+      *job = q->jobs[(q->head + q->count) % q->size];
+      found = 1;
+    }
+  pthread_mutex_unlock(&q->lock);
+  return found;
+}
+
+/*
+ * Description : Removes the oldest job from a queue, used by other workers.
+ *
+ * Arguments : q - Queue.
+ *             job - Location to store the job.
+ *             wait - Non-zero to wait for the queue if it is locked.
+ *
+ * Return Value : Non-zero if a job was removed.
+ */
+static int queue_steal(QUEUE *q, JOB *job, int wait)
+{
+  int found = 0;
+  if (wait) pthread_mutex_lock(&q->lock);
+  else if (pthread_mutex_trylock(&q->lock)) return 0; /* Owner or thief busy. */
+  if (q->count)
+    {
+      *job = q->jobs[q->head];
+      if (++q->head == q->size) q->head = 0;
+      q->count--;
+      found = 1;
+    }
+  pthread_mutex_unlock(&q->lock);
+  return found;
+}
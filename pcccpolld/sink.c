@@ -0,0 +1,471 @@
+/*
+ * This file is part of pcccpolld.
+ * Multi-controller PCCC polling service.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Tag update decoding and output sinks. Every update is decoded once and the
+ * result is passed to each configured sink. Updates of the same tag may be
+ * processed by different pool workers at once, so each update carries the
+ * tag's sequence number; the text sinks include it in every line and the
+ * shared memory sink ignores updates older than the data already in a slot.
+ */
+
+#include "pcccpolld.h"
+
+typedef struct _file_sink
+{
+  pthread_mutex_t lock;
+  FILE *file;
+} FILE_SINK;
+
+typedef struct _udp_sink
+{
+  int fd;
+  struct sockaddr_in addr;
+} UDP_SINK;
+
+typedef struct _shm_sink
+{
+  char name[NAME_MAX + 1];
+  void *base;
+  size_t size;
+} SHM_SINK;
+
+SINK *sinks;
+
+static int decode(const UPDATE *u, VALUES *v);
+static SINK *sink_alloc(const char *type, size_t priv_size);
+static void sink_append(SINK *sink);
+static void file_write(SINK *sink, const UPDATE *u, const VALUES *v);
+static void file_close(SINK *sink);
+static void udp_write(SINK *sink, const UPDATE *u, const VALUES *v);
+static void udp_close(SINK *sink);
+static void shm_write(SINK *sink, const UPDATE *u, const VALUES *v);
+static void shm_close(SINK *sink);
+
+static const char *quality_str[] = {"none", "good", "bad", "stale"};
+
+/*
+ * Description : Pool job processing one tag update. Decodes the data and
+ *               passes it to every sink, then frees the update.
+ *
+ * Arguments : arg - The update.
+ *
+ * Return Value : None.
+ */
+extern void sink_update(void *arg)
+{
+  UPDATE *u = (UPDATE *)arg;
+  VALUES v;
+  SINK *sink;
+  if (decode(u, &v))
+    log_msg(LOG_ERR, "%s:%d [%s] Error decoding tag data.\n", __FILE__,
+	    __LINE__, u->tag->name);
+  else
+    for (sink = sinks; sink != NULL; sink = sink->next)
+      sink->write(sink, u, &v);
+  free(u);
+  return;
+}
+
+/*
+ * Description : Closes and frees every sink.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+extern void sink_free_all(void)
+{
+  while (sinks != NULL)
+    {
+      SINK *next = sinks->next;
+      sinks->close(sinks);
+      free(sinks);
+      sinks = next;
+    }
+  return;
+}
+
+/*
+ * Description : Creates a sink appending one text line per update to a file.
+ *
+ * Arguments : path - File name.
+ *
+ * Return Value : A pointer to the sink.
+ *                NULL if an error occured.
+ */
+extern SINK *sink_file_new(const char *path)
+{
+  SINK *sink = sink_alloc("file", sizeof(FILE_SINK));
+  FILE_SINK *fs;
+  if (sink == NULL) return NULL;
+  fs = (FILE_SINK *)sink->priv;
+  fs->file = fopen(path, "a");
+  if (fs->file == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d Error opening sink file %s : %s\n", __FILE__,
+	      __LINE__, path, strerror(errno));
+      free(sink);
+      return NULL;
+    }
+  setvbuf(fs->file, NULL, _IOLBF, 0);
+  pthread_mutex_init(&fs->lock, NULL);
+  sink->write = file_write;
+  sink->close = file_close;
+  sink_append(sink);
+  return sink;
+}
+
+/*
+ * Description : Creates a sink sending one text datagram per update.
+ *
+ * Arguments : host - Destination host name or address.
+ *             port - Destination UDP port.
+ *
+ * Return Value : A pointer to the sink.
+ *                NULL if an error occured.
+ */
+extern SINK *sink_udp_new(const char *host, in_port_t port)
+{
+  SINK *sink = sink_alloc("udp", sizeof(UDP_SINK));
+  UDP_SINK *us;
+  struct addrinfo hints;
+  struct addrinfo *res;
+  int ret;
+  if (sink == NULL) return NULL;
+  us = (UDP_SINK *)sink->priv;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  ret = getaddrinfo(host, NULL, &hints, &res);
+  if (ret)
+    {
+      log_msg(LOG_ERR, "%s:%d Error resolving sink host %s : %s\n", __FILE__,
+	      __LINE__, host, gai_strerror(ret));
+      free(sink);
+      return NULL;
+    }
+  memcpy(&us->addr, res->ai_addr, sizeof(us->addr));
+  us->addr.sin_port = htons(port);
+  freeaddrinfo(res);
+  us->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if ((us->fd < 0)
+      || fcntl(us->fd, F_SETFL, fcntl(us->fd, F_GETFL, 0) | O_NONBLOCK))
+    {
+      log_msg(LOG_ERR, "%s:%d Error creating sink socket : %s\n", __FILE__,
+	      __LINE__, strerror(errno));
+      if (us->fd >= 0) close(us->fd);
+      free(sink);
+      return NULL;
+    }
+  sink->write = udp_write;
+  sink->close = udp_close;
+  sink_append(sink);
+  return sink;
+}
+
+/*
+ * Description : Creates a sink keeping the latest data of every tag in a
+ *               POSIX shared memory object.
+ *
+ * Arguments : name - Shared memory object name, e.g. "/pcccpolld".
+ *             slots - Number of tags.
+ *
+ * Return Value : A pointer to the sink.
+ *                NULL if an error occured.
+ */
+extern SINK *sink_shm_new(const char *name, unsigned int slots)
+{
+  SINK *sink = sink_alloc("shm", sizeof(SHM_SINK));
+  SHM_SINK *ss;
+  SHM_HDR *hdr;
+  int fd;
+  if (sink == NULL) return NULL;
+  ss = (SHM_SINK *)sink->priv;
+  strncpy(ss->name, name, NAME_MAX);
+  ss->size = sizeof(SHM_HDR) + slots * sizeof(SHM_SLOT);
+  fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+  if ((fd < 0) || ftruncate(fd, ss->size))
+    {
+      log_msg(LOG_ERR, "%s:%d Error creating shared memory %s : %s\n",
+	      __FILE__, __LINE__, name, strerror(errno));
+      if (fd >= 0) close(fd);
+      free(sink);
+      return NULL;
+    }
+  ss->base = mmap(NULL, ss->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ss->base == MAP_FAILED)
+    {
+      log_msg(LOG_ERR, "%s:%d Error mapping shared memory %s : %s\n",
+	      __FILE__, __LINE__, name, strerror(errno));
+      free(sink);
+      return NULL;
+    }
+  /*
+   * Readers check the magic number last, so clear it while the layout is
+   * rewritten.
+   */
+  hdr = (SHM_HDR *)ss->base;
+  hdr->magic = 0;
+  memset((char *)ss->base + sizeof(SHM_HDR), 0, slots * sizeof(SHM_SLOT));
+  hdr->version = SHM_VERSION;
+  hdr->num_slots = slots;
+  hdr->slot_size = sizeof(SHM_SLOT);
+  __atomic_store_n(&hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+  sink->write = shm_write;
+  sink->close = shm_close;
+  sink_append(sink);
+  return sink;
+}
+
+/*
+ * Description : Decodes an update's data into values and a text line.
+ *               Timers and counters are represented by their accumulator,
+ *               control elements by their position.
+ *
+ * Arguments : u - Update.
+ *             v - Location to store the decoded values.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the data could not be decoded.
+ */
+static int decode(const UPDATE *u, VALUES *v)
+{
+  union
+  {
+    PCCC_INT_T i[TAG_VALUES_MAX];
+    PCCC_BIN_T b[TAG_VALUES_MAX];
+    PCCC_FLOAT_T f[TAG_VALUES_MAX];
+    PCCC_TIMER_T t[TAG_VALUES_MAX];
+    PCCC_COUNT_T c[TAG_VALUES_MAX];
+    PCCC_CTL_T r[TAG_VALUES_MAX];
+  } data;
+  const TAG *tag = u->tag;
+  size_t i;
+  int len;
+  v->count = 0;
+  if (u->len)
+    {
+      if (pccc_data_decode(tag->file_type, u->data, u->len, &data,
+			   tag->elements) != PCCC_SUCCESS)
+	return -1;
+      v->count = tag->elements;
+    }
+  for (i = 0; i < v->count; i++)
+    switch (tag->file_type)
+      {
+      case PCCC_FT_INT:
+	v->val[i] = data.i[i];
+	break;
+      case PCCC_FT_FLOAT:
+	v->val[i] = data.f[i];
+	break;
+      case PCCC_FT_TIMER:
+	v->val[i] = data.t[i].acc;
+	break;
+      case PCCC_FT_COUNT:
+	v->val[i] = data.c[i].acc;
+	break;
+      case PCCC_FT_CTL:
+	v->val[i] = data.r[i].pos;
+	break;
+      default:
+	v->val[i] = data.b[i];
+	break;
+      }
+  len = snprintf(v->line, sizeof(v->line), "%ld.%06ld %s %u %s",
+		 (long)u->info.time.tv_sec, (long)u->info.time.tv_usec,
+		 tag->name, u->seq, quality_str[u->info.quality]);
+  for (i = 0; i < v->count; i++)
+    len += snprintf(v->line + len, sizeof(v->line) - len, " %.9g",
+		    v->val[i]);
+  len += snprintf(v->line + len, sizeof(v->line) - len, "\n");
+  v->line_len = len;
+  return 0;
+}
+
+/*
+ * Description : Allocates a sink with room for its specific data.
+ *
+ * Arguments : type - Sink type name.
+ *             priv_size - Size of the sink specific data.
+ *
+ * Return Value : A pointer to the sink.
+ *                NULL if a memory allocation error occured.
+ */
+static SINK *sink_alloc(const char *type, size_t priv_size)
+{
+  SINK *sink = (SINK *)calloc(1, sizeof(SINK) + priv_size);
+  if (sink == NULL)
+    {
+      log_msg(LOG_ERR, "%s:%d Error allocating %s sink : %s\n", __FILE__,
+	      __LINE__, type, strerror(errno));
+      return NULL;
+    }
+  sink->type = type;
+  sink->priv = sink + 1;
+  return sink;
+}
+
+/*
+ * Description : Adds a sink to the end of the sink list.
+ *
+ * Arguments : sink - Sink to add.
+ *
+ * Return Value : None.
+ */
+static void sink_append(SINK *sink)
+{
+  SINK **end;
+  for (end = &sinks; *end != NULL; end = &(*end)->next);
+  *end = sink;
+  return;
+}
+
+/*
+ * Description : Writes an update's text line to a sink file.
+ *
+ * Arguments : sink - File sink.
+ *             u - Update.
+ *             v - Decoded values.
+ *
+ * Return Value : None.
+ */
+static void file_write(SINK *sink, const UPDATE *u, const VALUES *v)
+{
+  FILE_SINK *fs = (FILE_SINK *)sink->priv;
+  pthread_mutex_lock(&fs->lock);
+  fwrite(v->line, 1, v->line_len, fs->file);
+  pthread_mutex_unlock(&fs->lock);
+  return;
+}
+
+/*
+ * Description : Closes a file sink.
+ *
+ * Arguments : sink - File sink.
+ *
+ * Return Value : None.
+ */
+static void file_close(SINK *sink)
+{
+  FILE_SINK *fs = (FILE_SINK *)sink->priv;
+  fclose(fs->file);
+  pthread_mutex_destroy(&fs->lock);
+  return;
+}
+
+/*
+ * Description : Sends an update's text line as a datagram.
+ *
+ * Arguments : sink - UDP sink.
+ *             u - Update.
+ *             v - Decoded values.
+ *
+ * Return Value : None.
+ */
+static void udp_write(SINK *sink, const UPDATE *u, const VALUES *v)
+{
+  UDP_SINK *us = (UDP_SINK *)sink->priv;
+  /*
+   * Datagrams that can't be sent right away are dropped rather than holding
+   * up the worker.
+   */
+  sendto(us->fd, v->line, v->line_len, 0, (struct sockaddr *)&us->addr,
+	 sizeof(us->addr));
+  return;
+}
+
+/*
+ * Description : Closes a UDP sink.
+ *
+ * Arguments : sink - UDP sink.
+ *
+ * Return Value : None.
+ */
+static void udp_close(SINK *sink)
+{
+  close(((UDP_SINK *)sink->priv)->fd);
+  return;
+}
+
+/*
+ * Description : Stores an update in its tag's shared memory slot.
+ *
+ * Arguments : sink - Shared memory sink.
+ *             u - Update.
+ *             v - Decoded values.
+ *
+ * Return Value : None.
+ */
+static void shm_write(SINK *sink, const UPDATE *u, const VALUES *v)
+{
+  SHM_SINK *ss = (SHM_SINK *)sink->priv;
+  SHM_SLOT *slot = (SHM_SLOT *)((char *)ss->base + sizeof(SHM_HDR))
+    + u->tag->index;
+  uint32_t lock;
+  /*
+   * Writers exclude each other by moving the lock from even to odd.
+   */
+  do lock = __atomic_load_n(&slot->lock, __ATOMIC_RELAXED);
+  while ((lock & 1)
+	 || !__atomic_compare_exchange_n(&slot->lock, &lock, lock + 1, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+  if (!slot->seq || ((int32_t)(u->seq - slot->seq) > 0))
+    {
+      slot->seq = u->seq;
+      slot->quality = u->info.quality;
+      slot->result = u->info.result;
+      slot->sec = u->info.time.tv_sec;
+      slot->usec = u->info.time.tv_usec;
+      /*
+       * There is no data until the first good read.
+       */
+      if (v->count)
+	{
+	  slot->count = v->count;
+	  memcpy(slot->val, v->val, v->count * sizeof(double));
+	}
+      memcpy(slot->name, u->tag->name, sizeof(slot->name));
+    }
+  __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+  return;
+}
+
+/*
+ * Description : Unmaps and removes a shared memory sink's object.
+ *
+ * Arguments : sink - Shared memory sink.
+ *
+ * Return Value : None.
+ */
+static void shm_close(SINK *sink)
+{
+  SHM_SINK *ss = (SHM_SINK *)sink->priv;
+  munmap(ss->base, ss->size);
+  shm_unlink(ss->name);
+  return;
+}
@@ -0,0 +1,320 @@
+/*
+ * This file is part of pcccprobe.
+ * Link throughput and turnaround probe.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Probes the path to a node with Echo commands of swept payload sizes using
+ * pccc_echo_probe() and reports the round trips, the fitted turnaround and
+ * per-byte model and the pipelined throughput. Given the baud rate, each
+ * figure is compared with what a DF1 full-duplex link at that rate allows,
+ * which points out slow modems, KE modules and nodes.
+ *
+ * Line figures assume 10 bit characters and count every byte on the wire:
+ * a command is DLE STX, six header bytes, the function code, the payload,
+ * DLE ETX and the checksum; the reply is the same without the function code
+ * and each is answered with a DLE ACK.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "../lib/pccc.h"
+
+#define CLIENT_NAME "pcccprobe" /* Name registered with df1d. */
+#define MAX_POINTS 64
+#define CMD_FRAME 11 /* Command bytes besides the payload and checksum. */
+#define RPLY_FRAME 10 /* Reply bytes besides the payload and checksum. */
+#define ACK_BYTES 2
+
+static void usage(void);
+static size_t parse_sizes(const char *list, PCCC_PROBE_PT *pts);
+static void report(const PCCC_PROBE_PT *pts, size_t num_pts,
+		   const PCCC_PROBE_MODEL *model);
+static double line_rtt(size_t bytes);
+static double line_rate(size_t bytes);
+
+static const char *default_sizes = "1,16,32,64,96,128,160,192,224,235";
+static unsigned long baud; /* Link baud rate, zero if unknown. */
+static unsigned int cs_bytes = 2; /* Checksum size, two for CRC. */
+static unsigned int window = 4; /* Commands outstanding when pipelined. */
+static unsigned int conns = 1;
+
+/*
+ * Description : Program entry point.
+ *
+ * Arguments : argc - Number of arguments.
+ *             argv - Argument vector.
+ *
+ * Return Value : Zero if successful, one if an error occured.
+ */
+int main(int argc, char *argv[])
+{
+  PCCC_PROBE_PT pts[MAX_POINTS];
+  PCCC_PROBE_MODEL model;
+  const char *host = "localhost";
+  const char *sizes = default_sizes;
+  in_port_t port = 10505;
+  int src_addr = -1;
+  uint8_t node = 1;
+  unsigned int reps = 10;
+  unsigned int timeout = 5;
+  int model_only = 0;
+  size_t num_pts;
+  char err[256];
+  PCCC_RET_T ret;
+  PCCC *con;
+  int i;
+  while ((i = getopt(argc, argv, "a:B:c:e:h:mn:p:r:s:t:w:")) != -1)
+    {
+      switch (i)
+	{
+	case 'a':
+	  src_addr = atoi(optarg) & 0xff;
+	  break;
+	case 'B':
+	  baud = strtoul(optarg, NULL, 10);
+	  break;
+	case 'c':
+	  conns = atoi(optarg);
+	  if (!conns) conns = 1;
+	  break;
+	case 'e':
+	  cs_bytes = strcasecmp(optarg, "bcc") ? 2 : 1;
+	  break;
+	case 'h':
+	  host = optarg;
+	  break;
+	case 'm':
+	  model_only = 1;
+	  break;
+	case 'n':
+	  node = atoi(optarg);
+	  break;
+	case 'p':
+	  port = atoi(optarg);
+	  break;
+	case 'r':
+	  reps = atoi(optarg);
+	  if (!reps) reps = 1;
+	  break;
+	case 's':
+	  sizes = optarg;
+	  break;
+	case 't':
+	  timeout = atoi(optarg);
+	  break;
+	case 'w':
+	  window = atoi(optarg);
+	  break;
+	default:
+	  usage();
+	  return 1;
+	}
+    }
+  num_pts = parse_sizes(sizes, pts);
+  if (!num_pts) return 1;
+  if (src_addr < 0) src_addr = (node + 1) & 0xff;
+  if ((conns > 255) || ((uint8_t)(node - src_addr) < conns))
+    {
+      fprintf(stderr, "pcccprobe: Link addresses %d-%d include node %u.\n",
+	      src_addr, (src_addr + conns - 1) & 0xff, node);
+      return 1;
+    }
+  con = (conns > 1)
+    ? pccc_pool_new(src_addr, conns, timeout, window ? window : 1)
+    : pccc_new(src_addr, timeout, window ? window : 1);
+  if (con == NULL)
+    {
+      fprintf(stderr, "pcccprobe: Cannot create connection.\n");
+      return 1;
+    }
+  ret = pccc_connect(con, host, port, CLIENT_NAME);
+  if (ret == PCCC_SUCCESS)
+    ret = pccc_echo_probe(con, node, pts, num_pts, reps, window, &model);
+  if (ret != PCCC_SUCCESS)
+    {
+      pccc_errstr(con, ret, err, sizeof(err));
+      fprintf(stderr, "pcccprobe: %s\n", err);
+      pccc_close(con);
+      pccc_free(con);
+      return 1;
+    }
+  pccc_close(con);
+  pccc_free(con);
+  if (model_only)
+    {
+      printf("%.6f %.9f %.4f\n", model.turnaround, model.per_byte, model.r2);
+      return model.samples ? 0 : 1;
+    }
+  printf("Node %u, %u round trips per size, %u outstanding over %u"
+	 " registration(s)\n\n", node, reps, window, conns);
+  report(pts, num_pts, &model);
+  return model.samples ? 0 : 1;
+}
+
+/*
+ * Description : Prints the usage message.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void usage(void)
+{
+  printf("Usage: pcccprobe [options]\n"
+	 "   -a <addr> : Link address, first of -c addresses, default node + 1.\n"
+	 "   -B <baud> : Link baud rate, to compare with the line rate.\n"
+	 "   -c <conns> : Registrations with df1d, default 1.\n"
+	 "   -e <crc|bcc> : Link error detection, default crc.\n"
+	 "   -h <host> : Host running df1d, default localhost.\n"
+	 "   -m : Only print the model, turnaround and per byte seconds and r2.\n"
+	 "   -n <node> : Node to probe, default 1.\n"
+	 "   -p <port> : df1d client port, default 10505.\n"
+	 "   -r <count> : Round trips per size, default 10.\n"
+	 "   -s <sizes> : Comma separated payload sizes, default\n"
+	 "                %s.\n"
+	 "   -t <sec> : Reply timeout, default 5.\n"
+	 "   -w <cmds> : Commands outstanding when pipelined, 0 to skip,"
+	 " default 4.\n", default_sizes);
+  return;
+}
+
+/*
+ * Description : Parses the list of payload sizes.
+ *
+ * Arguments : list - Comma separated sizes.
+ *             pts - Points to initialize.
+ *
+ * Return Value : Number of points, zero if the list is invalid.
+ */
+static size_t parse_sizes(const char *list, PCCC_PROBE_PT *pts)
+{
+  size_t n = 0;
+  char *end;
+  do
+    {
+      unsigned long bytes = strtoul(list, &end, 10);
+      if ((end == list) || !bytes || (bytes > 243) || (n == MAX_POINTS)
+	  || (*end && (*end != ',')))
+	{
+	  fprintf(stderr, "pcccprobe: Invalid payload sizes, give up to %d"
+		  " sizes from 1 to 243.\n", MAX_POINTS);
+	  return 0;
+	}
+      pts[n++].bytes = bytes;
+      list = end + 1;
+    }
+  while (*end);
+  return n;
+}
+
+/*
+ * Description : Prints the probe results.
+ *
+ * Arguments : pts - Measured points.
+ *             num_pts - Number of points.
+ *             model - Fitted model.
+ *
+ * Return Value : None.
+ */
+static void report(const PCCC_PROBE_PT *pts, size_t num_pts,
+		   const PCCC_PROBE_MODEL *model)
+{
+  const PCCC_PROBE_PT *best = NULL;
+  size_t i;
+  printf("Bytes   RTT ms   Min ms Model ms");
+  if (baud) printf("  Line ms");
+  if (window) printf("    Pipe B/s");
+  if (window && baud) printf("    Line B/s  Eff%%");
+  printf("  Errors\n");
+  for (i = 0; i < num_pts; i++)
+    {
+      const PCCC_PROBE_PT *pt = pts + i;
+      printf("%5zu %8.2f %8.2f %8.2f", pt->bytes, pt->rtt * 1e3,
+	     pt->rtt_min * 1e3,
+	     (model->turnaround + model->per_byte * pt->bytes) * 1e3);
+      if (baud) printf(" %8.2f", line_rtt(pt->bytes) * 1e3);
+      if (window) printf(" %11.0f", pt->rate);
+      if (window && baud)
+	printf(" %11.0f %5.0f", line_rate(pt->bytes),
+	       pt->rate * 100.0 / line_rate(pt->bytes));
+      printf(" %7u\n", pt->errors);
+      if (pt->rtt && ((best == NULL) || (pt->bytes / pt->rtt
+					 > best->bytes / best->rtt)))
+	best = pt;
+    }
+  if (!model->samples)
+    {
+      printf("\nNo round trips succeeded.\n");
+      return;
+    }
+  printf("\nModel : %.2f ms turnaround + %.1f uS/byte, r2 %.4f over %u round"
+	 " trips\n", model->turnaround * 1e3, model->per_byte * 1e6, model->r2,
+	 model->samples);
+  if (baud)
+    {
+      double fixed = line_rtt(0);
+      double per_byte = line_rtt(1) - fixed;
+      printf("Line : %.2f ms framing + %.1f uS/byte at %lu baud\n",
+	     fixed * 1e3, per_byte * 1e6, baud);
+      printf("Excess : %.2f ms turnaround, per byte cost %.0f%% of line\n",
+	     (model->turnaround - fixed) * 1e3,
+	     model->per_byte * 100.0 / per_byte);
+    }
+  if (best != NULL)
+    printf("Best one at a time : %.0f bytes/s at %zu bytes\n",
+	   best->bytes / best->rtt, best->bytes);
+  return;
+}
+
+/*
+ * Description : Computes the shortest round trip of an Echo on the link,
+ *               the time to transmit the command, the reply and their ACKs.
+ *
+ * Arguments : bytes - Payload size.
+ *
+ * Return Value : Round trip in seconds.
+ */
+static double line_rtt(size_t bytes)
+{
+  size_t chars = CMD_FRAME + RPLY_FRAME + 2 * (cs_bytes + bytes + ACK_BYTES);
+  return chars * 10.0 / baud;
+}
+
+/*
+ * Description : Computes the largest payload throughput of Echo commands on
+ *               a full-duplex link. The direction carrying the commands and
+ *               the ACKs of the replies is the busier one.
+ *
+ * Arguments : bytes - Payload size.
+ *
+ * Return Value : Payload bytes per second.
+ */
+static double line_rate(size_t bytes)
+{
+  size_t chars = CMD_FRAME + cs_bytes + bytes + ACK_BYTES;
+  return bytes * (baud / 10.0) / chars;
+}
@@ -0,0 +1,613 @@
+/*
+ * This file is part of pccctune.
+ * DF1 link parameter tuner.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+/*
+ * Tunes the retry limits and ACK timeout of a DF1 link from what the link
+ * is doing. Every interval df1d's statistics port is read for the link's
+ * messages, NAKs, ENQs, byte counts and the wait for each ACK, and:
+ *
+ * - The ACK timeout is set to twice the 99th percentile ACK wait, raised at
+ *   once and lowered by at most half per interval.
+ * - The NAK and ENQ limits are set to the fewest tries that keep the
+ *   chance of giving up on a message below the loss target, given the
+ *   share of transmissions NAKed or timing out.
+ *
+ * df1d's settings are changed with pccc_link_config() and the interface
+ * node's with pccc_cmd_SetVariables(), its timeout converted to cycles of
+ * its clock, so both ends retry alike. The link must allow link settings,
+ * see allow_link_cfg in df1d.cfg.xml. The node's counters, if their
+ * diagnostic address is given, add the node's own retries to the rates.
+ *
+ * The payload size that gives the best goodput at the measured error rate
+ * is reported for clients to use as their message size.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../lib/pccc.h"
+
+#define CLIENT_NAME "pccctune" /* Name registered with df1d. */
+#define NAME_LEN 64
+#define LAT_BUCKETS 24 /* ACK wait buckets in a tx record. */
+#define TICK_MSEC 10 /* df1d timer tick. */
+#define FRAME_BYTES 12 /* Link bytes of a message besides its payload. */
+#define MAX_PAYLOAD 236
+
+enum /* df1d link counters, in snapshot order. */
+  {
+    L_BYTES_IN, L_BYTES_OUT, L_MSGS_TX, L_MSGS_RX, L_ACKS_IN, L_NAKS_IN,
+    L_ENQS_OUT, L_ACKS_OUT, L_NAKS_OUT, L_ENQS_IN, L_BAD_CS, L_DUPS,
+    L_TX_FAIL, L_EXPIRED, L_COUNTERS
+  };
+
+typedef struct _sample /* Counters at one time. */
+{
+  char link[NAME_LEN];
+  double time;
+  long byte_usec;
+  unsigned int cnt[L_COUNTERS];
+  unsigned int max_nak; /* df1d settings in effect. */
+  unsigned int max_enq;
+  unsigned int timeout;
+  unsigned int wait[LAT_BUCKETS];
+  PCCC_DIAG_CNT_T node;
+} SAMPLE;
+
+typedef struct _setting /* Link settings. */
+{
+  unsigned int naks;
+  unsigned int enqs;
+  unsigned int timeout; /* mS */
+} SETTING;
+
+static void usage(void);
+static int get_range(const char *arg, unsigned int *min, unsigned int *max);
+static int sample(PCCC *con, uint8_t node, int addr, const char *host,
+		  const char *port, const char *link, SAMPLE *s);
+static int fetch_link(const char *host, const char *port, const char *link,
+		      SAMPLE *s);
+static unsigned int tries(double p);
+static unsigned int best_payload(double byte_ok);
+static unsigned int clamp(unsigned int v, unsigned int min, unsigned int max);
+
+static double loss = 1e-4; /* Target chance of giving up on a message. */
+static unsigned int retry_min = 2;
+static unsigned int retry_max = 8;
+static unsigned int tmo_min = 50;
+static unsigned int tmo_max = 3000;
+
+/*
+ * Description : Program entry point.
+ *
+ * Arguments : argc - Number of arguments.
+ *             argv - Argument vector.
+ *
+ * Return Value : Zero if successful, one if an error occured.
+ */
+int main(int argc, char *argv[])
+{
+  const char *host = "localhost";
+  const char *stats_port = "10600";
+  const char *link = NULL;
+  in_port_t port = 10505;
+  int src_addr = -1;
+  int diag_addr = -1;
+  uint8_t node = 1;
+  unsigned int interval = 30;
+  unsigned int timeout = 5;
+  unsigned int min_msgs = 20;
+  unsigned int cps = 40; /* Node clock, cycles per second. */
+  int set_node = 1;
+  int dry_run = 0;
+  long count = -1;
+  SETTING cur;
+  SAMPLE prev;
+  SAMPLE now;
+  char err[256];
+  PCCC_RET_T ret;
+  PCCC *con;
+  int i;
+  while ((i = getopt(argc, argv, "a:A:c:Dh:i:k:l:L:m:n:Np:R:s:t:T:")) != -1)
+    {
+      switch (i)
+	{
+	case 'a':
+	  src_addr = atoi(optarg) & 0xff;
+	  break;
+	case 'A':
+	  diag_addr = strtoul(optarg, NULL, 0) & 0xffff;
+	  break;
+	case 'c':
+	  count = atol(optarg);
+	  break;
+	case 'D':
+	  dry_run = 1;
+	  break;
+	case 'h':
+	  host = optarg;
+	  break;
+	case 'i':
+	  interval = atoi(optarg);
+	  if (!interval) interval = 1;
+	  break;
+	case 'k':
+	  cps = atoi(optarg);
+	  if (!cps) cps = 40;
+	  break;
+	case 'l':
+	  link = optarg;
+	  break;
+	case 'L':
+	  loss = atof(optarg);
+	  if ((loss <= 0.0) || (loss >= 1.0)) loss = 1e-4;
+	  break;
+	case 'm':
+	  min_msgs = atoi(optarg);
+	  break;
+	case 'n':
+	  node = atoi(optarg);
+	  break;
+	case 'N':
+	  set_node = 0;
+	  break;
+	case 'p':
+	  port = atoi(optarg);
+	  break;
+	case 'R':
+	  if (get_range(optarg, &retry_min, &retry_max) || !retry_min
+	      || (retry_max > 255))
+	    {
+	      fprintf(stderr, "pccctune: Invalid retry range %s.\n", optarg);
+	      return 1;
+	    }
+	  break;
+	case 's':
+	  stats_port = optarg;
+	  break;
+	case 't':
+	  timeout = atoi(optarg);
+	  break;
+	case 'T':
+	  if (get_range(optarg, &tmo_min, &tmo_max) || (tmo_min < TICK_MSEC)
+	      || (tmo_max > 10000))
+	    {
+	      fprintf(stderr, "pccctune: Invalid timeout range %s.\n", optarg);
+	      return 1;
+	    }
+	  break;
+	default:
+	  usage();
+	  return 1;
+	}
+    }
+  if (src_addr < 0) src_addr = (node + 1) & 0xff;
+  if (src_addr == node)
+    {
+      fprintf(stderr, "pccctune: Link address %d is node %u.\n", src_addr,
+	      node);
+      return 1;
+    }
+  con = pccc_new(src_addr, timeout, 1);
+  if (con == NULL)
+    {
+      fprintf(stderr, "pccctune: Cannot create connection.\n");
+      return 1;
+    }
+  ret = pccc_connect(con, host, port, CLIENT_NAME);
+  if (ret != PCCC_SUCCESS)
+    {
+      pccc_errstr(con, ret, err, sizeof(err));
+      fprintf(stderr, "pccctune: %s\n", err);
+      pccc_free(con);
+      return 1;
+    }
+  if (sample(con, node, diag_addr, host, stats_port, link, &prev))
+    {
+      pccc_close(con);
+      pccc_free(con);
+      return 1;
+    }
+  cur.naks = prev.max_nak;
+  cur.enqs = prev.max_enq;
+  cur.timeout = prev.timeout;
+  printf("Link %s, node %u : max NAKs %u, max ENQs %u, ACK timeout %u mS\n",
+	 prev.link, node, cur.naks, cur.enqs, cur.timeout);
+  fflush(stdout);
+  while (count < 0 || count--)
+    {
+      SETTING next;
+      unsigned long sent;
+      unsigned long naks;
+      unsigned long enqs;
+      unsigned long acked = 0;
+      unsigned long p99 = 0;
+      double nak_rate;
+      double enq_rate;
+      double dt;
+      double goodput;
+      unsigned int payload = MAX_PAYLOAD;
+      char stamp[16];
+      time_t t;
+      sleep(interval);
+      if (sample(con, node, diag_addr, host, stats_port, prev.link, &now))
+	{
+	  pccc_close(con);
+	  pccc_free(con);
+	  return 1;
+	}
+#define DF1D(i) ((unsigned long)(now.cnt[i] - prev.cnt[i]))
+#define NODE(m) ((unsigned long)(uint16_t)(now.node.m - prev.node.m))
+      /*
+       * Transmissions in either direction, those NAKed and those that
+       * timed out. The node's are only known from its counters.
+       */
+      sent = DF1D(L_MSGS_TX) + DF1D(L_TX_FAIL);
+      naks = DF1D(L_NAKS_IN);
+      enqs = DF1D(L_ENQS_OUT);
+      if (diag_addr >= 0)
+	{
+	  sent += NODE(msgs_sent) + NODE(undelivered);
+	  naks += NODE(naks_rcvd);
+	  enqs += NODE(enqs_sent);
+	  /*
+	   * NAKs for lack of a buffer are not line errors.
+	   */
+	  naks -= (NODE(nobuf_naks) < DF1D(L_NAKS_IN))
+	    ? NODE(nobuf_naks) : DF1D(L_NAKS_IN);
+	}
+      dt = now.time - prev.time;
+      goodput = (dt > 0.0)
+	? (DF1D(L_BYTES_IN) + DF1D(L_BYTES_OUT)) / dt : 0.0;
+      for (i = 0; i < LAT_BUCKETS; i++) acked += now.wait[i] - prev.wait[i];
+      if (acked)
+	{
+	  unsigned long sum = 0;
+	  for (i = 0; i < LAT_BUCKETS - 1; i++)
+	    {
+	      sum += now.wait[i] - prev.wait[i];
+	      if (sum * 100 >= acked * 99) break;
+	    }
+	  p99 = 2UL << i; /* Upper bound of the bucket, uS. */
+	}
+      nak_rate = (sent + naks) ? (double)naks / (sent + naks) : 0.0;
+      enq_rate = (sent + enqs) ? (double)enqs / (sent + enqs) : 0.0;
+      t = time(NULL);
+      strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&t));
+      printf("%s %5lu msgs %7.0f B/s NAK %5.2f%% ENQ %5.2f%% ACK p99 %4lu mS",
+	     stamp, sent, goodput, nak_rate * 100.0, enq_rate * 100.0,
+	     (p99 + 999) / 1000);
+      if (sent < min_msgs)
+	{
+	  printf(", too few messages, holding\n");
+	  fflush(stdout);
+	  prev = now;
+	  continue;
+	}
+      /*
+       * df1d gives up on the NAK that reaches the limit but only after
+       * the ENQ past it.
+       */
+      next.naks = clamp(tries(nak_rate), retry_min, retry_max);
+      next.enqs = clamp(tries(enq_rate) - 1, retry_min, retry_max);
+      next.timeout = cur.timeout;
+      if (acked)
+	{
+	  unsigned int want = (2 * p99 + 999) / 1000;
+	  if (want < next.timeout / 2) want = next.timeout / 2;
+	  want = (want + TICK_MSEC - 1) / TICK_MSEC * TICK_MSEC;
+	  next.timeout = clamp(want, tmo_min, tmo_max);
+	}
+      /*
+       * Timeouts with ACKs arriving close to the timeout suggest it is
+       * too short rather than frames being lost.
+       */
+      if ((enq_rate > loss) && (p99 / 1000 * 2 >= cur.timeout))
+	next.timeout = clamp(cur.timeout * 3 / 2, tmo_min, tmo_max);
+      if (DF1D(L_MSGS_TX) && (nak_rate > 0.0))
+	{
+	  double frame = (double)DF1D(L_BYTES_OUT) / (DF1D(L_MSGS_TX) + naks);
+	  payload = best_payload(pow(1.0 - nak_rate, 1.0 / frame));
+	}
+      printf(" -> NAKs %u ENQs %u timeout %u mS, payload %u\n", next.naks,
+	     next.enqs, next.timeout, payload);
+      if ((next.naks != cur.naks) || (next.enqs != cur.enqs)
+	  || (next.timeout != cur.timeout))
+	{
+	  if (!dry_run)
+	    {
+	      ret = pccc_link_config(con, next.naks, next.enqs, next.timeout);
+	      if ((ret == PCCC_SUCCESS) && set_node)
+		{
+		  unsigned int cycles = (next.timeout * cps + 999) / 1000;
+		  ret = pccc_cmd_SetVariables(con, NULL, node,
+					      clamp(cycles, 1, 255),
+					      next.naks, next.enqs);
+		  if ((ret == PCCC_ECMD_REPLY) || (ret == PCCC_ECMD_NODELIVER))
+		    {
+		      pccc_errstr(con, ret, err, sizeof(err));
+		      printf("  Node %u settings not changed, no longer"
+			     " trying : %s\n", node, err);
+		      set_node = 0;
+		      ret = PCCC_SUCCESS;
+		    }
+		}
+	      if (ret != PCCC_SUCCESS)
+		{
+		  pccc_errstr(con, ret, err, sizeof(err));
+		  fprintf(stderr, "pccctune: %s\n", err);
+		  pccc_close(con);
+		  pccc_free(con);
+		  return 1;
+		}
+	    }
+	  cur = next;
+	}
+#undef DF1D
+#undef NODE
+      fflush(stdout);
+      prev = now;
+    }
+  pccc_close(con);
+  pccc_free(con);
+  return 0;
+}
+
+/*
+ * Description : Prints the usage message.
+ *
+ * Arguments : None.
+ *
+ * Return Value : None.
+ */
+static void usage(void)
+{
+  printf("Usage: pccctune [options]\n"
+	 "   -a <addr> : Link address, default node + 1.\n"
+	 "   -A <addr> : Diagnostic address of the node's channel counters,"
+	 " to include\n"
+	 "               the node's retries.\n"
+	 "   -c <count> : Exit after this many intervals.\n"
+	 "   -D : Dry run, only print the settings that would be made.\n"
+	 "   -h <host> : Host running df1d, default localhost.\n"
+	 "   -i <sec> : Interval, default 30.\n"
+	 "   -k <cps> : Node clock cycles per second, default 40.\n"
+	 "   -l <link> : df1d link the node is on, default the first.\n"
+	 "   -L <prob> : Target chance of giving up on a message,"
+	 " default 0.0001.\n"
+	 "   -m <msgs> : Fewest messages in an interval to act on, default"
+	 " 20.\n"
+	 "   -n <node> : Interface node, default 1.\n"
+	 "   -N : Only tune df1d, leave the node's settings alone.\n"
+	 "   -p <port> : df1d client port, default 10505.\n"
+	 "   -R <min>:<max> : NAK and ENQ limit bounds, default 2:8.\n"
+	 "   -s <port> : df1d statistics port, default 10600.\n"
+	 "   -t <sec> : Reply timeout, default 5.\n"
+	 "   -T <min>:<max> : ACK timeout bounds in mS, default 50:3000.\n");
+  return;
+}
+
+/*
+ * Description : Parses a <min>:<max> range.
+ *
+ * Arguments : arg - Range.
+ *             min - Location to store the minimum.
+ *             max - Location to store the maximum.
+ *
+ * Return Value : Zero if successful, non-zero if the range is invalid.
+ */
+static int get_range(const char *arg, unsigned int *min, unsigned int *max)
+{
+  if ((sscanf(arg, "%u:%u", min, max) != 2) || (*min > *max)) return -1;
+  return 0;
+}
+
+/*
+ * Description : Reads df1d's and optionally the node's counters.
+ *
+ * Arguments : con - Connection to the node.
+ *             node - Node to read.
+ *             addr - Diagnostic address of the node's counters, negative
+ *                    to not read them.
+ *             host - Host running df1d.
+ *             port - df1d statistics port.
+ *             link - Link name, NULL for the first link.
+ *             s - Sample to fill in.
+ *
+ * Return Value : Zero if successful, non-zero after printing an error.
+ */
+static int sample(PCCC *con, uint8_t node, int addr, const char *host,
+		  const char *port, const char *link, SAMPLE *s)
+{
+  memset(&s->node, 0, sizeof(s->node));
+  if (addr >= 0)
+    {
+      PCCC_RET_T ret = pccc_cmd_ReadDiagCounters(con, NULL, node, &s->node,
+						 addr);
+      if (ret != PCCC_SUCCESS)
+	{
+	  char err[256];
+	  pccc_errstr(con, ret, err, sizeof(err));
+	  fprintf(stderr, "pccctune: Reading node %u counters : %s\n", node,
+		  err);
+	  return -1;
+	}
+    }
+  return fetch_link(host, port, link, s);
+}
+
+/*
+ * Description : Reads a link's counters and settings from df1d's
+ *               statistics port.
+ *
+ * Arguments : host - Host running df1d.
+ *             port - Statistics port.
+ *             link - Link name, NULL for the first link.
+ *             s - Sample to store them in.
+ *
+ * Return Value : Zero if successful, non-zero after printing an error.
+ */
+static int fetch_link(const char *host, const char *port, const char *link,
+		      SAMPLE *s)
+{
+  struct addrinfo hints = {0};
+  struct addrinfo *res;
+  struct addrinfo *ai;
+  char line[1024];
+  FILE *f;
+  int found = 0;
+  int have_tx = 0;
+  int done = 0;
+  int fd = -1;
+  int err;
+  hints.ai_socktype = SOCK_STREAM;
+  err = getaddrinfo(host, port, &hints, &res);
+  if (err)
+    {
+      fprintf(stderr, "pccctune: %s : %s\n", host, gai_strerror(err));
+      return -1;
+    }
+  for (ai = res; ai != NULL; ai = ai->ai_next)
+    {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      if (!connect(fd, ai->ai_addr, ai->ai_addrlen)) break;
+      close(fd);
+      fd = -1;
+    }
+  freeaddrinfo(res);
+  if ((fd < 0) || ((f = fdopen(fd, "r")) == NULL))
+    {
+      fprintf(stderr, "pccctune: Cannot connect to %s statistics port %s :"
+	      " %s\n", host, port, strerror(errno));
+      if (fd >= 0) close(fd);
+      return -1;
+    }
+  while (fgets(line, sizeof(line), f) != NULL)
+    {
+      char name[NAME_LEN];
+      unsigned int *c = s->cnt;
+      int used;
+      if (!strcmp(line, "end\n")) done = 1;
+      else if (!strncmp(line, "time ", 5)) s->time = atof(line + 5);
+      else if (!found && !strncmp(line, "link ", 5))
+	{
+	  if ((sscanf(line, "link %63s %ld %u %u %u %u %u %u %u %u %u %u %u"
+		      " %u %u %u", name, &s->byte_usec, &c[0], &c[1], &c[2],
+		      &c[3], &c[4], &c[5], &c[6], &c[7], &c[8], &c[9],
+		      &c[10], &c[11], &c[12], &c[13]) == 2 + L_COUNTERS)
+	      && ((link == NULL) || !strcmp(name, link)))
+	    {
+	      strcpy(s->link, name);
+	      found = 1;
+	    }
+	}
+      else if (found && !have_tx
+	       && (sscanf(line, "tx %63s %u %u %u%n", name, &s->max_nak,
+			  &s->max_enq, &s->timeout, &used) == 4)
+	       && !strcmp(name, s->link))
+	{
+	  char *p = line + used;
+	  int i;
+	  for (i = 0; i < LAT_BUCKETS; i++) s->wait[i] = strtoul(p, &p, 10);
+	  have_tx = 1;
+	}
+    }
+  fclose(f);
+  if (!done)
+    fprintf(stderr, "pccctune: Incomplete statistics from %s port %s.\n",
+	    host, port);
+  else if (!found)
+    fprintf(stderr, "pccctune: No link %s on %s.\n",
+	    link == NULL ? "" : link, host);
+  else if (!have_tx)
+    fprintf(stderr, "pccctune: df1d on %s does not report link settings.\n",
+	    host);
+  return !(done && found && have_tx);
+}
+
+/*
+ * Description : Computes the fewest tries that keep the chance of every
+ *               one failing below the loss target.
+ *
+ * Arguments : p - Chance of a single try failing.
+ *
+ * Return Value : Number of tries, at least one.
+ */
+static unsigned int tries(double p)
+{
+  double n;
+  if (p <= 0.0) return 1;
+  if (p >= 1.0) return 256;
+  n = ceil(log(loss) / log(p));
+  return (n < 1.0) ? 1 : (n > 256.0) ? 256 : (unsigned int)n;
+}
+
+/*
+ * Description : Finds the payload size with the best goodput when every
+ *               byte on the line is received intact with a given chance.
+ *               Goodput is the payload share of a frame times the chance
+ *               the frame arrives intact.
+ *
+ * Arguments : byte_ok - Chance of a byte being received intact.
+ *
+ * Return Value : Payload size in bytes.
+ */
+static unsigned int best_payload(double byte_ok)
+{
+  unsigned int best = MAX_PAYLOAD;
+  double best_eff = 0.0;
+  unsigned int n;
+  for (n = 16; n <= MAX_PAYLOAD; n++)
+    {
+      double eff = n * pow(byte_ok, n + FRAME_BYTES) / (n + FRAME_BYTES);
+      if (eff > best_eff)
+	{
+	  best_eff = eff;
+	  best = n;
+	}
+    }
+  return best;
+}
+
+/*
+ * Description : Limits a value to a range.
+ *
+ * Arguments : v - Value.
+ *             min - Smallest allowed.
+ *             max - Largest allowed.
+ *
+ * Return Value : The limited value.
+ */
+static unsigned int clamp(unsigned int v, unsigned int min, unsigned int max)
+{
+  return (v < min) ? min : (v > max) ? max : v;
+}
@@ -0,0 +1,519 @@
+/*
+ * Ring buffer manipulation functions.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+#include "common.h"
+#include "rbuf.h"
+#include "byteorder.h"
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+static size_t end_pos(const RBUF *rb);
+static void reverse(uint8_t *p, size_t len);
+
+/*
+ * Description : Allocates and initializes a new ring buffer.
+ *               The new buffer will be empty.
+ *
+ * Arguments : bytes - The size of the buffer to allocate.
+ *
+ * Return Value : A pointer to the new buffer.
+ *                NULL if a memory allocation error occured.
+ */
+extern RBUF *rbuf_new(size_t bytes)
+{
+  RBUF *rb;
+  rb = (RBUF *)malloc(sizeof(RBUF) + bytes);
+  if (rb == NULL) return NULL;
+  rb->data = (uint8_t *)(rb + 1);
+  rb->max = bytes;
+  rbuf_empty(rb);
+  return rb;
+}
+
+/*
+ * Description : Gets the number of bytes held in a ring buffer.
+ *
+ * Arguments : rb - Source buffer.
+ *
+ * Return Value : Bytes held.
+ */
+extern size_t rbuf_len(const RBUF *rb)
+{
+  return rb->len;
+}
+
+/*
+ * Description : Gets the number of bytes that can be added to a ring
+ *               buffer.
+ *
+ * Arguments : rb - Target buffer.
+ *
+ * Return Value : Free space in bytes.
+ */
+extern size_t rbuf_room(const RBUF *rb)
+{
+  return rb->max - rb->len;
+}
+
+/*
+ * Description : Gets the contiguous free space following the data held.
+ *               Bytes placed there are added with rbuf_commit(). The rest
+ *               of the free space, if any, is returned by the next call
+ *               once this span has been committed.
+ *
+ * Arguments : rb - Target buffer.
+ *             len - Location to store the length of the span.
+ *
+ * Return Value : Start of the free span.
+ */
+extern uint8_t *rbuf_reserve(RBUF *rb, size_t *len)
+{
+  size_t end = end_pos(rb);
+  if (rb->start + rb->len >= rb->max) *len = rb->start - end;
+  else *len = rb->max - end;
+  return rb->data + end;
+}
+
+/*
+ * Description : Adds bytes written into the span from rbuf_reserve().
+ *
+ * Arguments : rb - Target buffer.
+ *             len - Number of bytes written, no more than the span.
+ *
+ * Return Value : None.
+ */
+extern void rbuf_commit(RBUF *rb, size_t len)
+{
+  rb->len += len;
+  return;
+}
+
+/*
+ * Description : Gets the contiguous span of the oldest data held. The rest
+ *               of the data, if any, is returned by the next call once this
+ *               span has been consumed.
+ *
+ * Arguments : rb - Source buffer.
+ *             len - Location to store the length of the span.
+ *
+ * Return Value : Start of the data.
+ */
+extern const uint8_t *rbuf_peek(const RBUF *rb, size_t *len)
+{
+  *len = rb->max - rb->start;
+  if (*len > rb->len) *len = rb->len;
+  return rb->data + rb->start;
+}
+
+/*
+ * Description : Removes bytes from the front of a ring buffer.
+ *
+ * Arguments : rb - Source buffer.
+ *             len - Number of bytes to remove, no more than held.
+ *
+ * Return Value : None.
+ */
+extern void rbuf_consume(RBUF *rb, size_t len)
+{
+  rb->len -= len;
+  if (!rb->len) rb->start = 0; /* Keep the free space in one piece. */
+  else
+    {
+      rb->start += len;
+      if (rb->start >= rb->max) rb->start -= rb->max;
+    }
+  return;
+}
+
+/*
+ * Description : Moves the data held so that it is contiguous. Data that
+ *               wraps around the end of the buffer is rotated in place.
+ *
+ * Arguments : rb - Target buffer.
+ *
+ * Return Value : Start of the data, rbuf_len() bytes long.
+ */
+extern const uint8_t *rbuf_linearize(RBUF *rb)
+{
+  if (rb->start + rb->len > rb->max)
+    {
+      reverse(rb->data, rb->start);
+      reverse(rb->data + rb->start, rb->max - rb->start);
+      reverse(rb->data, rb->max);
+      rb->start = 0;
+    }
+  return rb->data + rb->start;
+}
+
+/*
+ * Description : Appends data to a ring buffer.
+ *
+ * Arguments : dst - Target buffer.
+ *             src - Data to append.
+ *             len - Length of the data.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the buffer would overflow, no data is copied.
+ */
+extern int rbuf_put(RBUF *dst, const void *src, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)src;
+  if (len > rbuf_room(dst)) return -1;
+  while (len)
+    {
+      size_t span;
+      uint8_t *to = rbuf_reserve(dst, &span);
+      if (span > len) span = len;
+      memcpy((void *)to, (const void *)p, span);
+      rbuf_commit(dst, span);
+      p += span;
+      len -= span;
+    }
+  return 0;
+}
+
+/*
+ * Description : Appends a single byte to a ring buffer.
+ *
+ * Arguments : dst - Target buffer.
+ *             src - Byte to append.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the buffer would overflow.
+ */
+extern int rbuf_put_byte(RBUF *dst, uint8_t src)
+{
+  if (dst->len == dst->max) return -1;
+  dst->data[end_pos(dst)] = src;
+  dst->len++;
+  return 0;
+}
+
+/*
+ * Description : Appends an array of 16 bit words in link byte order.
+ *
+ * Arguments : dst - Target buffer.
+ *             src - Words in host byte order.
+ *             n - Number of words.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the buffer would overflow, no data is copied.
+ */
+extern int rbuf_put_le16(RBUF *dst, const uint16_t *src, size_t n)
+{
+  size_t pos = end_pos(dst);
+  size_t i;
+  if (n * 2 > rbuf_room(dst)) return -1;
+  if (pos + n * 2 <= dst->max)
+    htol16_array(dst->data + pos, src, n);
+  else
+    for (i = 0; i < n; i++)
+      {
+	dst->data[pos] = src[i] & 0xff;
+	if (++pos == dst->max) pos = 0;
+	dst->data[pos] = src[i] >> 8;
+	if (++pos == dst->max) pos = 0;
+      }
+  dst->len += n * 2;
+  return 0;
+}
+
+/*
+ * Description : Appends an array of 32 bit words in link byte order.
+ *
+ * Arguments : dst - Target buffer.
+ *             src - Words in host byte order.
+ *             n - Number of words.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the buffer would overflow, no data is copied.
+ */
+extern int rbuf_put_le32(RBUF *dst, const uint32_t *src, size_t n)
+{
+  size_t pos = end_pos(dst);
+  size_t i;
+  unsigned int b;
+  if (n * 4 > rbuf_room(dst)) return -1;
+  if (pos + n * 4 <= dst->max)
+    htol32_array(dst->data + pos, src, n);
+  else
+    for (i = 0; i < n; i++)
+      for (b = 0; b < 32; b += 8)
+	{
+	  dst->data[pos] = (src[i] >> b) & 0xff;
+	  if (++pos == dst->max) pos = 0;
+	}
+  dst->len += n * 4;
+  return 0;
+}
+
+/*
+ * Description : Removes data from the front of a ring buffer.
+ *
+ * Arguments : src - Source buffer.
+ *             dst - Location to copy the data to.
+ *             len - Number of bytes to remove.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if fewer bytes are held, no data is removed.
+ */
+extern int rbuf_get(RBUF *src, void *dst, size_t len)
+{
+  uint8_t *p = (uint8_t *)dst;
+  if (len > src->len) return -1;
+  while (len)
+    {
+      size_t span;
+      const uint8_t *from = rbuf_peek(src, &span);
+      if (span > len) span = len;
+      memcpy((void *)p, (const void *)from, span);
+      rbuf_consume(src, span);
+      p += span;
+      len -= span;
+    }
+  return 0;
+}
+
+/*
+ * Description : Removes a single byte from the front of a ring buffer.
+ *
+ * Arguments : src - Source buffer.
+ *             dst - Location to place the byte.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if the buffer is empty.
+ */
+extern int rbuf_get_byte(RBUF *src, uint8_t *dst)
+{
+  if (!src->len) return -1;
+  *dst = src->data[src->start];
+  rbuf_consume(src, 1);
+  return 0;
+}
+
+/*
+ * Description : Removes an array of 16 bit words in link byte order.
+ *
+ * Arguments : src - Source buffer.
+ *             dst - Location for the words in host byte order.
+ *             n - Number of words.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if fewer bytes are held, no data is removed.
+ */
+extern int rbuf_get_le16(RBUF *src, uint16_t *dst, size_t n)
+{
+  size_t pos = src->start;
+  size_t i;
+  if (n * 2 > src->len) return -1;
+  if (pos + n * 2 <= src->max)
+    ltoh16_array(dst, src->data + pos, n);
+  else
+    for (i = 0; i < n; i++)
+      {
+	dst[i] = src->data[pos];
+	if (++pos == src->max) pos = 0;
+	dst[i] |= src->data[pos] << 8;
+	if (++pos == src->max) pos = 0;
+      }
+  rbuf_consume(src, n * 2);
+  return 0;
+}
+
+/*
+ * Description : Removes an array of 32 bit words in link byte order.
+ *
+ * Arguments : src - Source buffer.
+ *             dst - Location for the words in host byte order.
+ *             n - Number of words.
+ *
+ * Return Value : Zero if successful.
+ *                Non-zero if fewer bytes are held, no data is removed.
+ */
+extern int rbuf_get_le32(RBUF *src, uint32_t *dst, size_t n)
+{
+  size_t pos = src->start;
+  size_t i;
+  unsigned int b;
+  if (n * 4 > src->len) return -1;
+  if (pos + n * 4 <= src->max)
+    ltoh32_array(dst, src->data + pos, n);
+  else
+    for (i = 0; i < n; i++)
+      {
+	dst[i] = 0;
+	for (b = 0; b < 32; b += 8)
+	  {
+	    dst[i] |= (uint32_t)src->data[pos] << b;
+	    if (++pos == src->max) pos = 0;
+	  }
+      }
+  rbuf_consume(src, n * 4);
+  return 0;
+}
+
+/*
+ * Description : Reads data from a file descriptor into the free space of a
+ *               ring buffer, after any data already held.
+ *
+ * Arguments : fd - Source file descriptor.
+ *             dst - Destination buffer.
+ *
+ * Return Value : Same as read().
+ *                -1 with errno set to ENOBUFS if the buffer is full.
+ */
+extern ssize_t rbuf_read(int fd, RBUF *dst)
+{
+  ssize_t len;
+  size_t span;
+  uint8_t *to;
+  if (!rbuf_room(dst))
+    {
+      errno = ENOBUFS;
+      return -1;
+    }
+  to = rbuf_reserve(dst, &span);
+#ifdef _WIN32
+    if (!ReadFile((HANDLE)fd, (void*)to, span, &len, NULL)) return -1;
+#else
+  {
+    struct iovec iov[2];
+    int cnt = 1;
+    iov[0].iov_base = (void *)to;
+    iov[0].iov_len = span;
+    /*
+     * Free space wrapping to the start of the buffer is filled by the
+     * same call.
+     */
+    if ((span < rbuf_room(dst)) && (to + span == dst->data + dst->max))
+      {
+	iov[1].iov_base = (void *)dst->data;
+	iov[1].iov_len = rbuf_room(dst) - span;
+	cnt = 2;
+      }
+    do len = readv(fd, iov, cnt);
+    while ((len < 0) && (errno == EINTR));
+  }
+#endif
+  if (len > 0) rbuf_commit(dst, len);
+  return len;
+}
+
+/*
+ * Description : Writes as much of the data held in a ring buffer as the
+ *               file descriptor accepts, removing what was written.
+ *
+ * Arguments : fd - Target file descriptor.
+ *             src - Source data buffer.
+ *
+ * Return Value : Same as write().
+ */
+extern ssize_t rbuf_write(int fd, RBUF *src)
+{
+  ssize_t bytes;
+  size_t span;
+  const uint8_t *from = rbuf_peek(src, &span);
+#ifdef _WIN32
+    if (!WriteFile((HANDLE)fd, (void*)from, span, &bytes, NULL)) return -1;
+#else
+  {
+    struct iovec iov[2];
+    int cnt = 1;
+    iov[0].iov_base = (void *)from;
+    iov[0].iov_len = span;
+    if (span < src->len) /* Data wraps to the start of the buffer. */
+      {
+	iov[1].iov_base = (void *)src->data;
+	iov[1].iov_len = src->len - span;
+	cnt = 2;
+      }
+    do bytes = writev(fd, iov, cnt);
+    while ((bytes < 0) && (errno == EINTR));
+    if (bytes < 0) return -1;
+  }
+#endif
+  rbuf_consume(src, bytes);
+  return bytes;
+}
+
+/*
+ * Description : Empties a ring buffer.
+ *
+ * Arguments : rb - Target buffer.
+ *
+ * Return Value : None.
+ */
+extern void rbuf_empty(RBUF *rb)
+{
+  rb->start = 0;
+  rb->len = 0;
+  return;
+}
+
+/*
+ * Description : Free's memory allocated for a ring buffer.
+ *
+ * Arguments : rb - Pointer to buffer to free.
+ *
+ * Return Value : None.
+ */
+extern void rbuf_free(RBUF *rb)
+{
+  free((void *)rb);
+  return;
+}
+
+/*
+ * Description : Gets the offset following the last byte held.
+ *
+ * Arguments : rb - Ring buffer.
+ *
+ * Return Value : Offset where the next byte is added.
+ */
+static size_t end_pos(const RBUF *rb)
+{
+  size_t end = rb->start + rb->len;
+  return (end >= rb->max) ? end - rb->max : end;
+}
+
+/*
+ * Description : Reverses a range of bytes in place.
+ *
+ * Arguments : p - First byte.
+ *             len - Number of bytes.
+ *
+ * Return Value : None.
+ */
+static void reverse(uint8_t *p, size_t len)
+{
+  uint8_t *q = p + len;
+  while ((len > 1) && (p < --q))
+    {
+      uint8_t t = *p;
+      *p++ = *q;
+      *q = t;
+    }
+  return;
+}
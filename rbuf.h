@@ -0,0 +1,71 @@
+/*
+ * Ring buffer for byte streams.
+ * Copyright (C) 2007 Jason Valenzuela
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Design Systems Partners
+ * Attn: Jason Valenzuela
+ * 2516 JMT Industrial Drive, Suite 112
+ * Apopka, FL  32703
+ * jvalenzuela <at> dspfl <dot> com
+ */
+
+#ifndef _RBUF_H
+#define _RBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Unlike a BUF, which is filled from the start and only reset once it has
+ * been completely consumed, an RBUF wraps around: bytes can be added as
+ * soon as any have been consumed, and a partial read or write never moves
+ * data. Producers either copy data in with the rbuf_put*() functions or
+ * fill the span returned by rbuf_reserve() and rbuf_commit() it;
+ * consumers likewise copy data out with rbuf_get*() or use rbuf_peek()
+ * and rbuf_consume(). The typed functions move whole arrays of little
+ * endian (link byte order) values with a single bounds check.
+ */
+typedef struct _rbuf /* Ring buffer. */
+{
+  uint8_t *data;
+  size_t max; /* Capacity. */
+  size_t start; /* Offset of the oldest byte held. */
+  size_t len; /* Number of bytes held. */
+} RBUF;
+
+extern RBUF *rbuf_new(size_t bytes);
+extern size_t rbuf_len(const RBUF *rb);
+extern size_t rbuf_room(const RBUF *rb);
+extern uint8_t *rbuf_reserve(RBUF *rb, size_t *len);
+extern void rbuf_commit(RBUF *rb, size_t len);
+extern const uint8_t *rbuf_peek(const RBUF *rb, size_t *len);
+extern void rbuf_consume(RBUF *rb, size_t len);
+extern const uint8_t *rbuf_linearize(RBUF *rb);
+extern int rbuf_put(RBUF *dst, const void *src, size_t len);
+extern int rbuf_put_byte(RBUF *dst, uint8_t src);
+extern int rbuf_put_le16(RBUF *dst, const uint16_t *src, size_t n);
+extern int rbuf_put_le32(RBUF *dst, const uint32_t *src, size_t n);
+extern int rbuf_get(RBUF *src, void *dst, size_t len);
+extern int rbuf_get_byte(RBUF *src, uint8_t *dst);
+extern int rbuf_get_le16(RBUF *src, uint16_t *dst, size_t n);
+extern int rbuf_get_le32(RBUF *src, uint32_t *dst, size_t n);
+extern ssize_t rbuf_read(int fd, RBUF *dst);
+extern ssize_t rbuf_write(int fd, RBUF *src);
+extern void rbuf_empty(RBUF *rb);
+extern void rbuf_free(RBUF *rb);
+
+#endif /* _RBUF_H */